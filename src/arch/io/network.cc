@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/types.h>
 
@@ -18,6 +19,7 @@
 #include <netinet/tcp.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 #include "utils.hpp"
@@ -29,16 +31,13 @@
 #include "arch/types.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/exponential_backoff.hpp"
+#include "concurrency/pmap.hpp"
 #include "concurrency/wait_any.hpp"
 #include "containers/printf_buffer.hpp"
 #include "logger.hpp"
 #include "perfmon/perfmon.hpp"
 #include "errors.hpp"
 
-#ifdef _WIN32
-#include "concurrency/pmap.hpp"
-#endif
-
 #ifdef TRACE_WINSOCK
 #define winsock_debugf(...) debugf("winsock: " __VA_ARGS__)
 #else
@@ -312,6 +311,8 @@ void linux_tcp_conn_t::release_write_buffer(write_buffer_t *buffer) {
 
 void linux_tcp_conn_t::release_write_queue_op(write_queue_op_t *op) {
     op->keepalive = auto_drainer_t::lock_t();
+    // Frees the memory rather than keeping it around with the op
+    std::vector<char>().swap(op->owned);
     unused_write_queue_ops.push_front(op);
 }
 
@@ -525,10 +526,20 @@ linux_tcp_conn_t::write_handler_t::write_handler_t(linux_tcp_conn_t *_parent) :
 
 void linux_tcp_conn_t::write_handler_t::coro_pool_callback(write_queue_op_t *operation, UNUSED signal_t *interruptor) {
     if (operation->buffer != nullptr) {
-        parent->perform_write(operation->buffer, operation->size);
+        if (operation->owned.empty()) {
+            parent->perform_write(operation->buffer, operation->size);
+        } else {
+            const char *buffer = static_cast<const char *>(operation->buffer);
+            const const_charslice buffers[2] = {
+                const_charslice(buffer, buffer + operation->size),
+                const_charslice(operation->owned.data(),
+                                operation->owned.data() + operation->owned.size())
+            };
+            parent->perform_writev(buffers, 2);
+        }
         if (operation->dealloc != nullptr) {
             parent->release_write_buffer(operation->dealloc);
-            parent->write_queue_limiter.unlock(operation->size);
+            parent->write_queue_limiter.unlock(operation->limiter_count);
         }
     }
 
@@ -550,6 +561,7 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
     op->buffer = current_write_buffer->buffer;
     op->size = current_write_buffer->size;
     op->dealloc = current_write_buffer.release();
+    op->limiter_count = op->size;
     op->cond = nullptr;
     op->keepalive = auto_drainer_t::lock_t(drainer.get());
     current_write_buffer.init(get_write_buffer());
@@ -558,7 +570,28 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
        to be released once the write is completed by the coroutine pool */
     rassert(op->size <= WRITE_CHUNK_SIZE);
     rassert(WRITE_CHUNK_SIZE < WRITE_QUEUE_MAX_SIZE);
-    write_queue_limiter.co_lock(op->size);
+    write_queue_limiter.co_lock(op->limiter_count);
+
+    write_queue.push(op);
+}
+
+void linux_tcp_conn_t::internal_flush_write_buffer(std::vector<char> &&owned) {
+    write_queue_op_t *op = get_write_queue_op();
+    assert_thread();
+    rassert(write_in_progress);
+
+    op->buffer = current_write_buffer->buffer;
+    op->size = current_write_buffer->size;
+    op->dealloc = current_write_buffer.release();
+    op->owned = std::move(owned);
+    op->cond = nullptr;
+    op->keepalive = auto_drainer_t::lock_t(drainer.get());
+    current_write_buffer.init(get_write_buffer());
+
+    /* We can't hold the owned data to the queue size limit, so instead it counts as
+       a full queue. */
+    op->limiter_count = WRITE_QUEUE_MAX_SIZE;
+    write_queue_limiter.co_lock(op->limiter_count);
 
     write_queue.push(op);
 }
@@ -601,20 +634,62 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
         rassert(op.nb_bytes == size);  // TODO WINDOWS: does windows guarantee this?
     }
 #else
-    while (size > 0) {
-        ssize_t res = ::write(sock.get(), buf, size);
+    const char *data = static_cast<const char *>(buf);
+    const const_charslice buffer(data, data + size);
+    linux_tcp_conn_t::perform_writev(&buffer, 1);
+#endif
+}
+
+void linux_tcp_conn_t::perform_writev(const const_charslice *buffers, size_t count) {
+    assert_thread();
+
+#ifdef _WIN32
+    for (size_t i = 0; i < count; ++i) {
+        perform_write(buffers[i].beg, buffers[i].end - buffers[i].beg);
+    }
+#else
+    if (write_closed.is_pulsed()) {
+        /* The write end of the connection was closed, but there are still
+           operations in the write queue; we are one of those operations. Just
+           don't do anything. */
+        return;
+    }
+
+    if (!writev_to_socket(buffers, count, &write_closed)) {
+        on_shutdown_write();
+    }
+#endif
+}
+
+#ifndef _WIN32
+bool linux_tcp_conn_t::writev_to_socket(const const_charslice *buffers, size_t count,
+                                        signal_t *closer) {
+    scoped_array_t<iovec> iov(count);
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = const_cast<char *>(buffers[i].beg);
+        iov[i].iov_len = buffers[i].end - buffers[i].beg;
+    }
+
+    size_t first = 0;
+    while (first < count) {
+        if (iov[first].iov_len == 0) {
+            ++first;
+            continue;
+        }
+        ssize_t res = ::writev(sock.get(), iov.data() + first,
+                               std::min<size_t>(count - first, IOV_MAX));
 
         if (res == -1 && (get_errno() == EAGAIN || get_errno() == EWOULDBLOCK)) {
             /* Wait for a notification from the event queue, or for an order to
                shut down */
             linux_event_watcher_t::watch_t watch(event_watcher.get(), poll_event_out);
-            wait_any_t waiter(&watch, &write_closed);
+            wait_any_t waiter(&watch, closer);
             waiter.wait_lazily_unordered();
 
-            if (write_closed.is_pulsed()) {
-                /* We were closed for whatever reason. Whatever signalled us has already called
-                   on_shutdown_write(). */
-                break;
+            if (closer->is_pulsed()) {
+                /* We were closed for whatever reason. Whatever signalled us has already
+                   shut down the connection. */
+                return true;
             }
 
             /* Go around the loop and try to write again */
@@ -622,34 +697,40 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
         } else if (res == -1 && (get_errno() == EPIPE || get_errno() == ENOTCONN || get_errno() == EHOSTUNREACH ||
                                  get_errno() == ENETDOWN || get_errno() == EHOSTDOWN || get_errno() == ECONNRESET)) {
             /* These errors are expected to happen at some point in practice */
-            on_shutdown_write();
-            break;
+            return false;
 
         } else if (res == -1) {
             /* In theory this should never happen, but it probably will. So we write a log message
                and then shut down normally. */
             logERR("Could not write to socket: %s", errno_string(get_errno()).c_str());
-            on_shutdown_write();
-            break;
+            return false;
 
         } else if (res == 0) {
             /* This should never happen either, but it's better to write an error message than to
                crash completely. */
-            logERR("Didn't expect write() to return 0.");
-            on_shutdown_write();
-            break;
+            logERR("Didn't expect writev() to return 0.");
+            return false;
 
         } else {
-            rassert(res <= static_cast<ssize_t>(size));
-            buf = reinterpret_cast<const void *>(reinterpret_cast<const char *>(buf) + res);
-            size -= res;
             if (write_perfmon) {
                 write_perfmon->record(res);
             }
+            /* Skip over the buffers, or the parts of them, that were written */
+            for (size_t written = res; written > 0;) {
+                rassert(first < count);
+                size_t chunk = std::min(written, iov[first].iov_len);
+                iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + chunk;
+                iov[first].iov_len -= chunk;
+                written -= chunk;
+                if (iov[first].iov_len == 0) {
+                    ++first;
+                }
+            }
         }
     }
-#endif
+    return true;
 }
+#endif
 
 void linux_tcp_conn_t::write(const void *buf, size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
     write_op_wrapper_t sentry(this, closer);
@@ -714,6 +795,24 @@ void linux_tcp_conn_t::write_buffered(const void *vbuf, size_t size, signal_t *c
     }
 }
 
+size_t linux_tcp_conn_t::write_buffered(std::vector<char> &&data, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
+    if (data.size() < ZERO_COPY_WRITE_MIN_SIZE) {
+        write_buffered(data.data(), data.size(), closer);
+        return data.size();
+    }
+
+    write_op_wrapper_t sentry(this, closer);
+
+    /* The data goes on the write queue together with whatever is in the write buffer,
+       so that things don't get out of order */
+    internal_flush_write_buffer(std::move(data));
+
+    if (write_closed.is_pulsed()) {
+        throw tcp_conn_write_closed_exc_t();
+    }
+    return 0;
+}
+
 void linux_tcp_conn_t::writef(signal_t *closer, const char *format, ...) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
     va_list ap;
     va_start(ap, format);
@@ -911,7 +1010,8 @@ linux_secure_tcp_conn_t::linux_secure_tcp_conn_t(
         signal_t *interruptor, int local_port)
         THROWS_ONLY(connect_failed_exc_t, crypto::openssl_error_t, interrupted_exc_t) :
     linux_tcp_conn_t(host, port, interruptor, local_port),
-    conn(tls_ctx) {
+    conn(tls_ctx),
+    kernel_tls_send(false) {
 
     conn.set_fd(sock.get());
     SSL_set_connect_state(conn.get());
@@ -923,7 +1023,8 @@ linux_secure_tcp_conn_t::linux_secure_tcp_conn_t(
         SSL_CTX *tls_ctx, fd_t _sock, signal_t *interruptor)
         THROWS_ONLY(crypto::openssl_error_t, interrupted_exc_t) :
     linux_tcp_conn_t(_sock),
-    conn(tls_ctx) {
+    conn(tls_ctx),
+    kernel_tls_send(false) {
 
     conn.set_fd(sock.get());
     SSL_set_accept_state(conn.get());
@@ -950,7 +1051,13 @@ void linux_secure_tcp_conn_t::perform_handshake(signal_t *interruptor)
         int ret = SSL_do_handshake(conn.get());
 
         if (ret > 0) {
-            return; // Successful TLS handshake.
+            // Successful TLS handshake.  If the TLS context enables it and both the
+            // kernel and the negotiated cipher support it, OpenSSL has moved the
+            // encryption into the kernel by now.  Otherwise we keep doing it here.
+#if defined(BIO_get_ktls_send) && !defined(_WIN32)
+            kernel_tls_send = BIO_get_ktls_send(SSL_get_wbio(conn.get()));
+#endif
+            return;
         }
 
         if (ret == 0) {
@@ -1047,9 +1154,37 @@ size_t linux_secure_tcp_conn_t::read_internal(void *buffer, size_t size)
     }
 }
 
+void linux_secure_tcp_conn_t::perform_writev(const const_charslice *buffers,
+                                             size_t count) {
+#ifndef _WIN32
+    if (kernel_tls_send) {
+        assert_thread();
+        if (closed.is_pulsed()) {
+            return;
+        }
+        if (!writev_to_socket(buffers, count, &closed)) {
+            shutdown_socket();
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; ++i) {
+        perform_write(buffers[i].beg, buffers[i].end - buffers[i].beg);
+    }
+}
+
 void linux_secure_tcp_conn_t::perform_write(const void *buffer, size_t size) {
     assert_thread();
 
+#ifndef _WIN32
+    if (kernel_tls_send) {
+        const char *data = static_cast<const char *>(buffer);
+        const const_charslice slice(data, data + size);
+        perform_writev(&slice, 1);
+        return;
+    }
+#endif
+
     if (closed.is_pulsed()) {
         /* The connection was closed, but there are still operations in the
         write queue; we are one of those operations. Just don't do anything. */
@@ -1261,10 +1396,12 @@ void linux_tcp_conn_descriptor_t::make_server_connection(
 /* Network listener object */
 linux_nonthrowing_tcp_listener_t::linux_nonthrowing_tcp_listener_t(
          const std::set<ip_address_t> &bind_addresses, int _port,
-         const std::function<void(scoped_ptr_t<linux_tcp_conn_descriptor_t> &)> &cb) :
+         const std::function<void(scoped_ptr_t<linux_tcp_conn_descriptor_t> &)> &cb,
+         bool _reuse_port) :
     callback(cb),
     local_addresses(bind_addresses),
     port(_port),
+    reuse_port(_reuse_port),
     bound(false),
     socks(),
     last_used_socket_index(0),
@@ -1365,11 +1502,20 @@ int linux_nonthrowing_tcp_listener_t::init_sockets() {
         // has a table of what this option means.
         int res = setsockopt(fd_to_socket(sock_fd), SOL_SOCKET, SO_EXCLUSIVEADDRUSE, reinterpret_cast<char*>(&sockoptval), sizeof(sockoptval));
         guarantee_winerr(res != -1, "Could not set EXCLUSIVEADDRUSE option");
+        guarantee(!reuse_port, "SO_REUSEPORT is not supported on Windows");
 #else
         // On Unix-like systems, we set `SO_REUSEADDR` to allow the port
         // to be re-bound quickly (e.g. if you restart the server).
         int res = setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &sockoptval, sizeof(sockoptval)); 
         guarantee_err(res != -1, "Could not set REUSEADDR option");
+        if (reuse_port) {
+            // Older kernels don't have `SO_REUSEPORT`, in which case we fail to bind.
+            res = setsockopt(
+                sock_fd, SOL_SOCKET, SO_REUSEPORT, &sockoptval, sizeof(sockoptval));
+            if (res == -1) {
+                return get_errno();
+            }
+        }
 #endif
         /* XXX Making our socket NODELAY prevents the problem where responses to
          * pipelined requests are delayed, since the TCP Nagle algorithm will
@@ -1703,6 +1849,63 @@ int linux_tcp_listener_t::get_port() const {
     return listener->get_port();
 }
 
+linux_reuseport_tcp_listener_t::linux_reuseport_tcp_listener_t(
+    const std::set<ip_address_t> &bind_addresses, int _port, int num_threads,
+    const std::function<void(scoped_ptr_t<linux_tcp_conn_descriptor_t> &)> &callback) :
+        listeners(num_threads),
+        port(_port)
+{
+    guarantee(num_threads > 0);
+
+    // The first listener picks the port if we weren't given one, and the others then
+    // join it on that port.
+    bool success;
+    {
+        on_thread_t thread_switcher((threadnum_t(0)));
+        listeners[0].init(
+            new linux_nonthrowing_tcp_listener_t(bind_addresses, port, callback, true));
+        success = listeners[0]->begin_listening();
+        port = listeners[0]->get_port();
+    }
+
+    if (success) {
+        scoped_array_t<bool> successes(num_threads);
+        pmap(num_threads - 1, [&](int64_t j) {
+            const int i = j + 1;
+            on_thread_t thread_switcher((threadnum_t(i)));
+            listeners[i].init(new linux_nonthrowing_tcp_listener_t(
+                bind_addresses, port, callback, true));
+            successes[i] = listeners[i]->begin_listening();
+        });
+        for (int i = 1; i < num_threads; ++i) {
+            success = success && successes[i];
+        }
+    }
+
+    if (!success) {
+        destroy_listeners();
+        throw address_in_use_exc_t("localhost", port);
+    }
+}
+
+linux_reuseport_tcp_listener_t::~linux_reuseport_tcp_listener_t() {
+    destroy_listeners();
+}
+
+int linux_reuseport_tcp_listener_t::get_port() const {
+    return port;
+}
+
+void linux_reuseport_tcp_listener_t::destroy_listeners() {
+    // Each listener has to go away on the thread whose event loop it's registered with.
+    pmap(listeners.size(), [this](int64_t i) {
+        if (listeners[i].has()) {
+            on_thread_t thread_switcher((threadnum_t(i)));
+            listeners[i].reset();
+        }
+    });
+}
+
 linux_repeated_nonthrowing_tcp_listener_t::linux_repeated_nonthrowing_tcp_listener_t(
     const std::set<ip_address_t> &bind_addresses,
     int port,
@@ -142,6 +142,14 @@ public:
     void write_buffered(const void *buf, size_t size, signal_t *closer)
         THROWS_ONLY(tcp_conn_write_closed_exc_t);
 
+    /* This write_buffered() takes over the contents of `data` instead of copying them.
+    If there are at least `ZERO_COPY_WRITE_MIN_SIZE` bytes, they are handed to the
+    socket as they are, in the same `writev()` as the data that was buffered before
+    them.  Smaller data is copied into the write buffer like above.  Returns the
+    number of bytes that were copied. */
+    size_t write_buffered(std::vector<char> &&data, signal_t *closer)
+        THROWS_ONLY(tcp_conn_write_closed_exc_t);
+
     void writef(signal_t *closer, const char *format, ...)
         THROWS_ONLY(tcp_conn_write_closed_exc_t) ATTR_FORMAT(printf, 3, 4);
 
@@ -178,6 +186,14 @@ protected:
     void on_shutdown_read();
     void on_shutdown_write();
 
+#ifndef _WIN32
+    /* Writes the buffers to the socket with `writev()`, waiting for it to be writable
+    as needed.  Returns true once everything is written or `closer` is pulsed, and
+    false if the socket failed. */
+    bool writev_to_socket(const const_charslice *buffers, size_t count,
+                          signal_t *closer);
+#endif
+
     // Used by tcp_listener_t and any derived classes.
     explicit linux_tcp_conn_t(fd_t sock);
 
@@ -268,6 +284,7 @@ private:
 
     static const size_t WRITE_QUEUE_MAX_SIZE = 128 * KILOBYTE;
     static const size_t WRITE_CHUNK_SIZE = 8 * KILOBYTE;
+    static const size_t ZERO_COPY_WRITE_MIN_SIZE = 64 * KILOBYTE;
 
     /* Structs to avoid over-using dynamic allocation */
     struct write_buffer_t : public intrusive_list_node_t<write_buffer_t> {
@@ -279,6 +296,10 @@ private:
         write_buffer_t *dealloc;
         const void *buffer;
         size_t size;
+        // Data that was handed over to `write_buffered()`, written after `buffer`
+        std::vector<char> owned;
+        // How much of `write_queue_limiter` to release when the write is done
+        size_t limiter_count;
         cond_t *cond;
         auto_drainer_t::lock_t keepalive;
     };
@@ -318,6 +339,11 @@ private:
     data to be completely written. */
     void internal_flush_write_buffer();
 
+    /* Like `internal_flush_write_buffer()`, but also writes `owned` right after the
+    write buffer's contents.  As the whole of `owned` will be queued at once, this waits
+    for the write queue to be empty first. */
+    void internal_flush_write_buffer(std::vector<char> &&owned);
+
     /* Used to queue up buffers to write. The functions in `write_queue` will all be
     `std::bind()`s of the `perform_write()` function below. */
     unlimited_fifo_queue_t<write_queue_op_t*, intrusive_list_t<write_queue_op_t> > write_queue;
@@ -345,6 +371,10 @@ private:
     /* Used to actually perform a write. If the write end of the connection is open, then
     writes `size` bytes from `buffer` to the socket. */
     virtual void perform_write(const void *buffer, size_t size);
+
+    /* Like `perform_write()`, but writes several buffers one after the other, with a
+    single `writev()` call where possible. */
+    virtual void perform_writev(const const_charslice *buffers, size_t count);
 };
 
 #ifdef ENABLE_TLS
@@ -409,6 +439,10 @@ private:
     writes `size` bytes from `buffer` to the socket. */
     virtual void perform_write(const void *buffer, size_t size);
 
+    /* Without kernel TLS, records don't line up with our buffers anyway, so this just
+    writes them one after the other. */
+    virtual void perform_writev(const const_charslice *buffers, size_t count);
+
     void shutdown();
     void shutdown_socket();
 
@@ -416,6 +450,13 @@ private:
 
     tls_conn_wrapper_t conn;
 
+    /* Set if OpenSSL handed the session keys for sending to the kernel after the
+    handshake.  The kernel then encrypts whatever we write to the socket, so we write
+    to it directly instead of going through `SSL_write()`.  Received records are
+    still read with `SSL_read()`, which takes care of the non-data records, but the
+    kernel may decrypt those as well. */
+    bool kernel_tls_send;
+
     cond_t closed;
 };
 
@@ -453,7 +494,8 @@ the provided callback will be called in a new coroutine every time something con
 class linux_nonthrowing_tcp_listener_t : private linux_event_callback_t {
 public:
     linux_nonthrowing_tcp_listener_t(const std::set<ip_address_t> &bind_addresses, int _port,
-        const std::function<void(scoped_ptr_t<linux_tcp_conn_descriptor_t> &)> &callback);
+        const std::function<void(scoped_ptr_t<linux_tcp_conn_descriptor_t> &)> &callback,
+        bool _reuse_port = false);
 
     ~linux_nonthrowing_tcp_listener_t();
 
@@ -499,6 +541,10 @@ private:
     // The port we're asked to bind to
     int port;
 
+    // Whether to set `SO_REUSEPORT` on the sockets, so that other sockets can listen
+    // on the same port
+    bool reuse_port;
+
     // Inidicates successful binding to a port
     bool bound;
 
@@ -539,6 +585,30 @@ private:
     scoped_ptr_t<linux_nonthrowing_tcp_listener_t> listener;
 };
 
+/* Like `linux_tcp_listener_t`, but with a separate listening socket on each of the
+threads `0` to `num_threads - 1`, all bound to the same port with `SO_REUSEPORT`.  The
+kernel spreads incoming connections across the sockets, so that each connection is
+accepted, and the callback is called, on whichever of the threads got it.  This is not
+supported on Windows. */
+class linux_reuseport_tcp_listener_t {
+public:
+    linux_reuseport_tcp_listener_t(const std::set<ip_address_t> &bind_addresses, int port,
+        int num_threads,
+        const std::function<void(scoped_ptr_t<linux_tcp_conn_descriptor_t> &)> &callback);
+    ~linux_reuseport_tcp_listener_t();
+
+    int get_port() const;
+
+private:
+    void destroy_listeners();
+
+    // `listeners[i]` lives on thread `i`
+    scoped_array_t<scoped_ptr_t<linux_nonthrowing_tcp_listener_t> > listeners;
+    int port;
+
+    DISABLE_COPYING(linux_reuseport_tcp_listener_t);
+};
+
 /* Like a linux tcp listener but repeatedly tries to bind to its port until successful */
 class linux_repeated_nonthrowing_tcp_listener_t {
 public:
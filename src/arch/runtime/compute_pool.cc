@@ -0,0 +1,102 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include "arch/runtime/compute_pool.hpp"
+
+#include <signal.h>
+
+#include "arch/runtime/coroutines.hpp"
+#include "arch/runtime/message_hub.hpp"
+#include "arch/runtime/thread_pool.hpp"
+
+void compute_pool_t::job_t::on_thread_switch() {
+    // We're back on the thread that the job came from.
+    waiter->notify_sometime();
+}
+
+void *compute_pool_t::worker_loop(void *arg) {
+    compute_pool_t *parent = static_cast<compute_pool_t *>(arg);
+
+#ifndef _WIN32
+    // Disable signals on this thread, so that they're handled by the thread pool.
+    {
+        sigset_t sigmask;
+        int res = sigfillset(&sigmask);
+        guarantee_err(res == 0, "Could not get a full sigmask");
+
+        res = pthread_sigmask(SIG_SETMASK, &sigmask, nullptr);
+        guarantee_xerr(res == 0, res, "Could not block signal");
+    }
+#endif
+
+    while (true) {
+        job_t *job;
+        {
+            system_mutex_t::lock_t lock(&parent->jobs_mutex);
+            while (parent->jobs.empty() && !parent->shutting_down) {
+                parent->jobs_cond.wait(&parent->jobs_mutex);
+            }
+            if (parent->shutting_down) {
+                return nullptr;
+            }
+            job = parent->jobs.front();
+            parent->jobs.pop_front();
+        }
+
+        try {
+            (*job->fn)();
+        } catch (...) {
+            job->exception = std::current_exception();
+        }
+
+        // The job's thread picks the message up like any other message from another
+        // thread, without us having to be part of the thread pool.
+        job->origin_hub->insert_external_message(job);
+    }
+}
+
+compute_pool_t::compute_pool_t(int nthreads)
+    : threads(nthreads), shutting_down(false) {
+    guarantee(nthreads > 0);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        int res = pthread_create(&threads[i], nullptr,
+                                 &compute_pool_t::worker_loop, this);
+        guarantee_xerr(res == 0, res, "Could not create compute-pool thread.");
+    }
+}
+
+compute_pool_t::~compute_pool_t() {
+    {
+        system_mutex_t::lock_t lock(&jobs_mutex);
+        // Every job has a coroutine waiting for it, which has to be done by now.
+        rassert(jobs.empty());
+        shutting_down = true;
+        jobs_cond.broadcast();
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+        int res = pthread_join(threads[i], nullptr);
+        guarantee_xerr(res == 0, res, "Could not join compute-pool thread.");
+    }
+}
+
+void compute_pool_t::run(const std::function<void()> &fn) {
+    job_t job;
+    job.fn = &fn;
+    job.origin_hub = &linux_thread_pool_t::get_thread()->message_hub;
+    job.waiter = coro_t::self();
+    guarantee(job.waiter != nullptr, "compute_pool_t::run() must be called in a "
+                                     "coroutine.");
+
+    {
+        system_mutex_t::lock_t lock(&jobs_mutex);
+        jobs.push_back(&job);
+        jobs_cond.signal();
+    }
+
+    // `on_thread_switch()` can't run before we're waiting, because it runs on this
+    // thread.
+    coro_t::wait();
+
+    if (job.exception) {
+        std::rethrow_exception(job.exception);
+    }
+}
@@ -0,0 +1,62 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#ifndef ARCH_RUNTIME_COMPUTE_POOL_HPP_
+#define ARCH_RUNTIME_COMPUTE_POOL_HPP_
+
+#include <pthread.h>
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include "arch/io/concurrency.hpp"
+#include "arch/runtime/runtime_utils.hpp"
+#include "errors.hpp"
+
+class coro_t;
+class linux_message_hub_t;
+
+/* `compute_pool_t` is a set of threads outside of the thread pool that CPU-heavy work
+can be handed to.  Work that runs on one of the thread pool's threads holds up every
+other coroutine on that thread until it's done, while the calling coroutine of work
+that runs here just waits and lets the others run in the meantime.
+
+Unlike `blocker_pool_t`, which reports back to the one thread it was created on, each
+job reports back to the thread that it came from. */
+
+class compute_pool_t {
+public:
+    explicit compute_pool_t(int nthreads);
+    ~compute_pool_t();
+
+    /* Runs `fn` on one of the pool's threads, and blocks the calling coroutine until
+    it's done.  If `fn` throws, the exception is rethrown here.
+
+    `fn` must not use coroutines, signals, perfmons or anything else that belongs to
+    a thread of the thread pool.  Nothing else may change the data that it works on
+    while it runs. */
+    void run(const std::function<void()> &fn);
+
+private:
+    class job_t : public linux_thread_message_t {
+    public:
+        void on_thread_switch();
+
+        const std::function<void()> *fn;
+        std::exception_ptr exception;
+        linux_message_hub_t *origin_hub;
+        coro_t *waiter;
+    };
+
+    static void *worker_loop(void *arg);
+
+    std::vector<pthread_t> threads;
+    bool shutting_down;
+    std::deque<job_t *> jobs;
+    system_mutex_t jobs_mutex;
+    system_cond_t jobs_cond;
+
+    DISABLE_COPYING(compute_pool_t);
+};
+
+#endif  // ARCH_RUNTIME_COMPUTE_POOL_HPP_
@@ -15,6 +15,38 @@ perfmon_duration_sampler_t *pm_eventloop_singleton_t::get() {
     return &pm_eventloop;
 }
 
+struct pm_eventloop_time_t {
+    pm_eventloop_time_t()
+        : membership(&get_global_perfmon_collection(), &collection, "eventloop_time"),
+          counters_membership(&collection,
+                              &idle, "idle_ticks",
+                              &spinning, "spinning_ticks",
+                              &busy, "busy_ticks") { }
+    perfmon_collection_t collection;
+    perfmon_membership_t membership;
+    perfmon_counter_t idle;
+    perfmon_counter_t spinning;
+    perfmon_counter_t busy;
+    perfmon_multi_membership_t counters_membership;
+};
+
+static pm_eventloop_time_t *get_pm_eventloop_time() {
+    static pm_eventloop_time_t pm_eventloop_time;
+    return &pm_eventloop_time;
+}
+
+perfmon_counter_t *pm_eventloop_time_singleton_t::idle() {
+    return &get_pm_eventloop_time()->idle;
+}
+
+perfmon_counter_t *pm_eventloop_time_singleton_t::spinning() {
+    return &get_pm_eventloop_time()->spinning;
+}
+
+perfmon_counter_t *pm_eventloop_time_singleton_t::busy() {
+    return &get_pm_eventloop_time()->busy;
+}
+
 std::string format_poll_event(int event) {
     std::string s;
     if (event & poll_event_in) {
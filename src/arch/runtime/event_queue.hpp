@@ -21,6 +21,16 @@ struct pm_eventloop_singleton_t {
     static perfmon_duration_sampler_t *get();
 };
 
+// How long the event loops have spent waiting in the kernel, spinning while busy
+// polling, and handling events, in ticks summed over all threads, so that the CPU cost
+// of busy polling can be weighed against what it saves.  Initialized on first use, for
+// the same reason.
+struct pm_eventloop_time_singleton_t {
+    static perfmon_counter_t *idle();
+    static perfmon_counter_t *spinning();
+    static perfmon_counter_t *busy();
+};
+
 /* Pick the queue now*/
 
 #if defined(_WIN32)
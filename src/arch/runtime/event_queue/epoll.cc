@@ -12,6 +12,7 @@
 #include <new>
 #include <algorithm>
 #include <string>
+#include <vector>
 
 #include "config/args.hpp"
 #include "utils.hpp"
@@ -46,20 +47,60 @@ int epoll_to_user(int mode) {
 }
 
 epoll_event_queue_t::epoll_event_queue_t(linux_queue_parent_t *_parent)
-    : parent(_parent), nevents(0) {
+    : parent(_parent), nevents(0), max_spin_ticks(0), spin_ticks(0),
+      busy_polling(false) {
     // Create a poll fd
 
     epoll_fd = epoll_create1(0);
     guarantee_err(epoll_fd >= 0, "Could not create epoll fd");
 }
 
+int epoll_event_queue_t::wait_for_events(ticks_t now) {
+    if (max_spin_ticks > 0) {
+        // Spin, so that the next event or message is handled right away instead of
+        // after the kernel has woken us up.
+        if (!busy_polling) {
+            parent->begin_busy_poll();
+            busy_polling = true;
+        }
+        const ticks_t spin_start = now;
+        do {
+            int res = epoll_wait(epoll_fd, events, MAX_IO_EVENT_PROCESSING_BATCH_SIZE, 0);
+            if (res != 0 || parent->has_pending_messages()) {
+                // It paid off, so spin a bit longer next time.
+                *pm_eventloop_time_singleton_t::spinning() += get_ticks() - spin_start;
+                spin_ticks = std::min(max_spin_ticks, spin_ticks * 2);
+                return res;
+            }
+            now = get_ticks();
+        } while (now - spin_start < spin_ticks);
+
+        *pm_eventloop_time_singleton_t::spinning() += now - spin_start;
+        spin_ticks = std::max(max_spin_ticks / BUSY_POLL_MIN_BUDGET_DIVISOR,
+                              spin_ticks / 2);
+        parent->end_busy_poll();
+        busy_polling = false;
+    }
+
+    // Grab the events from the kernel!
+    int res = epoll_wait(epoll_fd, events, MAX_IO_EVENT_PROCESSING_BATCH_SIZE, -1);
+    *pm_eventloop_time_singleton_t::idle() += get_ticks() - now;
+    return res;
+}
+
 void epoll_event_queue_t::run() {
     int res;
 
+    max_spin_ticks = parent->get_busy_poll_usec() * THOUSAND;
+    spin_ticks = max_spin_ticks;
+
     // Now, start the loop
+    ticks_t busy_start = get_ticks();
     while (!parent->should_shut_down()) {
-        // Grab the events from the kernel!
-        res = epoll_wait(epoll_fd, events, MAX_IO_EVENT_PROCESSING_BATCH_SIZE, -1);
+        ticks_t now = get_ticks();
+        *pm_eventloop_time_singleton_t::busy() += now - busy_start;
+        res = wait_for_events(now);
+        busy_start = get_ticks();
 
         // epoll_wait might return with EINTR in some cases (in
         // particular under GDB), we just need to retry.
@@ -118,8 +159,17 @@ void epoll_event_queue_t::run() {
 
         nevents = 0;
 
+        if (busy_polling) {
+            parent->poll_messages();
+        }
+
         parent->pump();
     }
+
+    if (busy_polling) {
+        parent->end_busy_poll();
+        busy_polling = false;
+    }
 }
 
 epoll_event_queue_t::~epoll_event_queue_t() {
@@ -12,6 +12,7 @@
 #include "arch/runtime/runtime_utils.hpp"
 #include "arch/runtime/system_event.hpp"
 #include "config/args.hpp"
+#include "time.hpp"
 
 // Event queue structure
 struct epoll_event_queue_t {
@@ -30,6 +31,10 @@ public:
     void forget_event(system_event_t *, linux_event_callback_t *cb);
 
 private:
+    // Waits for events like `epoll_wait()`, but spins first if the parent wants busy
+    // polling.  `now` is the current time.
+    int wait_for_events(ticks_t now);
+
     linux_queue_parent_t *parent;
 
     fd_t epoll_fd;
@@ -40,6 +45,12 @@ private:
     epoll_event events[MAX_IO_EVENT_PROCESSING_BATCH_SIZE];
     int nevents;
 
+    // How long the parent lets us spin at most, and how long we currently do, which
+    // adapts to how often spinning pays off.
+    ticks_t max_spin_ticks;
+    ticks_t spin_ticks;
+    bool busy_polling;
+
 #ifndef NDEBUG
     /* In debug mode, check to make sure epoll() doesn't give us events that
     we didn't ask for. The ints stored here are combinations of poll_event_in
@@ -3,6 +3,7 @@
 #define ARCH_RUNTIME_EVENT_QUEUE_TYPES_HPP_
 
 #include <signal.h>
+#include <stdint.h>
 
 // Types that are used, in particular, by poll.hpp and epoll.hpp.
 
@@ -15,6 +16,18 @@ struct linux_event_callback_t {
 struct linux_queue_parent_t {
     virtual void pump() = 0;
     virtual bool should_shut_down() = 0;
+
+    /* Busy polling, which only the epoll queue supports.  `get_busy_poll_usec()` is
+    the longest the queue may spin before it blocks, or zero if it never should.  Between
+    `begin_busy_poll()` and `end_busy_poll()`, messages from other threads don't wake
+    the queue up through the kernel; the queue checks `has_pending_messages()` instead,
+    and handles them with `poll_messages()`. */
+    virtual int64_t get_busy_poll_usec() = 0;
+    virtual void begin_busy_poll() = 0;
+    virtual bool has_pending_messages() = 0;
+    virtual void poll_messages() = 0;
+    virtual void end_busy_poll() = 0;
+
     virtual ~linux_queue_parent_t() {}
 };
 
@@ -4,6 +4,8 @@
 #include <math.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include "config/args.hpp"
 #include "arch/runtime/event_queue.hpp"
 #include "arch/runtime/thread_pool.hpp"
@@ -21,9 +23,17 @@ linux_message_hub_t::linux_message_hub_t(linux_event_queue_t *queue,
                                          threadnum_t current_thread)
     : queue_(queue),
       thread_pool_(thread_pool),
+      incoming_rings_(thread_pool->n_threads),
       is_woken_up_(false),
+      busy_polling_(false),
+      ring_has_room_(false),
+      has_incoming_messages_(false),
       current_thread_(current_thread) {
 
+    for (size_t i = 0; i < incoming_rings_.size(); ++i) {
+        incoming_rings_[i].init(new incoming_ring_t());
+    }
+
 #ifndef NDEBUG
     if(MESSAGE_SCHEDULER_GRANULARITY < (1 << (NUM_SCHEDULER_PRIORITIES))) {
         logWRN("MESSAGE_SCHEDULER_GRANULARITY is too small to honor some of the "
@@ -46,6 +56,10 @@ linux_message_hub_t::~linux_message_hub_t() {
     }
 
     guarantee(incoming_messages_.empty());
+    for (size_t i = 0; i < incoming_rings_.size(); ++i) {
+        linux_thread_message_t *m;
+        guarantee(!incoming_rings_[i]->ring.pop(&m));
+    }
 }
 
 void linux_message_hub_t::do_store_message(threadnum_t nthread, linux_thread_message_t *msg) {
@@ -92,15 +106,20 @@ void linux_message_hub_t::store_message_sometime(threadnum_t nthread, linux_thre
 
 
 void linux_message_hub_t::insert_external_message(linux_thread_message_t *msg) {
-    bool do_wake_up;
     {
         spinlock_acq_t acq(&incoming_messages_lock_);
-        do_wake_up = !check_and_set_is_woken_up();
         incoming_messages_.push_back(msg);
+        has_incoming_messages_.value.store(true);
     }
 
     // Wakey wakey eggs and bakey
-    if (do_wake_up) {
+    wake_up();
+}
+
+void linux_message_hub_t::wake_up() {
+    // The exchange also makes sure that the messages we delivered are visible to
+    // `sort_incoming_messages_by_priority()` once it has reset the flag.
+    if (!is_woken_up_.value.exchange(true)) {
         event_.wakey_wakey();
     }
 }
@@ -120,6 +139,58 @@ void linux_message_hub_t::on_event(int events) {
     // up and so that poll-based event triggering doesn't infinite-loop.
     event_.consume_wakey_wakeys();
 
+    process_messages();
+}
+
+void linux_message_hub_t::begin_busy_poll() {
+    rassert(!busy_polling_);
+    busy_polling_ = true;
+    // Tell everybody that we're awake already.  If somebody beat us to it, `event_`
+    // is going to fire once anyway, which doesn't hurt.
+    is_woken_up_.value.store(true);
+}
+
+void linux_message_hub_t::notify_ring_has_room() {
+    ring_has_room_.value.store(true);
+    wake_up();
+}
+
+bool linux_message_hub_t::has_pending_messages() {
+    // Our event loop pushes our messages after it has handled what we report here.
+    if (ring_has_room_.value.load(std::memory_order_relaxed)
+        && ring_has_room_.value.exchange(false)) {
+        return true;
+    }
+    for (int i = 0; i < NUM_SCHEDULER_PRIORITIES; ++i) {
+        if (!priority_msg_lists_[i].empty()) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < incoming_rings_.size(); ++i) {
+        if (!incoming_rings_[i]->ring.empty()) {
+            return true;
+        }
+    }
+    return has_incoming_messages_.value.load();
+}
+
+void linux_message_hub_t::poll_messages() {
+    rassert(busy_polling_);
+    process_messages();
+}
+
+void linux_message_hub_t::end_busy_poll() {
+    rassert(busy_polling_);
+    busy_polling_ = false;
+    // From here on we have to be woken up again.  Anything that arrived before that
+    // doesn't wake us, so we have to do it ourselves.
+    is_woken_up_.value.exchange(false);
+    if (has_pending_messages()) {
+        wake_up();
+    }
+}
+
+void linux_message_hub_t::process_messages() {
     // Sort incoming messages into the respective priority_msg_lists_
     sort_incoming_messages_by_priority();
 
@@ -170,20 +241,14 @@ void linux_message_hub_t::on_event(int events) {
     }
 
     // We might have left some messages unprocessed.
-    // Check if that is the case, and if yes, make sure we are called again.
-    for (int i = 0; i < NUM_SCHEDULER_PRIORITIES; ++i) {
+    // Check if that is the case, and if yes, make sure we are called again.  (While
+    // we're busy polling, the event queue finds them by itself.)
+    for (int i = 0; !busy_polling_ && i < NUM_SCHEDULER_PRIORITIES; ++i) {
         if (!priority_msg_lists_[i].empty()) {
             // Place wakey_wakey and then yield to the event processing.
             // It will wake us up again immediately, but can handle a few
             // OS events (such as timers, network messages etc.) in the meantime.
-            bool do_wake_up;
-            {
-                spinlock_acq_t acq(&incoming_messages_lock_);
-                do_wake_up = !check_and_set_is_woken_up();
-            }
-            if (do_wake_up) {
-                event_.wakey_wakey();
-            }
+            wake_up();
             break;
         }
     }
@@ -195,12 +260,37 @@ void linux_message_hub_t::sort_incoming_messages_by_priority() {
     // assigning each message to a different priority queue
     // is more expensive.
 
-    // 1. Pull the messages
+    // 1. Pull the messages.  Anything delivered after we reset `is_woken_up_` is going
+    // to wake us up again, so we can't miss any.  While we're busy polling we leave it
+    // set, because the event queue is going to look for new messages anyway.
+    is_woken_up_.value.exchange(busy_polling_);
     msg_list_t new_messages;
     {
         spinlock_acq_t acq(&incoming_messages_lock_);
         new_messages.append_and_clear(&incoming_messages_);
-        is_woken_up_ = false;
+        has_incoming_messages_.value.store(false);
+    }
+
+    for (size_t i = 0; i < incoming_rings_.size(); ++i) {
+        incoming_ring_t *incoming = incoming_rings_[i].get();
+        // Take at most one ring's worth, so that a busy sender can't keep us here
+        // forever.  Whatever it pushes in the meantime wakes us up again.
+        size_t popped = 0;
+        linux_thread_message_t *m;
+        while (popped < incoming->ring.capacity() && incoming->ring.pop(&m)) {
+            new_messages.push_back(m);
+            ++popped;
+        }
+
+        // If the sender ran out of room, let it know that there is some now.  This
+        // pairs with the fence in `push_to_ring()`.
+        if (popped > 0) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (incoming->producer_stalled.value.load(std::memory_order_relaxed)
+                && incoming->producer_stalled.value.exchange(false)) {
+                thread_pool_->threads[i]->message_hub.notify_ring_has_room();
+            }
+        }
     }
 
     // 2. Sort the messages into their respective priority queues
@@ -219,38 +309,42 @@ void linux_message_hub_t::sort_incoming_messages_by_priority() {
     }
 }
 
-bool linux_message_hub_t::check_and_set_is_woken_up() {
-    const bool was_woken_up = is_woken_up_;
-    is_woken_up_ = true;
-    return was_woken_up;
-}
-
-// Pushes messages collected locally global lists available to all
-// threads.
+// Pushes messages collected locally onto the rings of the threads they're going to.
 void linux_message_hub_t::push_messages() {
     for (int i = 0; i < thread_pool_->n_threads; i++) {
-        // Append the local list for ith thread to that thread's global
-        // message list.
         thread_queue_t *queue = &queues_[i];
         if (!queue->msg_local_list.empty()) {
             // Transfer messages to the other core
+            linux_message_hub_t *dest = &thread_pool_->threads[i]->message_hub;
 
-            bool do_wake_up;
-            {
-                spinlock_acq_t acq(&thread_pool_->threads[i]->message_hub.incoming_messages_lock_);
-
-                // We only need to do a wake up if we're the first people to do a
-                // wake up.
-                do_wake_up =
-                    !thread_pool_->threads[i]->message_hub.check_and_set_is_woken_up();
-
-                thread_pool_->threads[i]->message_hub.incoming_messages_.append_and_clear(&queue->msg_local_list);
+            // We only need one wake up for however many messages we pushed, and only if
+            // nobody else has done one yet.  Wakey wakey, perhaps eggs and bakey
+            if (push_to_ring(dest, &queue->msg_local_list)) {
+                dest->wake_up();
             }
+        }
+    }
+}
 
-            // Wakey wakey, perhaps eggs and bakey
-            if (do_wake_up) {
-                thread_pool_->threads[i]->message_hub.event_.wakey_wakey();
+bool linux_message_hub_t::push_to_ring(linux_message_hub_t *dest, msg_list_t *list) {
+    incoming_ring_t *incoming = dest->incoming_rings_[current_thread_.threadnum].get();
+    bool pushed_any = false;
+    while (linux_thread_message_t *m = list->head()) {
+        // The message must be off our list before `dest` can see it.
+        list->remove(m);
+        if (!incoming->ring.push(m)) {
+            // The ring is full.  Ask `dest` to wake us up once it has made room, and
+            // check again in case it made room before it could see that.
+            incoming->producer_stalled.value.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!incoming->ring.push(m)) {
+                // The rest stays on our list, in order, until `dest` wakes us up and
+                // our event loop calls `push_messages()` again.
+                list->push_front(m);
+                break;
             }
         }
+        pushed_any = true;
     }
+    return pushed_any;
 }
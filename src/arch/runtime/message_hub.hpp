@@ -4,12 +4,17 @@
 
 #include <pthread.h>
 
+#include <atomic>
+
 #include "arch/runtime/event_queue.hpp"
 #include "arch/runtime/runtime_utils.hpp"
 #include "arch/runtime/system_event.hpp"
 #include "arch/spinlock.hpp"
 #include "config/args.hpp"
+#include "concurrency/cache_line_padded.hpp"
 #include "containers/intrusive_list.hpp"
+#include "containers/scoped.hpp"
+#include "containers/spsc_ring.hpp"
 #include "threading.hpp"
 
 
@@ -23,7 +28,13 @@ class linux_thread_pool_t;
 /* There is one message hub per thread, NOT one message hub for the entire program.
 
 Each message hub stores messages that are going from that message hub's home thread to
-other threads. It keeps a separate queue for messages destined for each other thread. */
+other threads. It keeps a separate queue for messages destined for each other thread.
+
+Messages travel between two threads of the pool through a lock-free ring that belongs
+to the receiving hub and is reserved for the sending thread, so that senders never
+contend with each other or with the receiver.  A sender that finds the ring full keeps
+the remaining messages on its local list, in order, until the receiver has made room and
+woken it up again. */
 
 class linux_message_hub_t : private linux_event_callback_t {
 public:
@@ -32,8 +43,8 @@ public:
     linux_message_hub_t(linux_event_queue_t *queue, linux_thread_pool_t *thread_pool,
                         threadnum_t current_thread);
 
-    /* For each thread, transfer messages from our msg_local_list for that thread to our
-    msg_global_list for that thread */
+    /* For each thread, transfer messages from our msg_local_list for that thread to
+    the ring that thread keeps for messages from us */
     void push_messages();
 
     /* Schedules the given message to be sent to the given thread by pushing it onto our
@@ -44,8 +55,16 @@ public:
     // guaranteed to be called in the same order relative to one another.
     void store_message_sometime(threadnum_t nthread, linux_thread_message_t *msg);
 
+    /* Busy polling, see `linux_queue_parent_t`.  While we're busy polling, nobody
+    wakes us up through `event_`; the event queue asks `has_pending_messages()` instead,
+    and calls `poll_messages()` to handle them. */
+    void begin_busy_poll();
+    bool has_pending_messages();
+    void poll_messages();
+    void end_busy_poll();
+
     // Called by the thread pool when it needs to deliver a message from the main thread
-    // (which does not have an event queue)
+    // (which does not have an event queue), or by any other thread outside of the pool.
     void insert_external_message(linux_thread_message_t *msg);
 
     ~linux_message_hub_t();
@@ -55,10 +74,26 @@ private:
     // debug mode.
     void do_store_message(threadnum_t nthread, linux_thread_message_t *msg);
 
-    // Moves messages from incoming_messages_ into the respective entries of
-    // priority_msg_lists, depending on the messages' priorities.
+    // Moves messages from the incoming rings and incoming_messages_ into the
+    // respective entries of priority_msg_lists, depending on the messages' priorities.
     void sort_incoming_messages_by_priority();
 
+    // Moves as many messages as fit from `list` onto the ring that `dest` keeps for
+    // messages from this thread.  Returns true if `dest` should be woken up.
+    bool push_to_ring(linux_message_hub_t *dest, msg_list_t *list);
+
+    // Wakes up this hub's thread, unless somebody already has since it last looked at
+    // its incoming messages.
+    void wake_up();
+
+    // Called by a thread that took messages off a ring that we found full, so that we
+    // push the rest of our messages.
+    void notify_ring_has_room();
+
+    // Sorts the incoming messages and handles some of them.  Does the work for
+    // `on_event()` and `poll_messages()`.
+    void process_messages();
+
     msg_list_t &get_priority_msg_list(int priority);
 
     linux_event_queue_t *const queue_;
@@ -68,16 +103,38 @@ private:
     struct thread_queue_t {
         //TODO this doesn't need to be a class anymore
 
-        /* Messages are cached here before being pushed to the global list so that we don't
-        have to acquire the spinlock as often */
+        /* Messages are cached here before being pushed onto the other thread's ring,
+        so that we only wake it up once per batch.  Messages that don't fit onto the
+        ring wait here too. */
         msg_list_t msg_local_list;
     } queues_[MAX_THREADS];
 
-    // Must only be used with acquired incoming_messages_lock_
-    bool check_and_set_is_woken_up();
-    bool is_woken_up_;
+    /* Messages coming in from one other thread of the pool.  `producer_stalled` is set
+    by the sender when it found the ring full, and tells us to wake it up once we have
+    taken messages off of it. */
+    struct incoming_ring_t {
+        incoming_ring_t() : ring(MESSAGE_HUB_RING_SIZE), producer_stalled(false) { }
+        spsc_ring_t<linux_thread_message_t *> ring;
+        cache_line_padded_t<std::atomic<bool> > producer_stalled;
+    };
+    // Indexed by the sending thread.
+    scoped_array_t<scoped_ptr_t<incoming_ring_t> > incoming_rings_;
+
+    // Set by whoever delivers a message first after we last looked at our incoming
+    // messages, so that a whole batch of messages only costs a single wakey_wakey.
+    // Stays set while we're busy polling.
+    cache_line_padded_t<std::atomic<bool> > is_woken_up_;
+    bool busy_polling_;
+
+    // Set by `notify_ring_has_room()`, so that busy polling notices it too.
+    cache_line_padded_t<std::atomic<bool> > ring_has_room_;
+
+    // Messages from threads outside of the pool, which can't have rings of their own.
     msg_list_t incoming_messages_;
     spinlock_t incoming_messages_lock_;
+    // Whether `incoming_messages_` might be non-empty, so that busy polling doesn't
+    // have to take the spinlock to find out.
+    cache_line_padded_t<std::atomic<bool> > has_incoming_messages_;
 
     // Use `sort_incoming_messages_by_priority()` to sort incoming_messages_ into
     // these lists.
@@ -90,7 +147,7 @@ private:
     void on_event(int events);
 
     // The eventfd (or pipe-based alternative) notified after the first incoming
-    // message is put onto incoming_messages_.
+    // message is put onto an incoming ring or incoming_messages_.
     system_event_t event_;
 
     /* The thread that we queue messages originating from. (Recall that there is one
@@ -71,8 +71,9 @@ private:
 };
 
 // Runs the action 'fun()' on thread zero.
-void run_in_thread_pool(const std::function<void()> &fun, int worker_threads) {
-    linux_thread_pool_t thread_pool(worker_threads, false);
+void run_in_thread_pool(const std::function<void()> &fun, int worker_threads,
+                        int64_t busy_poll_usec) {
+    linux_thread_pool_t thread_pool(worker_threads, false, busy_poll_usec);
     starter_t starter(&thread_pool, fun);
     thread_pool.run_thread_pool(&starter);
 }
@@ -4,12 +4,16 @@
 
 // Implementation in runtime.cc.
 
+#include <stdint.h>
+
 #include <functional>
 
 /* `run_in_thread_pool()` starts a RethinkDB thread pool, runs the given
 function in a coroutine inside of it, waits for the function to return, and then
-shuts down the thread pool. */
+shuts down the thread pool.  If `busy_poll_usec` isn't zero, idle threads spin for up
+to that long before they go to sleep, see `linux_thread_pool_t`. */
 
-void run_in_thread_pool(const std::function<void()> &fun, int worker_threads);
+void run_in_thread_pool(const std::function<void()> &fun, int worker_threads,
+                        int64_t busy_poll_usec);
 
 #endif  // ARCH_RUNTIME_STARTER_HPP_
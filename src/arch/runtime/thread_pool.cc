@@ -62,14 +62,16 @@ void linux_thread_pool_t::set_thread(linux_thread_t *val) {
     thread = val;
 }
 
-linux_thread_pool_t::linux_thread_pool_t(int worker_threads, bool _do_set_affinity) :
+linux_thread_pool_t::linux_thread_pool_t(int worker_threads, bool _do_set_affinity,
+                                         int64_t _busy_poll_usec) :
 #ifndef NDEBUG
       coroutine_summary(false),
 #endif
       interrupt_message(nullptr),
       generic_blocker_pool(nullptr),
       n_threads(worker_threads + 1),    // we create an extra utility thread
-      do_set_affinity(_do_set_affinity)
+      do_set_affinity(_do_set_affinity),
+      busy_poll_usec(_busy_poll_usec)
 {
     rassert(n_threads > 1);             // we want at least one non-utility thread
     rassert(n_threads <= MAX_THREADS);
@@ -458,6 +460,7 @@ linux_thread_t::linux_thread_t(linux_thread_pool_t *parent_pool, int thread_id)
     : queue(this),
       message_hub(&queue, parent_pool, threadnum_t(thread_id)),
       timer_handler(&queue),
+      busy_poll_usec(parent_pool->busy_poll_usec),
       do_shutdown(false)
 #ifndef NDEBUG
       , coroutine_counts_at_shutdown(NULL)
@@ -497,6 +500,26 @@ void linux_thread_t::on_event(int events) {
     }
 }
 
+int64_t linux_thread_t::get_busy_poll_usec() {
+    return busy_poll_usec;
+}
+
+void linux_thread_t::begin_busy_poll() {
+    message_hub.begin_busy_poll();
+}
+
+bool linux_thread_t::has_pending_messages() {
+    return message_hub.has_pending_messages();
+}
+
+void linux_thread_t::poll_messages() {
+    message_hub.poll_messages();
+}
+
+void linux_thread_t::end_busy_poll() {
+    message_hub.end_busy_poll();
+}
+
 bool linux_thread_t::should_shut_down() {
     int res = pthread_mutex_lock(&do_shutdown_mutex);
     guarantee_xerr(res == 0, res, "could not lock do_shutdown_mutex");
@@ -41,7 +41,9 @@ and shutting down the threads and event queues. */
 
 class linux_thread_pool_t {
 public:
-    linux_thread_pool_t(int worker_threads, bool do_set_affinity);
+    // If `busy_poll_usec` isn't zero, idle threads spin for up to that long, looking
+    // for work, before they go to sleep.
+    linux_thread_pool_t(int worker_threads, bool do_set_affinity, int64_t busy_poll_usec);
 
     // When the process receives a SIGINT or SIGTERM, interrupt_message will be delivered to the
     // same thread that initial_message was delivered to, and interrupt_message will be set to
@@ -102,6 +104,7 @@ public:
 
     int n_threads;
     bool do_set_affinity;
+    int64_t busy_poll_usec;
 
 #ifdef _WIN32
     static linux_thread_pool_t *get_global_thread_pool();
@@ -190,6 +193,13 @@ public:
 
     void pump();   // Called by the event queue
     bool should_shut_down();   // Called by the event queue
+
+    // Called by the event queue, see `linux_queue_parent_t`
+    int64_t get_busy_poll_usec();
+    void begin_busy_poll();
+    bool has_pending_messages();
+    void poll_messages();
+    void end_busy_poll();
 #ifndef NDEBUG
     void initiate_shut_down(std::map<std::string, size_t> *coroutine_counts); // Can be called from any thread
 #else
@@ -198,6 +208,8 @@ public:
     void on_event(int events);
 
 private:
+    const int64_t busy_poll_usec;
+
     volatile bool do_shutdown;
     pthread_mutex_t do_shutdown_mutex;
     system_event_t shutdown_notify_event;
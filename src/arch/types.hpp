@@ -88,6 +88,9 @@ typedef linux_nonthrowing_tcp_listener_t non_throwing_tcp_listener_t;
 class linux_tcp_listener_t;
 typedef linux_tcp_listener_t tcp_listener_t;
 
+class linux_reuseport_tcp_listener_t;
+typedef linux_reuseport_tcp_listener_t reuseport_tcp_listener_t;
+
 class linux_repeated_nonthrowing_tcp_listener_t;
 typedef linux_repeated_nonthrowing_tcp_listener_t repeated_nonthrowing_tcp_listener_t;
 
@@ -4,6 +4,7 @@
 #include "btree/internal_node.hpp"
 #include "btree/node.hpp"
 #include "btree/leaf_node.hpp"
+#include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
 #include "buffer_cache/alt.hpp"
 #include "utils.hpp"
@@ -98,3 +99,16 @@ void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
     btree_parallel_traversal(superblock, &helper, &non_interruptor);
     *key_count_out = helper.key_count;
 }
+
+int64_t get_btree_population(superblock_t *superblock) {
+    guarantee(superblock->get_stat_block_id() != NULL_BLOCK_ID);
+    buf_lock_t stat_block(superblock->expose_buf(),
+                          superblock->get_stat_block_id(),
+                          access_t::read);
+    buf_read_t read(&stat_block);
+    uint32_t sb_size;
+    const btree_statblock_t *sb_data =
+        static_cast<const btree_statblock_t *>(read.get_data_read(&sb_size));
+    guarantee(sb_size == BTREE_STATBLOCK_SIZE);
+    return sb_data->population;
+}
@@ -13,4 +13,8 @@ void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
                                 int64_t *key_count_out,
                                 std::vector<store_key_t> *keys_out);
 
+/* Returns the population from the stat block of a btree that has one, without
+traversing the btree. */
+int64_t get_btree_population(superblock_t *superblock);
+
 #endif /* BTREE_GET_DISTRIBUTION_HPP_ */
@@ -172,7 +172,9 @@ void btree_slice_t::init_sindex_superblock(sindex_superblock_t *superblock) {
 
     sb->magic = reql_btree_version_magic_t<cluster_version_t::v2_1>::value;
     sb->root_block = NULL_BLOCK_ID;
-    sb->stat_block = NULL_BLOCK_ID;
+    // The population in the stat block is what the index entry count estimates in
+    // `table.info()` are based on.  Indexes created by older versions don't have one.
+    sb->stat_block = create_stat_block(buf_parent_t(superblock->get()->txn()));
     sb->sindex_block = NULL_BLOCK_ID;
 }
 
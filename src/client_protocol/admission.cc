@@ -0,0 +1,231 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include "client_protocol/admission.hpp"
+
+#include <algorithm>
+
+#include "arch/runtime/coroutines.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/wait_any.hpp"
+#include "config/args.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "time.hpp"
+
+query_admission_t::priority_queue_t::priority_queue_t() :
+    virtual_time(0),
+    queued(0),
+    wait_time(secs_to_ticks(5), false) { }
+
+query_admission_t::query_admission_t(int64_t _max_running) :
+    max_running(_max_running),
+    running(0),
+    queued(0),
+    pending_admits(0) {
+    guarantee(max_running > 0);
+}
+
+query_admission_t::~query_admission_t() {
+    assert_thread();
+    // The last tickets may have been released with queries still waiting, in which
+    // case the coroutines that admit them may not have run yet.
+    while (pending_admits != 0) {
+        coro_t::yield();
+    }
+    guarantee(running == 0);
+    guarantee(queued == 0);
+}
+
+query_admission_t::ticket_t::ticket_t() : parent(nullptr) { }
+
+query_admission_t::ticket_t::~ticket_t() {
+    reset();
+}
+
+void query_admission_t::ticket_t::reset() {
+    if (parent != nullptr) {
+        query_admission_t *p = parent;
+        parent = nullptr;
+        p->release();
+    }
+}
+
+bool query_admission_t::try_admit_now() {
+    // Queries that arrive while others are waiting have to get in line, or they could
+    // overtake queries with a higher priority.
+    if (queued != 0) {
+        return false;
+    }
+    int64_t current = running;
+    while (current < max_running) {
+        if (running.compare_exchange_weak(current, current + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool query_admission_t::admit(ql::query_priority_t priority,
+                              const auth::user_context_t &user_context,
+                              bool can_shed,
+                              ticket_t *ticket_out,
+                              signal_t *interruptor) {
+    guarantee(ticket_out->parent == nullptr);
+    priority_queue_t *queue = &queues[static_cast<size_t>(priority)];
+
+    if (try_admit_now()) {
+        ++queue->admitted;
+        queue->wait_time.record(0);
+        ticket_out->parent = this;
+        return true;
+    }
+
+    if (can_shed && queue->queued >= CLIENT_ADMISSION_MAX_QUEUED_QUERIES) {
+        ++queue->shed;
+        return false;
+    }
+
+    const ticks_t start_ticks = get_ticks();
+    bool admitted;
+    {
+        cross_thread_signal_t ct_interruptor(interruptor, home_thread());
+        on_thread_t thread_switcher(home_thread());
+
+        // `queued` goes up before `admit_waiting()` looks at `running`, and `release()`
+        // lowers `running` before it looks at `queued`, so that one of them sees the
+        // other and the query can't be left waiting while nothing is running.
+        ++queued;
+        ++queue->queued;
+        waiter_t waiter;
+        auto user_it = queue->users.find(user_context);
+        if (user_it == queue->users.end()) {
+            user_it = queue->users.insert(
+                std::make_pair(user_context, user_queue_t())).first;
+            user_it->second.virtual_time = queue->virtual_time;
+        }
+        user_it->second.waiters.push_back(&waiter);
+        admit_waiting();
+
+        signal_timer_t timeout;
+        if (can_shed) {
+            timeout.start(CLIENT_ADMISSION_MAX_WAIT_MS);
+        }
+        wait_any_t waiter_done(&waiter.admitted, &ct_interruptor, &timeout);
+        waiter_done.wait_lazily_unordered();
+
+        admitted = waiter.admitted.is_pulsed();
+        if (!admitted) {
+            // The user's entry must still be there, since we're still in it.
+            user_it = queue->users.find(user_context);
+            guarantee(user_it != queue->users.end());
+            user_it->second.waiters.remove(&waiter);
+            if (user_it->second.waiters.empty()) {
+                queue->users.erase(user_it);
+            }
+            --queue->queued;
+            --queued;
+        }
+    }
+
+    if (admitted) {
+        ++queue->admitted;
+        queue->wait_time.record(ticks_to_secs(get_ticks() - start_ticks) * 1000);
+        ticket_out->parent = this;
+        if (interruptor->is_pulsed()) {
+            ticket_out->reset();
+            throw interrupted_exc_t();
+        }
+        return true;
+    } else if (interruptor->is_pulsed()) {
+        throw interrupted_exc_t();
+    } else {
+        ++queue->shed;
+        return false;
+    }
+}
+
+void query_admission_t::admit_waiting() {
+    assert_thread();
+    for (size_t i = 0; i < ql::NUM_QUERY_PRIORITIES; ++i) {
+        priority_queue_t *queue = &queues[i];
+        while (!queue->users.empty()) {
+            int64_t current = running;
+            do {
+                if (current >= max_running) {
+                    return;
+                }
+            } while (!running.compare_exchange_weak(current, current + 1));
+
+            // The user who has had the fewest turns goes next.
+            auto next = queue->users.begin();
+            for (auto it = queue->users.begin(); it != queue->users.end(); ++it) {
+                if (it->second.virtual_time < next->second.virtual_time) {
+                    next = it;
+                }
+            }
+            waiter_t *waiter = next->second.waiters.head();
+            next->second.waiters.remove(waiter);
+            next->second.virtual_time += 1;
+            queue->virtual_time = std::max(queue->virtual_time,
+                                           next->second.virtual_time);
+            if (next->second.waiters.empty()) {
+                queue->users.erase(next);
+            }
+            --queue->queued;
+            --queued;
+            waiter->admitted.pulse();
+        }
+    }
+}
+
+void query_admission_t::release() {
+    --running;
+    if (queued != 0) {
+        // Tickets are often released while an exception unwinds, so we mustn't switch
+        // threads here.
+        ++pending_admits;
+        coro_t::spawn_on_thread([this]() {
+            admit_waiting();
+            --pending_admits;
+        }, home_thread());
+    }
+}
+
+void *query_admission_t::begin_stats() {
+    void **contexts = new void *[ql::NUM_QUERY_PRIORITIES * 3];
+    for (size_t i = 0; i < ql::NUM_QUERY_PRIORITIES; ++i) {
+        contexts[i * 3] = queues[i].admitted.begin_stats();
+        contexts[i * 3 + 1] = queues[i].shed.begin_stats();
+        contexts[i * 3 + 2] = queues[i].wait_time.begin_stats();
+    }
+    return contexts;
+}
+
+void query_admission_t::visit_stats(void *data) {
+    void **contexts = static_cast<void **>(data);
+    for (size_t i = 0; i < ql::NUM_QUERY_PRIORITIES; ++i) {
+        queues[i].admitted.visit_stats(contexts[i * 3]);
+        queues[i].shed.visit_stats(contexts[i * 3 + 1]);
+        queues[i].wait_time.visit_stats(contexts[i * 3 + 2]);
+    }
+}
+
+ql::datum_t query_admission_t::end_stats(void *data) {
+    void **contexts = static_cast<void **>(data);
+    ql::datum_object_builder_t builder;
+    for (size_t i = 0; i < ql::NUM_QUERY_PRIORITIES; ++i) {
+        ql::datum_object_builder_t queue_builder;
+        queue_builder.overwrite("queries_waiting",
+            ql::datum_t(static_cast<double>(queues[i].queued)));
+        queue_builder.overwrite("queries_admitted_total",
+            queues[i].admitted.end_stats(contexts[i * 3]));
+        queue_builder.overwrite("queries_rejected_total",
+            queues[i].shed.end_stats(contexts[i * 3 + 1]));
+        queue_builder.overwrite("wait_time_ms",
+            queues[i].wait_time.end_stats(contexts[i * 3 + 2]));
+        builder.overwrite(
+            ql::query_priority_name(static_cast<ql::query_priority_t>(i)),
+            std::move(queue_builder).to_datum());
+    }
+    delete[] contexts;
+    return std::move(builder).to_datum();
+}
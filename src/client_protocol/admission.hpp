@@ -0,0 +1,103 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#ifndef CLIENT_PROTOCOL_ADMISSION_HPP_
+#define CLIENT_PROTOCOL_ADMISSION_HPP_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+
+#include "clustering/administration/auth/user_context.hpp"
+#include "concurrency/cond_var.hpp"
+#include "containers/intrusive_list.hpp"
+#include "containers/scoped.hpp"
+#include "perfmon/perfmon.hpp"
+#include "rdb_protocol/query_params.hpp"
+#include "threading.hpp"
+
+class signal_t;
+
+/* `query_admission_t` limits how many client queries run on the server at once, over
+all connections and threads.  Queries that arrive while the limit is reached wait in a
+queue for their priority class, and higher priority queries are always admitted first.
+Within a class, the users that have queries waiting take turns, so that one user
+sending many queries doesn't hold up everybody else's.
+
+While nothing is waiting, queries are admitted on their own thread without any
+cross-thread traffic.  The queues themselves live on the home thread.
+
+It's also the perfmon that reports how many queries are waiting in each class, how
+many were turned away, and how long the admitted ones waited. */
+class query_admission_t : public perfmon_t, public home_thread_mixin_t {
+public:
+    explicit query_admission_t(int64_t _max_running);
+    ~query_admission_t();
+
+    // Holds the admission of a query to run, until it's destroyed or reset.
+    class ticket_t {
+    public:
+        ticket_t();
+        ~ticket_t();
+        void reset();
+    private:
+        friend class query_admission_t;
+        query_admission_t *parent;
+        DISABLE_COPYING(ticket_t);
+    };
+
+    /* Waits until the query may run and admits it to `*ticket_out`.  If `can_shed` is
+    true, returns false without admitting the query when it would have to wait behind
+    too many others, or it has waited for too long. */
+    bool admit(ql::query_priority_t priority,
+               const auth::user_context_t &user_context,
+               bool can_shed,
+               ticket_t *ticket_out,
+               signal_t *interruptor);
+
+    void *begin_stats();
+    void visit_stats(void *);
+    ql::datum_t end_stats(void *);
+
+private:
+    struct waiter_t : public intrusive_list_node_t<waiter_t> {
+        cond_t admitted;
+    };
+
+    struct user_queue_t {
+        user_queue_t() : virtual_time(0) { }
+        intrusive_list_t<waiter_t> waiters;
+        // Goes up by one for each admitted query, the user with the lowest one goes
+        // next
+        uint64_t virtual_time;
+    };
+
+    struct priority_queue_t {
+        priority_queue_t();
+        std::map<auth::user_context_t, user_queue_t> users;
+        // The virtual time of the last admitted query, which users that start
+        // waiting again begin at, so that they can't save up turns while idle
+        uint64_t virtual_time;
+        std::atomic<int64_t> queued;
+        perfmon_counter_t admitted;
+        perfmon_counter_t shed;
+        perfmon_sampler_t wait_time;
+    };
+
+    bool try_admit_now();
+    void admit_waiting();
+    // Doesn't block, the waiting queries are admitted by a coroutine on the home
+    // thread.
+    void release();
+
+    const int64_t max_running;
+    std::atomic<int64_t> running;
+    std::atomic<int64_t> queued;
+    // How many of the coroutines that `release()` spawns haven't finished yet
+    std::atomic<int64_t> pending_admits;
+
+    priority_queue_t queues[ql::NUM_QUERY_PRIORITIES];
+
+    DISABLE_COPYING(query_admission_t);
+};
+
+#endif  // CLIENT_PROTOCOL_ADMISSION_HPP_
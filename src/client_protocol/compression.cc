@@ -0,0 +1,81 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include "client_protocol/compression.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "arch/runtime/coroutines.hpp"
+#include "config/args.hpp"
+#include "perfmon/perfmon.hpp"
+
+response_compressor_t::response_compressor_t(
+        perfmon_counter_t *_responses_compressed,
+        perfmon_counter_t *_bytes_saved) :
+    initialized(false),
+    responses_compressed(_responses_compressed),
+    bytes_saved(_bytes_saved) { }
+
+response_compressor_t::~response_compressor_t() {
+    if (initialized) {
+        deflateEnd(&stream);
+    }
+}
+
+bool response_compressor_t::compress(const char *data, size_t size, size_t offset,
+                                     scoped_array_t<char> *out_out,
+                                     size_t *compressed_size_out) {
+    if (size < CLIENT_COMPRESSION_MIN_RESPONSE_SIZE) {
+        return false;
+    }
+    guarantee(size <= std::numeric_limits<uInt>::max());
+
+    if (!initialized) {
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        // We want to get large responses through a slow network faster, not to make
+        // the CPU the bottleneck instead, so we pick speed over ratio.
+        if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) {
+            return false;
+        }
+        initialized = true;
+    } else {
+        int res = deflateReset(&stream);
+        guarantee(res == Z_OK);
+    }
+
+    // Output that isn't smaller than the response isn't worth sending, so that's
+    // all the space zlib gets.
+    out_out->init(offset + size);
+    stream.next_out = reinterpret_cast<Bytef *>(out_out->data() + offset);
+    stream.avail_out = size;
+
+    // Compressing a large response takes a while, so we yield between chunks like
+    // the JSON writer does between rows.
+    const size_t YIELD_INTERVAL = MEGABYTE;
+    size_t consumed = 0;
+    int res;
+    do {
+        const size_t chunk = std::min(size - consumed, YIELD_INTERVAL);
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data + consumed));
+        stream.avail_in = chunk;
+        consumed += chunk;
+        if (consumed < size) {
+            res = deflate(&stream, Z_NO_FLUSH);
+            coro_t::yield();
+        } else {
+            res = deflate(&stream, Z_FINISH);
+        }
+        // If zlib didn't take all of the input, it ran out of space.
+    } while (res == Z_OK && stream.avail_in == 0 && consumed < size);
+
+    if (res != Z_STREAM_END) {
+        out_out->reset();
+        return false;
+    }
+
+    *compressed_size_out = stream.total_out;
+    ++*responses_compressed;
+    *bytes_saved += size - stream.total_out;
+    return true;
+}
@@ -0,0 +1,50 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#ifndef CLIENT_PROTOCOL_COMPRESSION_HPP_
+#define CLIENT_PROTOCOL_COMPRESSION_HPP_
+
+#include <stdint.h>
+#include <zlib.h>
+
+#include "containers/scoped.hpp"
+
+class perfmon_counter_t;
+
+// The byte that comes before the payload of each response on a connection with
+// compression, saying how the rest of the payload is encoded.
+enum class response_encoding_t : uint8_t {
+    RAW = 0,
+    DEFLATE = 1
+};
+
+/* A `response_compressor_t` compresses the responses on a driver connection that asked
+for `"compression": "deflate"` in the V1_0 handshake.  Each response that is at least
+`CLIENT_COMPRESSION_MIN_RESPONSE_SIZE` bytes large is compressed on its own into a
+zlib stream, so that clients don't have to keep any state between responses.  Smaller
+responses, and those that don't get any smaller, are sent as they are.
+
+The zlib state is allocated on the first compressed response and then reused for the
+rest of the connection. */
+class response_compressor_t {
+public:
+    response_compressor_t(perfmon_counter_t *_responses_compressed,
+                          perfmon_counter_t *_bytes_saved);
+    ~response_compressor_t();
+
+    /* Compresses `size` bytes from `data` into `*out_out`, leaving `offset` bytes at
+    the front of it free for the response header.  Returns false if the response isn't
+    worth compressing, in which case it should be sent as it is.  This yields
+    between chunks of large responses. */
+    bool compress(const char *data, size_t size, size_t offset,
+                  scoped_array_t<char> *out_out, size_t *compressed_size_out);
+
+private:
+    bool initialized;
+    z_stream stream;
+
+    perfmon_counter_t *responses_compressed;
+    perfmon_counter_t *bytes_saved;
+
+    DISABLE_COPYING(response_compressor_t);
+};
+
+#endif  // CLIENT_PROTOCOL_COMPRESSION_HPP_
@@ -47,6 +47,7 @@ scoped_ptr_t<ql::query_params_t> json_protocol_t::parse_query_from_buffer(
 
 scoped_ptr_t<ql::query_params_t> json_protocol_t::parse_query(
         tcp_conn_t *conn,
+        response_compressor_t *compressor,
         signal_t *interruptor,
         ql::query_cache_t *query_cache) {
     int64_t token;
@@ -70,7 +71,7 @@ scoped_ptr_t<ql::query_params_t> json_protocol_t::parse_query(
             conn->pop(size, &pop_interruptor);
         }
 
-        send_response(&error, token, conn, interruptor);
+        send_response(&error, token, conn, compressor, interruptor);
         throw tcp_conn_read_closed_exc_t();
     }
 
@@ -86,7 +87,7 @@ scoped_ptr_t<ql::query_params_t> json_protocol_t::parse_query(
         parse_query_from_buffer(std::move(data), 0, query_cache, token, &error);
 
     if (!res.has()) {
-        send_response(&error, token, conn, interruptor);
+        send_response(&error, token, conn, compressor, interruptor);
     }
     return res;
 }
@@ -199,16 +200,15 @@ void json_protocol_t::write_response_to_buffer(ql::response_t *response,
 void json_protocol_t::send_response(ql::response_t *response,
                                     int64_t token,
                                     tcp_conn_t *conn,
+                                    response_compressor_t *compressor,
                                     signal_t *interruptor) {
-    uint32_t data_size; // filled in below
-    const size_t prefix_size = sizeof(token) + sizeof(data_size);
-
-    // Reserve space for the token and the size
+    // Reserve space for the header
+    const size_t header_size = wire_protocol_t::response_header_size(compressor);
     rapidjson::StringBuffer buffer;
-    buffer.Push(prefix_size);
+    buffer.Push(header_size);
 
     write_response_to_buffer(response, &buffer);
-    int64_t payload_size = buffer.GetSize() - prefix_size;
+    int64_t payload_size = buffer.GetSize() - header_size;
     guarantee(payload_size > 0);
 
     static_assert(std::is_same<decltype(wire_protocol_t::TOO_LARGE_RESPONSE_SIZE),
@@ -220,22 +220,10 @@ void json_protocol_t::send_response(ql::response_t *response,
                              Response::RESOURCE_LIMIT,
                              wire_protocol_t::too_large_response_message(payload_size),
                              ql::backtrace_registry_t::EMPTY_BACKTRACE);
-        send_response(response, token, conn, interruptor);
+        send_response(response, token, conn, compressor, interruptor);
         return;
     }
 
-    // Fill in the token and size
-    char *mutable_buffer = buffer.GetMutableBuffer();
-    for (size_t i = 0; i < sizeof(token); ++i) {
-        mutable_buffer[i] = reinterpret_cast<const char *>(&token)[i];
-    }
-
-    data_size = static_cast<uint32_t>(payload_size);
-    for (size_t i = 0; i < sizeof(data_size); ++i) {
-        mutable_buffer[i + sizeof(token)] =
-            reinterpret_cast<const char *>(&data_size)[i];
-    }
-
-    conn->write(buffer.GetString(), buffer.GetSize(), interruptor);
+    wire_protocol_t::send_response_buffer(token, &buffer, compressor, conn, interruptor);
 }
 
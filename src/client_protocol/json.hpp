@@ -8,6 +8,7 @@
 #include "containers/scoped.hpp"
 #include "rapidjson/stringbuffer.h"
 
+class response_compressor_t;
 class signal_t;
 
 namespace ql {
@@ -26,6 +27,7 @@ public:
             ql::response_t *error_out);
 
     static scoped_ptr_t<ql::query_params_t> parse_query(tcp_conn_t *conn,
+                                                        response_compressor_t *compressor,
                                                         signal_t *interruptor,
                                                         ql::query_cache_t *query_cache);
 
@@ -36,6 +38,7 @@ public:
     static void send_response(ql::response_t *response,
                               int64_t token,
                               tcp_conn_t *conn,
+                              response_compressor_t *compressor,
                               signal_t *interruptor);
 };
 
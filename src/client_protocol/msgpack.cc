@@ -0,0 +1,657 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include "client_protocol/msgpack.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "arch/io/network.hpp"
+#include "arch/runtime/coroutines.hpp"
+#include "arch/timing.hpp"
+#include "client_protocol/protocols.hpp"
+#include "concurrency/pmap.hpp"
+#include "rdb_protocol/base64.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/pseudo_binary.hpp"
+#include "rdb_protocol/pseudo_time.hpp"
+#include "rdb_protocol/query_params.hpp"
+#include "rdb_protocol/rdb_backtrace.hpp"
+#include "rdb_protocol/ql2.pb.h"
+#include "rdb_protocol/response.hpp"
+#include "rdb_protocol/term_storage.hpp"
+#include "utils.hpp"
+
+const int8_t msgpack_protocol_t::MSGPACK_EXT_TIME = 1;
+
+namespace {
+
+// Same as for the recursion in `datum_t`.
+const size_t MIN_MSGPACK_RECURSION_STACK_SPACE = 16 * KILOBYTE;
+
+void write_byte(uint8_t byte, rapidjson::StringBuffer *buffer_out) {
+    buffer_out->Put(static_cast<char>(byte));
+}
+
+// MessagePack stores all multi-byte values in big-endian order.
+void write_big_endian(uint64_t value, size_t bytes,
+                      rapidjson::StringBuffer *buffer_out) {
+    char *out = buffer_out->Push(bytes);
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = static_cast<char>(value >> (8 * (bytes - 1 - i)));
+    }
+}
+
+void write_bytes(const char *data, size_t size, rapidjson::StringBuffer *buffer_out) {
+    if (size > 0) {
+        memcpy(buffer_out->Push(size), data, size);
+    }
+}
+
+/* Writes the type byte and length of a value whose length isn't part of the type
+byte, using the smallest of the 8, 16 and 32 bit forms.  `code8` is the type byte of
+the 8 bit form, and the other two follow it, except for arrays and maps, which don't
+have an 8 bit form. */
+void write_sized_header(uint8_t code8, size_t size,
+                        rapidjson::StringBuffer *buffer_out) {
+    if (size <= std::numeric_limits<uint8_t>::max()) {
+        write_byte(code8, buffer_out);
+        write_big_endian(size, 1, buffer_out);
+    } else if (size <= std::numeric_limits<uint16_t>::max()) {
+        write_byte(code8 + 1, buffer_out);
+        write_big_endian(size, 2, buffer_out);
+    } else {
+        guarantee(size <= std::numeric_limits<uint32_t>::max());
+        write_byte(code8 + 2, buffer_out);
+        write_big_endian(size, 4, buffer_out);
+    }
+}
+
+void write_container_header(uint8_t fix_code, uint8_t code16, size_t size,
+                            rapidjson::StringBuffer *buffer_out) {
+    if (size < 16) {
+        write_byte(fix_code | static_cast<uint8_t>(size), buffer_out);
+    } else if (size <= std::numeric_limits<uint16_t>::max()) {
+        write_byte(code16, buffer_out);
+        write_big_endian(size, 2, buffer_out);
+    } else {
+        guarantee(size <= std::numeric_limits<uint32_t>::max());
+        write_byte(code16 + 1, buffer_out);
+        write_big_endian(size, 4, buffer_out);
+    }
+}
+
+void write_string(const char *data, size_t size, rapidjson::StringBuffer *buffer_out) {
+    if (size < 32) {
+        write_byte(0xa0 | static_cast<uint8_t>(size), buffer_out);
+    } else {
+        write_sized_header(0xd9, size, buffer_out);
+    }
+    write_bytes(data, size, buffer_out);
+}
+
+void write_double(double d, rapidjson::StringBuffer *buffer_out) {
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(d), "doubles must be 64 bits wide");
+    memcpy(&bits, &d, sizeof(bits));
+    write_byte(0xcb, buffer_out);
+    write_big_endian(bits, 8, buffer_out);
+}
+
+void write_integer(int64_t i, rapidjson::StringBuffer *buffer_out) {
+    if (i >= -32 && i <= 127) {
+        // Positive and negative fixints
+        write_byte(static_cast<uint8_t>(i), buffer_out);
+    } else if (i >= std::numeric_limits<int8_t>::min()
+               && i <= std::numeric_limits<int8_t>::max()) {
+        write_byte(0xd0, buffer_out);
+        write_big_endian(static_cast<uint64_t>(i), 1, buffer_out);
+    } else if (i >= std::numeric_limits<int16_t>::min()
+               && i <= std::numeric_limits<int16_t>::max()) {
+        write_byte(0xd1, buffer_out);
+        write_big_endian(static_cast<uint64_t>(i), 2, buffer_out);
+    } else if (i >= std::numeric_limits<int32_t>::min()
+               && i <= std::numeric_limits<int32_t>::max()) {
+        write_byte(0xd2, buffer_out);
+        write_big_endian(static_cast<uint64_t>(i), 4, buffer_out);
+    } else {
+        write_byte(0xd3, buffer_out);
+        write_big_endian(static_cast<uint64_t>(i), 8, buffer_out);
+    }
+}
+
+void write_time(const ql::datum_t &time, rapidjson::StringBuffer *buffer_out) {
+    const double epoch_time = ql::pseudo::time_to_epoch_time(time);
+    const ql::datum_t tz = ql::pseudo::time_tz(time);
+    const size_t tz_size = tz.get_type() == ql::datum_t::R_STR ? tz.as_str().size() : 0;
+
+    write_sized_header(0xc7, sizeof(epoch_time) + tz_size, buffer_out);
+    write_byte(static_cast<uint8_t>(msgpack_protocol_t::MSGPACK_EXT_TIME), buffer_out);
+    uint64_t bits;
+    memcpy(&bits, &epoch_time, sizeof(bits));
+    write_big_endian(bits, 8, buffer_out);
+    if (tz_size > 0) {
+        write_bytes(tz.as_str().data(), tz_size, buffer_out);
+    }
+}
+
+void write_datum_internal(const ql::datum_t &datum,
+                          rapidjson::StringBuffer *buffer_out) {
+    switch (datum.get_type()) {
+    case ql::datum_t::MINVAL:
+        rfail_datum(ql::base_exc_t::LOGIC, "Cannot convert `r.minval` to MessagePack.");
+    case ql::datum_t::MAXVAL:
+        rfail_datum(ql::base_exc_t::LOGIC, "Cannot convert `r.maxval` to MessagePack.");
+    case ql::datum_t::R_NULL: write_byte(0xc0, buffer_out); break;
+    case ql::datum_t::R_BOOL:
+        write_byte(datum.as_bool() ? 0xc3 : 0xc2, buffer_out);
+        break;
+    case ql::datum_t::R_BINARY: {
+        const datum_string_t &data = datum.as_binary();
+        write_sized_header(0xc4, data.size(), buffer_out);
+        write_bytes(data.data(), data.size(), buffer_out);
+    } break;
+    case ql::datum_t::R_NUM: {
+        // Like the JSON protocol, send integers as such, but never -0.
+        const double d = datum.as_num();
+        int64_t i;
+        if (!(d == 0.0 && std::signbit(d)) && ql::number_as_integer(d, &i)) {
+            write_integer(i, buffer_out);
+        } else {
+            write_double(d, buffer_out);
+        }
+    } break;
+    case ql::datum_t::R_STR:
+        write_string(datum.as_str().data(), datum.as_str().size(), buffer_out);
+        break;
+    case ql::datum_t::R_ARRAY: {
+        const size_t size = datum.arr_size();
+        write_container_header(0x90, 0xdc, size, buffer_out);
+        call_with_enough_stack([&] {
+                for (size_t i = 0; i < size; ++i) {
+                    write_datum_internal(datum.get(i), buffer_out);
+                }
+            }, MIN_MSGPACK_RECURSION_STACK_SPACE);
+    } break;
+    case ql::datum_t::R_OBJECT: {
+        if (datum.is_ptype(ql::pseudo::time_string)) {
+            write_time(datum, buffer_out);
+            break;
+        }
+        const size_t size = datum.obj_size();
+        write_container_header(0x80, 0xde, size, buffer_out);
+        call_with_enough_stack([&] {
+                for (size_t i = 0; i < size; ++i) {
+                    auto pair = datum.get_pair(i);
+                    write_string(pair.first.data(), pair.first.size(), buffer_out);
+                    write_datum_internal(pair.second, buffer_out);
+                }
+            }, MIN_MSGPACK_RECURSION_STACK_SPACE);
+    } break;
+    case ql::datum_t::UNINITIALIZED: // fallthru
+    default: unreachable();
+    }
+}
+
+/* Decodes MessagePack into a rapidjson document, which is what the term storage of
+queries is built on.  All reads are bounds checked, since the data comes straight from
+the client. */
+class msgpack_reader_t {
+public:
+    msgpack_reader_t(const char *data, size_t size,
+                     rapidjson::Document::AllocatorType *_allocator) :
+        pos(reinterpret_cast<const uint8_t *>(data)),
+        end(reinterpret_cast<const uint8_t *>(data) + size),
+        allocator(_allocator) { }
+
+    bool at_end() const {
+        return pos == end;
+    }
+
+    bool read_value(rapidjson::Value *out) {
+        uint8_t code;
+        if (!read_big_endian(1, &code)) {
+            return false;
+        }
+        if (code <= 0x7f) {
+            out->SetInt64(code);
+            return true;
+        } else if (code >= 0xe0) {
+            out->SetInt64(static_cast<int8_t>(code));
+            return true;
+        } else if ((code & 0xf0) == 0x80) {
+            return read_map(code & 0x0f, out);
+        } else if ((code & 0xf0) == 0x90) {
+            return read_array(code & 0x0f, out);
+        } else if ((code & 0xe0) == 0xa0) {
+            return read_string(code & 0x1f, out);
+        }
+
+        switch (code) {
+        case 0xc0: out->SetNull(); return true;
+        case 0xc2: out->SetBool(false); return true;
+        case 0xc3: out->SetBool(true); return true;
+        case 0xc4: return read_sized(1, &msgpack_reader_t::read_binary, out);
+        case 0xc5: return read_sized(2, &msgpack_reader_t::read_binary, out);
+        case 0xc6: return read_sized(4, &msgpack_reader_t::read_binary, out);
+        case 0xc7: return read_sized(1, &msgpack_reader_t::read_ext, out);
+        case 0xc8: return read_sized(2, &msgpack_reader_t::read_ext, out);
+        case 0xc9: return read_sized(4, &msgpack_reader_t::read_ext, out);
+        case 0xca: {
+            uint32_t bits;
+            float f;
+            if (!read_big_endian(4, &bits)) {
+                return false;
+            }
+            memcpy(&f, &bits, sizeof(f));
+            out->SetDouble(f);
+            return true;
+        }
+        case 0xcb: {
+            uint64_t bits;
+            double d;
+            if (!read_big_endian(8, &bits)) {
+                return false;
+            }
+            memcpy(&d, &bits, sizeof(d));
+            out->SetDouble(d);
+            return true;
+        }
+        case 0xcc: return read_unsigned<uint8_t>(out);
+        case 0xcd: return read_unsigned<uint16_t>(out);
+        case 0xce: return read_unsigned<uint32_t>(out);
+        case 0xcf: return read_unsigned<uint64_t>(out);
+        case 0xd0: return read_signed<int8_t, uint8_t>(out);
+        case 0xd1: return read_signed<int16_t, uint16_t>(out);
+        case 0xd2: return read_signed<int32_t, uint32_t>(out);
+        case 0xd3: return read_signed<int64_t, uint64_t>(out);
+        case 0xd4: return read_ext(1, out);
+        case 0xd5: return read_ext(2, out);
+        case 0xd6: return read_ext(4, out);
+        case 0xd7: return read_ext(8, out);
+        case 0xd8: return read_ext(16, out);
+        case 0xd9: return read_sized(1, &msgpack_reader_t::read_string, out);
+        case 0xda: return read_sized(2, &msgpack_reader_t::read_string, out);
+        case 0xdb: return read_sized(4, &msgpack_reader_t::read_string, out);
+        case 0xdc: return read_sized(2, &msgpack_reader_t::read_array, out);
+        case 0xdd: return read_sized(4, &msgpack_reader_t::read_array, out);
+        case 0xde: return read_sized(2, &msgpack_reader_t::read_map, out);
+        case 0xdf: return read_sized(4, &msgpack_reader_t::read_map, out);
+        default: return false;
+        }
+    }
+
+private:
+    typedef bool (msgpack_reader_t::*sized_reader_t)(size_t, rapidjson::Value *);
+
+    template <class uint_t>
+    bool read_big_endian(size_t bytes, uint_t *value_out) {
+        if (static_cast<size_t>(end - pos) < bytes) {
+            return false;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value = (value << 8) | pos[i];
+        }
+        pos += bytes;
+        *value_out = static_cast<uint_t>(value);
+        return true;
+    }
+
+    template <class uint_t>
+    bool read_unsigned(rapidjson::Value *out) {
+        uint_t value;
+        if (!read_big_endian(sizeof(value), &value)) {
+            return false;
+        }
+        out->SetUint64(value);
+        return true;
+    }
+
+    template <class int_t, class uint_t>
+    bool read_signed(rapidjson::Value *out) {
+        uint_t value;
+        if (!read_big_endian(sizeof(value), &value)) {
+            return false;
+        }
+        out->SetInt64(static_cast<int_t>(value));
+        return true;
+    }
+
+    bool read_sized(size_t length_bytes, sized_reader_t reader, rapidjson::Value *out) {
+        uint32_t size;
+        if (!read_big_endian(length_bytes, &size)) {
+            return false;
+        }
+        return (this->*reader)(size, out);
+    }
+
+    bool read_raw(size_t size, const char **data_out) {
+        if (static_cast<size_t>(end - pos) < size) {
+            return false;
+        }
+        *data_out = reinterpret_cast<const char *>(pos);
+        pos += size;
+        return true;
+    }
+
+    bool read_string(size_t size, rapidjson::Value *out) {
+        const char *data;
+        if (!read_raw(size, &data)) {
+            return false;
+        }
+        out->SetString(data, size, *allocator);
+        return true;
+    }
+
+    void set_ptype(const char *reql_type, rapidjson::Value *out) {
+        out->SetObject();
+        out->AddMember(
+            rapidjson::Value(ql::datum_t::reql_type_string.data(),
+                             ql::datum_t::reql_type_string.size(),
+                             *allocator),
+            rapidjson::Value(reql_type, *allocator),
+            *allocator);
+    }
+
+    // The term storage only knows JSON, so binary data has to be base64 encoded here.
+    bool read_binary(size_t size, rapidjson::Value *out) {
+        const char *data;
+        if (!read_raw(size, &data)) {
+            return false;
+        }
+        std::string encoded = encode_base64(data, size);
+        set_ptype(ql::pseudo::binary_string, out);
+        out->AddMember(
+            rapidjson::Value(ql::pseudo::data_key, *allocator),
+            rapidjson::Value(encoded.data(), encoded.size(), *allocator),
+            *allocator);
+        return true;
+    }
+
+    bool read_ext(size_t size, rapidjson::Value *out) {
+        int8_t type;
+        const char *data;
+        if (!read_big_endian(1, &type) || !read_raw(size, &data)) {
+            return false;
+        }
+        if (type != msgpack_protocol_t::MSGPACK_EXT_TIME || size < sizeof(double)) {
+            return false;
+        }
+        uint64_t bits = 0;
+        for (size_t i = 0; i < sizeof(bits); ++i) {
+            bits = (bits << 8) | static_cast<uint8_t>(data[i]);
+        }
+        double epoch_time;
+        memcpy(&epoch_time, &bits, sizeof(epoch_time));
+
+        set_ptype(ql::pseudo::time_string, out);
+        out->AddMember("epoch_time", rapidjson::Value(epoch_time), *allocator);
+        if (size > sizeof(double)) {
+            out->AddMember(
+                "timezone",
+                rapidjson::Value(data + sizeof(double),
+                                 size - sizeof(double),
+                                 *allocator),
+                *allocator);
+        }
+        return true;
+    }
+
+    bool read_array(size_t size, rapidjson::Value *out) {
+        // Every element takes at least one byte, which keeps a bogus size from making
+        // us allocate a huge array.
+        if (static_cast<size_t>(end - pos) < size) {
+            return false;
+        }
+        out->SetArray();
+        out->Reserve(size, *allocator);
+        return call_with_enough_stack<bool>([&] {
+                for (size_t i = 0; i < size; ++i) {
+                    rapidjson::Value element;
+                    if (!read_value(&element)) {
+                        return false;
+                    }
+                    out->PushBack(element, *allocator);
+                }
+                return true;
+            }, MIN_MSGPACK_RECURSION_STACK_SPACE);
+    }
+
+    bool read_map(size_t size, rapidjson::Value *out) {
+        if (static_cast<size_t>(end - pos) < 2 * size) {
+            return false;
+        }
+        out->SetObject();
+        return call_with_enough_stack<bool>([&] {
+                for (size_t i = 0; i < size; ++i) {
+                    rapidjson::Value key;
+                    rapidjson::Value value;
+                    if (!read_value(&key) || !key.IsString() || !read_value(&value)) {
+                        return false;
+                    }
+                    out->AddMember(key, value, *allocator);
+                }
+                return true;
+            }, MIN_MSGPACK_RECURSION_STACK_SPACE);
+    }
+
+    const uint8_t *pos;
+    const uint8_t *end;
+    rapidjson::Document::AllocatorType *allocator;
+
+    DISABLE_COPYING(msgpack_reader_t);
+};
+
+scoped_ptr_t<ql::query_params_t> parse_query_from_buffer(
+        scoped_array_t<char> &&buffer,
+        ql::query_cache_t *query_cache, int64_t token,
+        ql::response_t *error_out) {
+    rapidjson::Document doc;
+    scoped_ptr_t<ql::query_params_t> res;
+    if (msgpack_protocol_t::parse_document(buffer.data(), buffer.size(), &doc)) {
+        try {
+            res = make_scoped<ql::query_params_t>(token, query_cache,
+                    scoped_ptr_t<ql::term_storage_t>(
+                        new ql::json_term_storage_t(std::move(buffer), std::move(doc))));
+        } catch (const ql::bt_exc_t &ex) {
+            error_out->fill_error(Response::CLIENT_ERROR,
+                                  ex.error_type,
+                                  strprintf("Server could not parse query: %s",
+                                            ex.message.c_str()),
+                                  ex.bt_datum);
+        }
+    } else {
+        error_out->fill_error(Response::CLIENT_ERROR,
+                              Response::RESOURCE_LIMIT,
+                              wire_protocol_t::unparseable_query_message,
+                              ql::backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+    return res;
+}
+
+void write_response_internal(ql::response_t *response,
+                             rapidjson::StringBuffer *buffer_out,
+                             bool throw_errors) {
+    size_t start_offset = buffer_out->GetSize();
+
+    try {
+        const bool has_error_type =
+            response->type() == Response::RUNTIME_ERROR && response->error_type();
+        const bool has_notes =
+            response->type() == Response::SUCCESS_PARTIAL ||
+            response->type() == Response::SUCCESS_SEQUENCE;
+        const size_t num_keys = 2
+            + (has_error_type ? 1 : 0)
+            + (response->backtrace() ? 1 : 0)
+            + (response->profile() ? 1 : 0)
+            + (has_notes ? 1 : 0);
+        write_container_header(0x80, 0xde, num_keys, buffer_out);
+
+        write_string("t", 1, buffer_out);
+        write_integer(response->type(), buffer_out);
+        if (has_error_type) {
+            write_string("e", 1, buffer_out);
+            write_integer(*response->error_type(), buffer_out);
+        }
+
+        write_string("r", 1, buffer_out);
+        write_container_header(0x90, 0xdc, response->data().size(), buffer_out);
+        const size_t PARALLELIZATION_THRESHOLD = 500;
+        if (response->data().size() > PARALLELIZATION_THRESHOLD) {
+            int64_t num_threads = std::min<int64_t>(16, get_num_db_threads());
+            int32_t thread_offset = get_thread_id().threadnum;
+            std::vector<rapidjson::StringBuffer> buffers(num_threads);
+
+            size_t per_thread = response->data().size() / num_threads;
+            pmap(num_threads, [&](int64_t m) {
+                    int32_t target_thread =
+                        (thread_offset + static_cast<int32_t>(m)) % get_num_db_threads();
+                    on_thread_t rethreader((threadnum_t(target_thread)));
+                    size_t offset = per_thread * m;
+                    size_t end = (m == num_threads - 1) ?
+                        response->data().size() : (per_thread * (m + 1));
+
+                    for (size_t i = offset; i < end; ++i) {
+                        const size_t YIELD_INTERVAL = 2000;
+                        if ((i + 1) % YIELD_INTERVAL == 0) {
+                            coro_t::yield();
+                        }
+                        write_datum_internal(response->data()[i], &buffers[m]);
+                    }
+                });
+
+            // The elements of a MessagePack array are just written one after the
+            // other, so the buffers can be concatenated as they are.
+            for (const auto &buffer : buffers) {
+                write_bytes(buffer.GetString(), buffer.GetSize(), buffer_out);
+            }
+        } else {
+            for (const auto &item : response->data()) {
+                write_datum_internal(item, buffer_out);
+            }
+        }
+        if (response->backtrace()) {
+            write_string("b", 1, buffer_out);
+            write_datum_internal(*response->backtrace(), buffer_out);
+        }
+        if (response->profile()) {
+            write_string("p", 1, buffer_out);
+            write_datum_internal(*response->profile(), buffer_out);
+        }
+        if (has_notes) {
+            write_string("n", 1, buffer_out);
+            write_container_header(0x90, 0xdc, response->notes().size(), buffer_out);
+            for (const auto &note : response->notes()) {
+                write_integer(note, buffer_out);
+            }
+        }
+    } catch (const ql::base_exc_t &ex) {
+        buffer_out->Pop(buffer_out->GetSize() - start_offset);
+        response->fill_error(Response::RUNTIME_ERROR, Response::QUERY_LOGIC,
+                             ex.what(), ql::backtrace_registry_t::EMPTY_BACKTRACE);
+        write_response_internal(response, buffer_out, true);
+    } catch (const std::exception &ex) {
+        if (throw_errors) {
+            throw;
+        }
+
+        buffer_out->Pop(buffer_out->GetSize() - start_offset);
+        response->fill_error(Response::RUNTIME_ERROR, Response::INTERNAL,
+            strprintf("Internal error in msgpack_protocol_t::write: %s", ex.what()),
+            ql::backtrace_registry_t::EMPTY_BACKTRACE);
+        write_response_internal(response, buffer_out, true);
+    }
+}
+
+} // namespace
+
+scoped_ptr_t<ql::query_params_t> msgpack_protocol_t::parse_query(
+        tcp_conn_t *conn,
+        response_compressor_t *compressor,
+        signal_t *interruptor,
+        ql::query_cache_t *query_cache) {
+    int64_t token;
+    uint32_t size;
+    conn->read_buffered(&token, sizeof(token), interruptor);
+    conn->read_buffered(&size, sizeof(size), interruptor);
+    ql::response_t error;
+
+    if (size >= wire_protocol_t::TOO_LARGE_QUERY_SIZE) {
+        error.fill_error(Response::CLIENT_ERROR,
+                         Response::RESOURCE_LIMIT,
+                         wire_protocol_t::too_large_query_message(size),
+                         ql::backtrace_registry_t::EMPTY_BACKTRACE);
+
+        if (size < wire_protocol_t::HARD_LIMIT_TOO_LARGE_QUERY_SIZE) {
+            signal_timer_t read_timeout_interruptor{wire_protocol_t::TOO_LONG_QUERY_TIME};
+            wait_any_t pop_interruptor(interruptor, &read_timeout_interruptor);
+            conn->pop(size, &pop_interruptor);
+        }
+
+        send_response(&error, token, conn, compressor, interruptor);
+        throw tcp_conn_read_closed_exc_t();
+    }
+
+    // Unlike JSON, MessagePack doesn't need to be null terminated.
+    scoped_array_t<char> data(size);
+    conn->read(data.data(), size, interruptor);
+
+    scoped_ptr_t<ql::query_params_t> res =
+        parse_query_from_buffer(std::move(data), query_cache, token, &error);
+
+    if (!res.has()) {
+        send_response(&error, token, conn, compressor, interruptor);
+    }
+    return res;
+}
+
+// Small wrapper - in debug mode we would rather crash than send the error back
+void msgpack_protocol_t::write_response_to_buffer(ql::response_t *response,
+                                                  rapidjson::StringBuffer *buffer_out) {
+#ifdef NDEBUG
+    write_response_internal(response, buffer_out, false);
+#else
+    write_response_internal(response, buffer_out, true);
+#endif
+}
+
+void msgpack_protocol_t::send_response(ql::response_t *response,
+                                       int64_t token,
+                                       tcp_conn_t *conn,
+                                       response_compressor_t *compressor,
+                                       signal_t *interruptor) {
+    // Reserve space for the header
+    const size_t header_size = wire_protocol_t::response_header_size(compressor);
+    rapidjson::StringBuffer buffer;
+    buffer.Push(header_size);
+
+    write_response_to_buffer(response, &buffer);
+    int64_t payload_size = buffer.GetSize() - header_size;
+    guarantee(payload_size > 0);
+
+    if (payload_size >= wire_protocol_t::TOO_LARGE_RESPONSE_SIZE) {
+        response->fill_error(Response::RUNTIME_ERROR,
+                             Response::RESOURCE_LIMIT,
+                             wire_protocol_t::too_large_response_message(payload_size),
+                             ql::backtrace_registry_t::EMPTY_BACKTRACE);
+        send_response(response, token, conn, compressor, interruptor);
+        return;
+    }
+
+    wire_protocol_t::send_response_buffer(token, &buffer, compressor, conn, interruptor);
+}
+
+void msgpack_protocol_t::write_datum(const ql::datum_t &datum,
+                                     rapidjson::StringBuffer *buffer_out) {
+    write_datum_internal(datum, buffer_out);
+}
+
+bool msgpack_protocol_t::parse_document(const char *data, size_t size,
+                                        rapidjson::Document *doc_out) {
+    msgpack_reader_t reader(data, size, &doc_out->GetAllocator());
+    return reader.read_value(doc_out) && reader.at_end();
+}
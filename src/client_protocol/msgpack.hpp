@@ -0,0 +1,61 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#ifndef CLIENT_PROTOCOL_MSGPACK_HPP_
+#define CLIENT_PROTOCOL_MSGPACK_HPP_
+
+#include <stdint.h>
+
+#include "arch/types.hpp"
+#include "containers/scoped.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+
+class response_compressor_t;
+class signal_t;
+
+namespace ql {
+class datum_t;
+class response_t;
+class query_cache_t;
+class query_params_t;
+}
+
+/* `msgpack_protocol_t` is used instead of `json_protocol_t` for clients that ask for
+`"wire_format": "msgpack"` in the V1_0 handshake.  Queries and responses are framed
+the same way, but the payload is MessagePack instead of JSON text.  Queries have the
+same structure as in the JSON protocol, and responses are maps with the same keys.
+
+Datums are encoded as their natural MessagePack types, except for:
+ - `r.binary` values, which are MessagePack `bin` values rather than base64 encoded
+   pseudo-types, and
+ - times, which use the extension type `MSGPACK_EXT_TIME`.  Its payload is the epoch
+   time as a big-endian double followed by the timezone string, e.g. "+00:00". */
+class msgpack_protocol_t {
+public:
+    static const int8_t MSGPACK_EXT_TIME;
+
+    static scoped_ptr_t<ql::query_params_t> parse_query(tcp_conn_t *conn,
+                                                        response_compressor_t *compressor,
+                                                        signal_t *interruptor,
+                                                        ql::query_cache_t *query_cache);
+
+    static void write_response_to_buffer(ql::response_t *response,
+                                         rapidjson::StringBuffer *buffer_out);
+
+    static void send_response(ql::response_t *response,
+                              int64_t token,
+                              tcp_conn_t *conn,
+                              response_compressor_t *compressor,
+                              signal_t *interruptor);
+
+    // Appends the MessagePack encoding of `datum` to `buffer_out`.
+    static void write_datum(const ql::datum_t &datum,
+                            rapidjson::StringBuffer *buffer_out);
+
+    // Decodes a single MessagePack value that takes up all of `data` into `doc_out`,
+    // the way the JSON protocol would have parsed it.  Binary values and times become
+    // their JSON pseudo-types.  Returns false if the data is malformed.
+    static bool parse_document(const char *data, size_t size,
+                               rapidjson::Document *doc_out);
+};
+
+#endif // CLIENT_PROTOCOL_MSGPACK_HPP_
@@ -1,8 +1,12 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "client_protocol/protocols.hpp"
 
+#include <string.h>
+
 #include <limits>
 
+#include "arch/io/network.hpp"
+
 const uint32_t wire_protocol_t::HARD_LIMIT_TOO_LARGE_QUERY_SIZE = GIGABYTE;
 const uint32_t wire_protocol_t::TOO_LONG_QUERY_TIME = 5*60*1000; // ms
 const uint32_t wire_protocol_t::TOO_LARGE_QUERY_SIZE = 128 * MEGABYTE;
@@ -21,3 +25,59 @@ std::string wire_protocol_t::too_large_response_message(size_t size) {
     return strprintf("Response size (%zu) greater than maximum (%" PRIu32 ").",
                      size, TOO_LARGE_RESPONSE_SIZE - 1);
 }
+
+size_t wire_protocol_t::response_header_size(const response_compressor_t *compressor) {
+    return sizeof(int64_t) + sizeof(uint32_t)
+        + (compressor != nullptr ? sizeof(response_encoding_t) : 0);
+}
+
+namespace {
+
+void fill_response_header(int64_t token,
+                          size_t payload_size,
+                          const response_compressor_t *compressor,
+                          response_encoding_t encoding,
+                          char *header_out) {
+    const size_t header_size = wire_protocol_t::response_header_size(compressor);
+    // The size includes the encoding byte, which belongs to the payload.
+    const uint32_t data_size = static_cast<uint32_t>(
+        payload_size + header_size - sizeof(token) - sizeof(uint32_t));
+    memcpy(header_out, &token, sizeof(token));
+    memcpy(header_out + sizeof(token), &data_size, sizeof(data_size));
+    if (compressor != nullptr) {
+        header_out[sizeof(token) + sizeof(data_size)] = static_cast<char>(encoding);
+    } else {
+        guarantee(encoding == response_encoding_t::RAW);
+    }
+}
+
+}  // namespace
+
+void wire_protocol_t::send_response_buffer(int64_t token,
+                                           rapidjson::StringBuffer *buffer,
+                                           response_compressor_t *compressor,
+                                           tcp_conn_t *conn,
+                                           signal_t *interruptor) {
+    const size_t header_size = response_header_size(compressor);
+    guarantee(buffer->GetSize() > header_size);
+    const size_t payload_size = buffer->GetSize() - header_size;
+
+    if (compressor != nullptr) {
+        // The compressed payload is written straight into a buffer that has room for
+        // the header, so that it can go to the connection in one unbuffered write just
+        // like an uncompressed one.
+        scoped_array_t<char> compressed;
+        size_t compressed_size;
+        if (compressor->compress(buffer->GetString() + header_size, payload_size,
+                                 header_size, &compressed, &compressed_size)) {
+            fill_response_header(token, compressed_size, compressor,
+                                 response_encoding_t::DEFLATE, compressed.data());
+            conn->write(compressed.data(), header_size + compressed_size, interruptor);
+            return;
+        }
+    }
+
+    fill_response_header(token, payload_size, compressor,
+                         response_encoding_t::RAW, buffer->GetMutableBuffer());
+    conn->write(buffer->GetString(), buffer->GetSize(), interruptor);
+}
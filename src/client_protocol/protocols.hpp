@@ -7,7 +7,9 @@
 #include <string>
 
 // Include all available wire protocols
+#include "client_protocol/compression.hpp"
 #include "client_protocol/json.hpp"
+#include "client_protocol/msgpack.hpp"
 
 // Contains common declarations used by all wire protocols, this is a class rather than
 // a namespace so we don't have to extern stuff.
@@ -21,6 +23,19 @@ public:
     static const std::string unparseable_query_message;
     static std::string too_large_query_message(uint32_t size);
     static std::string too_large_response_message(size_t size);
+
+    // Responses start with the token and the size of the payload.  On connections with
+    // compression, the payload starts with a `response_encoding_t` byte.
+    static size_t response_header_size(const response_compressor_t *compressor);
+
+    /* Sends the response payload in `buffer`, which starts with `response_header_size`
+    bytes for the header.  The payload is compressed first if `compressor` is set and
+    it's worth it. */
+    static void send_response_buffer(int64_t token,
+                                     rapidjson::StringBuffer *buffer,
+                                     response_compressor_t *compressor,
+                                     tcp_conn_t *conn,
+                                     signal_t *interruptor);
 };
 
 #endif // CLIENT_PROTOCOL_PROTOCOLS_HPP_
@@ -15,6 +15,7 @@
 #include <random> // NOLINT(build/include_order)
 #include <set> // NOLINT(build/include_order)
 #include <string> // NOLINT(build/include_order)
+#include <vector> // NOLINT(build/include_order)
 
 #include "arch/arch.hpp"
 #include "arch/io/network.hpp"
@@ -189,19 +190,33 @@ size_t http_conn_cache_t::sha_hasher_t::operator()(const conn_key_t &x) const {
 query_server_t::query_server_t(rdb_context_t *_rdb_ctx,
                                const std::set<ip_address_t> &local_addresses,
                                int port,
+                               bool _reuse_port,
                                query_handler_t *_handler,
                                uint32_t http_timeout_sec,
                                tls_ctx_t *_tls_ctx) :
         tls_ctx(_tls_ctx),
         rdb_ctx(_rdb_ctx),
         handler(_handler),
-        http_conn_cache(http_timeout_sec),
-        next_thread(0) {
+        reuse_port(_reuse_port),
+        thread_load_membership(
+            &_rdb_ctx->stats.qe_stats_collection, &thread_load, "client_threads"),
+        admission(CLIENT_ADMISSION_MAX_RUNNING_QUERIES_PER_THREAD * get_num_db_threads()),
+        admission_membership(
+            &_rdb_ctx->stats.qe_stats_collection, &admission, "admission"),
+        http_conn_cache(http_timeout_sec) {
     rassert(rdb_ctx != nullptr);
     try {
-        tcp_listener.init(new tcp_listener_t(local_addresses, port,
-            std::bind(&query_server_t::handle_conn,
-                      this, ph::_1, auto_drainer_t::lock_t(&drainer))));
+        if (reuse_port) {
+            reuseport_listener.init(new reuseport_tcp_listener_t(
+                local_addresses, port, get_num_db_threads(),
+                [this](scoped_ptr_t<tcp_conn_descriptor_t> &nconn) {
+                    handle_conn(nconn, auto_drainer_t::lock_t(thread_drainers.get()));
+                }));
+        } else {
+            tcp_listener.init(new tcp_listener_t(local_addresses, port,
+                std::bind(&query_server_t::handle_conn,
+                          this, ph::_1, auto_drainer_t::lock_t(&drainer))));
+        }
     } catch (const address_in_use_exc_t &ex) {
         throw address_in_use_exc_t(
             strprintf("Could not bind to RDB protocol port: %s", ex.what()));
@@ -211,7 +226,7 @@ query_server_t::query_server_t(rdb_context_t *_rdb_ctx,
 query_server_t::~query_server_t() { }
 
 int query_server_t::get_port() const {
-    return tcp_listener->get_port();
+    return reuse_port ? reuseport_listener->get_port() : tcp_listener->get_port();
 }
 
 void write_datum(tcp_conn_t *connection, ql::datum_t datum, signal_t *interruptor) {
@@ -251,16 +266,26 @@ ql::datum_t read_datum(tcp_conn_t *connection, signal_t *interruptor) {
 
 void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn,
                                  auto_drainer_t::lock_t keepalive) {
-    threadnum_t chosen_thread = threadnum_t(next_thread);
-    next_thread = (next_thread + 1) % get_num_db_threads();
-
-    cross_thread_signal_t ct_keepalive(keepalive.get_drain_signal(), chosen_thread);
-    on_thread_t rethreader(chosen_thread);
+    // With `SO_REUSEPORT` the kernel already spread the connections over the threads,
+    // so we do the handshake where we are.  Idle connections can still be moved to
+    // less loaded threads later on.
+    threadnum_t chosen_thread = reuse_port
+        ? get_thread_id()
+        : thread_load.least_loaded_thread();
+
+    // We count the connection before switching threads, or else all the connections
+    // accepted in a burst would see the same load and go to the same thread.
+    client_thread_load_t::connection_t load_connection(&thread_load, chosen_thread);
+
+    // These are replaced when the connection moves to another thread.
+    scoped_ptr_t<cross_thread_signal_t> ct_keepalive(
+        new cross_thread_signal_t(keepalive.get_drain_signal(), chosen_thread));
+    scoped_ptr_t<on_thread_t> rethreader(new on_thread_t(chosen_thread));
 
     scoped_ptr_t<tcp_conn_t> conn;
 
     try {
-        nconn->make_server_connection(tls_ctx, &conn, &ct_keepalive);
+        nconn->make_server_connection(tls_ctx, &conn, ct_keepalive.get());
     } catch (const interrupted_exc_t &) {
         // TLS handshake was interrupted.
         return;
@@ -271,6 +296,8 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
     }
 
     uint8_t version = 0;
+    bool use_msgpack = false;
+    scoped_ptr_t<response_compressor_t> compressor;
     std::unique_ptr<auth::base_authenticator_t> authenticator;
     uint32_t error_code = 0;
     std::string error_message;
@@ -279,7 +306,7 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
 
         int32_t client_magic_number;
         conn->read_buffered(
-            &client_magic_number, sizeof(client_magic_number), &ct_keepalive);
+            &client_magic_number, sizeof(client_magic_number), ct_keepalive.get());
 
         switch (client_magic_number) {
             case VersionDummy::V0_1:
@@ -314,14 +341,16 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
                 new auth::plaintext_authenticator_t(rdb_ctx->get_auth_watchable()));
 
             uint32_t auth_key_size;
-            conn->read_buffered(&auth_key_size, sizeof(uint32_t), &ct_keepalive);
+            conn->read_buffered(
+                &auth_key_size, sizeof(uint32_t), ct_keepalive.get());
             if (auth_key_size > 2048) {
                 throw client_protocol::client_server_error_t(
                     -1, "Client provided an authorization key that is too long.");
             }
 
             scoped_array_t<char> auth_key_buffer(auth_key_size);
-            conn->read_buffered(auth_key_buffer.data(), auth_key_size, &ct_keepalive);
+            conn->read_buffered(
+                auth_key_buffer.data(), auth_key_size, ct_keepalive.get());
 
             try {
                 authenticator->next_message(
@@ -333,7 +362,8 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
             }
 
             int32_t wire_protocol;
-            conn->read_buffered(&wire_protocol, sizeof(wire_protocol), &ct_keepalive);
+            conn->read_buffered(
+                &wire_protocol, sizeof(wire_protocol), ct_keepalive.get());
             switch (wire_protocol) {
                 case VersionDummy::JSON:
                     break;
@@ -349,7 +379,7 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
             }
 
             char const *success_msg = "SUCCESS";
-            conn->write(success_msg, strlen(success_msg) + 1, &ct_keepalive);
+            conn->write(success_msg, strlen(success_msg) + 1, ct_keepalive.get());
         } else {
             authenticator.reset(
                 new auth::scram_authenticator_t(rdb_ctx->get_auth_watchable()));
@@ -359,17 +389,26 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
                 datum_object_builder.overwrite("success", ql::datum_t::boolean(true));
                 datum_object_builder.overwrite("max_protocol_version", ql::datum_t(0.0));
                 datum_object_builder.overwrite("min_protocol_version", ql::datum_t(0.0));
+                datum_object_builder.overwrite(
+                    "wire_formats",
+                    ql::datum_t(std::vector<ql::datum_t>{
+                            ql::datum_t("json"), ql::datum_t("msgpack")},
+                        ql::configured_limits_t::unlimited));
+                datum_object_builder.overwrite(
+                    "compression_methods",
+                    ql::datum_t(std::vector<ql::datum_t>{ql::datum_t("deflate")},
+                                ql::configured_limits_t::unlimited));
                 datum_object_builder.overwrite(
                     "server_version", ql::datum_t(RETHINKDB_VERSION));
 
                 write_datum(
                     conn.get(),
                     std::move(datum_object_builder).to_datum(),
-                    &ct_keepalive);
+                    ct_keepalive.get());
             }
 
             {
-                ql::datum_t datum = read_datum(conn.get(), &ct_keepalive);
+                ql::datum_t datum = read_datum(conn.get(), ct_keepalive.get());
 
                 ql::datum_t protocol_version =
                     datum.get_field("protocol_version", ql::NOTHROW);
@@ -382,6 +421,38 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
                         2, "Unsupported `protocol_version`.");
                 }
 
+                // Clients that don't ask for a wire format get JSON.
+                ql::datum_t wire_format = datum.get_field("wire_format", ql::NOTHROW);
+                if (wire_format.has()) {
+                    if (wire_format.get_type() != ql::datum_t::R_STR) {
+                        throw client_protocol::client_server_error_t(
+                            6, "Expected a string for `wire_format`.");
+                    }
+                    if (wire_format.as_str() == "msgpack") {
+                        use_msgpack = true;
+                    } else if (wire_format.as_str() != "json") {
+                        throw client_protocol::client_server_error_t(
+                            6, "Unsupported `wire_format`.");
+                    }
+                }
+
+                // Responses are only compressed if the client asks for it.
+                ql::datum_t compression = datum.get_field("compression", ql::NOTHROW);
+                if (compression.has()) {
+                    if (compression.get_type() != ql::datum_t::R_STR) {
+                        throw client_protocol::client_server_error_t(
+                            6, "Expected a string for `compression`.");
+                    }
+                    if (compression.as_str() == "deflate") {
+                        compressor.init(new response_compressor_t(
+                            &rdb_ctx->stats.compressed_responses_total,
+                            &rdb_ctx->stats.compression_bytes_saved_total));
+                    } else if (compression.as_str() != "none") {
+                        throw client_protocol::client_server_error_t(
+                            6, "Unsupported `compression`.");
+                    }
+                }
+
                 ql::datum_t authentication_method =
                     datum.get_field("authentication_method", ql::NOTHROW);
                 if (authentication_method.get_type() != ql::datum_t::R_STR) {
@@ -410,11 +481,11 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
                 write_datum(
                     conn.get(),
                     std::move(datum_object_builder).to_datum(),
-                    &ct_keepalive);
+                    ct_keepalive.get());
             }
 
             {
-                ql::datum_t datum = read_datum(conn.get(), &ct_keepalive);
+                ql::datum_t datum = read_datum(conn.get(), ct_keepalive.get());
 
                 ql::datum_t authentication =
                     datum.get_field("authentication", ql::NOTHROW);
@@ -433,7 +504,7 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
                 write_datum(
                     conn.get(),
                     std::move(datum_object_builder).to_datum(),
-                    &ct_keepalive);
+                    ct_keepalive.get());
             }
         }
 
@@ -441,21 +512,55 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
         UNUSED bool peer_res = conn->getpeername(&client_addr_port);
 
         guarantee(authenticator != nullptr);
-        ql::query_cache_t query_cache(
-            rdb_ctx,
-            client_addr_port,
-            (version < 4)
-                ? ql::return_empty_normal_batches_t::YES
-                : ql::return_empty_normal_batches_t::NO,
-            auth::user_context_t(authenticator->get_authenticated_username()));
-
-        connection_loop<json_protocol_t>(
-            conn.get(),
-            (version < 4)
-                ? 1
-                : 1024,
-            &query_cache,
-            &ct_keepalive);
+        // We can't tell whether the TLS library has buffered more of the connection,
+        // so only plain connections are moved between threads.
+        const bool can_move = (tls_ctx == nullptr);
+        threadnum_t move_to_thread = INVALID_THREAD;
+        for (;;) {
+            {
+                ql::query_cache_t query_cache(
+                    rdb_ctx,
+                    client_addr_port,
+                    (version < 4)
+                        ? ql::return_empty_normal_batches_t::YES
+                        : ql::return_empty_normal_batches_t::NO,
+                    auth::user_context_t(authenticator->get_authenticated_username()));
+
+                const size_t max_concurrent_queries = (version < 4) ? 1 : 1024;
+                const bool move = use_msgpack
+                    ? connection_loop<msgpack_protocol_t>(
+                        conn.get(),
+                        max_concurrent_queries,
+                        &query_cache,
+                        compressor.get_or_null(),
+                        can_move,
+                        ct_keepalive.get(),
+                        &move_to_thread)
+                    : connection_loop<json_protocol_t>(
+                        conn.get(),
+                        max_concurrent_queries,
+                        &query_cache,
+                        compressor.get_or_null(),
+                        can_move,
+                        ct_keepalive.get(),
+                        &move_to_thread);
+                if (!move) {
+                    break;
+                }
+            }
+
+            // The connection is idle, so nothing but `conn` lives on this thread
+            // anymore.  The `cross_thread_signal_t` must be created on the thread of
+            // the drain signal, so we go back there first.
+            conn->rethread(INVALID_THREAD);
+            rethreader.reset();
+            ct_keepalive.reset();
+            ct_keepalive.init(
+                new cross_thread_signal_t(keepalive.get_drain_signal(), move_to_thread));
+            rethreader.init(new on_thread_t(move_to_thread));
+            conn->rethread(move_to_thread);
+            load_connection.move_to(move_to_thread);
+        }
     } catch (client_protocol::client_server_error_t const &error) {
         // We can't write the response here due to coroutine switching inside an
         // exception handler
@@ -484,7 +589,7 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
         try {
             if (version < 10) {
                 std::string error = "ERROR: " + error_message + "\n";
-                conn->write(error.c_str(), error.length() + 1, &ct_keepalive);
+                conn->write(error.c_str(), error.length() + 1, ct_keepalive.get());
             } else {
                 ql::datum_object_builder_t datum_object_builder;
                 datum_object_builder.overwrite("success", ql::datum_t::boolean(false));
@@ -495,7 +600,7 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
                 write_datum(
                     conn.get(),
                     std::move(datum_object_builder).to_datum(),
-                    &ct_keepalive);
+                    ct_keepalive.get());
             }
 
             conn->shutdown_write();
@@ -550,10 +655,13 @@ void save_exception(std::exception_ptr *err,
 }
 
 template <class protocol_t>
-void query_server_t::connection_loop(tcp_conn_t *conn,
+bool query_server_t::connection_loop(tcp_conn_t *conn,
                                      size_t max_concurrent_queries,
                                      ql::query_cache_t *query_cache,
-                                     signal_t *drain_signal) {
+                                     response_compressor_t *compressor,
+                                     bool can_move,
+                                     signal_t *drain_signal,
+                                     threadnum_t *move_to_thread_out) {
     std::exception_ptr err;
     std::string err_str;
     cond_t abort;
@@ -568,11 +676,47 @@ void query_server_t::connection_loop(tcp_conn_t *conn,
     wait_any_t interruptor(drain_signal, &abort);
 #endif  // __linux
 
+    // The connection can only move to another thread between queries, when none are
+    // running and nothing of the next one has been read yet.  While waiting for the
+    // next query on a busy thread, `idle_waiter` is pulsed when the last running query
+    // finishes.
+    const ticks_t start_ticks = get_ticks();
+    size_t running_queries = 0;
+    cond_t *idle_waiter = nullptr;
+    auto nothing_buffered = [&]() {
+        const_charslice buffered = conn->peek();
+        return buffered.beg == buffered.end;
+    };
+
     new_semaphore_t sem(max_concurrent_queries);
     auto_drainer_t coro_drainer;
     while (!err) {
+#ifdef __linux
+        threadnum_t move_to_thread = INVALID_THREAD;
+        if (can_move
+            && get_ticks() - start_ticks
+                > CLIENT_REBALANCE_MIN_INTERVAL_MS * MILLION
+            && nothing_buffered()
+            && thread_load.should_move_from(get_thread_id(), &move_to_thread)) {
+            if (running_queries > 0) {
+                cond_t idle;
+                assignment_sentry_t<cond_t *> idle_sentry(&idle_waiter, &idle);
+                linux_event_watcher_t::watch_t readable(ew, poll_event_in);
+                wait_any_t idle_or_readable(&idle, &readable);
+                wait_interruptible(&idle_or_readable, &interruptor);
+            }
+            if (!err
+                && running_queries == 0
+                && nothing_buffered()
+                && query_cache->is_empty()) {
+                *move_to_thread_out = move_to_thread;
+                return true;
+            }
+        }
+#endif  // __linux
+
         scoped_ptr_t<ql::query_params_t> outer_query =
-            protocol_t::parse_query(conn, &interruptor, query_cache);
+            protocol_t::parse_query(conn, compressor, &interruptor, query_cache);
         if (outer_query.has()) {
             outer_query->throttler.init(&sem, 1);
             wait_interruptible(outer_query->throttler.acquisition_signal(),
@@ -582,17 +726,38 @@ void query_server_t::connection_loop(tcp_conn_t *conn,
                 scoped_ptr_t<ql::query_params_t> query = std::move(outer_query);
                 // Since we `spawn_now_dangerously` it's always safe to acquire this.
                 auto_drainer_t::lock_t coro_drainer_lock(&coro_drainer);
+                client_thread_load_t::query_t load_query(&thread_load);
+                ++running_queries;
                 wait_any_t cb_interruptor(coro_drainer_lock.get_drain_signal(),
                                           &interruptor);
                 ql::response_t response;
                 bool replied = false;
 
                 save_exception(&err, &err_str, &abort, [&]() {
-                    handler->run_query(query.get(), &response, &cb_interruptor);
+                    // Only new queries wait to be admitted, and running a prepared
+                    // query starts a new one just like `START` does.  Continuations
+                    // and stops belong to queries that were admitted already, and
+                    // holding them up could keep those from ever finishing.
+                    query_admission_t::ticket_t ticket;
+                    if ((query->type == Query::START || query->type == Query::EXECUTE)
+                        && !admission.admit(query->priority,
+                                            query_cache->get_user_context(),
+                                            !query->noreply,
+                                            &ticket,
+                                            &cb_interruptor)) {
+                        response.fill_error(Response::RUNTIME_ERROR,
+                                            Response::RESOURCE_LIMIT,
+                                            "The server is overloaded and didn't run "
+                                            "the query, try again later.",
+                                            ql::backtrace_registry_t::EMPTY_BACKTRACE);
+                    } else {
+                        handler->run_query(query.get(), &response, &cb_interruptor);
+                        ticket.reset();
+                    }
                     if (!query->noreply) {
                         new_mutex_acq_t send_lock(&send_mutex, &cb_interruptor);
                         protocol_t::send_response(&response, query->token,
-                                                  conn, &cb_interruptor);
+                                                  conn, compressor, &cb_interruptor);
                         replied = true;
                     }
                 });
@@ -602,9 +767,13 @@ void query_server_t::connection_loop(tcp_conn_t *conn,
                                             err_str, &response);
                         new_mutex_acq_t send_lock(&send_mutex, drain_signal);
                         protocol_t::send_response(&response, query->token,
-                                                  conn, &cb_interruptor);
+                                                  conn, compressor, &cb_interruptor);
                     }
                 });
+                --running_queries;
+                if (running_queries == 0 && idle_waiter != nullptr) {
+                    idle_waiter->pulse_if_not_already_pulsed();
+                }
             });
             guarantee(!outer_query.has());
             // Since we're using `spawn_now_dangerously` above, we need to yield
@@ -617,6 +786,7 @@ void query_server_t::connection_loop(tcp_conn_t *conn,
     if (err) {
         std::rethrow_exception(err);
     }
+    return false;
 }
 
 void query_server_t::handle(const http_req_t &req,
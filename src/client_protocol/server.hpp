@@ -14,8 +14,11 @@
 #include "arch/io/openssl.hpp"
 #include "arch/runtime/runtime.hpp"
 #include "arch/timing.hpp"
+#include "client_protocol/admission.hpp"
+#include "client_protocol/thread_load.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/one_per_thread.hpp"
 #include "containers/archive/archive.hpp"
 #include "containers/counted.hpp"
 #include "http/http.hpp"
@@ -25,6 +28,7 @@
 class auth_key_t;
 
 class rdb_context_t;
+class response_compressor_t;
 namespace ql {
 class query_params_t;
 class query_cache_t;
@@ -101,6 +105,7 @@ public:
         rdb_context_t *rdb_ctx,
         const std::set<ip_address_t> &local_addresses,
         int port,
+        bool _reuse_port,
         query_handler_t *_handler,
         uint32_t http_timeout_sec,
         tls_ctx_t* tls_ctx);
@@ -114,16 +119,22 @@ private:
                              const std::string &err,
                              ql::response_t *response_out);
 
-    // For the client driver socket
+    // For the client driver socket.  The lock must be on a drainer on the current
+    // thread.
     void handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn,
                      auto_drainer_t::lock_t);
 
-    // This is templatized based on the wire protocol requested by the client
+    // This is templatized based on the wire protocol requested by the client.  Returns
+    // true if the connection is idle and should move to `*move_to_thread_out`, in
+    // which case it must be continued with a new query cache on that thread.
     template<class protocol_t>
-    void connection_loop(tcp_conn_t *conn,
+    bool connection_loop(tcp_conn_t *conn,
                          size_t max_concurrent_queries,
                          ql::query_cache_t *query_cache,
-                         signal_t *interruptor);
+                         response_compressor_t *compressor,
+                         bool can_move,
+                         signal_t *interruptor,
+                         threadnum_t *move_to_thread_out);
 
     // For HTTP server
     void handle(const http_req_t &request,
@@ -134,12 +145,25 @@ private:
     rdb_context_t *const rdb_ctx;
     query_handler_t *const handler;
 
+    // If this is set, every thread accepts connections on its own `SO_REUSEPORT`
+    // socket and keeps them, instead of a single thread accepting all of them and
+    // handing them out.
+    const bool reuse_port;
+
+    client_thread_load_t thread_load;
+    perfmon_membership_t thread_load_membership;
+
+    query_admission_t admission;
+    perfmon_membership_t admission_membership;
+
     /* WARNING: The order here is fragile. */
     auto_drainer_t drainer;
+    // Connections accepted by `reuseport_listener` hold a lock on the drainer for
+    // the thread they were accepted on.
+    one_per_thread_t<auto_drainer_t> thread_drainers;
     http_conn_cache_t http_conn_cache;
     scoped_ptr_t<tcp_listener_t> tcp_listener;
-
-    int next_thread;
+    scoped_ptr_t<reuseport_tcp_listener_t> reuseport_listener;
 };
 
 #endif /* CLIENT_PROTOCOL_SERVER_HPP_ */
@@ -0,0 +1,98 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include "client_protocol/thread_load.hpp"
+
+#include "config/args.hpp"
+#include "rdb_protocol/datum.hpp"
+
+client_thread_load_t::client_thread_load_t() :
+    threads(get_num_db_threads()) { }
+
+threadnum_t client_thread_load_t::least_loaded_thread() const {
+    int best = 0;
+    int64_t best_queries = threads[0].value.queries;
+    int64_t best_connections = threads[0].value.connections;
+    for (int i = 1; i < static_cast<int>(threads.size()); ++i) {
+        int64_t queries = threads[i].value.queries;
+        int64_t connections = threads[i].value.connections;
+        if (queries < best_queries
+            || (queries == best_queries && connections < best_connections)) {
+            best = i;
+            best_queries = queries;
+            best_connections = connections;
+        }
+    }
+    return threadnum_t(best);
+}
+
+bool client_thread_load_t::should_move_from(threadnum_t thread,
+                                            threadnum_t *thread_out) const {
+    threadnum_t target = least_loaded_thread();
+    if (target == thread) {
+        return false;
+    }
+    // Moving a connection takes two thread switches, so we only do it if the
+    // difference is big enough to be more than noise.
+    if (get(thread)->queries - get(target)->queries
+            < CLIENT_REBALANCE_MIN_QUERY_IMBALANCE) {
+        return false;
+    }
+    *thread_out = target;
+    return true;
+}
+
+client_thread_load_t::connection_t::connection_t(client_thread_load_t *_parent,
+                                                  threadnum_t _thread) :
+    parent(_parent), thread(_thread) {
+    ++parent->get(thread)->connections;
+}
+
+client_thread_load_t::connection_t::~connection_t() {
+    --parent->get(thread)->connections;
+}
+
+void client_thread_load_t::connection_t::move_to(threadnum_t new_thread) {
+    ++parent->get(new_thread)->connections;
+    --parent->get(thread)->connections;
+    thread = new_thread;
+}
+
+client_thread_load_t::query_t::query_t(client_thread_load_t *_parent) :
+    parent(_parent), thread(get_thread_id()) {
+    ++parent->get(thread)->queries;
+}
+
+client_thread_load_t::query_t::~query_t() {
+    --parent->get(thread)->queries;
+}
+
+void *client_thread_load_t::begin_stats() {
+    return nullptr;
+}
+
+void client_thread_load_t::visit_stats(void *) { }
+
+ql::datum_t client_thread_load_t::end_stats(void *) {
+    ql::datum_array_builder_t builder(ql::configured_limits_t::unlimited);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        ql::datum_object_builder_t thread_builder;
+        thread_builder.overwrite("client_connections",
+            ql::datum_t(static_cast<double>(threads[i].value.connections)));
+        thread_builder.overwrite("clients_active",
+            ql::datum_t(static_cast<double>(threads[i].value.queries)));
+        builder.add(std::move(thread_builder).to_datum());
+    }
+    return std::move(builder).to_datum();
+}
+
+client_thread_load_t::thread_load_t *client_thread_load_t::get(threadnum_t thread) {
+    guarantee(thread.threadnum >= 0
+              && static_cast<size_t>(thread.threadnum) < threads.size());
+    return &threads[thread.threadnum].value;
+}
+
+const client_thread_load_t::thread_load_t *client_thread_load_t::get(
+        threadnum_t thread) const {
+    guarantee(thread.threadnum >= 0
+              && static_cast<size_t>(thread.threadnum) < threads.size());
+    return &threads[thread.threadnum].value;
+}
@@ -0,0 +1,76 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#ifndef CLIENT_PROTOCOL_THREAD_LOAD_HPP_
+#define CLIENT_PROTOCOL_THREAD_LOAD_HPP_
+
+#include <atomic>
+
+#include "concurrency/cache_line_padded.hpp"
+#include "containers/scoped.hpp"
+#include "perfmon/core.hpp"
+#include "threading.hpp"
+
+/* `client_thread_load_t` keeps track of how many client connections and running
+queries each thread has.  The query server places new connections on the least loaded
+thread, and moves idle connections away from threads that are much busier than the
+least loaded one.  It's also a perfmon, so that the balance can be checked in the
+`query_engine` stats of the server.
+
+All methods can be called from any thread. */
+class client_thread_load_t : public perfmon_t {
+public:
+    client_thread_load_t();
+
+    /* Returns the thread with the fewest running queries, and among those the one with
+    the fewest connections. */
+    threadnum_t least_loaded_thread() const;
+
+    /* Returns true and sets `thread_out` if an idle connection on `thread` should move
+    to `*thread_out` to even out the load. */
+    bool should_move_from(threadnum_t thread, threadnum_t *thread_out) const;
+
+    /* A `connection_t` counts a client connection towards the load of `thread`, or
+    the thread it was last moved to.  It's created before the connection switches to
+    `thread`, so that connections that are placed right after it already see it. */
+    class connection_t {
+    public:
+        connection_t(client_thread_load_t *parent, threadnum_t thread);
+        ~connection_t();
+        void move_to(threadnum_t thread);
+    private:
+        client_thread_load_t *parent;
+        threadnum_t thread;
+        DISABLE_COPYING(connection_t);
+    };
+
+    /* A `query_t` counts a running query towards the load of the thread it was
+    created on. */
+    class query_t {
+    public:
+        explicit query_t(client_thread_load_t *parent);
+        ~query_t();
+    private:
+        client_thread_load_t *parent;
+        threadnum_t thread;
+        DISABLE_COPYING(query_t);
+    };
+
+    void *begin_stats();
+    void visit_stats(void *);
+    ql::datum_t end_stats(void *);
+
+private:
+    struct thread_load_t {
+        thread_load_t() : connections(0), queries(0) { }
+        std::atomic<int64_t> connections;
+        std::atomic<int64_t> queries;
+    };
+
+    thread_load_t *get(threadnum_t thread);
+    const thread_load_t *get(threadnum_t thread) const;
+
+    scoped_array_t<cache_line_padded_t<thread_load_t> > threads;
+
+    DISABLE_COPYING(client_thread_load_t);
+};
+
+#endif  // CLIENT_PROTOCOL_THREAD_LOAD_HPP_
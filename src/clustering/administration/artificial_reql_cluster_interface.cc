@@ -245,6 +245,22 @@ bool artificial_reql_cluster_interface_t::table_estimate_doc_counts(
     }
 }
 
+bool artificial_reql_cluster_interface_t::table_estimate_sindex_counts(
+        auth::user_context_t const &user_context,
+        counted_t<const ql::db_t> db,
+        const name_string_t &name,
+        ql::env_t *env,
+        std::map<std::string, int64_t> *sindex_counts_out,
+        admin_err_t *error_out) {
+    if (db->name == artificial_reql_cluster_interface_t::database_name) {
+        /* System tables don't have secondary indexes. */
+        sindex_counts_out->clear();
+        return true;
+    }
+    return next_or_error(error_out) && m_next->table_estimate_sindex_counts(
+        user_context, db, name, env, sindex_counts_out, error_out);
+}
+
 bool artificial_reql_cluster_interface_t::table_config(
         auth::user_context_t const &user_context,
         counted_t<const ql::db_t> db,
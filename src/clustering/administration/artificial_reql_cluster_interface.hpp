@@ -109,6 +109,13 @@ public:
             ql::env_t *env,
             std::vector<int64_t> *doc_counts_out,
             admin_err_t *error_out);
+    bool table_estimate_sindex_counts(
+            auth::user_context_t const &user_context,
+            counted_t<const ql::db_t> db,
+            const name_string_t &name,
+            ql::env_t *env,
+            std::map<std::string, int64_t> *sindex_counts_out,
+            admin_err_t *error_out);
     bool table_config(
             auth::user_context_t const &user_context,
             counted_t<const ql::db_t> db,
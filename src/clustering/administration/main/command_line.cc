@@ -731,6 +731,7 @@ service_address_ports_t get_service_address_ports(const std::map<std::string, op
         exists_option(opts, "--no-http-admin"),
         offseted_port(get_single_int(opts, "--http-port"), port_offset),
         offseted_port(get_single_int(opts, "--driver-port"), port_offset),
+        exists_option(opts, "--driver-reuseport"),
         port_offset);
 }
 
@@ -883,6 +884,19 @@ bool initialize_tls_ctx(
     }
     SSL_CTX_set_options(tls_ctx_out->get(), protocol_flags);
 
+    /* With kernel TLS, OpenSSL hands the session keys to the kernel after the
+    handshake, and the kernel encrypts and decrypts the records.  It only does that
+    if the kernel has the `tls` module loaded and supports the negotiated cipher, so
+    connections silently keep doing TLS in user space otherwise. */
+    if (exists_option(opts, "--tls-kernel-offload")) {
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_CTX_set_options(tls_ctx_out->get(), SSL_OP_ENABLE_KTLS);
+#else
+        logWRN("This build of OpenSSL does not support kernel TLS, ignoring "
+               "--tls-kernel-offload.");
+#endif
+    }
+
     // Prefer server ciphers, and always generate new keys for DHE or ECDHE.
     SSL_CTX_set_options(
         tls_ctx_out->get(),
@@ -1594,6 +1608,13 @@ options::help_section_t get_network_options(const bool join_required, std::vecto
                                              strprintf("%d", port_defaults::reql_port)));
     help.add("--driver-port port", "port for rethinkdb protocol client drivers");
 
+#ifndef _WIN32
+    options_out->push_back(options::option_t(options::names_t("--driver-reuseport"),
+                                             options::OPTIONAL_NO_PARAMETER));
+    help.add("--driver-reuseport", "accept client driver connections on every thread, "
+             "using one SO_REUSEPORT socket per thread");
+#endif
+
     options_out->push_back(options::option_t(options::names_t("--port-offset", "-o"),
                                              options::OPTIONAL,
                                              strprintf("%d", port_defaults::port_offset)));
@@ -1633,6 +1654,18 @@ options::help_section_t get_cpu_options(std::vector<options::option_t> *options_
                                              options::OPTIONAL,
                                              strprintf("%d", get_cpu_count())));
     help.add("-c [ --cores ] n", "the number of cores to use");
+    options_out->push_back(options::option_t(options::names_t("--compute-threads"),
+                                             options::OPTIONAL,
+                                             "0"));
+    help.add("--compute-threads n", "the number of extra threads that large sorts and "
+             "other CPU-heavy query work are handed to, so that they don't hold up "
+             "other queries; 0 to disable");
+    options_out->push_back(options::option_t(options::names_t("--busy-poll-usec"),
+                                             options::OPTIONAL,
+                                             "0"));
+    help.add("--busy-poll-usec usec", "how long idle threads keep looking for work "
+             "before they go to sleep, which lowers latency at the cost of CPU time; "
+             "0 to disable (Linux only)");
     return help;
 }
 
@@ -1647,6 +1680,69 @@ MUST_USE bool parse_cores_option(const std::map<std::string, options::values_t>
     return true;
 }
 
+MUST_USE bool parse_compute_threads_option(
+        const std::map<std::string, options::values_t> &opts,
+        int *compute_threads_out) {
+    int compute_threads = get_single_int(opts, "--compute-threads");
+    if (compute_threads < 0 || compute_threads > MAX_THREADS) {
+        fprintf(stderr, "ERROR: number specified for compute threads must be between "
+                "0 and %d\n", MAX_THREADS);
+        return false;
+    }
+    *compute_threads_out = compute_threads;
+    return true;
+}
+
+MUST_USE bool parse_busy_poll_option(const std::map<std::string, options::values_t> &opts,
+                                     int64_t *busy_poll_usec_out) {
+    int busy_poll_usec = get_single_int(opts, "--busy-poll-usec");
+    if (busy_poll_usec < 0 || busy_poll_usec > MILLION) {
+        fprintf(stderr, "ERROR: number specified for busy-poll-usec must be between "
+                "0 and %lld\n", MILLION);
+        return false;
+    }
+    *busy_poll_usec_out = busy_poll_usec;
+    return true;
+}
+
+options::help_section_t get_changefeed_options(
+        std::vector<options::option_t> *options_out) {
+    options::help_section_t help("Changefeed options");
+    options_out->push_back(options::option_t(options::names_t("--changefeed-journal-size"),
+                                             options::OPTIONAL,
+                                             strprintf("%lld",
+                                                       CHANGEFEED_JOURNAL_MAX_BYTES
+                                                           / MEGABYTE)));
+    help.add("--changefeed-journal-size mb", "how many megabytes of changes each table "
+             "shard keeps on disk for changefeeds that resume after a disconnect");
+    options_out->push_back(options::option_t(options::names_t("--changefeed-journal-age"),
+                                             options::OPTIONAL,
+                                             strprintf("%d",
+                                                       CHANGEFEED_JOURNAL_MAX_AGE_SECS)));
+    help.add("--changefeed-journal-age seconds", "how long changefeeds can be "
+             "disconnected for and still resume without missing changes");
+    return help;
+}
+
+MUST_USE bool parse_changefeed_journal_options(
+        const std::map<std::string, options::values_t> &opts,
+        int64_t *max_bytes_out,
+        int *max_age_secs_out) {
+    int max_megabytes = get_single_int(opts, "--changefeed-journal-size");
+    if (max_megabytes <= 0) {
+        fprintf(stderr, "ERROR: changefeed-journal-size must be positive\n");
+        return false;
+    }
+    int max_age_secs = get_single_int(opts, "--changefeed-journal-age");
+    if (max_age_secs <= 0) {
+        fprintf(stderr, "ERROR: changefeed-journal-age must be positive\n");
+        return false;
+    }
+    *max_bytes_out = static_cast<int64_t>(max_megabytes) * MEGABYTE;
+    *max_age_secs_out = max_age_secs;
+    return true;
+}
+
 options::help_section_t get_service_options(std::vector<options::option_t> *options_out) {
     options::help_section_t help("Service options");
     options_out->push_back(options::option_t(options::names_t("--pid-file"),
@@ -1730,6 +1826,8 @@ options::help_section_t get_tls_options(std::vector<options::option_t> *options_
                                              options::OPTIONAL));
     options_out->push_back(options::option_t(options::names_t("--tls-dhparams"),
                                              options::OPTIONAL));
+    options_out->push_back(options::option_t(options::names_t("--tls-kernel-offload"),
+                                             options::OPTIONAL_NO_PARAMETER));
     help.add(
         "--tls-min-protocol protocol",
         "the minimum TLS protocol version that the server accepts; options are "
@@ -1744,6 +1842,10 @@ options::help_section_t get_tls_options(std::vector<options::option_t> *options_
         "--tls-dhparams dhparams_filename",
         "provide parameters for DHE key agreement; REQUIRED if using DHE cipher suites; "
         "at least 2048-bit recommended");
+    help.add(
+        "--tls-kernel-offload",
+        "let the kernel encrypt and decrypt TLS connections where the kernel and the "
+        "cipher suite support it; needs OpenSSL 3.0 built with kernel TLS support");
 
     return help;
 }
@@ -1781,6 +1883,7 @@ void get_rethinkdb_serve_options(std::vector<options::help_section_t> *help_out,
     help_out->push_back(get_auth_options(options_out));
     help_out->push_back(get_web_options(options_out));
     help_out->push_back(get_cpu_options(options_out));
+    help_out->push_back(get_changefeed_options(options_out));
     help_out->push_back(get_service_options(options_out));
     help_out->push_back(get_setuser_options(options_out));
     help_out->push_back(get_help_options(options_out));
@@ -1814,6 +1917,7 @@ void get_rethinkdb_porcelain_options(std::vector<options::help_section_t> *help_
     help_out->push_back(get_auth_options(options_out));
     help_out->push_back(get_web_options(options_out));
     help_out->push_back(get_cpu_options(options_out));
+    help_out->push_back(get_changefeed_options(options_out));
     help_out->push_back(get_service_options(options_out));
     help_out->push_back(get_setuser_options(options_out));
     help_out->push_back(get_help_options(options_out));
@@ -1959,7 +2063,8 @@ int main_rethinkdb_create(int argc, char *argv[]) {
                                      direct_io_mode,
                                      max_concurrent_io_requests,
                                      &result),
-                           num_workers);
+                           num_workers,
+                           0);
 
         if (result) {
             // Tell the directory lock that the directory is now good to go, as it will
@@ -2052,6 +2157,24 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        int compute_threads;
+        if (!parse_compute_threads_option(opts, &compute_threads)) {
+            return EXIT_FAILURE;
+        }
+
+        int64_t busy_poll_usec;
+        if (!parse_busy_poll_option(opts, &busy_poll_usec)) {
+            return EXIT_FAILURE;
+        }
+
+        int64_t changefeed_journal_max_bytes;
+        int changefeed_journal_max_age_secs;
+        if (!parse_changefeed_journal_options(opts,
+                                              &changefeed_journal_max_bytes,
+                                              &changefeed_journal_max_age_secs)) {
+            return EXIT_FAILURE;
+        }
+
         int max_concurrent_io_requests;
         if (!parse_io_threads_option(opts, &max_concurrent_io_requests)) {
             return EXIT_FAILURE;
@@ -2109,7 +2232,10 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
                                 node_reconnect_timeout_secs
                                     ? node_reconnect_timeout_secs.get()
                                     : cluster_defaults::reconnect_timeout,
-                                tls_configs);
+                                tls_configs,
+                                compute_threads,
+                                changefeed_journal_max_bytes,
+                                changefeed_journal_max_age_secs);
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
 
@@ -2126,7 +2252,8 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
                                      static_cast<cluster_semilattice_metadata_t*>(nullptr),
                                      &data_directory_lock,
                                      &result),
-                           num_workers);
+                           num_workers,
+                           busy_poll_usec);
         return result ? EXIT_SUCCESS : EXIT_FAILURE;
     } catch (const options::named_error_t &ex) {
         output_named_error(ex, help);
@@ -2214,12 +2341,16 @@ int main_rethinkdb_proxy(int argc, char *argv[]) {
                                 node_reconnect_timeout_secs
                                     ? node_reconnect_timeout_secs.get()
                                     : cluster_defaults::reconnect_timeout,
-                                tls_configs);
+                                tls_configs,
+                                0,
+                                CHANGEFEED_JOURNAL_MAX_BYTES,
+                                CHANGEFEED_JOURNAL_MAX_AGE_SECS);
 
         bool result;
         run_in_thread_pool(
             std::bind(&run_rethinkdb_proxy, &serve_info, initial_password, &result),
-            num_workers);
+            num_workers,
+            0);
         return result ? EXIT_SUCCESS : EXIT_FAILURE;
     } catch (const options::named_error_t &ex) {
         output_named_error(ex, help);
@@ -2327,6 +2458,24 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        int compute_threads;
+        if (!parse_compute_threads_option(opts, &compute_threads)) {
+            return EXIT_FAILURE;
+        }
+
+        int64_t busy_poll_usec;
+        if (!parse_busy_poll_option(opts, &busy_poll_usec)) {
+            return EXIT_FAILURE;
+        }
+
+        int64_t changefeed_journal_max_bytes;
+        int changefeed_journal_max_age_secs;
+        if (!parse_changefeed_journal_options(opts,
+                                              &changefeed_journal_max_bytes,
+                                              &changefeed_journal_max_age_secs)) {
+            return EXIT_FAILURE;
+        }
+
         int max_concurrent_io_requests;
         if (!parse_io_threads_option(opts, &max_concurrent_io_requests)) {
             return EXIT_FAILURE;
@@ -2406,7 +2555,10 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                 node_reconnect_timeout_secs
                                     ? node_reconnect_timeout_secs.get()
                                     : cluster_defaults::reconnect_timeout,
-                                tls_configs);
+                                tls_configs,
+                                compute_threads,
+                                changefeed_journal_max_bytes,
+                                changefeed_journal_max_age_secs);
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
 
@@ -2423,7 +2575,8 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                      &serve_info,
                                      &data_directory_lock,
                                      &result),
-                           num_workers);
+                           num_workers,
+                           busy_poll_usec);
 
         return result ? EXIT_SUCCESS : EXIT_FAILURE;
     } catch (const options::named_error_t &ex) {
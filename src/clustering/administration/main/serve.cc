@@ -6,6 +6,7 @@
 #include "arch/arch.hpp"
 #include "arch/io/network.hpp"
 #include "arch/os_signal.hpp"
+#include "arch/runtime/compute_pool.hpp"
 #include "buffer_cache/cache_balancer.hpp"
 #include "clustering/administration/artificial_reql_cluster_interface.hpp"
 #include "clustering/administration/http/server.hpp"
@@ -30,6 +31,7 @@
 #include "clustering/administration/tables/name_resolver.hpp"
 #include "clustering/table_manager/table_meta_client.hpp"
 #include "clustering/table_manager/multi_table_manager.hpp"
+#include "config/args.hpp"
 #include "containers/incremental_lenses.hpp"
 #include "containers/lifetime.hpp"
 #include "extproc/extproc_pool.hpp"
@@ -115,6 +117,13 @@ bool do_serve(io_backender_t *io_backender,
         evaluations. */
         extproc_pool_t extproc_pool(get_num_threads());
 
+        /* `compute_pool` runs CPU-heavy query work, such as large sorts, outside of
+        the thread pool so that it doesn't hold up the other queries. */
+        scoped_ptr_t<compute_pool_t> compute_pool;
+        if (serve_info.compute_threads > 0) {
+            compute_pool.init(new compute_pool_t(serve_info.compute_threads));
+        }
+
         /* `thread_pool_log_writer_t` automatically registers itself. While it exists,
         log messages will be written using the event loop instead of blocking. */
         thread_pool_log_writer_t log_writer;
@@ -278,11 +287,16 @@ bool do_serve(io_backender_t *io_backender,
         terms. It contains pointers to all the things that the ReQL term evaluation code
         needs. */
         rdb_context_t rdb_ctx(&extproc_pool,
+                              compute_pool.get_or_null(),
                               &mailbox_manager,
                               nullptr,   /* we'll fill this in later */
                               semilattice_manager_auth.get_root_view(),
                               &get_global_perfmon_collection(),
-                              serve_info.reql_http_proxy);
+                              serve_info.reql_http_proxy,
+                              io_backender,
+                              base_path,
+                              serve_info.changefeed_journal_max_bytes,
+                              serve_info.changefeed_journal_max_age_secs * MILLION);
         {
             /* Extract a subview of the directory with all the table meta manager
             business cards. */
@@ -539,6 +553,7 @@ bool do_serve(io_backender_t *io_backender,
                 rdb_query_server_t rdb_query_server(
                     serve_info.ports.local_addresses_driver,
                     serve_info.ports.reql_port,
+                    serve_info.ports.driver_reuse_port,
                     &rdb_ctx,
                     &server_config_client,
                     server_id,
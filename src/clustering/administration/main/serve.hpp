@@ -48,6 +48,7 @@ struct service_address_ports_t {
         client_port(0),
         http_port(0),
         reql_port(0),
+        driver_reuse_port(false),
         port_offset(0) { }
 
     service_address_ports_t(const std::set<ip_address_t> &_local_addresses,
@@ -60,6 +61,7 @@ struct service_address_ports_t {
                             bool _http_admin_is_disabled,
                             int _http_port,
                             int _reql_port,
+                            bool _driver_reuse_port,
                             int _port_offset) :
         local_addresses(_local_addresses),
         local_addresses_cluster(_local_addresses_cluster),
@@ -71,6 +73,7 @@ struct service_address_ports_t {
         http_admin_is_disabled(_http_admin_is_disabled),
         http_port(_http_port),
         reql_port(_reql_port),
+        driver_reuse_port(_driver_reuse_port),
         port_offset(_port_offset)
     {
             sanitize_port(port, "port", port_offset);
@@ -95,6 +98,8 @@ struct service_address_ports_t {
     bool http_admin_is_disabled;
     int http_port;
     int reql_port;
+    // Accept driver connections on every thread with `SO_REUSEPORT` sockets
+    bool driver_reuse_port;
     int port_offset;
 };
 
@@ -120,7 +125,10 @@ public:
                  std::vector<std::string> &&_argv,
                  const int _join_delay_secs,
                  const int _node_reconnect_timeout_secs,
-                 tls_configs_t _tls_configs) :
+                 tls_configs_t _tls_configs,
+                 const int _compute_threads,
+                 const int64_t _changefeed_journal_max_bytes,
+                 const int _changefeed_journal_max_age_secs) :
         joins(std::move(_joins)),
         reql_http_proxy(std::move(_reql_http_proxy)),
         web_assets(std::move(_web_assets)),
@@ -129,7 +137,10 @@ public:
         config_file(_config_file),
         argv(std::move(_argv)),
         join_delay_secs(_join_delay_secs),
-        node_reconnect_timeout_secs(_node_reconnect_timeout_secs)
+        node_reconnect_timeout_secs(_node_reconnect_timeout_secs),
+        compute_threads(_compute_threads),
+        changefeed_journal_max_bytes(_changefeed_journal_max_bytes),
+        changefeed_journal_max_age_secs(_changefeed_journal_max_age_secs)
     {
         tls_configs = _tls_configs;
     }
@@ -151,6 +162,12 @@ public:
     int join_delay_secs;
     int node_reconnect_timeout_secs;
     tls_configs_t tls_configs;
+    // The number of threads for CPU-heavy query work, or zero to do it all on the
+    // thread pool.
+    int compute_threads;
+    // How much the changefeed journals keep for resuming feeds.
+    int64_t changefeed_journal_max_bytes;
+    int changefeed_journal_max_age_secs;
 };
 
 /* This has been factored out from `command_line.hpp` because it takes a very
@@ -12,6 +12,7 @@
 #include "clustering/administration/tables/table_config.hpp"
 #include "clustering/table_manager/table_meta_client.hpp"
 #include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/pmap.hpp"
 #include "containers/archive/string_stream.hpp"
 #include "rdb_protocol/artificial_table/artificial_table.hpp"
 #include "rdb_protocol/env.hpp"
@@ -538,6 +539,57 @@ bool real_reql_cluster_interface_t::table_estimate_doc_counts(
       CATCH_OP_ERRORS(db->name, name, error_out, "", "")
 }
 
+bool real_reql_cluster_interface_t::table_estimate_sindex_counts(
+        auth::user_context_t const &user_context,
+        counted_t<const ql::db_t> db,
+        const name_string_t &name,
+        ql::env_t *env,
+        std::map<std::string, int64_t> *sindex_counts_out,
+        admin_err_t *error_out) {
+    guarantee(db->name != name_string_t::guarantee_valid("rethinkdb"),
+        "real_reql_cluster_interface_t should never get queries for system tables");
+
+    cross_thread_signal_t interruptor_on_home(env->interruptor, home_thread());
+    try {
+        on_thread_t thread_switcher(home_thread());
+
+        namespace_id_t table_id;
+        m_table_meta_client->find(db->id, name, &table_id);
+
+        user_context.require_read_permission(m_rdb_context, db->id, table_id);
+
+        table_config_and_shards_t config;
+        m_table_meta_client->get_config(table_id, &interruptor_on_home, &config);
+
+        /* Read the population of every index at once. Each one only reads the stat
+        blocks of the index btrees, so this is cheap compared to counting. */
+        sindex_counts_out->clear();
+        std::exception_ptr exception;
+        pmap(config.config.sindexes.begin(), config.config.sindexes.end(),
+            [&](const std::pair<const std::string, sindex_config_t> &pair) {
+                boost::optional<int64_t> population;
+                try {
+                    population = fetch_sindex_population(
+                        table_id, pair.first, this, &interruptor_on_home);
+                } catch (...) {
+                    /* We'll rethrow it outside the `pmap()` */
+                    exception = std::current_exception();
+                    return;
+                }
+                if (!static_cast<bool>(population)) {
+                    /* There are no statistics for this index. */
+                    return;
+                }
+                (*sindex_counts_out)[pair.first] = *population;
+            });
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return true;
+    } CATCH_NAME_ERRORS(db->name, name, error_out)
+      CATCH_OP_ERRORS(db->name, name, error_out, "", "")
+}
+
 bool real_reql_cluster_interface_t::table_config(
         auth::user_context_t const &user_context,
         counted_t<const ql::db_t> db,
@@ -34,7 +34,9 @@ const char *table_server_stats_request_t::table_server_request_type = "table_ser
 parsed_stats_t::server_stats_t::server_stats_t() :
     responsive(false),
     queries_per_sec(0), queries_total(0),
-    client_connections(0), clients_active(0) { }
+    client_connections(0), clients_active(0),
+    compressed_responses_total(0), compression_bytes_saved_total(0),
+    compute_offloads_total(0) { }
 
 parsed_stats_t::table_stats_t::table_stats_t() :
     read_docs_per_sec(0), read_docs_total(0),
@@ -167,6 +169,16 @@ void parsed_stats_t::store_query_engine_stats(const ql::datum_t &qe_perf,
     store_perfmon_value(qe_perf, "queries_total", &stats_out->queries_total);
     store_perfmon_value(qe_perf, "client_connections", &stats_out->client_connections);
     store_perfmon_value(qe_perf, "clients_active", &stats_out->clients_active);
+    store_perfmon_value(qe_perf, "compressed_responses_total",
+                        &stats_out->compressed_responses_total);
+    store_perfmon_value(qe_perf, "compression_bytes_saved_total",
+                        &stats_out->compression_bytes_saved_total);
+    store_perfmon_value(qe_perf, "compute_offloads_total",
+                        &stats_out->compute_offloads_total);
+    stats_out->client_threads =
+        qe_perf.get_field("client_threads", ql::throw_bool_t::NOTHROW);
+    stats_out->admission =
+        qe_perf.get_field("admission", ql::throw_bool_t::NOTHROW);
 }
 
 void parsed_stats_t::store_table_stats(const namespace_id_t &table_id,
@@ -452,10 +464,19 @@ bool server_stats_request_t::to_datum(const parsed_stats_t &stats,
         ADD_STAT(qe_builder, server_stats, clients_active);
         ADD_STAT(qe_builder, server_stats, queries_per_sec);
         ADD_STAT(qe_builder, server_stats, queries_total);
+        ADD_STAT(qe_builder, server_stats, compressed_responses_total);
+        ADD_STAT(qe_builder, server_stats, compression_bytes_saved_total);
+        ADD_STAT(qe_builder, server_stats, compute_offloads_total);
         ADD_SERVER_STAT(qe_builder, stats, server_id, read_docs_per_sec);
         ADD_SERVER_STAT(qe_builder, stats, server_id, read_docs_total);
         ADD_SERVER_STAT(qe_builder, stats, server_id, written_docs_per_sec);
         ADD_SERVER_STAT(qe_builder, stats, server_id, written_docs_total);
+        if (server_stats.client_threads.has()) {
+            qe_builder.overwrite("client_threads", server_stats.client_threads);
+        }
+        if (server_stats.admission.has()) {
+            qe_builder.overwrite("admission", server_stats.admission);
+        }
         row_builder.overwrite("query_engine", std::move(qe_builder).to_datum());
     }
     *result_out = std::move(row_builder).to_datum();
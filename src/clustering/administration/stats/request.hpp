@@ -46,6 +46,13 @@ public:
         double queries_total;
         double client_connections;
         double clients_active;
+        double compressed_responses_total;
+        double compression_bytes_saved_total;
+        double compute_offloads_total;
+        // The connections and running queries of each thread, as an array of objects
+        ql::datum_t client_threads;
+        // The waiting, admitted and rejected queries of each priority class
+        ql::datum_t admission;
 
         std::map<namespace_id_t, table_stats_t> tables;
     };
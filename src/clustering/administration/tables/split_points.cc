@@ -85,8 +85,9 @@ static void ensure_distinct(std::vector<store_key_t> *split_points) {
     }
 }
 
-void fetch_distribution(
+static void fetch_distribution_read(
         const namespace_id_t &table_id,
+        const distribution_read_t &inner_read,
         real_reql_cluster_interface_t *reql_cluster_interface,
         signal_t *interruptor,
         std::map<store_key_t, int64_t> *counts_out)
@@ -94,9 +95,6 @@ void fetch_distribution(
     namespace_interface_access_t ns_if_access =
         reql_cluster_interface->get_namespace_repo()->get_namespace_interface(
             table_id, interruptor);
-    static const int depth = 2;
-    static const int limit = 128;
-    distribution_read_t inner_read(depth, limit);
     read_t read(inner_read, profile_bool_t::DONT_PROFILE, read_mode_t::OUTDATED);
     read_response_t resp;
     try {
@@ -117,6 +115,45 @@ void fetch_distribution(
         boost::get<distribution_read_response_t>(resp.response).key_counts);
 }
 
+void fetch_distribution(
+        const namespace_id_t &table_id,
+        real_reql_cluster_interface_t *reql_cluster_interface,
+        signal_t *interruptor,
+        std::map<store_key_t, int64_t> *counts_out)
+        THROWS_ONLY(interrupted_exc_t, failed_table_op_exc_t, no_such_table_exc_t) {
+    static const int depth = 2;
+    static const int limit = 128;
+    fetch_distribution_read(
+        table_id,
+        distribution_read_t(depth, limit),
+        reql_cluster_interface,
+        interruptor,
+        counts_out);
+}
+
+boost::optional<int64_t> fetch_sindex_population(
+        const namespace_id_t &table_id,
+        const std::string &sindex_id,
+        real_reql_cluster_interface_t *reql_cluster_interface,
+        signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t, failed_table_op_exc_t, no_such_table_exc_t) {
+    std::map<store_key_t, int64_t> counts;
+    fetch_distribution_read(
+        table_id,
+        distribution_read_t(sindex_id),
+        reql_cluster_interface,
+        interruptor,
+        &counts);
+    if (counts.empty()) {
+        return boost::none;
+    }
+    int64_t population = 0;
+    for (const auto &pair : counts) {
+        population += pair.second;
+    }
+    return population;
+}
+
 bool calculate_split_points_with_distribution(
         const std::map<store_key_t, int64_t> &counts,
         size_t num_shards,
@@ -6,6 +6,9 @@
 #include <string>
 #include <vector>
 
+#include "errors.hpp"
+#include <boost/optional.hpp>
+
 #include "btree/keys.hpp"
 #include "clustering/table_manager/table_meta_client.hpp"
 #include "containers/uuid.hpp"
@@ -22,6 +25,16 @@ void fetch_distribution(
         std::map<store_key_t, int64_t> *counts_out)
         THROWS_ONLY(interrupted_exc_t, failed_table_op_exc_t, no_such_table_exc_t);
 
+/* `fetch_sindex_population` returns the number of entries in the secondary index
+`sindex_id`, summed over all shards.  It returns nothing if the index doesn't exist,
+isn't ready yet, or was created by a version that didn't keep index statistics. */
+boost::optional<int64_t> fetch_sindex_population(
+        const namespace_id_t &table_id,
+        const std::string &sindex_id,
+        real_reql_cluster_interface_t *reql_cluster_interface,
+        signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t, failed_table_op_exc_t, no_such_table_exc_t);
+
 /* `calculate_split_points_with_distribution` generates a set of split points that are
 guaranteed to divide the data approximately evenly, using the results of
 `fetch_distribution()`. It returns `false` if there are too few documents in the
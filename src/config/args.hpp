@@ -31,6 +31,11 @@
 // decrease concurrency
 #define MAX_IO_EVENT_PROCESSING_BATCH_SIZE        50
 
+// When busy polling is on, an event loop that spins in vain halves how long it spins
+// the next time, down to the configured budget divided by this.  Spinning that finds
+// work doubles it again, up to the full budget.
+#define BUSY_POLL_MIN_BUDGET_DIVISOR              16
+
 // The io batch factor ensures a minimum number of i/o operations
 // which are picked from any specific i/o account consecutively.
 // A higher value might be advantageous for throughput if seek times
@@ -66,6 +71,12 @@
 // 0 = minimal priority
 #define SINDEX_POST_CONSTRUCTION_CACHE_PRIORITY   5
 
+// How many primary keys secondary index post construction reads before it writes
+// the index entries for them out in one transaction, sorted by index key.  Larger
+// batches make the index writes more sequential, but hold the index write lock and
+// dirty more of the cache at a time.
+#define SINDEX_POST_CONSTRUCTION_BATCH_SIZE       256
+
 // Size of the buffer used to perform IO operations (in bytes).
 #define IO_BUFFER_SIZE                            (4 * KILOBYTE)
 
@@ -114,6 +125,54 @@
 // How large can the key be, in bytes?  This value needs to fit in a byte.
 #define MAX_KEY_SIZE                              250
 
+// How many messages a changefeed server coalesces for one client before sending
+// them right away, instead of waiting until the writes that produced them yield.
+#define CHANGEFEED_MAX_COALESCED_MSGS             1000
+
+// How much a changefeed server keeps in its change journal for resuming feeds by
+// default, in bytes, and for how long, in seconds.  Whichever limit is hit first
+// applies.  They can be changed with `--changefeed-journal-size` and
+// `--changefeed-journal-age`.
+#define CHANGEFEED_JOURNAL_MAX_BYTES              (64 * MEGABYTE)
+#define CHANGEFEED_JOURNAL_MAX_AGE_SECS           3600
+
+// How many changes a change journal keeps in memory while it waits for the disk,
+// before it drops the oldest ones.
+#define CHANGEFEED_JOURNAL_MAX_UNWRITTEN          10000
+
+// How many changes a changefeed that spills its queue to disk writes or reads back
+// at once.
+#define CHANGEFEED_SPILL_BATCH_SIZE               1000
+
+// How many items beyond its limit an `.order_by.limit.changes()` feed keeps on each
+// shard, so that items leaving the top of the feed can usually be replaced without
+// reading from disk.
+#define CHANGEFEED_LIMIT_SPARE_ITEMS              32
+
+// How many more queries a thread must be running than the least loaded thread before
+// the query server moves idle client connections off of it, and how long a client
+// connection stays on a thread at least before it can be moved, in milliseconds.
+#define CLIENT_REBALANCE_MIN_QUERY_IMBALANCE      2
+#define CLIENT_REBALANCE_MIN_INTERVAL_MS          1000
+
+// Responses to drivers that asked for compression are only compressed if they are at
+// least this many bytes large.  Smaller ones don't gain enough to be worth the CPU time.
+#define CLIENT_COMPRESSION_MIN_RESPONSE_SIZE      (4 * KILOBYTE)
+
+// How many queries from clients may run at once per thread, before new ones have to
+// wait to be admitted.  Queries that would have to wait behind more than
+// `CLIENT_ADMISSION_MAX_QUEUED_QUERIES` others of the same priority, or that have
+// waited for longer than `CLIENT_ADMISSION_MAX_WAIT_MS`, fail instead.
+#define CLIENT_ADMISSION_MAX_RUNNING_QUERIES_PER_THREAD 64
+#define CLIENT_ADMISSION_MAX_QUEUED_QUERIES       4096
+#define CLIENT_ADMISSION_MAX_WAIT_MS              (10 * THOUSAND)
+
+// How large the work of a CPU-heavy term has to be before it's handed to the compute
+// pool (see `ql::should_offload()`).  Below this, the trip to the other thread costs
+// about as much as the stall it would avoid.
+#define COMPUTE_OFFLOAD_MIN_SORT_ROWS             (10 * THOUSAND)
+#define COMPUTE_OFFLOAD_MIN_JSON_SIZE             (256 * KILOBYTE)
+
 // Special block IDs.  These don't really belong here because they're
 // more magic constants than tunable parameters.
 
@@ -183,6 +242,12 @@
 // 2^(MESSAGE_SCHEDULER_MAX_PRIORITY - MESSAGE_SCHEDULER_MIN_PRIORITY + 1)
 #define MESSAGE_SCHEDULER_GRANULARITY           32
 
+// How many messages can be in flight from one thread to another before the sending
+// thread has to wait for the receiving thread to catch up.  Every thread keeps one ring
+// of this size for every thread, so this costs n_threads^2 * 8 bytes per message slot.
+// Must be a power of two.
+#define MESSAGE_HUB_RING_SIZE                   512
+
 // Priorities for specific tasks
 #define CORO_PRIORITY_SINDEX_CONSTRUCTION       (-2)
 #define CORO_PRIORITY_BACKFILL_SENDER           (-2)
@@ -58,6 +58,18 @@ int64_t tcp_conn_stream_t::write_buffered(const void *p, int64_t n) {
     }
 }
 
+int64_t tcp_conn_stream_t::write_buffered(std::vector<char> &&data,
+                                          size_t *bytes_copied_out) {
+    try {
+        cond_t non_closer;
+        const int64_t n = data.size();
+        *bytes_copied_out = conn_->write_buffered(std::move(data), &non_closer);
+        return n;
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        return -1;
+    }
+}
+
 bool tcp_conn_stream_t::flush_buffer() {
     try {
         cond_t non_closer;
@@ -147,6 +159,15 @@ int64_t keepalive_tcp_conn_stream_t::write_buffered(const void *p, int64_t n) {
     return tcp_conn_stream_t::write_buffered(p, n);
 }
 
+int64_t keepalive_tcp_conn_stream_t::write_buffered(std::vector<char> &&data,
+                                                    size_t *bytes_copied_out) {
+    if (keepalive_callback != nullptr) {
+        keepalive_callback->keepalive_write();
+    }
+
+    return tcp_conn_stream_t::write_buffered(std::move(data), bytes_copied_out);
+}
+
 bool keepalive_tcp_conn_stream_t::flush_buffer() {
     if (keepalive_callback != nullptr) {
         keepalive_callback->keepalive_write();
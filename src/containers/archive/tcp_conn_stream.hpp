@@ -2,6 +2,8 @@
 #ifndef CONTAINERS_ARCHIVE_TCP_CONN_STREAM_HPP_
 #define CONTAINERS_ARCHIVE_TCP_CONN_STREAM_HPP_
 
+#include <vector>
+
 #include "arch/address.hpp"
 #include "arch/io/openssl.hpp"
 #include "arch/types.hpp"
@@ -23,6 +25,10 @@ public:
     virtual MUST_USE int64_t read(void *p, int64_t n);
     virtual MUST_USE int64_t write(const void *p, int64_t n);
     virtual MUST_USE int64_t write_buffered(const void *p, int64_t n);
+    // Takes over `data` rather than copying it if it's large, see
+    // `linux_tcp_conn_t::write_buffered()`.
+    virtual MUST_USE int64_t write_buffered(std::vector<char> &&data,
+                                            size_t *bytes_copied_out);
     virtual bool flush_buffer();
 
     void rethread(threadnum_t new_thread);
@@ -75,6 +81,8 @@ public:
     virtual MUST_USE int64_t read(void *p, int64_t n);
     virtual MUST_USE int64_t write(const void *p, int64_t n);
     virtual MUST_USE int64_t write_buffered(const void *p, int64_t n);
+    virtual MUST_USE int64_t write_buffered(std::vector<char> &&data,
+                                            size_t *bytes_copied_out);
     virtual bool flush_buffer();
 
 private:
@@ -175,6 +175,50 @@ void internal_disk_backed_queue_t::pop(buffer_group_viewer_t *viewer) {
     txn.commit();
 }
 
+void internal_disk_backed_queue_t::peek_from(int64_t offset,
+                                             buffer_group_viewer_t *viewer) {
+    guarantee(offset >= 0);
+    mutex_t::acq_t mutex_acq(&mutex);
+
+    txn_t txn(cache_conn.get(), read_access_t::read);
+
+    block_id_t block_id = tail_block_id;
+    int64_t index = 0;
+    while (block_id != NULL_BLOCK_ID) {
+        buf_lock_t block(buf_parent_t(&txn), block_id, access_t::read);
+        std::vector<std::vector<char> > refs;
+        {
+            buf_read_t read(&block);
+            const queue_block_t *queue_block
+                = static_cast<const queue_block_t *>(read.get_data_read());
+            for (int32_t pos = queue_block->live_data_offset;
+                 pos < queue_block->data_size;) {
+                const char *ref = queue_block->data + pos;
+                int ref_size = blob::ref_size(cache->max_block_size(), ref,
+                                              DBQ_MAX_REF_SIZE);
+                if (index >= offset) {
+                    refs.push_back(std::vector<char>(ref, ref + ref_size));
+                }
+                pos += ref_size;
+                ++index;
+            }
+            block_id = queue_block->next;
+        }
+
+        for (auto &&ref : refs) {
+            char buffer[DBQ_MAX_REF_SIZE];
+            memset(buffer, 0, DBQ_MAX_REF_SIZE);
+            memcpy(buffer, ref.data(), ref.size());
+            blob_t blob(cache->max_block_size(), buffer, DBQ_MAX_REF_SIZE);
+            blob_acq_t acq_group;
+            buffer_group_t blob_group;
+            blob.expose_all(buf_parent_t(&block), access_t::read,
+                            &blob_group, &acq_group);
+            viewer->view_buffer_group(const_view(&blob_group));
+        }
+    }
+}
+
 bool internal_disk_backed_queue_t::empty() {
     return queue_size == 0;
 }
@@ -2,6 +2,7 @@
 #ifndef CONTAINERS_DISK_BACKED_QUEUE_HPP_
 #define CONTAINERS_DISK_BACKED_QUEUE_HPP_
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -50,6 +51,10 @@ public:
 
     void pop(buffer_group_viewer_t *viewer);
 
+    // Shows the values from the `offset`th one that `pop` would return onwards to
+    // `viewer`, in order, without removing them.
+    void peek_from(int64_t offset, buffer_group_viewer_t *viewer);
+
     bool empty();
 
     int64_t size();
@@ -103,6 +108,26 @@ private:
     DISABLE_COPYING(deserializing_viewer_t);
 };
 
+// Deserializes every buffer group it's shown and passes the value on to a callback.
+template <class T>
+class calling_viewer_t : public buffer_group_viewer_t {
+public:
+    explicit calling_viewer_t(const std::function<void(T &&)> *f) : f_(f) { }
+    virtual ~calling_viewer_t() { }
+
+    virtual void view_buffer_group(const const_buffer_group_t *group) {
+        T value;
+        // See the comment in `deserializing_viewer_t`.
+        deserialize_from_group<cluster_version_t::LATEST_OVERALL>(group, &value);
+        (*f_)(std::move(value));
+    }
+
+private:
+    const std::function<void(T &&)> *f_;
+
+    DISABLE_COPYING(calling_viewer_t);
+};
+
 // Copies the buffer group into a write_message_t
 class copying_viewer_t : public buffer_group_viewer_t {
 public:
@@ -0,0 +1,95 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#ifndef CONTAINERS_SPSC_RING_HPP_
+#define CONTAINERS_SPSC_RING_HPP_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <utility>
+
+#include "concurrency/cache_line_padded.hpp"
+#include "containers/scoped.hpp"
+#include "errors.hpp"
+
+/* `spsc_ring_t` is a bounded FIFO queue that one thread pushes onto and one (possibly
+different) thread pops off of, without taking any locks.  Each side keeps its own index
+on its own cache line, and remembers the last index it saw of the other side, so that
+it only has to look at the other side's cache line when the ring seems full or empty.
+
+`push()` and `pop()` synchronize the slot contents, but nothing more; callers that need
+to combine the ring with other flags must put their own fences in place. */
+template <class T>
+class spsc_ring_t {
+public:
+    // `capacity` must be a power of two.
+    explicit spsc_ring_t(size_t capacity)
+        : slots_(capacity), mask_(capacity - 1) {
+        guarantee(capacity > 0 && (capacity & mask_) == 0,
+                  "spsc_ring_t capacity must be a power of two");
+        producer_.value.tail = 0;
+        producer_.value.cached_head = 0;
+        consumer_.value.head = 0;
+        consumer_.value.cached_tail = 0;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+    // Must only be called by the producer.  Returns false if the ring is full.
+    bool push(T value) {
+        producer_side_t *p = &producer_.value;
+        const size_t tail = p->tail.load(std::memory_order_relaxed);
+        if (tail - p->cached_head == slots_.size()) {
+            p->cached_head = consumer_.value.head.load(std::memory_order_acquire);
+            if (tail - p->cached_head == slots_.size()) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = std::move(value);
+        p->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Must only be called by the consumer.
+    bool empty() {
+        consumer_side_t *c = &consumer_.value;
+        const size_t head = c->head.load(std::memory_order_relaxed);
+        if (head == c->cached_tail) {
+            c->cached_tail = producer_.value.tail.load(std::memory_order_acquire);
+        }
+        return head == c->cached_tail;
+    }
+
+    // Must only be called by the consumer.  Returns false if the ring is empty.
+    bool pop(T *out) {
+        consumer_side_t *c = &consumer_.value;
+        const size_t head = c->head.load(std::memory_order_relaxed);
+        if (head == c->cached_tail) {
+            c->cached_tail = producer_.value.tail.load(std::memory_order_acquire);
+            if (head == c->cached_tail) {
+                return false;
+            }
+        }
+        *out = std::move(slots_[head & mask_]);
+        c->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct producer_side_t {
+        std::atomic<size_t> tail;
+        size_t cached_head;
+    };
+    struct consumer_side_t {
+        std::atomic<size_t> head;
+        size_t cached_tail;
+    };
+
+    scoped_array_t<T> slots_;
+    const size_t mask_;
+    cache_line_padded_t<producer_side_t> producer_;
+    cache_line_padded_t<consumer_side_t> consumer_;
+
+    DISABLE_COPYING(spsc_ring_t);
+};
+
+#endif  // CONTAINERS_SPSC_RING_HPP_
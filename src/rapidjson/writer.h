@@ -26,9 +26,16 @@
 #include "internal/strfunc.h"
 #include "internal/dtoa.h"
 #include "internal/itoa.h"
+#include "internal/meta.h"
 #include "stringbuffer.h"
+#include <cstring>
 #include <new>      // placement new
 
+// RethinkDB addition: used to find runs of characters that need no escaping
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #if RAPIDJSON_HAS_STDSTRING
 #include <string>
 #endif
@@ -48,6 +55,53 @@ RAPIDJSON_DIAG_OFF(4127) // conditional expression is constant
 
 RAPIDJSON_NAMESPACE_BEGIN
 
+// RethinkDB addition: returns the length of the prefix of `str` that can be written to
+// a JSON string as it is, i.e. the position of the first control character, quote or
+// backslash.  Processes 16 bytes at a time where SSE2 is available.
+inline size_t ScanUnescaped(const char *str, size_t length) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i max_control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= length; i += 16) {
+        const __m128i chunk =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i));
+        // `chunk` equals `max(chunk, 0x1F)` exactly for the (unsigned) bytes below 0x20
+        const __m128i needs_escape = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                         _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, max_control), max_control));
+        const int mask = _mm_movemask_epi8(needs_escape);
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+#endif
+    for (; i < length; ++i) {
+        const unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c < 0x20 || c == '"' || c == '\\') {
+            break;
+        }
+    }
+    return i;
+}
+
+// RethinkDB addition: appends `length` characters to an output stream
+template <typename OutputStream>
+inline void PutRun(OutputStream &os, const typename OutputStream::Ch *str,
+                   size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        os.Put(str[i]);
+    }
+}
+
+template <typename Encoding, typename Allocator>
+inline void PutRun(GenericStringBuffer<Encoding, Allocator> &os,
+                   const typename Encoding::Ch *str, size_t length) {
+    std::memcpy(os.Push(length), str, length * sizeof(typename Encoding::Ch));
+}
+
 //! JSON writer
 /*! Writer implements the concept Handler.
     It generates JSON text by events to an output os.
@@ -289,6 +343,18 @@ protected:
         os_->Put('\"');
         GenericStringStream<SourceEncoding> is(str);
         while (is.Tell() < length) {
+            // RethinkDB addition: copy runs of characters that don't need escaping
+            // in bulk instead of looking each of them up in `escape`.
+            if (sizeof(Ch) == 1 && TargetEncoding::supportUnicode
+                && internal::IsSame<SourceEncoding, TargetEncoding>::Value) {
+                const size_t run = ScanUnescaped(reinterpret_cast<const char *>(is.src_),
+                                                 length - is.Tell());
+                if (run > 0) {
+                    PutRun(*os_, is.src_, run);
+                    is.src_ += run;
+                    continue;
+                }
+            }
             const Ch c = is.Peek();
             if (!TargetEncoding::supportUnicode && (unsigned)c >= 0x80) {
                 // Unicode escaping
@@ -21,7 +21,9 @@ void cfeed_artificial_table_backend_t::machinery_t::send_all_change(
                 index_vals_t(),
                 pkey,
                 old_val,
-                new_val}));
+                new_val,
+                boost::none,
+                boost::none}));
 }
 
 void cfeed_artificial_table_backend_t::machinery_t::send_all_stop() {
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <functional>
 #include <iterator>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -1438,7 +1439,9 @@ void rdb_modification_report_cb_t::on_mod_report(
                         new_cfeed_keys,
                         report.primary_key,
                         report.info.deleted.first,
-                        report.info.added.first}),
+                        report.info.added.first,
+                        boost::none,
+                        boost::none}),
                 report.primary_key,
                 cfeed_stamp_spot,
                 cserver.second);
@@ -1531,6 +1534,13 @@ void compute_keys(const store_key_t &primary_key,
     ql::datum_t index =
         index_info.mapping.compile_wire_func()->call(&sindex_env, doc)->as_datum();
 
+    // `null` can't be an index key, so the row isn't in the index.  This is how
+    // filtered indexes leave out most rows, so we don't want to throw for it like
+    // `print_secondary` would.
+    if (index.get_type() == ql::datum_t::R_NULL) {
+        return;
+    }
+
     if (index_info.multi == sindex_multi_bool_t::MULTI
         && index.get_type() == ql::datum_t::R_ARRAY) {
         for (uint64_t i = 0; i < index.arr_size(); ++i) {
@@ -1727,6 +1737,42 @@ void deserialize_sindex_info_or_crash(
         });
 }
 
+bool compute_keys_or_drop(const store_key_t &primary_key,
+                          ql::datum_t doc,
+                          const sindex_disk_info_t &index_info,
+                          std::vector<std::pair<store_key_t, ql::datum_t> > *keys_out,
+                          std::vector<index_pair_t> *cfeed_keys_out) {
+    try {
+        compute_keys(primary_key, doc, index_info, keys_out, cfeed_keys_out);
+        return true;
+    } catch (const ql::base_exc_t &) {
+        // `compute_keys` may have put out the keys for some elements of a multi index
+        // before it failed on a later one.  The row isn't in the index at all, so none
+        // of them count.
+        keys_out->clear();
+        if (cfeed_keys_out != nullptr) {
+            cfeed_keys_out->clear();
+        }
+        return false;
+    }
+}
+
+std::vector<store_key_t> sindex_keys_to_delete(
+        const std::vector<std::pair<store_key_t, ql::datum_t> > &old_keys,
+        const std::vector<std::pair<store_key_t, ql::datum_t> > &new_keys) {
+    std::set<store_key_t> overwritten;
+    for (const auto &pair : new_keys) {
+        overwritten.insert(pair.first);
+    }
+    std::vector<store_key_t> res;
+    for (const auto &pair : old_keys) {
+        if (overwritten.count(pair.first) == 0) {
+            res.push_back(pair.first);
+        }
+    }
+    return res;
+}
+
 /* Used below by rdb_update_sindexes. */
 void rdb_update_single_sindex(
         store_t *store,
@@ -1762,67 +1808,17 @@ void rdb_update_single_sindex(
 
     auto cserver = store->changefeed_server(modification->primary_key);
 
+    // We compute both the old and the new keys before touching the index, so that we
+    // can overwrite the entries whose key didn't change instead of deleting them and
+    // inserting them again right after.
+    bool has_old_keys = false;
+    std::vector<std::pair<store_key_t, ql::datum_t> > old_keys;
     if (modification->info.deleted.first.has()) {
         guarantee(!modification->info.deleted.second.empty());
-        try {
-            ql::datum_t deleted = modification->info.deleted.first;
-
-            std::vector<std::pair<store_key_t, ql::datum_t> > keys;
-            compute_keys(
-                modification->primary_key, deleted, sindex_info,
-                &keys, cfeed_old_keys_out);
-            if (cserver.first != nullptr) {
-                cserver.first->foreach_limit(
-                    sindex->name.name,
-                    sindex->sindex.id,
-                    &modification->primary_key,
-                    [&](rwlock_in_line_t *clients_spot,
-                        rwlock_in_line_t *limit_clients_spot,
-                        rwlock_in_line_t *lm_spot,
-                        ql::changefeed::limit_manager_t *lm) {
-                        guarantee(clients_spot->read_signal()->is_pulsed());
-                        guarantee(limit_clients_spot->read_signal()->is_pulsed());
-                        for (const auto &pair : keys) {
-                            lm->del(lm_spot, pair.first, is_primary_t::NO);
-                        }
-                    }, cserver.second);
-            }
-            for (auto it = keys.begin(); it != keys.end(); ++it) {
-                promise_t<superblock_t *> return_superblock_local;
-                {
-                    keyvalue_location_t kv_location;
-                    rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
-
-                    find_keyvalue_location_for_write(
-                        &sizer,
-                        superblock,
-                        it->first.btree_key(),
-                        repli_timestamp_t::distant_past,
-                        deletion_context->balancing_detacher(),
-                        &kv_location,
-                        trace,
-                        &return_superblock_local);
-
-                    if (kv_location.value.has()) {
-                        kv_location_delete(
-                            &kv_location,
-                            it->first,
-                            repli_timestamp_t::distant_past,
-                            deletion_context,
-                            delete_mode_t::REGULAR_QUERY,
-                            nullptr);
-                    }
-                    // The keyvalue location gets destroyed here.
-                }
-                superblock =
-                    static_cast<sindex_superblock_t *>(return_superblock_local.wait());
-            }
-        } catch (const ql::base_exc_t &) {
-            // Do nothing (it wasn't actually in the index).
-
-            // See comment in `catch` below.
-            guarantee(cfeed_old_keys_out == nullptr || cfeed_old_keys_out->size() == 0);
-        }
+        // If this fails, the row wasn't actually in the index.
+        has_old_keys = compute_keys_or_drop(
+            modification->primary_key, modification->info.deleted.first,
+            sindex_info, &old_keys, cfeed_old_keys_out);
     }
 
     // If the secondary index is being deleted, we don't add any new values to
@@ -1830,92 +1826,128 @@ void rdb_update_single_sindex(
     // This is so we don't race against any sindex erase about who is faster
     // (we with inserting new entries, or the erase with removing them).
     const bool sindex_is_being_deleted = sindex->sindex.being_deleted;
+    bool has_new_keys = false;
+    std::vector<std::pair<store_key_t, ql::datum_t> > new_keys;
     if (!sindex_is_being_deleted && modification->info.added.first.has()) {
-        bool decremented_updates_left = false;
-        try {
-            ql::datum_t added = modification->info.added.first;
-
-            std::vector<std::pair<store_key_t, ql::datum_t> > keys;
+        // If this fails, we just drop the row from the index.  In that case
+        // `new_keys` stays empty, so that we delete all of the old entries below.
+        has_new_keys = compute_keys_or_drop(
+            modification->primary_key, modification->info.added.first,
+            sindex_info, &new_keys, cfeed_new_keys_out);
+    }
+    if (keys_available_cond != nullptr) {
+        guarantee(*updates_left > 0);
+        if (--*updates_left == 0) {
+            keys_available_cond->pulse();
+        }
+    }
 
-            compute_keys(
-                modification->primary_key, added, sindex_info,
-                &keys, cfeed_new_keys_out);
-            if (keys_available_cond != nullptr) {
-                guarantee(*updates_left > 0);
-                decremented_updates_left = true;
-                if (--*updates_left == 0) {
-                    keys_available_cond->pulse();
+    if (has_old_keys) {
+        if (cserver.first != nullptr) {
+            cserver.first->foreach_limit(
+                sindex->name.name,
+                sindex->sindex.id,
+                &modification->primary_key,
+                [&](rwlock_in_line_t *clients_spot,
+                    rwlock_in_line_t *limit_clients_spot,
+                    rwlock_in_line_t *lm_spot,
+                    ql::changefeed::limit_manager_t *lm) {
+                    guarantee(clients_spot->read_signal()->is_pulsed());
+                    guarantee(limit_clients_spot->read_signal()->is_pulsed());
+                    for (const auto &pair : old_keys) {
+                        lm->del(lm_spot, pair.first, is_primary_t::NO);
+                    }
+                }, cserver.second);
+        }
+        const std::vector<store_key_t> to_delete =
+            sindex_keys_to_delete(old_keys, new_keys);
+        for (auto it = to_delete.begin(); it != to_delete.end(); ++it) {
+            promise_t<superblock_t *> return_superblock_local;
+            {
+                keyvalue_location_t kv_location;
+                rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+
+                find_keyvalue_location_for_write(
+                    &sizer,
+                    superblock,
+                    it->btree_key(),
+                    repli_timestamp_t::distant_past,
+                    deletion_context->balancing_detacher(),
+                    &kv_location,
+                    trace,
+                    &return_superblock_local);
+
+                if (kv_location.value.has()) {
+                    kv_location_delete(
+                        &kv_location,
+                        *it,
+                        repli_timestamp_t::distant_past,
+                        deletion_context,
+                        delete_mode_t::REGULAR_QUERY,
+                        nullptr);
                 }
+                // The keyvalue location gets destroyed here.
             }
-            if (cserver.first != nullptr) {
-                cserver.first->foreach_limit(
-                    sindex->name.name,
-                    sindex->sindex.id,
-                    &modification->primary_key,
-                    [&](rwlock_in_line_t *clients_spot,
-                        rwlock_in_line_t *limit_clients_spot,
-                        rwlock_in_line_t *lm_spot,
-                        ql::changefeed::limit_manager_t *lm) {
-                        guarantee(clients_spot->read_signal()->is_pulsed());
-                        guarantee(limit_clients_spot->read_signal()->is_pulsed());
-                        for (const auto &pair :keys) {
-                            lm->add(lm_spot, pair.first, is_primary_t::NO,
-                                    pair.second, added);
-                        }
-                    }, cserver.second);
-            }
-            for (auto it = keys.begin(); it != keys.end(); ++it) {
-                promise_t<superblock_t *> return_superblock_local;
-                {
-                    keyvalue_location_t kv_location;
-
-                    rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
-                    find_keyvalue_location_for_write(
-                        &sizer,
-                        superblock,
-                        it->first.btree_key(),
-                        repli_timestamp_t::distant_past,
-                        deletion_context->balancing_detacher(),
-                        &kv_location,
-                        trace,
-                        &return_superblock_local);
+            superblock =
+                static_cast<sindex_superblock_t *>(return_superblock_local.wait());
+        }
+    }
 
+    if (has_new_keys) {
+        const ql::datum_t &added = modification->info.added.first;
+        const std::vector<char> &value_ref = modification->info.added.second;
+        if (cserver.first != nullptr) {
+            cserver.first->foreach_limit(
+                sindex->name.name,
+                sindex->sindex.id,
+                &modification->primary_key,
+                [&](rwlock_in_line_t *clients_spot,
+                    rwlock_in_line_t *limit_clients_spot,
+                    rwlock_in_line_t *lm_spot,
+                    ql::changefeed::limit_manager_t *lm) {
+                    guarantee(clients_spot->read_signal()->is_pulsed());
+                    guarantee(limit_clients_spot->read_signal()->is_pulsed());
+                    for (const auto &pair : new_keys) {
+                        lm->add(lm_spot, pair.first, is_primary_t::NO,
+                                pair.second, added);
+                    }
+                }, cserver.second);
+        }
+        for (auto it = new_keys.begin(); it != new_keys.end(); ++it) {
+            promise_t<superblock_t *> return_superblock_local;
+            {
+                keyvalue_location_t kv_location;
+
+                rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+                find_keyvalue_location_for_write(
+                    &sizer,
+                    superblock,
+                    it->first.btree_key(),
+                    repli_timestamp_t::distant_past,
+                    deletion_context->balancing_detacher(),
+                    &kv_location,
+                    trace,
+                    &return_superblock_local);
+
+                // If the entry is already there with the same value (e.g. because
+                // post construction already wrote it), we leave the leaf alone.
+                const bool unchanged = kv_location.value.has()
+                    && sizer.size(kv_location.value.get())
+                        == static_cast<int>(value_ref.size())
+                    && memcmp(kv_location.value.get(), value_ref.data(),
+                              value_ref.size()) == 0;
+                if (!unchanged) {
                     ql::serialization_result_t res =
-                        kv_location_set(&kv_location, it->first,
-                                        modification->info.added.second,
+                        kv_location_set(&kv_location, it->first, value_ref,
                                         repli_timestamp_t::distant_past,
                                         deletion_context);
                     // this particular context cannot fail AT THE MOMENT.
                     guarantee(!bad(res));
-                    // The keyvalue location gets destroyed here.
-                }
-                superblock = static_cast<sindex_superblock_t *>(
-                    return_superblock_local.wait());
-            }
-        } catch (const ql::base_exc_t &) {
-            // Do nothing (we just drop the row from the index).
-
-            // If we've decremented `updates_left` already, that means we might
-            // have sent a change with new values for this key even though we're
-            // actually dropping the row.  I *believe* that this catch statement
-            // can only be triggered by an exception thrown from `compute_keys`
-            // (which begs the question of why so many other statements are
-            // inside of it), so this guarantee should never trip.
-            if (keys_available_cond != nullptr) {
-                guarantee(!decremented_updates_left);
-                guarantee(cfeed_new_keys_out->size() == 0);
-                guarantee(*updates_left > 0);
-                if (--*updates_left == 0) {
-                    keys_available_cond->pulse();
                 }
+                // The keyvalue location gets destroyed here.
             }
-        }
-    } else {
-        if (keys_available_cond != nullptr) {
-            guarantee(*updates_left > 0);
-            if (--*updates_left == 0) {
-                keys_available_cond->pulse();
-            }
+            superblock = static_cast<sindex_superblock_t *>(
+                return_superblock_local.wait());
         }
     }
 
@@ -2026,8 +2058,10 @@ public:
     }
 
     ~post_construct_traversal_helper_t() {
-        sindexes_.clear();
         if (wtxn_.has()) {
+            new_mutex_acq_t wtxn_acq(&wtxn_lock_);
+            write_pending_entries(&wtxn_acq);
+            sindexes_.clear();
             wtxn_->commit();
         }
     }
@@ -2045,58 +2079,58 @@ public:
         store_->btree->stats.pm_keys_read.record();
         store_->btree->stats.pm_total_keys_read += 1;
 
-        // Grab the key and value and construct a modification report for the key/value
-        // pair.
+        // Compute the index entries for the key/value pair.  This doesn't touch the
+        // indexes, so the pairs that are being traversed concurrently don't have to
+        // wait for each other here.
         const store_key_t primary_key(keyvalue.key());
         const rdb_value_t *rdb_value =
             static_cast<const rdb_value_t *>(keyvalue.value());
-        rdb_modification_report_t mod_report(primary_key);
         const max_block_size_t block_size =
             keyvalue.expose_buf().cache()->max_block_size();
-        mod_report.info.added
-            = std::make_pair(
-                get_data(rdb_value, buf_parent_t(keyvalue.expose_buf())),
-                std::vector<char>(rdb_value->value_ref(),
-                    rdb_value->value_ref() + rdb_value->inline_size(block_size)));
+        ql::datum_t doc = get_data(rdb_value, buf_parent_t(keyvalue.expose_buf()));
+        std::vector<char> value_ref(
+            rdb_value->value_ref(),
+            rdb_value->value_ref() + rdb_value->inline_size(block_size));
+        std::vector<pending_entry_t> entries;
+        for (const auto &pair : sindex_infos_) {
+            std::vector<std::pair<store_key_t, ql::datum_t> > keys;
+            try {
+                compute_keys(primary_key, doc, pair.second, &keys, nullptr);
+            } catch (const ql::base_exc_t &) {
+                // Just like `rdb_update_single_sindex`, we drop the row from the index.
+                continue;
+            }
+            for (auto &&key : keys) {
+                entries.push_back(
+                    pending_entry_t{pair.first, std::move(key.first), value_ref});
+            }
+        }
 
-        // Store the value into the secondary indexes
         {
-            // We need this mutex because we don't want `wtxn` to be destructed,
-            // but also because only one coroutine can be traversing the indexes
-            // through `rdb_update_sindexes` at a time (or else the btree will get
-            // corrupted!).
+            // We need this mutex because we don't want `wtxn` to be destructed while
+            // we add to `pending_`.
             new_mutex_acq_t wtxn_acq(&wtxn_lock_, interruptor_);
             guarantee(wtxn_.has());
-            const rdb_post_construction_deletion_context_t deletion_context;
-            rdb_update_sindexes(store_,
-                                sindexes_,
-                                &mod_report,
-                                wtxn_.get(),
-                                &deletion_context,
-                                nullptr,
-                                nullptr,
-                                nullptr);
+            std::move(entries.begin(), entries.end(), std::back_inserter(pending_));
         }
 
-        // Account for the sindex writes in the stats
-        store_->btree->stats.pm_keys_set.record(sindexes_.size());
-        store_->btree->stats.pm_total_keys_set += sindexes_.size();
-
         // Update the traversed range boundary (everything below here will happen in
         // key order).
-        // This can't be interrupted, because we have already called rdb_update_sindexes,
-        // so now we /must/ update traversed_right_bound.
+        // This can't be interrupted, because the entries are already in `pending_` and
+        // will be written out with the current transaction, so now we /must/ update
+        // traversed_right_bound.
         waiter.wait();
         traversed_right_bound_ = primary_key;
 
-        // Release the write transaction and secondary index locks once we've reached the
-        // designated chunk size. Then acquire a new transaction once the previous one
-        // has been flushed.
+        // Write out the entries and release the write transaction and secondary index
+        // locks once we've reached the designated chunk size. Then acquire a new
+        // transaction once the previous one has been flushed.
         {
             new_mutex_acq_t wtxn_acq(&wtxn_lock_, interruptor_);
             ++current_chunk_size_;
-            if (current_chunk_size_ >= MAX_CHUNK_SIZE) {
+            if (current_chunk_size_ >= SINDEX_POST_CONSTRUCTION_BATCH_SIZE) {
                 current_chunk_size_ = 0;
+                write_pending_entries(&wtxn_acq);
                 sindexes_.clear();
                 wtxn_->commit();
                 wtxn_.reset();
@@ -2122,10 +2156,65 @@ public:
     }
 
 private:
-    // Number of key/value pairs we process before releasing the write transaction
-    // and waiting for the secondary index data to be flushed to disk.
-    // Also see the comment above `scoped_ptr_t<txn_t> wtxn;` below.
-    static const int MAX_CHUNK_SIZE = 32;
+    // An entry for one of the indexes that hasn't been written out yet.
+    struct pending_entry_t {
+        uuid_u sindex_id;
+        store_key_t key;
+        std::vector<char> value_ref;
+    };
+
+    // Writes out `pending_` sorted by index and key.  The primary btree is traversed
+    // in primary key order, which is random order for the indexes, so this keeps
+    // consecutive writes on the same leaf nodes instead of all over the index.
+    void write_pending_entries(new_mutex_acq_t *wtxn_acq) {
+        wtxn_acq->guarantee_is_holding(&wtxn_lock_);
+        std::sort(pending_.begin(), pending_.end(),
+                  [](const pending_entry_t &a, const pending_entry_t &b) {
+                      return a.sindex_id < b.sindex_id
+                          || (a.sindex_id == b.sindex_id && a.key < b.key);
+                  });
+        const rdb_post_construction_deletion_context_t deletion_context;
+        size_t keys_set = 0;
+        for (auto &&access : sindexes_) {
+            const uuid_u &id = access->sindex.id;
+            auto it = std::lower_bound(
+                pending_.begin(), pending_.end(), id,
+                [](const pending_entry_t &entry, const uuid_u &sindex_id) {
+                    return entry.sindex_id < sindex_id;
+                });
+            sindex_superblock_t *superblock = access->superblock.get();
+            for (; it != pending_.end() && it->sindex_id == id; ++it) {
+                promise_t<superblock_t *> return_superblock_local;
+                {
+                    keyvalue_location_t kv_location;
+                    rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+                    find_keyvalue_location_for_write(
+                        &sizer,
+                        superblock,
+                        it->key.btree_key(),
+                        repli_timestamp_t::distant_past,
+                        deletion_context.balancing_detacher(),
+                        &kv_location,
+                        nullptr,
+                        &return_superblock_local);
+                    ql::serialization_result_t res =
+                        kv_location_set(&kv_location, it->key, it->value_ref,
+                                        repli_timestamp_t::distant_past,
+                                        &deletion_context);
+                    // this particular context cannot fail AT THE MOMENT.
+                    guarantee(!bad(res));
+                }
+                superblock = static_cast<sindex_superblock_t *>(
+                    return_superblock_local.wait());
+                ++keys_set;
+            }
+        }
+        pending_.clear();
+
+        // Account for the sindex writes in the stats
+        store_->btree->stats.pm_keys_set.record(keys_set);
+        store_->btree->stats.pm_total_keys_set += keys_set;
+    }
 
     void start_write_transaction(new_mutex_acq_t *wtxn_acq) {
         wtxn_acq->guarantee_is_holding(&wtxn_lock_);
@@ -2143,7 +2232,7 @@ private:
         // needed here.
         scoped_ptr_t<real_superblock_t> superblock;
         store_->acquire_superblock_for_write(
-                2 + MAX_CHUNK_SIZE,
+                2 + SINDEX_POST_CONSTRUCTION_BATCH_SIZE,
                 write_durability_t::HARD,
                 &token,
                 &wtxn_,
@@ -2162,10 +2251,21 @@ private:
             &all_sindexes);
 
         // Filter out indexes that are being deleted. No need to keep post-constructing
-        // those.
+        // those.  Entries that were computed for them are skipped when writing.
         guarantee(sindexes_.empty());
         for (auto &&access : all_sindexes) {
             if (!access->sindex.being_deleted) {
+                if (sindex_infos_.count(access->sindex.id) == 0) {
+                    sindex_disk_info_t info;
+                    try {
+                        deserialize_sindex_info_or_crash(
+                            access->sindex.opaque_definition, &info);
+                    } catch (const archive_exc_t &e) {
+                        crash("%s", e.what());
+                    }
+                    sindex_infos_.insert(
+                        std::make_pair(access->sindex.id, std::move(info)));
+                }
                 sindexes_.emplace_back(std::move(access));
             }
         }
@@ -2173,13 +2273,6 @@ private:
             // All indexes have been deleted. Interrupt the traversal.
             on_indexes_deleted_->pulse_if_not_already_pulsed();
         }
-
-        // We pretend that the indexes have been fully constructed, so that when we call
-        // `rdb_update_sindexes` above, it actually updates the range we're currently
-        // constructing. This is a bit hacky, but works.
-        for (auto &&access : sindexes_) {
-            access->sindex.needs_post_construction_range = key_range_t::empty();
-        }
     }
 
     store_t *store_;
@@ -2194,6 +2287,10 @@ private:
     store_key_t traversed_right_bound_;
     bool stopped_before_completion_;
 
+    // The definitions of the indexes, so that we can compute their entries without
+    // holding on to them.
+    std::map<uuid_u, sindex_disk_info_t> sindex_infos_;
+
     // We re-use a single write transaction and secondary index acquisition for a chunk
     // of writes to get better efficiency when flushing the index writes to disk.
     // We reset the transaction  after each chunk because large write transactions can
@@ -2204,8 +2301,9 @@ private:
     // are already live will also be delayed.
     scoped_ptr_t<txn_t> wtxn_;
     store_t::sindex_access_vector_t sindexes_;
+    std::vector<pending_entry_t> pending_;
     int current_chunk_size_;
-    // Controls access to `sindexes_` and `wtxn_`.
+    // Controls access to `sindexes_`, `pending_` and `wtxn_`.
     new_mutex_t wtxn_lock_;
 };
 
@@ -288,6 +288,21 @@ void deserialize_sindex_info_or_crash(
         sindex_disk_info_t *info_out)
     THROWS_ONLY(archive_exc_t);
 
+/* Computes the keys of `doc` in the given secondary index, and their changefeed
+counterparts if `cfeed_keys_out` isn't null.  Returns false if the row isn't in the
+index because computing its keys failed; the outputs are left empty in that case. */
+bool compute_keys_or_drop(const store_key_t &primary_key,
+                          ql::datum_t doc,
+                          const sindex_disk_info_t &index_info,
+                          std::vector<std::pair<store_key_t, ql::datum_t> > *keys_out,
+                          std::vector<index_pair_t> *cfeed_keys_out);
+
+/* Returns the `old_keys` whose index entries have to be deleted when a row's keys
+change to `new_keys`.  Entries whose key stays the same are overwritten instead. */
+std::vector<store_key_t> sindex_keys_to_delete(
+        const std::vector<std::pair<store_key_t, ql::datum_t> > &old_keys,
+        const std::vector<std::pair<store_key_t, ql::datum_t> > &new_keys);
+
 /* An rdb_modification_cb_t is passed to BTree operations and allows them to
  * modify the secondary while they perform an operation. */
 class superblock_queue_t;
@@ -10,6 +10,7 @@
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/interruptor.hpp"
 #include "containers/archive/boost_types.hpp"
+#include "containers/disk_backed_queue.hpp"
 #include "rdb_protocol/artificial_table/backend.hpp"
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/env.hpp"
@@ -27,6 +28,8 @@ namespace ql {
 namespace changefeed {
 
 struct indexed_datum_t {
+    // Only for deserialization, see `spilling_queue_t`.
+    indexed_datum_t() { }
     indexed_datum_t(
             datum_t _val,
             boost::optional<std::string> _btree_index_key)
@@ -40,6 +43,7 @@ struct indexed_datum_t {
     // well in optionals.
     // MOVABLE_BUT_NOT_COPYABLE(indexed_datum_t);
 };
+RDB_MAKE_SERIALIZABLE_2(indexed_datum_t, val, btree_index_key);
 
 struct stamped_range_t {
     explicit stamped_range_t(uint64_t _next_expected_stamp)
@@ -68,6 +72,8 @@ void debug_print(printf_buffer_t *buf, const stamped_range_t &rng) {
 }
 
 struct change_val_t {
+    // Only for deserialization, see `spilling_queue_t`.
+    change_val_t() { }
     change_val_t(std::pair<uuid_u, uint64_t> _source_stamp,
                  store_key_t _pkey,
                  boost::optional<indexed_datum_t> _old_val,
@@ -88,11 +94,17 @@ struct change_val_t {
     std::pair<uuid_u, uint64_t> source_stamp;
     store_key_t pkey;
     boost::optional<indexed_datum_t> old_val, new_val;
+    // Where the change is in the journal of the `server_t` it came from, if the
+    // subscription asked for resume tokens.
+    boost::optional<uint64_t> journal_seq;
     DEBUG_ONLY(boost::optional<std::string> sindex;);
     // This should be true, but older versions of boost don't support `move`
     // well in optionals.
     // MOVABLE_BUT_NOT_COPYABLE(change_val_t);
 };
+// Changes are only serialized to spill them to disk, which loses the debug-only
+// `sindex`.
+RDB_MAKE_SERIALIZABLE_5(change_val_t, source_stamp, pkey, old_val, new_val, journal_seq);
 
 namespace debug {
 std::string print(const uuid_u &u) {
@@ -178,6 +190,10 @@ public:
     virtual change_val_t pop() = 0;
     virtual const change_val_t &peek() = 0;
     virtual void purge_below(std::map<uuid_u, uint64_t> stamps) = 0;
+    // Changes that are queued but can't be popped until they're read back from
+    // disk, and how many of those there may be.  See `spilling_queue_t`.
+    virtual size_t spilled_size() const { return 0; }
+    virtual size_t spill_limit() const { return 0; }
 };
 
 class nonsquashing_queue_t final : public maybe_squashing_queue_t {
@@ -282,6 +298,205 @@ private:
     std::list<store_key_t> queue_order;
 };
 
+// The stats of a changefeed that may spill its queue to disk.  They show up in
+// `_debug_stats` under `query_engine`.
+class spill_stats_t {
+public:
+    spill_stats_t(perfmon_collection_t *parent, const uuid_u &sub_uuid)
+        : membership(parent, &collection, "changefeed_" + uuid_to_str(sub_uuid)),
+          counters_membership(&collection,
+                              &queued, "queued",
+                              &spilled, "spilled",
+                              &spilled_total, "spilled_total") { }
+    // How many changes are queued in total, how many of those are on disk, and how
+    // many were ever written to disk.
+    perfmon_counter_t queued, spilled, spilled_total;
+private:
+    perfmon_collection_t collection;
+    perfmon_membership_t membership;
+    perfmon_multi_membership_t counters_membership;
+    DISABLE_COPYING(spill_stats_t);
+};
+
+// Keeps up to `memory_limit` changes in `memory`, and once that's full puts the
+// changes that come in after them in a temporary file instead, so that a slow
+// reader doesn't lose changes as soon as it's `memory_limit` behind.  Changes are
+// added while we can't block (see `msg_visitor_t`), so all the disk access happens
+// in `pump`, which runs in a coroutine of its own and calls `on_readable` whenever
+// it moves changes back into memory.  `size` only counts the changes that can be
+// popped right away, and squashing only happens among those.
+class spilling_queue_t final : public maybe_squashing_queue_t {
+public:
+    spilling_queue_t(scoped_ptr_t<maybe_squashing_queue_t> &&_memory,
+                     size_t _memory_limit,
+                     size_t _disk_limit,
+                     io_backender_t *_io_backender,
+                     serializer_filepath_t _filepath,
+                     spill_stats_t *_stats,
+                     std::function<void()> _on_readable)
+        : memory(std::move(_memory)),
+          memory_limit(_memory_limit),
+          disk_limit(_disk_limit),
+          io_backender(_io_backender),
+          filepath(std::move(_filepath)),
+          stats(_stats),
+          on_readable(std::move(_on_readable)),
+          writing(0),
+          on_disk(0),
+          generation(0),
+          disk_generation(0),
+          pumping(false),
+          reported_queued(0),
+          reported_spilled(0) {
+        guarantee(memory_limit != 0);
+        update_stats();
+    }
+    void add(change_val_t change_val) final {
+        if (spilled_size() == 0 && memory->size() < memory_limit) {
+            memory->add(std::move(change_val));
+        } else {
+            unwritten.push_back(std::move(change_val));
+            maybe_start_pump();
+        }
+        update_stats();
+    }
+    size_t size() const final {
+        return memory->size();
+    }
+    size_t spilled_size() const final {
+        return unwritten.size() + writing + on_disk;
+    }
+    size_t spill_limit() const final {
+        return disk_limit;
+    }
+    void clear() final {
+        memory->clear();
+        unwritten.clear();
+        writing = 0;
+        on_disk = 0;
+        // `pump` throws away the file and whatever it's in the middle of.
+        ++generation;
+        update_stats();
+    }
+    const change_val_t &peek() final {
+        return memory->peek();
+    }
+    change_val_t pop() final {
+        change_val_t ret = memory->pop();
+        if (spilled_size() != 0 && memory->size() <= memory_limit / 2) {
+            maybe_start_pump();
+        }
+        update_stats();
+        return ret;
+    }
+    void purge_below(std::map<uuid_u, uint64_t>) final {
+        // We only start spilling once the start stamps are known.
+        r_sanity_fail();
+    }
+private:
+    void maybe_start_pump() {
+        if (!pumping) {
+            pumping = true;
+            coro_t::spawn_sometime(
+                std::bind(&spilling_queue_t::pump, this, drainer.lock()));
+        }
+    }
+    void pump(auto_drainer_t::lock_t keepalive) {
+        while (!keepalive.get_drain_signal()->is_pulsed()) {
+            if (disk_generation != generation) {
+                // `clear` was called, so what's in the file is stale.
+                disk.reset();
+                disk_generation = generation;
+            } else if (on_disk != 0 && memory->size() < memory_limit) {
+                read_batch();
+            } else if (on_disk == 0 && writing == 0 && unwritten.size() != 0
+                       && memory->size() < memory_limit) {
+                // Nothing is on disk, so the unwritten changes are next in line.
+                while (unwritten.size() != 0 && memory->size() < memory_limit) {
+                    memory->add(std::move(unwritten.front()));
+                    unwritten.pop_front();
+                }
+                on_readable();
+            } else if (unwritten.size() != 0) {
+                write_batch();
+            } else {
+                break;
+            }
+            update_stats();
+        }
+        pumping = false;
+    }
+    void write_batch() {
+        uint64_t start_generation = generation;
+        size_t n = std::min<size_t>(unwritten.size(), CHANGEFEED_SPILL_BATCH_SIZE);
+        scoped_array_t<write_message_t> wms(n);
+        for (size_t i = 0; i < n; ++i) {
+            // The file never outlives the process, so the latest version is fine.
+            serialize<cluster_version_t::LATEST_OVERALL>(&wms[i], unwritten.front());
+            unwritten.pop_front();
+        }
+        writing = n;
+        if (!disk.has()) {
+            disk.init(new internal_disk_backed_queue_t(
+                io_backender, filepath, &disk_stats));
+        }
+        disk->push(wms);
+        if (generation == start_generation) {
+            writing = 0;
+            on_disk += n;
+            stats->spilled_total += n;
+        }
+    }
+    void read_batch() {
+        uint64_t start_generation = generation;
+        size_t n = std::min<size_t>(
+            std::min(on_disk, memory_limit - memory->size()),
+            CHANGEFEED_SPILL_BATCH_SIZE);
+        std::vector<change_val_t> batch(n);
+        for (size_t i = 0; i < n; ++i) {
+            deserializing_viewer_t<change_val_t> viewer(&batch[i]);
+            disk->pop(&viewer);
+        }
+        if (generation == start_generation) {
+            on_disk -= n;
+            for (auto &&change_val : batch) {
+                memory->add(std::move(change_val));
+            }
+            on_readable();
+        }
+    }
+    void update_stats() {
+        int64_t queued = memory->size() + spilled_size();
+        int64_t spilled = writing + on_disk;
+        stats->queued += queued - reported_queued;
+        stats->spilled += spilled - reported_spilled;
+        reported_queued = queued;
+        reported_spilled = spilled;
+    }
+
+    // The oldest changes, the ones we can pop.
+    scoped_ptr_t<maybe_squashing_queue_t> memory;
+    const size_t memory_limit, disk_limit;
+    io_backender_t *const io_backender;
+    const serializer_filepath_t filepath;
+    spill_stats_t *const stats;
+    const std::function<void()> on_readable;
+    // The file's own stats are too detailed to be worth exposing.
+    perfmon_collection_t disk_stats;
+    // Only `pump` touches this, so it never blocks anything else.
+    scoped_ptr_t<internal_disk_backed_queue_t> disk;
+    // The newest changes, waiting to be written after the ones on disk.
+    std::deque<change_val_t> unwritten;
+    // How many changes `pump` is writing right now, and how many are on disk.
+    size_t writing, on_disk;
+    // Incremented by `clear`, so `pump` knows to throw away what it's doing.
+    uint64_t generation, disk_generation;
+    bool pumping;
+    int64_t reported_queued, reported_spilled;
+    auto_drainer_t drainer;
+    DISABLE_COPYING(spilling_queue_t);
+};
+
 boost::optional<datum_t> apply_ops(
     const datum_t &val,
     const std::vector<scoped_ptr_t<op_t> > &ops,
@@ -314,18 +529,216 @@ boost::optional<datum_t> apply_ops(
     }
 }
 
+struct stamped_msg_t {
+    stamped_msg_t() { }
+    stamped_msg_t(uuid_u _server_uuid, uint64_t _stamp, msg_t _submsg)
+        : server_uuid(std::move(_server_uuid)),
+          stamp(_stamp),
+          submsg(std::move(_submsg)) { }
+    uuid_u server_uuid;
+    uint64_t stamp;
+    msg_t submsg;
+};
+
+class discarding_viewer_t : public buffer_group_viewer_t {
+public:
+    discarding_viewer_t() { }
+    void view_buffer_group(const const_buffer_group_t *) final { }
+private:
+    DISABLE_COPYING(discarding_viewer_t);
+};
+
+change_journal_t::change_journal_t(io_backender_t *io_backender,
+                                   const serializer_filepath_t &filename,
+                                   perfmon_collection_t *stats_parent,
+                                   uint64_t _first_seq,
+                                   int64_t _max_bytes,
+                                   microtime_t _max_age)
+    : max_bytes(_max_bytes),
+      max_age(_max_age),
+      queue(new internal_disk_backed_queue_t(io_backender, filename, stats_parent)),
+      written_first_seq(_first_seq),
+      unwritten_first_seq(_first_seq),
+      write_scheduled(false),
+      first_seq(_first_seq),
+      next_seq(_first_seq),
+      total_bytes(0) {
+    guarantee(first_seq > 0);
+}
+
+change_journal_t::~change_journal_t() { }
+
+uint64_t change_journal_t::append(const msg_t::change_t &change) {
+    if (unwritten.size() >= CHANGEFEED_JOURNAL_MAX_UNWRITTEN) {
+        // The disk can't keep up.  Rather than using more and more memory, we drop
+        // the oldest change, and with it everything before it.  `write_cb` and
+        // `trim` get rid of whatever of that is on disk.
+        unwritten.pop_front();
+        ++unwritten_first_seq;
+        first_seq = unwritten_first_seq;
+    }
+    unwritten.push_back(unwritten_change_t{current_microtime(), change});
+    if (!write_scheduled) {
+        write_scheduled = true;
+        coro_t::spawn_sometime(
+            std::bind(&change_journal_t::write_cb, this, drainer.lock()));
+    }
+    return next_seq++;
+}
+
+void change_journal_t::write_cb(auto_drainer_t::lock_t keepalive) {
+    keepalive.assert_is_holding(&drainer);
+    while (!unwritten.empty() && !keepalive.get_drain_signal()->is_pulsed()) {
+        mutex_t::acq_t acq(&queue_mutex);
+        // If `append` dropped changes, everything in `queue` is before `first_seq`,
+        // and `trim` empties it.
+        trim(current_microtime());
+        if (entry_infos.empty()) {
+            written_first_seq = unwritten_first_seq;
+        }
+        guarantee(written_first_seq + entry_infos.size() == unwritten_first_seq);
+        if (unwritten.empty()) {
+            break;
+        }
+        // Everything that was appended while we waited goes in one transaction.
+        const uint64_t batch_first_seq = unwritten_first_seq;
+        const size_t count = unwritten.size();
+        scoped_array_t<write_message_t> wms(count);
+        std::vector<microtime_t> times(count);
+        for (size_t i = 0; i < count; ++i) {
+            // Like all disk backed queues the journal doesn't persist across
+            // restarts, so we can use the latest version.
+            serialize<cluster_version_t::LATEST_OVERALL>(&wms[i], unwritten[i].change);
+            times[i] = unwritten[i].time;
+        }
+        queue->push(wms);
+        // The changes stay in `unwritten` until they're in `queue`, so that
+        // `replay` always finds them in one or the other.  `append` may have
+        // dropped some of them in the meantime.
+        for (size_t i = 0; i < count; ++i) {
+            const int64_t bytes = wms[i].size();
+            entry_infos.push_back(entry_info_t{times[i], bytes});
+            total_bytes += bytes;
+        }
+        while (!unwritten.empty() && unwritten_first_seq < batch_first_seq + count) {
+            unwritten.pop_front();
+            ++unwritten_first_seq;
+        }
+        trim(current_microtime());
+    }
+    write_scheduled = false;
+}
+
+change_journal_t::write_pause_t::write_pause_t(change_journal_t *_parent)
+    : parent(_parent), acq(&parent->queue_mutex) { }
+
+bool change_journal_t::replay(
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f) {
+    mutex_t::acq_t acq(&queue_mutex);
+    return replay_with_mutex(after, up_to, f);
+}
+
+bool change_journal_t::replay(
+        const write_pause_t &pause,
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f) {
+    guarantee(pause.parent == this);
+    return replay_with_mutex(after, up_to, f);
+}
+
+bool change_journal_t::replay_unwritten(
+        const write_pause_t &pause,
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f) {
+    guarantee(pause.parent == this);
+    guarantee(up_to < next_seq);
+    if (after > up_to || after + 1 < unwritten_first_seq) {
+        return false;
+    }
+    return replay_from_memory(after, up_to, f);
+}
+
+bool change_journal_t::replay_with_mutex(
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f) {
+    guarantee(up_to < next_seq);
+    trim(current_microtime());
+    if (after > up_to || after + 1 < first_seq) {
+        return false;
+    }
+    uint64_t next = after + 1;
+    // `write_cb` can't change `queue` or `entry_infos` while we hold the mutex, but
+    // `append` can drop changes from `unwritten` while we read from the disk.
+    const uint64_t written_end_seq = written_first_seq + entry_infos.size();
+    if (next <= up_to && next < written_end_seq) {
+        std::function<void(msg_t::change_t &&)> cb = [&](msg_t::change_t &&change) {
+            if (next <= up_to) {
+                f(next, std::move(change));
+            }
+            ++next;
+        };
+        calling_viewer_t<msg_t::change_t> viewer(&cb);
+        queue->peek_from(next - written_first_seq, &viewer);
+        guarantee(next == written_end_seq);
+    }
+    if (next > up_to) {
+        return true;
+    }
+    return replay_from_memory(next - 1, up_to, f);
+}
+
+bool change_journal_t::replay_from_memory(
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f) {
+    if (after + 1 < unwritten_first_seq) {
+        // `append` dropped them.
+        return false;
+    }
+    for (uint64_t next = after + 1; next <= up_to; ++next) {
+        msg_t::change_t change = unwritten[next - unwritten_first_seq].change;
+        f(next, std::move(change));
+    }
+    return true;
+}
+
+void change_journal_t::trim(microtime_t now) {
+    while (!entry_infos.empty()
+           && (written_first_seq < first_seq
+               || total_bytes > max_bytes
+               || entry_infos.front().time + max_age < now)) {
+        discarding_viewer_t viewer;
+        queue->pop(&viewer);
+        total_bytes -= entry_infos.front().bytes;
+        entry_infos.pop_front();
+        ++written_first_seq;
+        first_seq = std::max(first_seq, written_first_seq);
+    }
+}
+
 server_t::client_info_t::client_info_t()
     : limit_clients(&opt_lt<std::string>),
-      limit_clients_lock(new rwlock_t()) { }
+      limit_clients_lock(new rwlock_t()),
+      flush_scheduled(false) { }
 
 server_t::server_t(mailbox_manager_t *_manager, store_t *_parent)
     : uuid(generate_uuid()),
       manager(_manager),
       parent(_parent),
+      journal_users(0),
+      journal_idle_generation(0),
+      next_journal_seq(1),
       stop_mailbox(manager,
                    std::bind(&server_t::stop_mailbox_cb, this, ph::_1, ph::_2)),
       limit_stop_mailbox(manager, std::bind(&server_t::limit_stop_mailbox_cb,
-                                            this, ph::_1, ph::_2, ph::_3, ph::_4)) { }
+                                            this, ph::_1, ph::_2, ph::_3, ph::_4)),
+      sub_stop_mailbox(manager, std::bind(&server_t::sub_stop_mailbox_cb,
+                                          this, ph::_1, ph::_2, ph::_3)) { }
 
 server_t::~server_t() { }
 
@@ -391,6 +804,30 @@ void server_t::limit_stop_mailbox_cb(signal_t *,
     }
 }
 
+void server_t::sub_stop_mailbox_cb(signal_t *,
+                                   client_t::addr_t addr,
+                                   uuid_u sub_uuid) {
+    // Declared before the lock so that the filter is freed after we release it.
+    counted_t<sub_filter_t> destroyable_filter;
+    auto_drainer_t::lock_t lock(&drainer);
+    rwlock_in_line_t spot(&clients_lock, access_t::write);
+    spot.write_signal()->wait_lazily_unordered();
+    auto it = clients.find(addr);
+    // As above, the client might already be gone, and with multiple shards per
+    // btree we get the message more than once.
+    if (it != clients.end()) {
+        auto sub_it = it->second.subs.find(sub_uuid);
+        if (sub_it != it->second.subs.end()) {
+            it->second.sub_index.erase(sub_uuid, sub_it->second->pkey_ranges());
+            destroyable_filter = std::move(sub_it->second);
+            it->second.subs.erase(sub_it);
+            if (destroyable_filter->journals()) {
+                release_journal_user(lock);
+            }
+        }
+    }
+}
+
 void server_t::add_client(
         const client_t::addr_t &addr,
         region_t region,
@@ -399,11 +836,17 @@ void server_t::add_client(
     rwlock_in_line_t spot(&clients_lock, access_t::write);
     spot.write_signal()->wait_lazily_unordered();
     client_info_t *info = &clients[addr];
+    client_entry_t *entry = &*clients.find(addr);
 
     // We do this regardless of whether there's already an entry for this
     // address, because we might be subscribed to multiple regions if we're
     // oversharded.  This will have to become smarter once you can unsubscribe
     // at finer granularity (i.e. when we support changefeeds on selections).
+    client_index.visit_mutable(
+        region,
+        [&](const region_t &, std::set<client_entry_t *> *entries) {
+            entries->insert(entry);
+        });
     info->regions.push_back(std::move(region));
 
     // The entry might already exist if we have multiple shards per btree, but
@@ -483,27 +926,121 @@ void server_t::add_client_cb(
     auto it = clients.find(addr);
     // We can be removed more than once safely (e.g. in the case of oversharding).
     if (it != clients.end()) {
-        send_one_with_lock(&*it, msg_t(msg_t::stop_t()), keepalive);
+        boost::optional<pending_batch_t> batch;
+        {
+            // The client is going away, so we send everything that's pending
+            // along with the `stop_t` rather than leaving it to `flush_cb`.
+            ASSERT_NO_CORO_WAITING;
+            batch = stamp_and_queue(
+                &*it, pending_msg_t(msg_t(msg_t::stop_t())), keepalive);
+            if (!batch) {
+                batch = take_pending(&it->second);
+            }
+        }
+        // We keep our place in line for `clients_lock` so that nothing gets
+        // stamped after the `stop_t`, which means the transforms of this last
+        // batch are applied while other writes wait.  It's at most one batch per
+        // client that goes away.
+        send_pending(addr, std::move(*batch));
     }
     coro_spot.write_signal()->wait_lazily_unordered();
-    size_t erased = clients.erase(addr);
+    it = clients.find(addr);
     // This is true even if we have multiple shards per btree because
     // `add_client` only spawns one of us.
-    guarantee(erased == 1);
+    guarantee(it != clients.end());
+    for (const auto &region : it->second.regions) {
+        client_index.visit_mutable(
+            region,
+            [&](const region_t &, std::set<client_entry_t *> *entries) {
+                entries->erase(&*it);
+            });
+    }
+    for (const auto &pair : it->second.subs) {
+        if (pair.second->journals()) {
+            release_journal_user(keepalive);
+        }
+    }
+    clients.erase(it);
 }
 
-struct stamped_msg_t {
-    stamped_msg_t() { }
-    stamped_msg_t(uuid_u _server_uuid, uint64_t _stamp, msg_t _submsg)
-        : server_uuid(std::move(_server_uuid)),
-          stamp(_stamp),
-          submsg(std::move(_submsg)) { }
-    uuid_u server_uuid;
-    uint64_t stamp;
-    msg_t submsg;
-};
+boost::optional<server_t::pending_batch_t> server_t::stamp_and_queue(
+        std::pair<const client_t::addr_t, client_info_t> *client,
+        pending_msg_t &&msg,
+        const auto_drainer_t::lock_t &keepalive) {
+    keepalive.assert_is_holding(&drainer);
+    // We don't need a write lock as long as we make sure the coroutine doesn't
+    // block between reading and updating the stamp, and the stamps of the pending
+    // messages stay consecutive.
+    ASSERT_NO_CORO_WAITING;
+    client_info_t *info = &client->second;
+    info->stamp += 1;
+    info->pending.push_back(std::move(msg));
+    if (info->pending.size() >= CHANGEFEED_MAX_COALESCED_MSGS) {
+        return take_pending(info);
+    }
+    if (!info->flush_scheduled) {
+        info->flush_scheduled = true;
+        coro_t::spawn_sometime(
+            std::bind(&server_t::flush_cb, this, client->first, keepalive));
+    }
+    return boost::none;
+}
 
-RDB_MAKE_SERIALIZABLE_3(stamped_msg_t, server_uuid, stamp, submsg);
+server_t::pending_batch_t server_t::take_pending(client_info_t *info) {
+    ASSERT_NO_CORO_WAITING;
+    pending_batch_t ret;
+    ret.first_stamp = info->stamp - info->pending.size();
+    ret.msgs = std::move(info->pending);
+    info->pending.clear();
+    return ret;
+}
+
+void server_t::send_pending(const client_t::addr_t &addr, pending_batch_t &&batch) {
+    std::vector<msg_t> msgs;
+    msgs.reserve(batch.msgs.size());
+    for (auto &&pending : batch.msgs) {
+        if (pending.transforms.size() != 0) {
+            auto *change = boost::get<msg_t::change_t>(&pending.msg.op);
+            guarantee(change != nullptr && change->sub_changes);
+            for (const auto &pair : pending.transforms) {
+                msg_t::sub_change_t sub_change{pair.second->apply(pending.old_val),
+                                               pair.second->apply(pending.new_val)};
+                // If the transforms drop both sides the subscription won't see
+                // anything, so there's no need to send it an entry.  The message
+                // still goes out because its stamp is taken.
+                if (sub_change.old_val.has() || sub_change.new_val.has()) {
+                    (*change->sub_changes)[pair.first] = std::move(sub_change);
+                }
+            }
+        }
+        msgs.push_back(std::move(pending.msg));
+    }
+    send(manager, addr, stamped_msgs_t(uuid, batch.first_stamp, std::move(msgs)));
+}
+
+void server_t::flush_cb(client_t::addr_t addr, auto_drainer_t::lock_t keepalive) {
+    keepalive.assert_is_holding(&drainer);
+    // By the time we get here every write that was already running, such as the
+    // rest of a batched write, had a chance to add to the pending messages.
+    rwlock_acq_t acq(&clients_lock, access_t::read);
+    auto it = clients.find(addr);
+    if (it == clients.end()) {
+        // `add_client_cb` sent everything before removing the client.
+        return;
+    }
+    boost::optional<pending_batch_t> batch;
+    {
+        ASSERT_NO_CORO_WAITING;
+        it->second.flush_scheduled = false;
+        if (it->second.pending.size() == 0) {
+            // A full batch was sent in the meantime.
+            return;
+        }
+        batch = take_pending(&it->second);
+    }
+    acq.reset();
+    send_pending(addr, std::move(*batch));
+}
 
 // This function takes a `lock_t` to make sure you have one.  (We can't just
 // always acquire a drainer lock before sending because we sometimes send a
@@ -514,14 +1051,65 @@ void server_t::send_one_with_lock(
         msg_t msg,
         const auto_drainer_t::lock_t &keepalive) {
     keepalive.assert_is_holding(&drainer);
-    uint64_t stamp;
-    {
-        // We don't need a write lock as long as we make sure the coroutine
-        // doesn't block between reading and updating the stamp.
-        ASSERT_NO_CORO_WAITING;
-        stamp = client->second.stamp++;
+    if (boost::optional<pending_batch_t> batch
+            = stamp_and_queue(client, pending_msg_t(std::move(msg)), keepalive)) {
+        send_pending(client->first, std::move(*batch));
     }
-    send(manager, client->first, stamped_msg_t(uuid, stamp, std::move(msg)));
+}
+
+bool server_t::filter_change(client_info_t *info,
+                             const msg_t::change_t &change,
+                             const boost::optional<uint64_t> &journal_seq,
+                             boost::optional<pending_msg_t> *out) {
+    ASSERT_NO_CORO_WAITING;
+    msg_t::change_t filtered;
+    filtered.pkey = change.pkey;
+    filtered.journal_seq = journal_seq;
+    filtered.sub_changes = std::map<uuid_u, msg_t::sub_change_t>();
+    std::set<std::string> sindexes;
+    bool wants_raw_vals = false;
+    std::vector<std::pair<uuid_u, counted_t<sub_filter_t> > > transforms;
+    info->sub_index.each_candidate(change.pkey, [&](const uuid_u &sub_uuid) {
+        auto sub_it = info->subs.find(sub_uuid);
+        guarantee(sub_it != info->subs.end());
+        const counted_t<sub_filter_t> &filter = sub_it->second;
+        if (!filter->might_contain(change)) {
+            return;
+        }
+        if (boost::optional<std::string> sindex = filter->sindex()) {
+            sindexes.insert(*sindex);
+        }
+        if (filter->has_ops()) {
+            // Applied by `send_pending`.
+            transforms.push_back(std::make_pair(sub_uuid, filter));
+        } else {
+            wants_raw_vals = true;
+        }
+    });
+    if (!wants_raw_vals && transforms.size() == 0) {
+        return false;
+    }
+    for (const auto &sindex : sindexes) {
+        auto old_it = change.old_indexes.find(sindex);
+        if (old_it != change.old_indexes.end()) {
+            filtered.old_indexes.insert(*old_it);
+        }
+        auto new_it = change.new_indexes.find(sindex);
+        if (new_it != change.new_indexes.end()) {
+            filtered.new_indexes.insert(*new_it);
+        }
+    }
+    if (wants_raw_vals) {
+        filtered.old_val = change.old_val;
+        filtered.new_val = change.new_val;
+    }
+    *out = pending_msg_t(msg_t(std::move(filtered)));
+    if (transforms.size() != 0) {
+        (*out)->old_val = change.old_val;
+        (*out)->new_val = change.new_val;
+        (*out)->transforms = std::move(transforms);
+    }
+    return true;
 }
 
 void server_t::send_all(
@@ -533,22 +1121,38 @@ void server_t::send_all(
     stamp_spot->guarantee_is_for_lock(&parent->cfeed_stamp_lock);
     stamp_spot->write_signal()->wait_lazily_unordered();
 
+    const msg_t::change_t *change = boost::get<msg_t::change_t>(&msg.op);
+    boost::optional<uint64_t> journal_seq;
+    if (change != nullptr && journal.has()) {
+        // We hold the stamp lock, so the journal has the same order as the stamps.
+        // Appending only queues the change for the journal's own coroutine to
+        // write, so writes don't wait for the journal's disk.
+        journal_seq = journal->append(*change);
+    }
     rwlock_acq_t acq(&clients_lock, access_t::read);
-    std::map<client_t::addr_t, uint64_t> stamps;
-    for (auto &&pair : clients) {
-        // We don't need a write lock as long as we make sure the coroutine
-        // doesn't block between reading and updating the stamp.
-        ASSERT_NO_CORO_WAITING;
-        if (std::any_of(pair.second.regions.begin(),
-                        pair.second.regions.end(),
-                        std::bind(&region_contains_key, ph::_1, std::cref(key)))) {
-            stamps[pair.first] = pair.second.stamp++;
+    // Most of the time the messages are only queued here and sent by `flush_cb`
+    // together with the other changes of the same write batch.
+    std::vector<std::pair<client_t::addr_t, pending_batch_t> > full_batches;
+    for (client_entry_t *entry : client_index.lookup(key)) {
+        boost::optional<pending_msg_t> filtered;
+        // Skipping a client doesn't use up a stamp, so its feed never waits for
+        // the change.
+        if (change != nullptr
+            && !filter_change(&entry->second, *change, journal_seq, &filtered)) {
+            continue;
+        }
+        boost::optional<pending_batch_t> batch = stamp_and_queue(
+            entry,
+            filtered ? std::move(*filtered) : pending_msg_t(msg_t(msg)),
+            keepalive);
+        if (batch) {
+            full_batches.push_back(std::make_pair(entry->first, std::move(*batch)));
         }
     }
     acq.reset();
     stamp_spot->reset(); // Done stamping, no need to hold onto it while we send.
-    for (const auto &pair : stamps) {
-        send(manager, pair.first, stamped_msg_t(uuid, pair.second, msg));
+    for (auto &&pair : full_batches) {
+        send_pending(pair.first, std::move(pair.second));
     }
 }
 
@@ -560,6 +1164,10 @@ server_t::limit_addr_t server_t::get_limit_stop_addr() {
     return limit_stop_mailbox.get_address();
 }
 
+server_t::sub_stop_addr_t server_t::get_sub_stop_addr() {
+    return sub_stop_mailbox.get_address();
+}
+
 boost::optional<uint64_t> server_t::get_stamp(
         const client_t::addr_t &addr,
         const auto_drainer_t::lock_t &keepalive) {
@@ -574,6 +1182,208 @@ boost::optional<uint64_t> server_t::get_stamp(
     }
 }
 
+boost::optional<uint64_t> server_t::add_sub(
+        const client_t::addr_t &addr,
+        rdb_context_t *ctx,
+        const sub_registration_t &registration,
+        const auto_drainer_t::lock_t &keepalive,
+        boost::optional<journal_pos_t> *journal_pos_out) {
+    keepalive.assert_is_holding(&drainer);
+    counted_t<sub_filter_t> new_filter = make_counted<sub_filter_t>(ctx, registration);
+    std::vector<pending_msg_t> replayed;
+    auto replay_cb = [&](uint64_t seq, msg_t::change_t &&change) {
+        if (boost::optional<pending_msg_t> msg = replay_change(
+                registration.sub, new_filter, seq, change)) {
+            replayed.push_back(std::move(*msg));
+        }
+    };
+
+    // The replay happens before we take any locks, so that a feed resuming from far
+    // back doesn't hold up the writes and the other feeds while we read the journal.
+    // First we catch up to the end of the journal, then we stop the journal from
+    // writing to disk and catch up again, so that what's journaled after that can be
+    // replayed from memory once we have the locks.  We count ourselves as a user of
+    // the journal until we know whether the subscription is new, so that it isn't
+    // dropped in the meantime.
+    counted_t<change_journal_t> current_journal;
+    scoped_ptr_t<change_journal_t::write_pause_t> write_pause;
+    journal_pos_t pos{0, true};
+    bool resuming = false;
+    if (registration.journal) {
+        ++journal_users;
+        current_journal = get_or_create_journal(ctx);
+        pos.seq = current_journal->last_seq();
+        if (!registration.resume_from.empty()) {
+            auto resume_it = registration.resume_from.find(uuid);
+            if (resume_it == registration.resume_from.end()) {
+                // The feed didn't know about us, e.g. because of a reshard.
+                pos.complete = false;
+            } else {
+                resuming = true;
+                pos.complete = current_journal->replay(
+                    resume_it->second, pos.seq, replay_cb);
+            }
+        }
+        if (resuming && pos.complete) {
+            write_pause.init(new change_journal_t::write_pause_t(current_journal.get()));
+            const uint64_t paused_seq = current_journal->last_seq();
+            pos.complete = current_journal->replay(
+                *write_pause, pos.seq, paused_seq, replay_cb);
+            pos.seq = paused_seq;
+        }
+    }
+
+    rwlock_acq_t stamp_acq(&parent->cfeed_stamp_lock, access_t::read);
+    rwlock_acq_t client_acq(&clients_lock, access_t::write);
+    auto it = clients.find(addr);
+    if (it == clients.end()) {
+        if (registration.journal) {
+            release_journal_user(keepalive);
+        }
+        return boost::none;
+    }
+    // With multiple shards per btree the registration arrives once per shard.
+    counted_t<sub_filter_t> *filter = &it->second.subs[registration.sub];
+    bool is_new = !filter->has();
+    if (is_new) {
+        *filter = new_filter;
+        it->second.sub_index.insert(registration.sub, (*filter)->pkey_ranges());
+    }
+    uint64_t stamp = it->second.stamp;
+    if (!registration.journal) {
+        return stamp;
+    }
+    if (!is_new) {
+        release_journal_user(keepalive);
+        *journal_pos_out = journal_pos_t{current_journal->last_seq(), true};
+        return stamp;
+    }
+
+    // The stamp lock keeps `send_all` from journaling anything while we're here, so
+    // once we've replayed what was journaled since we paused the journal, the
+    // replayed changes and the ones sent live neither overlap nor leave a gap.  That
+    // doesn't block, since those changes are all still in memory.
+    const uint64_t last_seq = current_journal->last_seq();
+    if (resuming && pos.complete) {
+        pos.complete = current_journal->replay_unwritten(
+            *write_pause, pos.seq, last_seq, replay_cb);
+    }
+    pos.seq = last_seq;
+    *journal_pos_out = pos;
+
+    // The replayed changes are stamped right after `stamp`, so the subscription
+    // accepts them even though every other subscription of the client ignores
+    // them (see `replay_change`).
+    std::vector<pending_batch_t> full_batches;
+    for (auto &&msg : replayed) {
+        boost::optional<pending_batch_t> batch
+            = stamp_and_queue(&*it, std::move(msg), keepalive);
+        if (batch) {
+            full_batches.push_back(std::move(*batch));
+        }
+    }
+    client_acq.reset();
+    stamp_acq.reset();
+    for (auto &&batch : full_batches) {
+        send_pending(addr, std::move(batch));
+    }
+    return stamp;
+}
+
+counted_t<change_journal_t> server_t::get_or_create_journal(rdb_context_t *ctx) {
+    mutex_t::acq_t acq(&journal_mutex);
+    if (!journal.has()) {
+        journal = make_counted<change_journal_t>(
+            parent->io_backender_,
+            // A journal that was dropped might not be gone yet, so every journal
+            // gets its own file.
+            serializer_filepath_t(
+                parent->base_path_,
+                "changefeed_journal_" + uuid_to_str(generate_uuid())),
+            &parent->perfmon_collection,
+            next_journal_seq,
+            ctx->changefeed_journal_max_bytes,
+            ctx->changefeed_journal_max_age);
+    }
+    return journal;
+}
+
+void server_t::release_journal_user(const auto_drainer_t::lock_t &keepalive) {
+    keepalive.assert_is_holding(&drainer);
+    guarantee(journal_users > 0);
+    --journal_users;
+    if (journal_users == 0 && journal.has()) {
+        ++journal_idle_generation;
+        coro_t::spawn_sometime(std::bind(&server_t::drop_idle_journal,
+                                         this,
+                                         journal_idle_generation,
+                                         keepalive));
+    }
+}
+
+void server_t::drop_idle_journal(uint64_t idle_generation,
+                                 auto_drainer_t::lock_t keepalive) {
+    keepalive.assert_is_holding(&drainer);
+    if (!journal.has()) {
+        return;
+    }
+    // A feed that went away can still resume until the changes it missed are
+    // older than `max_age`, so we keep journaling until then.
+    try {
+        nap(journal->get_max_age() / THOUSAND, keepalive.get_drain_signal());
+    } catch (const interrupted_exc_t &) {
+        return;
+    }
+    if (journal_users != 0 || journal_idle_generation != idle_generation
+        || !journal.has()) {
+        return;
+    }
+    // `send_all` and `add_sub` only use `journal` without blocking or through
+    // their own reference, so we can take it away without any locks.  Destroying
+    // the journal, which deletes its file, happens once the last of those
+    // references is gone.
+    next_journal_seq = journal->last_seq() + 1;
+    counted_t<change_journal_t> dropped = std::move(journal);
+}
+
+boost::optional<server_t::pending_msg_t> server_t::replay_change(
+        const uuid_u &sub_uuid,
+        const counted_t<sub_filter_t> &filter,
+        uint64_t seq,
+        const msg_t::change_t &change) {
+    if (!filter->might_contain(change)) {
+        return boost::none;
+    }
+    msg_t::change_t targeted;
+    targeted.pkey = change.pkey;
+    targeted.journal_seq = seq;
+    if (boost::optional<std::string> sindex = filter->sindex()) {
+        auto old_it = change.old_indexes.find(*sindex);
+        if (old_it != change.old_indexes.end()) {
+            targeted.old_indexes.insert(*old_it);
+        }
+        auto new_it = change.new_indexes.find(*sindex);
+        if (new_it != change.new_indexes.end()) {
+            targeted.new_indexes.insert(*new_it);
+        }
+    }
+    // The values only go in `sub_changes`, so that the other subscriptions of the
+    // client skip the change.  The transforms are applied by `send_pending`, since
+    // part of the replay happens while we hold the locks.
+    targeted.sub_changes = std::map<uuid_u, msg_t::sub_change_t>();
+    pending_msg_t ret((msg_t()));
+    if (filter->has_ops()) {
+        ret.old_val = change.old_val;
+        ret.new_val = change.new_val;
+        ret.transforms.push_back(std::make_pair(sub_uuid, filter));
+    } else {
+        (*targeted.sub_changes)[sub_uuid]
+            = msg_t::sub_change_t{change.old_val, change.new_val};
+    }
+    ret.msg = msg_t(std::move(targeted));
+    return ret;
+}
+
 uuid_u server_t::get_uuid() {
     return uuid;
 }
@@ -847,6 +1657,66 @@ bool limit_order_t::operator()(const std::string &a, const std::string &b) const
     unreachable();
 }
 
+limit_queue_t::limit_queue_t(limit_order_t _gt) : gt(std::move(_gt)) { }
+
+limit_queue_t::iterator limit_queue_t::lower_bound(const item_t &item) {
+    return std::lower_bound(items.begin(), items.end(), item, gt);
+}
+
+std::pair<limit_queue_t::iterator, bool> limit_queue_t::insert(item_t item) {
+    iterator it = find_id(item.first);
+    if (it != items.end()) {
+        return std::make_pair(it, false);
+    }
+    if (item.second.first.get_type() != datum_t::R_NULL) {
+        auto res = sindex_keys.insert(std::make_pair(item.first, item.second.first));
+        guarantee(res.second);
+    }
+    it = items.insert(lower_bound(item), std::move(item));
+    return std::make_pair(it, true);
+}
+
+limit_queue_t::iterator limit_queue_t::find_id(const std::string &id) {
+    // Only the sort key and the id matter for the comparison.
+    auto key_it = sindex_keys.find(id);
+    item_t probe(
+        id,
+        std::make_pair(
+            key_it != sindex_keys.end() ? key_it->second : datum_t::null(),
+            datum_t()));
+    iterator it = lower_bound(probe);
+    return it != items.end() && it->first == id ? it : items.end();
+}
+
+bool limit_queue_t::del_id(const std::string &id) {
+    iterator it = find_id(id);
+    if (it == items.end()) {
+        return false;
+    }
+    erase(it);
+    return true;
+}
+
+void limit_queue_t::erase(iterator it) {
+    guarantee(it != items.end());
+    sindex_keys.erase(it->first);
+    items.erase(it);
+}
+
+std::vector<std::string> limit_queue_t::truncate_top(size_t n) {
+    std::vector<std::string> ret;
+    if (items.size() > n) {
+        size_t excess = items.size() - n;
+        ret.reserve(excess);
+        for (auto it = items.begin(); it != items.begin() + excess; ++it) {
+            sindex_keys.erase(it->first);
+            ret.push_back(std::move(it->first));
+        }
+        items.erase(items.begin(), items.begin() + excess);
+    }
+    return ret;
+}
+
 void limit_manager_t::send(msg_t &&msg) {
     if (!parent->drainer.is_draining()) {
         auto_drainer_t::lock_t drain_lock(&parent->drainer);
@@ -856,6 +1726,147 @@ void limit_manager_t::send(msg_t &&msg) {
     }
 }
 
+sub_filter_t::sub_filter_t(rdb_context_t *ctx,
+                           const sub_registration_t &registration)
+    : spec(registration.spec),
+      journal(registration.journal) {
+    // The final `nullptr` argument means we don't profile any work done with this `env`.
+    env = make_scoped<env_t>(
+        ctx,
+        return_empty_normal_batches_t::NO,
+        drainer.get_drain_signal(),
+        registration.optargs,
+        registration.user_context,
+        registration.deterministic_time,
+        nullptr);
+    if (const auto *range = boost::get<keyspec_t::range_t>(&spec)) {
+        for (const auto &transform : range->transforms) {
+            ops.push_back(make_op(transform));
+        }
+        if (!range->sindex) {
+            store_keys = range->datumspec.primary_key_map();
+            if (!store_keys) {
+                store_key_range =
+                    range->datumspec.covering_range().to_primary_keyrange();
+            }
+        }
+    }
+}
+
+sub_filter_t::~sub_filter_t() { }
+
+bool sub_filter_t::might_contain(const msg_t::change_t &change) const {
+    if (const auto *key = boost::get<store_key_t>(&spec)) {
+        return *key == change.pkey;
+    }
+    const auto *range = boost::get<keyspec_t::range_t>(&spec);
+    guarantee(range != nullptr);
+    if (range->sindex) {
+        for (const index_vals_t *vals : {&change.old_indexes, &change.new_indexes}) {
+            auto it = vals->find(*range->sindex);
+            if (it != vals->end()) {
+                for (const auto &idx : it->second) {
+                    if (range->datumspec.copies(idx.first) != 0) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    } else if (store_keys) {
+        return store_keys->find(change.pkey) != store_keys->end();
+    } else {
+        guarantee(store_key_range);
+        return store_key_range->contains_key(change.pkey);
+    }
+}
+
+boost::optional<std::string> sub_filter_t::sindex() const {
+    if (const auto *range = boost::get<keyspec_t::range_t>(&spec)) {
+        return range->sindex;
+    }
+    return boost::none;
+}
+
+boost::optional<std::vector<key_range_t> > sub_filter_t::pkey_ranges() const {
+    if (const auto *key = boost::get<store_key_t>(&spec)) {
+        return std::vector<key_range_t>{key_range_t::one_key(*key)};
+    }
+    const auto *range = boost::get<keyspec_t::range_t>(&spec);
+    guarantee(range != nullptr);
+    if (range->sindex) {
+        return boost::none;
+    } else if (store_keys) {
+        std::vector<key_range_t> ranges;
+        ranges.reserve(store_keys->size());
+        for (const auto &pair : *store_keys) {
+            ranges.push_back(key_range_t::one_key(pair.first));
+        }
+        return ranges;
+    } else {
+        guarantee(store_key_range);
+        return std::vector<key_range_t>{*store_key_range};
+    }
+}
+
+datum_t sub_filter_t::apply(const datum_t &val) {
+    if (!val.has()) {
+        return datum_t();
+    }
+    mutex_t::acq_t acq(&apply_mutex);
+    // As in `range_sub_t::apply_ops`, it's safe to pass `datum_t()` as the key.
+    boost::optional<datum_t> d = changefeed::apply_ops(val, ops, env.get(), datum_t());
+    return d ? *d : datum_t();
+}
+
+sub_index_t::sub_index_t()
+    : by_pkey(key_edge_t(store_key_t::min()), key_edge_t::make_unbounded()) { }
+
+void sub_index_t::insert(const uuid_u &sub,
+                         const boost::optional<std::vector<key_range_t> > &ranges) {
+    if (!ranges) {
+        unkeyed.insert(sub);
+        return;
+    }
+    for (const auto &range : *ranges) {
+        if (!range.is_empty()) {
+            by_pkey.visit_mutable(
+                key_edge_t(range.left), range.right,
+                [&](const key_edge_t &, const key_edge_t &, std::set<uuid_u> *subs) {
+                    subs->insert(sub);
+                });
+        }
+    }
+}
+
+void sub_index_t::erase(const uuid_u &sub,
+                        const boost::optional<std::vector<key_range_t> > &ranges) {
+    if (!ranges) {
+        unkeyed.erase(sub);
+        return;
+    }
+    for (const auto &range : *ranges) {
+        if (!range.is_empty()) {
+            by_pkey.visit_mutable(
+                key_edge_t(range.left), range.right,
+                [&](const key_edge_t &, const key_edge_t &, std::set<uuid_u> *subs) {
+                    subs->erase(sub);
+                });
+        }
+    }
+}
+
+void sub_index_t::each_candidate(
+        const store_key_t &pkey,
+        const std::function<void(const uuid_u &)> &f) const {
+    for (const uuid_u &sub : by_pkey.lookup(key_edge_t(pkey))) {
+        f(sub);
+    }
+    for (const uuid_u &sub : unkeyed) {
+        f(sub);
+    }
+}
+
 limit_manager_t::limit_manager_t(
     rwlock_in_line_t *clients_lock,
     region_t _region,
@@ -879,6 +1890,7 @@ limit_manager_t::limit_manager_t(
       spec(std::move(_spec)),
       gt(std::move(_gt)),
       item_queue(gt),
+      complete(item_vec.size() < capacity(spec.limit)),
       aborted(false) {
     guarantee(clients_lock->read_signal()->is_pulsed());
 
@@ -898,11 +1910,22 @@ limit_manager_t::limit_manager_t(
     }
 
     guarantee(item_queue.size() == 0);
-    for (const auto &pair : item_vec) {
-        bool inserted = item_queue.insert(pair).second;
+    for (auto &&pair : item_vec) {
+        bool inserted = item_queue.insert(std::move(pair)).second;
         guarantee(inserted);
     }
-    send(msg_t(msg_t::limit_start_t(uuid, std::move(item_vec))));
+    // The client only gets the top `spec.limit`, the rest are spares.
+    std::vector<item_t> start_data;
+    size_t n = std::min(spec.limit, item_queue.size());
+    start_data.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        start_data.push_back(*item_queue.at_rank(i));
+    }
+    send(msg_t(msg_t::limit_start_t(uuid, std::move(start_data))));
+}
+
+size_t limit_manager_t::capacity(size_t limit) {
+    return limit + std::min<size_t>(limit, CHANGEFEED_LIMIT_SPARE_ITEMS);
 }
 
 void limit_manager_t::add(
@@ -950,13 +1973,15 @@ public:
                   const keyspec_t::limit_t *_spec,
                   sorting_t _sorting,
                   boost::optional<item_t> _start,
-                  const item_queue_t *_item_queue)
+                  size_t _n,
+                  const limit_queue_t *_item_queue)
         : env(_env),
           ops(_ops),
           pk_range(_pk_range),
           spec(_spec),
           sorting(_sorting),
           start(std::move(_start)),
+          n(_n),
           item_queue(_item_queue) { }
 
     std::vector<item_t> operator()(const primary_ref_t &ref) {
@@ -980,7 +2005,6 @@ public:
         case sorting_t::UNORDERED: // fallthru
         default: unreachable();
         }
-        size_t n = spec->limit - item_queue->size();
         rdb_rget_slice(
             ref.btree,
             region_t(),
@@ -1035,7 +2059,7 @@ public:
                 [](const datum_range_t &) { return true; },
                 [](const std::map<datum_t, uint64_t> &) { return false; }));
         datum_range_t srange = spec->range.datumspec.covering_range();
-        size_t n = spec->limit - item_queue->size();
+        size_t to_read = n;
         if (start) {
             datum_t dstart = start->second.first;
             switch (sorting) {
@@ -1050,11 +2074,11 @@ public:
             }
 
             // Because we're using closed bounds, we have to make sure to read enough.
-            for (const auto &pair : *item_queue) {
-                if (pair->second.first != dstart) {
+            for (const auto &item : *item_queue) {
+                if (item.second.first != dstart) {
                     break;
                 }
-                n += 1;
+                to_read += 1;
             }
         }
         reql_version_t reql_version =
@@ -1070,7 +2094,7 @@ public:
             std::vector<transform_variant_t>(),
             boost::optional<terminal_variant_t>(limit_read_t{
                     is_primary_t::NO,
-                    n,
+                    to_read,
                     // This code uses the same generic code path as a normal
                     // read, and a normal read needs to keep track of the
                     // region and last seen key for unsharding, but we
@@ -1112,15 +2136,17 @@ private:
     const keyspec_t::limit_t *spec;
     sorting_t sorting;
     boost::optional<item_t> start;
-    const item_queue_t *item_queue;
+    size_t n;
+    const limit_queue_t *item_queue;
 };
 
 std::vector<item_t> limit_manager_t::read_more(
     const boost::variant<primary_ref_t, sindex_ref_t> &ref,
-    const boost::optional<item_t> &start) {
-    guarantee(item_queue.size() < spec.limit);
+    const boost::optional<item_t> &start,
+    size_t n) {
     ref_visitor_t visitor(
-        env.get(), &ops, &region.inner, &spec, spec.range.sorting, start, &item_queue);
+        env.get(), &ops, &region.inner, &spec, spec.range.sorting, start, n,
+        &item_queue);
     return boost::apply_visitor(visitor, ref);
 }
 
@@ -1132,62 +2158,57 @@ void limit_manager_t::commit(
         return;
     }
 
-    // Before we delete anything, we get the boundary between the active set and
-    // the data that didn't make it into the set.  Anything <= that according to
-    // our ordering could never be kicked out of the set because of a read from
-    // disk.
-    boost::optional<item_t> active_boundary;
-    auto item_queue_it = item_queue.begin();
-    if (item_queue_it != item_queue.end()) {
-        active_boundary = **item_queue_it;
+    // Before we change anything, we remember the worst item the client has, so that
+    // we can tell what it had afterwards, and the worst item we have.  If we don't
+    // have everything, anything worse than that might be beaten by something on
+    // disk, so we leave it there.
+    const size_t limit = spec.limit;
+    boost::optional<item_t> threshold;
+    if (item_queue.size() >= limit && limit != 0) {
+        threshold = *item_queue.at_rank(limit - 1);
     }
+    boost::optional<item_t> boundary;
+    if (!complete && item_queue.size() != 0) {
+        boundary = *item_queue.begin();
+    }
+    auto was_active = [&](const item_t &item) {
+        return limit != 0 && (!threshold || !gt(item, *threshold));
+    };
 
-    item_queue_t real_added(gt);
+    std::map<std::string, std::pair<datum_t, datum_t> > real_added;
     std::set<std::string> real_deleted;
     for (const auto &id : deleted) {
-        bool data_deleted = item_queue.del_id(id);
-        if (data_deleted) {
-            bool inserted = real_deleted.insert(id).second;
-            guarantee(inserted);
+        auto it = item_queue.find_id(id);
+        if (it != item_queue.end()) {
+            if (was_active(*it)) {
+                bool inserted = real_deleted.insert(id).second;
+                guarantee(inserted);
+            }
+            item_queue.erase(it);
         }
     }
     deleted.clear();
-    bool added_on_disk = false;
+    std::set<std::string> inserted_ids;
     for (const auto &pair : added) {
-        // We only add to the set if we know we beat anything that might be read
-        // off of disk below.  This is fine because if the resulting set is
-        // still too small, and the things we didn't add happen to beat the
-        // other things in the table, we'll read them first.
-        if (!(active_boundary && gt(item_t(pair), *active_boundary))) {
-            bool inserted = item_queue.insert(pair).second;
+        item_t item(pair);
+        // If something better is on disk we'll read it below before this anyway.
+        if (!(boundary && gt(item, *boundary))) {
+            bool inserted = item_queue.insert(std::move(item)).second;
             // We can never get two additions for the same key without a deletion
             // in-between.
             guarantee(inserted);
-            inserted = real_added.insert(pair).second;
-            guarantee(inserted);
-        } else {
-            added_on_disk = true;
+            inserted_ids.insert(pair.first);
         }
     }
     added.clear();
 
-    std::vector<std::string> truncated = item_queue.truncate_top(spec.limit);
-    for (auto &&id : truncated) {
-        auto it = real_added.find_id(id);
-        if (it != real_added.end()) {
-            real_added.erase(it);
-        } else {
-            bool inserted = real_deleted.insert(std::move(id)).second;
-            guarantee(inserted);
-        }
-    }
-
-    bool anything_on_disk = real_deleted.size() != 0 || added_on_disk;
-    if (item_queue.size() < spec.limit && anything_on_disk) {
+    // We only go to disk once we've run out of spare items.
+    if (item_queue.size() < limit && !complete) {
+        size_t n = capacity(limit) - item_queue.size();
         std::vector<item_t> s;
         boost::optional<exc_t> exc;
         try {
-            s = read_more(sindex_ref, active_boundary);
+            s = read_more(sindex_ref, boundary, n);
         } catch (const exc_t &e) {
             exc = e;
         }
@@ -1197,35 +2218,69 @@ void limit_manager_t::commit(
             abort(*exc);
             return;
         }
-        for (auto &&pair : s) {
-            bool inserted = item_queue.insert(pair).second;
+        complete = s.size() < n;
+        for (auto &&item : s) {
+            std::string id = item.first;
             // Reading duplicates from disk is fine.
-            if (inserted) {
-                bool added_insert = real_added.insert(pair).second;
-                guarantee(added_insert);
-            }
-        }
-        // We need to truncate again because `read_more` may read too much in
-        // the secondary index case.
-        std::vector<std::string> read_trunc = item_queue.truncate_top(spec.limit);
-        for (auto &&id : read_trunc) {
-            auto it = real_added.find_id(id);
-            if (it != real_added.end()) {
-                real_added.erase(it);
-            } else {
-                bool inserted = real_deleted.insert(std::move(id)).second;
+            if (item_queue.insert(std::move(item)).second) {
+                inserted_ids.insert(std::move(id));
+            }
+        }
+    }
+
+    // Now we work out how the top `limit` items changed.  Everything we inserted
+    // that made it in is new to the client, ...
+    for (const auto &id : inserted_ids) {
+        auto it = item_queue.find_id(id);
+        guarantee(it != item_queue.end());
+        if (item_queue.rank(it) < limit) {
+            bool inserted = real_added.insert(
+                std::make_pair(it->first, it->second)).second;
+            guarantee(inserted);
+        }
+    }
+    if (item_queue.size() > limit) {
+        // ... anything the client had that got pushed out by them is gone, ...
+        for (auto it = item_queue.at_rank(limit);; --it) {
+            if (!was_active(*it)) {
+                break;
+            }
+            if (inserted_ids.count(it->first) == 0) {
+                bool inserted = real_deleted.insert(it->first).second;
                 guarantee(inserted);
             }
+            if (it == item_queue.begin()) {
+                break;
+            }
         }
     }
+    if (threshold && item_queue.size() != 0) {
+        // ... and anything we already had that moved up to replace deleted items is
+        // new to the client too.
+        auto it = item_queue.at_rank(std::min(limit, item_queue.size()) - 1);
+        for (; it != item_queue.end() && gt(*it, *threshold); ++it) {
+            if (inserted_ids.count(it->first) == 0) {
+                bool inserted = real_added.insert(
+                    std::make_pair(it->first, it->second)).second;
+                guarantee(inserted);
+            }
+        }
+    }
+
+    // `read_more` may read too much in the secondary index case, and the writes
+    // may have added too much.
+    if (item_queue.truncate_top(capacity(limit)).size() != 0) {
+        complete = false;
+    }
+
     std::set<std::string> remaining_deleted;
     for (auto &&id : real_deleted) {
-        auto it = real_added.find_id(id);
+        auto it = real_added.find(id);
         if (it != real_added.end()) {
             msg_t::limit_change_t msg;
             msg.sub = uuid;
             msg.old_key = id;
-            msg.new_val = std::move(**it);
+            msg.new_val = item_t(std::move(*it));
             real_added.erase(it);
             send(msg_t(std::move(msg)));
         } else {
@@ -1240,16 +2295,16 @@ void limit_manager_t::commit(
         msg.old_key = id;
         auto it = real_added.begin();
         if (it != real_added.end()) {
-            msg.new_val = std::move(**it);
+            msg.new_val = item_t(std::move(*it));
             real_added.erase(it);
         }
         send(msg_t(std::move(msg)));
     }
 
-    for (auto &&it : real_added) {
+    for (auto &&pair : real_added) {
         msg_t::limit_change_t msg;
         msg.sub = uuid;
-        msg.new_val = std::move(*it);
+        msg.new_val = item_t(std::move(pair));
         send(msg_t(std::move(msg)));
     }
     real_added.clear();
@@ -1267,9 +2322,11 @@ RDB_IMPL_SERIALIZABLE_3(msg_t::limit_change_t, sub, old_key, new_val);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::limit_change_t);
 RDB_IMPL_SERIALIZABLE_2(msg_t::limit_stop_t, sub, exc);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::limit_stop_t);
-RDB_IMPL_SERIALIZABLE_5(
+RDB_IMPL_SERIALIZABLE_2(msg_t::sub_change_t, old_val, new_val);
+INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::sub_change_t);
+RDB_IMPL_SERIALIZABLE_7(
     msg_t::change_t,
-    old_indexes, new_indexes, pkey, old_val, new_val);
+    old_indexes, new_indexes, pkey, old_val, new_val, sub_changes, journal_seq);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::change_t);
 RDB_IMPL_SERIALIZABLE_0_SINCE_v1_13(msg_t::stop_t);
 
@@ -1563,7 +2620,8 @@ public:
         const store_key_t &pkey,
         const boost::optional<std::string> &DEBUG_ONLY(sindex),
         boost::optional<indexed_datum_t> old_val,
-        boost::optional<indexed_datum_t> new_val) {
+        boost::optional<indexed_datum_t> new_val,
+        const boost::optional<uint64_t> &journal_seq) {
         if (!active()) return;
         auto stamp_pair = std::make_pair(shard_uuid, stamp);
         if (stamp_pair == last_stamp || update_stamp(shard_uuid, stamp)) {
@@ -1571,14 +2629,17 @@ public:
             // update step and always pass it through.  (This supports cases
             // like `.get_all(1, 1)`).
             last_stamp = stamp_pair;
-            queue->add(change_val_t(
+            change_val_t change_val(
                 std::make_pair(shard_uuid, stamp),
                 pkey,
                 old_val,
                 new_val
-                DEBUG_ONLY(, sindex)));
-            if (queue->size() > limits.changefeed_queue_size()) {
-                skipped += queue->size();
+                DEBUG_ONLY(, sindex));
+            change_val.journal_seq = journal_seq;
+            queue->add(std::move(change_val));
+            size_t queued = queue->size() + queue->spilled_size();
+            if (queued > limits.changefeed_queue_size() + queue->spill_limit()) {
+                skipped += queued;
                 queue->clear();
             } else if (queue->size() > limits.changefeed_queue_size() / 2) {
                 // We do this even if the queue is only half full because we
@@ -1644,6 +2705,9 @@ public:
     bool can_be_removed();
 
     virtual void abort_feed() = 0;
+    // Drops the server-side state of a range or point subscription that
+    // registered itself with its stamp read.
+    virtual void unregister_sub(const uuid_u &sub_uuid) = 0;
     void stop_subs(const auto_drainer_t::lock_t &lock);
     void mark_detached() { detached = true; }
 
@@ -1744,20 +2808,22 @@ public:
 
     client_t::addr_t get_addr() const;
     void abort_feed() final { aborted.pulse_if_not_already_pulsed(); }
+    void unregister_sub(const uuid_u &sub_uuid) final;
     virtual auto_drainer_t::lock_t get_drainer_lock() { return drainer.lock(); }
 private:
     virtual void maybe_remove_feed() { client->maybe_remove_feed(client_lock, table_id); }
     virtual void stop_limit_sub(limit_sub_t *sub);
 
-    void mailbox_cb(signal_t *interruptor, stamped_msg_t msg);
+    void mailbox_cb(signal_t *interruptor, stamped_msgs_t msgs);
     void constructor_cb();
 
     auto_drainer_t::lock_t client_lock;
     client_t *client;
     namespace_id_t table_id;
     mailbox_manager_t *manager;
-    mailbox_t<void(stamped_msg_t)> mailbox;
+    mailbox_t<void(stamped_msgs_t)> mailbox;
     std::vector<server_t::addr_t> stop_addrs;
+    std::vector<server_t::sub_stop_addr_t> sub_stop_addrs;
     std::vector<scoped_ptr_t<disconnect_watcher_t> > disconnect_watchers;
 
     struct queue_t {
@@ -1813,6 +2879,7 @@ real_feed_t::real_feed_t(auto_drainer_t::lock_t _client_lock,
         for (auto it = resp->addrs.begin(); it != resp->addrs.end(); ++it) {
             stop_addrs.push_back(std::move(*it));
         }
+        sub_stop_addrs.assign(resp->sub_stop_addrs.begin(), resp->sub_stop_addrs.end());
 
         std::set<peer_id_t> peers;
         for (auto it = stop_addrs.begin(); it != stop_addrs.end(); ++it) {
@@ -1863,6 +2930,12 @@ client_t::addr_t real_feed_t::get_addr() const {
     return mailbox.get_address();
 }
 
+void real_feed_t::unregister_sub(const uuid_u &sub_uuid) {
+    for (const auto &addr : sub_stop_addrs) {
+        send(manager, addr, mailbox.get_address(), sub_uuid);
+    }
+}
+
 void real_feed_t::constructor_cb() {
     auto lock = make_scoped<auto_drainer_t::lock_t>(&drainer);
     {
@@ -1997,6 +3070,8 @@ public:
                      _include_states,
                      _include_types),
           pkey(std::move(_pkey)),
+          uuid(generate_uuid()),
+          registered(false),
           stamp(0),
           started(false),
           state(state_t::INITIALIZING),
@@ -2005,8 +3080,12 @@ public:
         _feed->add_point_sub(this, store_key_t(pkey.print_primary()));
     }
     virtual ~point_sub_t() {
-        destructor_cleanup(std::bind(&feed_t::del_point_sub, feed, this,
-                                     store_key_t(pkey.print_primary())));
+        destructor_cleanup([this]() {
+                if (registered) {
+                    feed->unregister_sub(uuid);
+                }
+                feed->del_point_sub(this, store_key_t(pkey.print_primary()));
+            });
     }
     feed_type_t cfeed_type() const final { return feed_type_t::point; }
 
@@ -2068,10 +3147,24 @@ public:
             state = state_t::READY;
         }
 
+        store_key_t store_key(pkey.print_primary());
+        // We mark ourselves as registered before the read so that we still
+        // unregister if it only fails on the way back.
+        registered = true;
         read_response_t read_resp;
         nif->read(
             env->get_user_context(),
-            read_t(changefeed_point_stamp_t{addr, store_key_t(pkey.print_primary())},
+            read_t(changefeed_point_stamp_t{
+                       addr,
+                       store_key,
+                       sub_registration_t{
+                           uuid,
+                           store_key,
+                           env->get_all_optargs(),
+                           env->get_user_context(),
+                           env->get_deterministic_time(),
+                           false,
+                           std::map<uuid_u, uint64_t>()}},
                    profile_bool_t::DONT_PROFILE, read_mode_t::SINGLE),
             &read_resp,
             order_token_t::ignore,
@@ -2145,6 +3238,8 @@ public:
     }
 private:
     datum_t pkey;
+    const uuid_u uuid;
+    bool registered;
     boost::optional<change_val_t> initial_val;
     uint64_t stamp;
     bool started;
@@ -2174,6 +3269,9 @@ public:
                 const datum_t &_squash,
                 bool _include_states,
                 bool _include_types,
+                bool _include_resume_tokens,
+                std::map<uuid_u, uint64_t> _resume_from,
+                size_t _spill_size,
                 env_t *outer_env,
                 keyspec_t::range_t _spec)
         // We don't turn on squashing until later for range subs.  (We need to
@@ -2186,6 +3284,12 @@ public:
                      _squash,
                      _include_states,
                      _include_types),
+          uuid(generate_uuid()),
+          registered(false),
+          include_resume_tokens(_include_resume_tokens),
+          resume_from(std::move(_resume_from)),
+          spill_size(_spill_size),
+          spill_context(_rdb_context),
           spec(std::move(_spec)),
           state(state_t::READY),
           sent_state(state_t::NONE),
@@ -2198,11 +3302,22 @@ public:
         if (!store_keys) {
             store_key_range = spec.datumspec.covering_range().to_primary_keyrange();
         }
+        if (spill_size != 0) {
+            spill_stats.init(
+                new spill_stats_t(&spill_context->stats.qe_stats_collection, uuid));
+        }
         _feed->add_range_sub(this);
     }
     feed_type_t cfeed_type() const final { return feed_type_t::stream; }
     virtual ~range_sub_t() {
-        destructor_cleanup(std::bind(&feed_t::del_range_sub, feed, this));
+        destructor_cleanup([this]() {
+                if (registered) {
+                    feed->unregister_sub(uuid);
+                }
+                feed->del_range_sub(this);
+            });
+        // A `spilling_queue_t` has to stop using `spill_stats` first.
+        queue.reset();
     }
     boost::optional<std::string> sindex() const { return spec.sindex; }
     size_t copies(const datum_t &sindex_key) const {
@@ -2282,10 +3397,30 @@ public:
                 vals_to_change(datum_t(), d, true),
                 change_type_t::INITIAL);
         }
-        return change_val_to_change(pop_change_val(),
-                                    false,
-                                    false,
-                                    include_types);
+        change_val_t cv = pop_change_val();
+        datum_t change = change_val_to_change(cv, false, false, include_types);
+        if (!include_resume_tokens) {
+            return change;
+        }
+        if (cv.journal_seq) {
+            journal_positions[cv.source_stamp.first] = *cv.journal_seq;
+        }
+        if (!change.has()) {
+            return change;
+        }
+        // The token covers every server, so that a feed resumed from it knows
+        // where to start on the servers it hasn't seen a change from.
+        std::map<datum_string_t, datum_t> token;
+        for (const auto &pair : journal_positions) {
+            token[datum_string_t(uuid_to_str(pair.first))] =
+                datum_t(static_cast<double>(pair.second));
+        }
+        return change.merge(
+            datum_t{
+                std::map<datum_string_t, datum_t>{
+                    std::pair<datum_string_t, datum_t>{
+                        datum_string_t("resume_token"),
+                        datum_t(std::move(token))}}});
     }
     bool has_el() final {
         return (include_states && state != sent_state)
@@ -2303,6 +3438,22 @@ public:
         }
     }
 
+    // Like squashing, this waits until we've purged, which a `spilling_queue_t`
+    // can't do.
+    void maybe_enable_spilling() {
+        if (spill_stats.has()) {
+            queue = make_scoped<spilling_queue_t>(
+                std::move(queue),
+                limits.changefeed_queue_size(),
+                spill_size,
+                spill_context->io_backender,
+                serializer_filepath_t(
+                    spill_context->base_path, "changefeed_spill_" + uuid_to_str(uuid)),
+                spill_stats.get(),
+                [this]() { maybe_signal_cond(); });
+        }
+    }
+
     counted_t<datum_stream_t> to_stream(
         env_t *outer_env,
         std::string,
@@ -2314,11 +3465,22 @@ public:
         assert_thread();
         r_sanity_check(self.get() == this);
 
+        changefeed_stamp_t stamp(addr);
+        stamp.registration = sub_registration_t{
+            uuid,
+            spec,
+            outer_env->get_all_optargs(),
+            outer_env->get_user_context(),
+            outer_env->get_deterministic_time(),
+            include_resume_tokens,
+            resume_from};
+        // See the comment in `point_sub_t::to_stream`.
+        registered = true;
         read_response_t read_resp;
         // Note that we use the `outer_env`'s interruptor for the read.
         nif->read(
             outer_env->get_user_context(),
-            read_t(changefeed_stamp_t(addr),
+            read_t(std::move(stamp),
                    profile_bool_t::DONT_PROFILE,
                    read_mode_t::SINGLE),
             &read_resp, order_token_t::ignore, outer_env->interruptor);
@@ -2344,6 +3506,30 @@ public:
         queue->purge_below(purge_stamps);
         rcheck_datum(orig_stamps.size() != 0, base_exc_t::RESUMABLE_OP_FAILED,
                      "Empty start stamps.  Did you just reshard?");
+        if (include_resume_tokens) {
+            for (const auto &pair : *resp->stamp_infos) {
+                guarantee(pair.second.journal_pos);
+                rcheck_datum(pair.second.journal_pos->complete,
+                             base_exc_t::OP_FAILED,
+                             "Cannot resume the changefeed, because the changes since "
+                             "the resume token are no longer available.  (Did you "
+                             "reshard or restart a server, or wait longer than the "
+                             "changefeed journal retention?)");
+                // Until we've returned the replayed changes we're still where the
+                // token we resumed from was.
+                auto resume_it = resume_from.find(pair.first);
+                journal_positions[pair.first] = resume_it != resume_from.end()
+                    ? resume_it->second
+                    : pair.second.journal_pos->seq;
+            }
+            for (const auto &pair : resume_from) {
+                rcheck_datum(resp->stamp_infos->count(pair.first) != 0,
+                             base_exc_t::OP_FAILED,
+                             "Cannot resume the changefeed, because the resume token "
+                             "is for servers that no longer serve this table.  (Did "
+                             "you reshard or restart a server?)");
+            }
+        }
 
         if (maybe_src) {
             // Nothing can happen between constructing the new `scoped_ptr_t` and
@@ -2356,6 +3542,7 @@ public:
             return make_splice_stream(maybe_src, std::move(sub_self), bt);
         } else {
             maybe_enable_squashing();
+            maybe_enable_spilling();
             return make_counted<stream_t<subscription_t> >(std::move(self), bt);
         }
     }
@@ -2368,6 +3555,10 @@ public:
         backtrace_id_t bt) {
         assert_thread();
         r_sanity_check(self.get() == this);
+        rcheck_src(bt, !include_resume_tokens, base_exc_t::LOGIC,
+                   "Resume tokens are not supported on system tables.");
+        rcheck_src(bt, spill_size == 0, base_exc_t::LOGIC,
+                   "Changefeeds on system tables can't spill to disk.");
 
         artificial_include_initial = include_initial;
 
@@ -2390,6 +3581,7 @@ public:
     }
     const std::map<uuid_u, uint64_t> &get_next_stamps() { return next_stamps; }
     const std::map<uuid_u, uint64_t> &get_orig_stamps() { return orig_stamps; }
+    const uuid_u &get_uuid() const { return uuid; }
 private:
     scoped_ptr_t<env_t> make_env(env_t *outer_env) {
         // This is to support fake environments from the unit tests that don't
@@ -2412,6 +3604,21 @@ private:
     scoped_ptr_t<env_t> env;
     std::vector<scoped_ptr_t<op_t> > ops;
 
+    // Identifies us to the `server_t`s we registered with in `to_stream`.
+    const uuid_u uuid;
+    bool registered;
+
+    // See `change_journal_t`.  `journal_positions` is what we put in the resume
+    // token of the next change we return.
+    const bool include_resume_tokens;
+    const std::map<uuid_u, uint64_t> resume_from;
+    std::map<uuid_u, uint64_t> journal_positions;
+
+    // See `spilling_queue_t`.  `spill_stats` is only set if we may spill.
+    const size_t spill_size;
+    rdb_context_t *const spill_context;
+    scoped_ptr_t<spill_stats_t> spill_stats;
+
     // The stamp (see `stamped_msg_t`) associated with our `changefeed_stamp_t`
     // read.  We use these to make sure we don't see changes from writes before
     // our subscription.
@@ -2456,7 +3663,6 @@ public:
           spec(std::move(_spec)),
           gt(limit_order_t(spec.range.sorting)),
           item_queue(gt),
-          active_data(gt),
           include_initial(false),
           include_offsets(_include_offsets) {
         _feed->add_limit_sub(this, uuid);
@@ -2476,13 +3682,13 @@ public:
             if (include_initial) {
                 if (include_states) els.push_back(maybe_add_type(initializing_datum(),
                                                                  change_type_t::STATE));
-                size_t i = 0;
-                for (auto it = active_data.rbegin(); it != active_data.rend(); ++it) {
+                size_t n = std::min(spec.limit, item_queue.size());
+                for (size_t i = 0; i < n; ++i) {
                     std::map<datum_string_t, datum_t> m;
-                    m[datum_string_t("new_val")] = (**it)->second.second;
+                    m[datum_string_t("new_val")] = item_queue.at_rank(i)->second.second;
                     if (include_offsets) {
                         m[datum_string_t("new_offset")] =
-                            datum_t(static_cast<double>(i++));
+                            datum_t(static_cast<double>(i));
                     }
                     els.push_back(maybe_add_type(datum_t(std::move(m)),
                                                  change_type_t::INITIAL));
@@ -2565,19 +3771,8 @@ public:
 #endif
         got_init += 1;
         for (const auto &pair : start_data) {
-            auto it = item_queue.insert(pair).first;
-            active_data.insert(it);
-            if (active_data.size() > spec.limit) {
-                auto old_ft = active_data.begin();
-                for (auto ft = active_data.begin(); ft != active_data.end(); ++ft) {
-                    old_ft = ft;
-                }
-                size_t erased = active_data.erase(*active_data.begin());
-                guarantee(erased == 1);
-            }
-            guarantee(active_data.size() == spec.limit
-                      || (active_data.size() < spec.limit
-                          && active_data.size() == item_queue.size()));
+            bool inserted = item_queue.insert(pair).second;
+            guarantee(inserted);
         }
         maybe_start();
     }
@@ -2624,101 +3819,56 @@ public:
         }
     }
 
-    template<class T>
-    boost::optional<size_t> slow_active_offset(const T &it) {
-        size_t i = 0;
-        for (auto ft = active_data.begin();
-             ft != active_data.end();
-             ++ft, ++i) {
-            if (*ft == it) {
-                return active_data.size() - (i + 1);
-            }
-        }
-        return boost::none;
-    }
-
+    // The active data is always the best `spec.limit` items in `item_queue`, so
+    // an item's offset is just its rank.
     limit_change_t note_change_impl(
         const boost::optional<std::string> &old_key,
         const boost::optional<item_t> &new_val) {
         ASSERT_NO_CORO_WAITING;
 
+        const size_t limit = spec.limit;
         boost::optional<item_t> old_send, new_send;
         boost::optional<size_t> old_offset, new_offset;
         if (old_key) {
             auto it = item_queue.find_id(*old_key);
             guarantee(it != item_queue.end());
-            if (include_offsets) {
-                old_offset = slow_active_offset(it);
-            }
-            size_t erased = active_data.erase(it);
-            if (erased != 0) {
+            size_t rank = item_queue.rank(it);
+            if (rank < limit) {
                 // The old value was in the set.
+                old_send = *it;
                 if (include_offsets) {
-                    guarantee(old_offset);
-                }
-                old_send = **it;
-            } else {
-                if (include_offsets) {
-                    guarantee(!old_offset);
+                    old_offset = rank;
                 }
             }
             item_queue.erase(it);
         }
         if (new_val) {
             auto pair = item_queue.insert(*new_val);
-            auto it = pair.first;
             guarantee(pair.second);
-            bool insert;
-            if (active_data.size() == 0) {
-                insert = false;
-            } else {
-                guarantee(active_data.size() != 0);
-                insert = !gt(it, *active_data.begin());
-            }
-            if (insert) {
-                // The new value is in the old set bounds (and thus in the set).
-                active_data.insert(it);
+            size_t rank = item_queue.rank(pair.first);
+            if (rank < limit) {
+                // The new value is in the set.
+                new_send = *pair.first;
                 if (include_offsets) {
-                    new_offset = slow_active_offset(it);
-                    guarantee(new_offset);
+                    new_offset = rank;
                 }
-                new_send = **it;
             }
         }
-        if (active_data.size() > spec.limit) {
-            // The old value wasn't in the set, but the new value is, and a
-            // value has to leave the set to make room.
-            auto last = *active_data.begin();
-            guarantee(new_send && !old_send && !old_offset);
+        if (new_send && !old_send && item_queue.size() > limit) {
+            // The old value wasn't in the set, but the new value is, so the value
+            // that used to be last had to leave the set to make room.
+            old_send = *item_queue.at_rank(limit);
             if (include_offsets) {
-                // We subtract two here because `new_val` was already inserted.
-                old_offset = active_data.size() - 2;
-            }
-            old_send = **last;
-            active_data.erase(last);
-        } else if (active_data.size() < spec.limit) {
-            // The set is too small.
-            if (new_send) {
-                // The set is too small because there aren't enough rows in the table.
-                guarantee(active_data.size() == item_queue.size());
-            } else if (active_data.size() < item_queue.size()) {
-                // The set is too small because the new value wasn't in the old
-                // set bounds, so we need to add the next best element.
-                auto it = active_data.size() == 0
-                    ? item_queue.end()
-                    : *active_data.begin();
-
-                guarantee(it != item_queue.begin());
-                --it;
-                active_data.insert(it);
-                if (include_offsets) {
-                    new_offset = active_data.size() - 1;
-                }
-                new_send = **it;
+                old_offset = limit - 1;
+            }
+        } else if (old_send && !new_send && item_queue.size() >= limit) {
+            // The old value left the set and the new value didn't take its place,
+            // so the next best value moves up to become the last one.
+            new_send = *item_queue.at_rank(limit - 1);
+            if (include_offsets) {
+                new_offset = limit - 1;
             }
         }
-        guarantee(active_data.size() == spec.limit
-                  || active_data.size() == item_queue.size());
 
         datum_t old_d = old_send ? (*old_send).second.second : datum_t();
         datum_t new_d = new_send ? (*new_send).second.second : datum_t();
@@ -2798,10 +3948,9 @@ public:
     keyspec_t::limit_t spec;
 
     limit_order_t gt;
-    item_queue_t item_queue;
-    typedef item_queue_t::iterator data_it_t;
-    typedef std::function<bool(const data_it_t &, const data_it_t &)> data_it_lt_t;
-    std::set<data_it_t, data_it_lt_t> active_data;
+    // The union of the best items on each shard, the best `spec.limit` of which
+    // are the active data.
+    limit_queue_t item_queue;
 
     std::deque<datum_t> els;
     std::vector<std::pair<boost::optional<std::string>, boost::optional<item_t> > >
@@ -2854,7 +4003,18 @@ public:
             datum_t new_val = null, old_val = null;
             if (!sub->active()) return;
             bool trivial = false;
-            if (sub->has_ops()) {
+            if (sub->has_ops() && change.sub_changes) {
+                // The server already applied our transforms.
+                auto it = change.sub_changes->find(sub->get_uuid());
+                if (it == change.sub_changes->end()) return;
+                if (it->second.new_val.has()) {
+                    new_val = it->second.new_val;
+                }
+                if (it->second.old_val.has()) {
+                    old_val = it->second.old_val;
+                }
+                trivial = (new_val == old_val);
+            } else if (sub->has_ops()) {
                 if (change.new_val.has()) {
                     if (boost::optional<datum_t> d = sub->apply_ops(change.new_val)) {
                         new_val = *d;
@@ -2872,12 +4032,28 @@ public:
                 // values might have changed.
                 trivial = (new_val == old_val);
             } else {
-                guarantee(change.old_val.has() || change.new_val.has());
-                if (change.new_val.has()) {
-                    new_val = change.new_val;
+                const msg_t::sub_change_t *replayed = nullptr;
+                if (change.sub_changes) {
+                    // A change the server replays from its journal only has an
+                    // entry for the subscription that resumes.
+                    auto it = change.sub_changes->find(sub->get_uuid());
+                    if (it != change.sub_changes->end()) {
+                        replayed = &it->second;
+                    } else if (!change.has_vals()) {
+                        // The server only sent this change for other subscriptions.
+                        return;
+                    }
                 }
-                if (change.old_val.has()) {
-                    old_val = change.old_val;
+                const datum_t &raw_new = replayed != nullptr
+                    ? replayed->new_val : change.new_val;
+                const datum_t &raw_old = replayed != nullptr
+                    ? replayed->old_val : change.old_val;
+                guarantee(raw_old.has() || raw_new.has());
+                if (raw_new.has()) {
+                    new_val = raw_new;
+                }
+                if (raw_old.has()) {
+                    old_val = raw_old;
                 }
             }
             ASSERT_NO_CORO_WAITING;
@@ -2904,7 +4080,8 @@ public:
                     if (!trivial) {
                         sub->add_el(server_uuid, stamp, change.pkey, sindex,
                                     std::move(old_idxs.back()),
-                                    std::move(new_idxs.back()));
+                                    std::move(new_idxs.back()),
+                                    change.journal_seq);
                     }
                     old_idxs.pop_back();
                     new_idxs.pop_back();
@@ -2914,7 +4091,8 @@ public:
                     if (old_val != null) {
                         sub->add_el(server_uuid, stamp, change.pkey, sindex,
                                     std::move(old_idxs.back()),
-                                    boost::none);
+                                    boost::none,
+                                    change.journal_seq);
                     }
                     old_idxs.pop_back();
                 }
@@ -2923,7 +4101,8 @@ public:
                     if (new_val != null) {
                         sub->add_el(server_uuid, stamp, change.pkey, sindex,
                                     boost::none,
-                                    std::move(new_idxs.back()));
+                                    std::move(new_idxs.back()),
+                                    change.journal_seq);
                     }
                     new_idxs.pop_back();
                 }
@@ -2932,11 +4111,15 @@ public:
                     for (size_t i = 0; i < sub->copies(change.pkey); ++i) {
                         sub->add_el(server_uuid, stamp, change.pkey, sindex,
                                     indexed_datum_t(old_val, boost::none),
-                                    indexed_datum_t(new_val, boost::none));
+                                    indexed_datum_t(new_val, boost::none),
+                                    change.journal_seq);
                     }
                 }
             }
         });
+        if (!change.has_vals()) {
+            return;
+        }
         feed->on_point_sub(
             change.pkey,
             *lock,
@@ -2954,7 +4137,8 @@ public:
                 change.new_val.has()
                     ? boost::optional<indexed_datum_t>(
                         indexed_datum_t(change.new_val, boost::none))
-                    : boost::none));
+                    : boost::none,
+                boost::optional<uint64_t>()));
     }
     void operator()(const msg_t::stop_t &) const {
         feed->abort_feed();
@@ -2976,7 +4160,7 @@ void msg_visit(feed_t *feed,
     feed->update_stamps(server_uuid, stamp);
 }
 
-void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
+void real_feed_t::mailbox_cb(signal_t *, stamped_msgs_t msgs) {
     // We stop receiving messages when detached (we're only receiving
     // messages because we haven't managed to get a message to the
     // stop mailboxes for some of the primary replicas yet).  This also stops
@@ -2993,7 +4177,7 @@ void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
         if (!lock.get_drain_signal()->is_pulsed()) {
             // We don't need a lock for this because the set of `uuid_u`s never
             // changes after it's initialized.
-            auto it = queues.find(msg.server_uuid);
+            auto it = queues.find(msgs.server_uuid);
             guarantee(it != queues.end());
             queue_t *queue = it->second.get();
             guarantee(queue != NULL);
@@ -3003,8 +4187,12 @@ void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
             if (detached) return;
 
             // Add us to the queue.
-            guarantee(msg.stamp >= queue->next);
-            queue->map.push(std::move(msg));
+            guarantee(msgs.first_stamp >= queue->next);
+            for (size_t i = 0; i < msgs.msgs.size(); ++i) {
+                queue->map.push(stamped_msg_t(msgs.server_uuid,
+                                              msgs.first_stamp + i,
+                                              std::move(msgs.msgs[i])));
+            }
 
             // Read as much as we can from the queue (this enforces ordering.)
             while (queue->map.size() != 0 && queue->map.top().stamp == queue->next) {
@@ -3224,6 +4412,7 @@ private:
                 }
             }
             sub->maybe_enable_squashing();
+            sub->maybe_enable_spilling();
             cached_ready = true;
         }
         return cached_ready;
@@ -3438,6 +4627,10 @@ RDB_MAKE_SERIALIZABLE_4_FOR_CLUSTER(
 RDB_MAKE_SERIALIZABLE_0_FOR_CLUSTER(keyspec_t::empty_t);
 RDB_MAKE_SERIALIZABLE_2_FOR_CLUSTER(keyspec_t::limit_t, range, limit);
 RDB_MAKE_SERIALIZABLE_1_FOR_CLUSTER(keyspec_t::point_t, key);
+RDB_MAKE_SERIALIZABLE_7_FOR_CLUSTER(
+    sub_registration_t,
+    sub, spec, optargs, user_context, deterministic_time, journal, resume_from);
+RDB_MAKE_SERIALIZABLE_2_FOR_CLUSTER(journal_pos_t, seq, complete);
 
 void feed_t::add_sub_with_lock(
     rwlock_t *rwlock, const std::function<void()> &f) THROWS_NOTHING {
@@ -3777,6 +4970,22 @@ scoped_ptr_t<subscription_t> new_sub(
         subscription_t *operator()(const keyspec_t::range_t &range) const {
             rcheck_datum(!ss->include_offsets, base_exc_t::LOGIC,
                          "Cannot include offsets for range subs.");
+            if (ss->include_resume_tokens) {
+                // The tokens are only exact if every change is returned on its own
+                // and in the order the servers sent them.
+                rcheck_datum(!ss->maybe_src.has(), base_exc_t::LOGIC,
+                             "Cannot include resume tokens with `include_initial`.");
+                rcheck_datum(ss->squash.get_type() == datum_t::R_BOOL
+                             && !ss->squash.as_bool(), base_exc_t::LOGIC,
+                             "Cannot include resume tokens with `squash`.");
+            }
+            if (ss->spill_size != 0) {
+                rdb_context_t *ctx = env->get_rdb_ctx();
+                rcheck_datum(ctx != nullptr && ctx->io_backender != nullptr,
+                             base_exc_t::OP_FAILED,
+                             "Cannot spill changefeed queues to disk on a proxy "
+                             "server.");
+            }
             return new range_sub_t(
                 env->get_rdb_ctx(),
                 env->get_user_context(),
@@ -3785,12 +4994,19 @@ scoped_ptr_t<subscription_t> new_sub(
                 ss->squash,
                 ss->include_states,
                 ss->include_types,
+                ss->include_resume_tokens,
+                ss->resume_from,
+                ss->spill_size,
                 env,
                 range);
         }
         subscription_t *operator()(const keyspec_t::empty_t &) const {
             rcheck_datum(!ss->include_offsets, base_exc_t::LOGIC,
                          "Cannot include offsets for empty subs.");
+            rcheck_datum(!ss->include_resume_tokens, base_exc_t::LOGIC,
+                         "Cannot include resume tokens for empty subs.");
+            rcheck_datum(ss->spill_size == 0, base_exc_t::LOGIC,
+                         "Cannot spill the queue of empty subs to disk.");
             return new empty_sub_t(
                 env->get_rdb_ctx(),
                 env->get_user_context(),
@@ -3801,6 +5017,10 @@ scoped_ptr_t<subscription_t> new_sub(
                 ss->include_types);
         }
         subscription_t *operator()(const keyspec_t::limit_t &limit) const {
+            rcheck_datum(!ss->include_resume_tokens, base_exc_t::LOGIC,
+                         "Cannot include resume tokens for limit subs.");
+            rcheck_datum(ss->spill_size == 0, base_exc_t::LOGIC,
+                         "Cannot spill the queue of limit subs to disk.");
             return new limit_sub_t(
                 env->get_rdb_ctx(),
                 env->get_user_context(),
@@ -3815,6 +5035,10 @@ scoped_ptr_t<subscription_t> new_sub(
         subscription_t *operator()(const keyspec_t::point_t &point) const {
             rcheck_datum(!ss->include_offsets, base_exc_t::LOGIC,
                          "Cannot include offsets for point subs.");
+            rcheck_datum(!ss->include_resume_tokens, base_exc_t::LOGIC,
+                         "Cannot include resume tokens for point subs.");
+            rcheck_datum(ss->spill_size == 0, base_exc_t::LOGIC,
+                         "Cannot spill the queue of point subs to disk.");
             return new point_sub_t(
                 env->get_rdb_ctx(),
                 env->get_user_context(),
@@ -3848,7 +5072,9 @@ streamspec_t::streamspec_t(counted_t<datum_stream_t> _maybe_src,
     include_types(std::move(_include_types)),
     limits(std::move(_limits)),
     squash(std::move(_squash)),
-    spec(std::move(_spec)) { }
+    spec(std::move(_spec)),
+    include_resume_tokens(false),
+    spill_size(0) { }
 
 counted_t<datum_stream_t> client_t::new_stream(
     env_t *env,
@@ -4008,6 +5234,8 @@ public:
     NORETURN virtual void stop_limit_sub(limit_sub_t *) {
         crash("Limit subscriptions are not supported on artificial feeds.");
     }
+    // Artificial subscriptions never register with a `server_t`.
+    void unregister_sub(const uuid_u &) final { }
 private:
     artificial_t *parent;
     auto_drainer_t drainer;
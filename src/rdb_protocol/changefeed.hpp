@@ -15,6 +15,8 @@
 
 #include "btree/keys.hpp"
 #include "clustering/administration/auth/user_context.hpp"
+#include "concurrency/auto_drainer.hpp"
+#include "concurrency/mutex.hpp"
 #include "concurrency/new_mutex.hpp"
 #include "concurrency/promise.hpp"
 #include "concurrency/rwlock.hpp"
@@ -24,22 +26,28 @@
 #include "protocol_api.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/datumspec.hpp"
+#include "rdb_protocol/optargs.hpp"
 #include "rdb_protocol/shards.hpp"
 #include "region/region.hpp"
+#include "region/region_map.hpp"
 #include "repli_timestamp.hpp"
 #include "rpc/connectivity/peer_id.hpp"
 #include "rpc/mailbox/typed.hpp"
 #include "rpc/serialize_macros.hpp"
+#include "time.hpp"
 #include "containers/archive/boost_types.hpp"
 
 class artificial_table_backend_t;
-class auto_drainer_t;
 class base_table_t;
 class btree_slice_t;
+class internal_disk_backed_queue_t;
+class io_backender_t;
 class mailbox_manager_t;
 class namespace_interface_access_t;
 class name_resolver_t;
+class perfmon_collection_t;
 class real_superblock_t;
+class serializer_filepath_t;
 class sindex_superblock_t;
 struct rdb_modification_report_t;
 struct sindex_disk_info_t;
@@ -93,12 +101,32 @@ struct msg_t {
         exc_t exc;
         RDB_DECLARE_ME_SERIALIZABLE(limit_stop_t);
     };
+    // The result of applying a registered subscription's transforms to both sides
+    // of a change on the shard.  An empty `datum_t` means the transforms dropped
+    // that side.
+    struct sub_change_t {
+        datum_t old_val, new_val;
+        RDB_DECLARE_ME_SERIALIZABLE(sub_change_t);
+    };
     struct change_t {
         index_vals_t old_indexes, new_indexes;
         store_key_t pkey;
         /* For a newly-created row, `old_val` is an empty `datum_t`. For a deleted row,
         `new_val` is an empty `datum_t`. */
         datum_t old_val, new_val;
+        /* Set if the `server_t` filtered this change against the registered
+        subscriptions of the receiving feed (see `sub_filter_t`).  In that case
+        `old_indexes` and `new_indexes` only contain the indexes those subscriptions
+        read, `old_val` and `new_val` are only filled in if a subscription without
+        transforms wants the change, and subscriptions with transforms find their
+        already transformed values here (or no entry if they don't see the change
+        at all). */
+        boost::optional<std::map<uuid_u, sub_change_t> > sub_changes;
+        /* The position of the change in the `server_t`'s `change_journal_t`, if it
+        keeps one.  This changed the cluster wire format without a new
+        `cluster_version_t`, see `CLUSTER_VERSION_STRING`. */
+        boost::optional<uint64_t> journal_seq;
+        bool has_vals() const { return old_val.has() || new_val.has(); }
         RDB_DECLARE_ME_SERIALIZABLE(change_t);
     };
     struct stop_t {
@@ -125,10 +153,24 @@ struct msg_t {
 
 RDB_DECLARE_SERIALIZABLE(msg_t);
 
+// What a `server_t` sends to a client: a run of messages with consecutive stamps,
+// so that a bulk write doesn't turn into one cluster message per changed row.
+struct stamped_msgs_t {
+    stamped_msgs_t() { }
+    stamped_msgs_t(uuid_u _server_uuid, uint64_t _first_stamp, std::vector<msg_t> _msgs)
+        : server_uuid(std::move(_server_uuid)),
+          first_stamp(_first_stamp),
+          msgs(std::move(_msgs)) { }
+    uuid_u server_uuid;
+    uint64_t first_stamp;
+    std::vector<msg_t> msgs;
+};
+
+RDB_MAKE_SERIALIZABLE_3(stamped_msgs_t, server_uuid, first_stamp, msgs);
+
 class real_feed_t;
-struct stamped_msg_t;
 
-typedef mailbox_addr_t<void(stamped_msg_t)> client_addr_t;
+typedef mailbox_addr_t<void(stamped_msgs_t)> client_addr_t;
 
 struct keyspec_t {
     struct range_t {
@@ -183,6 +225,14 @@ struct streamspec_t {
     configured_limits_t limits;
     datum_t squash;
     keyspec_t::spec_t spec;
+    // These are only supported for range subscriptions, and are set separately
+    // because most feeds don't use them.
+    bool include_resume_tokens;
+    // Keyed by `server_t` uuid, see `change_journal_t`.
+    std::map<uuid_u, uint64_t> resume_from;
+    // How many changes may be queued on disk once `limits.changefeed_queue_size()`
+    // changes are queued in memory.  0 means the queue never spills.
+    size_t spill_size;
     streamspec_t(counted_t<datum_stream_t> _maybe_src,
                  std::string _table_name,
                  bool _include_offsets,
@@ -198,6 +248,38 @@ RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(keyspec_t::empty_t);
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(keyspec_t::limit_t);
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(keyspec_t::point_t);
 
+// Sent along with the stamp read of a range or point subscription so that the
+// `server_t` can filter and transform changes for it before they leave the shard.
+// The journaling fields changed the cluster wire format within the same
+// `cluster_version_t`, so servers from before them can't be in the same cluster
+// (see `CLUSTER_VERSION_STRING`).
+struct sub_registration_t {
+    uuid_u sub;
+    // The range spec of a range subscription, or the key of a point subscription.
+    boost::variant<keyspec_t::range_t, store_key_t> spec;
+    global_optargs_t optargs;
+    auth::user_context_t user_context;
+    datum_t deterministic_time;
+    // Set if the subscription wants resume tokens, in which case the `server_t`
+    // starts journaling its changes.
+    bool journal;
+    // If not empty, the `server_t` replays the journaled changes after the
+    // position it finds under its own uuid to the subscription.
+    std::map<uuid_u, uint64_t> resume_from;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(sub_registration_t);
+
+// Where a journaling subscription starts in a `server_t`'s journal.
+struct journal_pos_t {
+    // The last change journaled before the subscription registered.  Every later
+    // change is sent to it live.
+    uint64_t seq;
+    // False if the subscription asked to resume from a position the journal no
+    // longer covers, in which case some of the changes it missed weren't replayed.
+    bool complete;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(journal_pos_t);
+
 // The `client_t` exists on the server handling the changefeed query, in the
 // `rdb_context_t`.  When a query subscribes to the changes on a table, it
 // should call `new_stream`.  The `client_t` will give it back a stream of rows.
@@ -256,108 +338,6 @@ private:
 
 typedef mailbox_addr_t<void(client_addr_t)> server_addr_t;
 
-template<class Id, class Key, class Val, class Gt>
-class index_queue_t {
-private:
-    std::map<Id, std::pair<Key, Val> > data;
-    typedef typename std::map<Id, std::pair<Key, Val> >::iterator diterator;
-    std::set<diterator,
-             std::function<bool(const diterator &, const diterator &)> > index;
-
-    // This can't be passed by reference because we sometimes erase the source
-    // of the reference in the body of this function.
-    void erase(diterator it) {
-        guarantee(it != data.end());
-        auto ft = index.find(it);
-        guarantee(ft != index.end());
-        index.erase(ft);
-        data.erase(it);
-        guarantee(data.size() == index.size());
-    }
-public:
-    typedef typename
-    std::set<diterator, std::function<bool(const diterator &,
-                                           const diterator &)> >::iterator iterator;
-    typedef typename
-    std::set<diterator, std::function<bool(const diterator &,
-                                           const diterator &)> >::const_iterator
-    const_iterator;
-
-    explicit index_queue_t(Gt gt) : index(gt) { }
-
-    MUST_USE std::pair<iterator, bool>
-    insert(std::pair<Id, std::pair<Key, Val> > pair) {
-        return insert(std::move(pair.first),
-                      std::move(pair.second.first),
-                      std::move(pair.second.second));
-    }
-    MUST_USE std::pair<iterator, bool> insert(Id i, Key k, Val v) {
-        std::pair<diterator, bool> p = data.insert(
-            std::make_pair(std::move(i), std::make_pair(std::move(k), std::move(v))));
-        iterator it;
-        if (p.second) { // inserted
-            auto pair = index.insert(p.first);
-            guarantee(pair.second);
-            it = pair.first;
-        } else {
-            it = index.find(p.first);
-            guarantee(it != index.end());
-        }
-        guarantee(data.size() == index.size());
-        return std::make_pair(it, p.second);
-    }
-
-    size_t size() const {
-        guarantee(data.size() == index.size());
-        return data.size();
-    }
-
-    iterator begin() { return index.begin(); }
-    iterator end() { return index.end(); }
-    const_iterator begin() const { return index.begin(); }
-    const_iterator end() const { return index.end(); }
-    // This is sometimes called after `**raw_it` has been invalidated, so we
-    // can't just dispatch to the `erase(diterator)` implementation above.
-    void erase(const iterator &raw_it) {
-        guarantee(raw_it != index.end());
-        data.erase(*raw_it);
-        index.erase(raw_it);
-        guarantee(data.size() == index.size());
-    }
-    void clear() {
-        data.clear();
-        index.clear();
-        guarantee(data.size() == index.size());
-    }
-
-    iterator find_id(const Id &i) {
-        auto dit = data.find(i);
-        return dit == data.end() ? index.end() : index.find(dit);
-    }
-    MUST_USE bool del_id(const Id &i) {
-        auto it = data.find(i);
-        if (it == data.end()) {
-            return false;
-        } else {
-            erase(it);
-            return true;
-        }
-    }
-    iterator top() {
-        return size() == 0 ? end() : *index.begin();
-    }
-    std::vector<Id> truncate_top(size_t n) {
-        std::vector<Id> ret;
-        while (index.size() > n) {
-            ret.push_back((*index.begin())->first);
-            data.erase(*index.begin());
-            index.erase(index.begin());
-        }
-        guarantee(data.size() == index.size());
-        return ret;
-    }
-};
-
 class limit_order_t {
 public:
     explicit limit_order_t(sorting_t _sorting);
@@ -376,7 +356,44 @@ private:
     const sorting_t sorting;
 };
 
-typedef index_queue_t<std::string, datum_t, datum_t, limit_order_t> item_queue_t;
+// The items of an `.order_by.limit.changes()` feed, in order, that can also be
+// looked up by their mangled primary key.  The items live in one vector sorted
+// worst first, so a rank is just an offset from the end, and the only other
+// allocation is an entry in `sindex_keys` for items that have a secondary index
+// key.  Inserting and erasing move the items after the spot, which is cheaper than
+// allocating tree nodes for the sizes limit changefeeds use.  Iterators are
+// invalidated by `insert`, `erase` and `truncate_top`.
+class limit_queue_t {
+public:
+    typedef std::vector<item_t>::iterator iterator;
+    typedef std::vector<item_t>::const_iterator const_iterator;
+
+    explicit limit_queue_t(limit_order_t _gt);
+
+    // Returns the item with the same id instead if there is one.
+    MUST_USE std::pair<iterator, bool> insert(item_t item);
+    iterator find_id(const std::string &id);
+    MUST_USE bool del_id(const std::string &id);
+    void erase(iterator it);
+    // Erases the worst items until only `n` are left and returns their ids.
+    std::vector<std::string> truncate_top(size_t n);
+
+    size_t size() const { return items.size(); }
+    iterator begin() { return items.begin(); }
+    iterator end() { return items.end(); }
+    const_iterator begin() const { return items.begin(); }
+    const_iterator end() const { return items.end(); }
+    // The best item has rank 0.
+    size_t rank(const_iterator it) const { return items.end() - it - 1; }
+    iterator at_rank(size_t r) { return items.end() - r - 1; }
+    const_iterator at_rank(size_t r) const { return items.end() - r - 1; }
+private:
+    iterator lower_bound(const item_t &item);
+
+    limit_order_t gt;
+    std::vector<item_t> items;
+    std::map<std::string, datum_t> sindex_keys;
+};
 
 struct primary_ref_t {
     btree_slice_t *btree;
@@ -429,11 +446,17 @@ public:
     const std::string table;
     const boost::optional<uuid_u> sindex_id;
     const uuid_u uuid;
+
+    // How many items we keep for a limit of `limit`.  The ones beyond `limit`
+    // aren't sent to the client, but save a read from disk when an item leaves the
+    // top `limit`.
+    static size_t capacity(size_t limit);
 private:
     // Can throw `exc_t` exceptions if an error occurs while reading from disk.
     std::vector<item_t> read_more(
         const boost::variant<primary_ref_t, sindex_ref_t> &ref,
-        const boost::optional<item_t> &start);
+        const boost::optional<item_t> &start,
+        size_t n);
     void send(msg_t &&msg);
 
     scoped_ptr_t<env_t> env;
@@ -445,7 +468,11 @@ private:
     std::vector<scoped_ptr_t<op_t> > ops;
 
     limit_order_t gt;
-    item_queue_t item_queue;
+    // The best `capacity(spec.limit)` items in `region`, the best `spec.limit` of
+    // which the client has.  Any item better than the worst one is in here.
+    limit_queue_t item_queue;
+    // True if `item_queue` holds every item in `region`.
+    bool complete;
 
     std::map<std::string, std::pair<datum_t, datum_t> > added;
     std::set<std::string> deleted;
@@ -456,6 +483,174 @@ public:
     auto_drainer_t drainer;
 };
 
+// The shard-side half of a registered range or point subscription.  It decides
+// whether a change can be seen by the subscription and evaluates the
+// subscription's transforms, so that the `server_t` only ships what the
+// subscription will actually use.  Make sure you hold a lock on the `server_t`'s
+// `clients_lock` when calling the member functions.
+class sub_filter_t : public single_threaded_countable_t<sub_filter_t> {
+public:
+    sub_filter_t(rdb_context_t *ctx, const sub_registration_t &registration);
+    // Out of line because `env_t` is incomplete here.
+    ~sub_filter_t();
+
+    // Conservative: the subscription may still drop the change itself (e.g. for
+    // `get_intersecting` feeds), but it never wants a change we return false for.
+    bool might_contain(const msg_t::change_t &change) const;
+    boost::optional<std::string> sindex() const;
+    // The primary key ranges the subscription can see, or `boost::none` for a
+    // subscription on a secondary index.
+    boost::optional<std::vector<key_range_t> > pkey_ranges() const;
+    bool has_ops() const { return ops.size() != 0; }
+    // True if the subscription asked for resume tokens.
+    bool journals() const { return journal; }
+    // Returns an empty `datum_t` if `val` is empty or the transforms dropped it.
+    // May block.
+    datum_t apply(const datum_t &val);
+private:
+    boost::variant<keyspec_t::range_t, store_key_t> spec;
+    bool journal;
+    boost::optional<std::map<store_key_t, uint64_t> > store_keys;
+    boost::optional<key_range_t> store_key_range;
+
+    scoped_ptr_t<env_t> env;
+    std::vector<scoped_ptr_t<op_t> > ops;
+    // Several batches of the same client can be sent at once, and they shouldn't
+    // evaluate the transforms in `env` at the same time.
+    mutex_t apply_mutex;
+
+    auto_drainer_t drainer;
+    DISABLE_COPYING(sub_filter_t);
+};
+
+// Indexes the registered subscriptions of a client by the primary keys they can
+// see, so that `server_t::send_all` finds the candidates for a change in
+// O(log n + matches) instead of asking every subscription.  Subscriptions on a
+// secondary index can't be keyed this way and are always candidates.
+class sub_index_t {
+public:
+    sub_index_t();
+    // `ranges` is what `sub_filter_t::pkey_ranges` returned for `sub`.
+    void insert(const uuid_u &sub,
+                const boost::optional<std::vector<key_range_t> > &ranges);
+    void erase(const uuid_u &sub,
+               const boost::optional<std::vector<key_range_t> > &ranges);
+    // Calls `f` exactly once for every candidate.
+    void each_candidate(const store_key_t &pkey,
+                        const std::function<void(const uuid_u &)> &f) const;
+private:
+    typedef key_range_t::right_bound_t key_edge_t;
+    range_map_t<key_edge_t, std::set<uuid_u> > by_pkey;
+    std::set<uuid_u> unkeyed;
+};
+
+// A bounded log of the changes on a `server_t`, kept on disk, so that a feed that
+// lost its connection can resume from the last change it saw instead of
+// re-reading the whole range with `include_initial`.  The changes are numbered
+// consecutively starting at `first_seq`, and the oldest ones are dropped once the
+// journal grows beyond `max_bytes` or they are older than `max_age`.  The journal
+// doesn't survive a restart, and the numbers are only meaningful together with the
+// uuid of the `server_t`.
+class change_journal_t : public single_threaded_countable_t<change_journal_t> {
+public:
+    change_journal_t(io_backender_t *io_backender,
+                     const serializer_filepath_t &filename,
+                     perfmon_collection_t *stats_parent,
+                     uint64_t first_seq,
+                     int64_t max_bytes,
+                     microtime_t max_age);
+    ~change_journal_t();
+
+    // Returns the sequence number of the change.  The change is written to disk
+    // by a separate coroutine, so this doesn't block.  If the disk falls more than
+    // `CHANGEFEED_JOURNAL_MAX_UNWRITTEN` changes behind, the oldest changes are
+    // dropped instead.
+    uint64_t append(const msg_t::change_t &change);
+    // The sequence number of the last appended change, or `first_seq - 1` if
+    // there is none.
+    uint64_t last_seq() const { return next_seq - 1; }
+    microtime_t get_max_age() const { return max_age; }
+    // Calls `f` in order with every change after `after` up to and including
+    // `up_to`, which must not be after `last_seq()`, and returns true, or returns
+    // false if some of them have already been dropped (or `after` is after
+    // `up_to`).  `f` must not block.
+    bool replay(
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f);
+
+    // While a `write_pause_t` exists, the journal doesn't write anything to disk,
+    // so every change appended in the meantime can be replayed without blocking.
+    class write_pause_t {
+    public:
+        explicit write_pause_t(change_journal_t *parent);
+    private:
+        friend class change_journal_t;
+        change_journal_t *parent;
+        mutex_t::acq_t acq;
+        DISABLE_COPYING(write_pause_t);
+    };
+    // Like `replay`, for the holder of `pause`.
+    bool replay(
+        const write_pause_t &pause,
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f);
+    // Like `replay`, but doesn't block.  That's only possible for changes appended
+    // after `pause` was created, for earlier ones it returns false.
+    bool replay_unwritten(
+        const write_pause_t &pause,
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f);
+
+private:
+    bool replay_with_mutex(
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f);
+    bool replay_from_memory(
+        uint64_t after,
+        uint64_t up_to,
+        const std::function<void(uint64_t, msg_t::change_t &&)> &f);
+    void write_cb(auto_drainer_t::lock_t keepalive);
+    void trim(microtime_t now);
+
+    const int64_t max_bytes;
+    const microtime_t max_age;
+
+    scoped_ptr_t<internal_disk_backed_queue_t> queue;
+    // Held while `queue` is written to or read from, so that `replay` sees the
+    // changes at the positions it expects.
+    mutex_t queue_mutex;
+    struct entry_info_t {
+        microtime_t time;
+        int64_t bytes;
+    };
+    // One entry per change in `queue`, the first one is for `written_first_seq`.
+    // Only changed while `queue_mutex` is held.
+    std::deque<entry_info_t> entry_infos;
+    uint64_t written_first_seq;
+    // The appended changes that `write_cb` hasn't written to `queue` yet, the first
+    // one is for `unwritten_first_seq`.  Usually they come right after the ones in
+    // `queue`, unless `append` dropped some, in which case all the changes in
+    // `queue` are before `first_seq`.
+    struct unwritten_change_t {
+        microtime_t time;
+        msg_t::change_t change;
+    };
+    std::deque<unwritten_change_t> unwritten;
+    uint64_t unwritten_first_seq;
+    bool write_scheduled;
+    // The first change that can still be replayed, and the next one to append.
+    uint64_t first_seq, next_seq;
+    int64_t total_bytes;
+
+    auto_drainer_t drainer;
+
+    DISABLE_COPYING(change_journal_t);
+};
+
 // There is one `server_t` per `store_t`, and it is used to send changes that
 // occur on that `store_t` to any subscribed `real_feed_t`s contained in a
 // `client_t`.
@@ -464,6 +659,7 @@ public:
     typedef server_addr_t addr_t;
     typedef mailbox_addr_t<void(client_t::addr_t, boost::optional<std::string>, uuid_u)>
         limit_addr_t;
+    typedef mailbox_addr_t<void(client_t::addr_t, uuid_u)> sub_stop_addr_t;
     explicit server_t(mailbox_manager_t *_manager, store_t *_parent);
     ~server_t();
     void add_client(
@@ -491,9 +687,21 @@ public:
         const auto_drainer_t::lock_t &keepalive);
     addr_t get_stop_addr();
     limit_addr_t get_limit_stop_addr();
+    sub_stop_addr_t get_sub_stop_addr();
     boost::optional<uint64_t> get_stamp(
         const client_t::addr_t &addr,
         const auto_drainer_t::lock_t &keepalive);
+    // Like `get_stamp`, but also registers a subscription of the client atomically
+    // with respect to the stamp, so that every change stamped at or after the
+    // returned stamp is filtered for it.  If the subscription journals,
+    // `journal_pos_out` is set, and the changes it resumes from are queued for it
+    // right after the returned stamp.
+    boost::optional<uint64_t> add_sub(
+        const client_t::addr_t &addr,
+        rdb_context_t *ctx,
+        const sub_registration_t &registration,
+        const auto_drainer_t::lock_t &keepalive,
+        boost::optional<journal_pos_t> *journal_pos_out);
     uuid_u get_uuid();
     // `f` will be called with a read lock on `clients` and a write lock on the
     // limit manager.
@@ -517,6 +725,9 @@ private:
                                client_t::addr_t addr,
                                boost::optional<std::string> sindex,
                                uuid_u uuid);
+    void sub_stop_mailbox_cb(signal_t *interruptor,
+                             client_t::addr_t addr,
+                             uuid_u uuid);
     void add_client_cb(
         signal_t *stopped,
         client_t::addr_t addr,
@@ -528,6 +739,21 @@ private:
     const uuid_u uuid;
     mailbox_manager_t *const manager;
 
+    // A message that has been stamped but not sent yet.  The transforms of the
+    // subscriptions in `transforms` still have to be applied to `old_val` and
+    // `new_val`, which `send_pending` does once we no longer hold the stamp lock or
+    // `clients_lock`, so that slow transforms don't hold up writes.
+    struct pending_msg_t {
+        explicit pending_msg_t(msg_t &&_msg) : msg(std::move(_msg)) { }
+        msg_t msg;
+        datum_t old_val, new_val;
+        std::vector<std::pair<uuid_u, counted_t<sub_filter_t> > > transforms;
+    };
+    struct pending_batch_t {
+        uint64_t first_stamp;
+        std::vector<pending_msg_t> msgs;
+    };
+
     struct client_info_t {
         client_info_t();
         scoped_ptr_t<cond_t> cond;
@@ -541,8 +767,41 @@ private:
                      bool(const boost::optional<std::string> &,
                           const boost::optional<std::string> &)> > limit_clients;
         scoped_ptr_t<rwlock_t> limit_clients_lock;
+        // The range and point subscriptions registered by this client.
+        std::map<uuid_u, counted_t<sub_filter_t> > subs;
+        sub_index_t sub_index;
+        // Messages that have been stamped but not sent yet.  Their stamps are
+        // consecutive and end right before `stamp`.
+        std::vector<pending_msg_t> pending;
+        bool flush_scheduled;
     };
     std::map<client_t::addr_t, client_info_t> clients;
+    typedef std::pair<const client_t::addr_t, client_info_t> client_entry_t;
+    // The entries of `clients` by the regions they subscribed to, so that
+    // `send_all` doesn't have to look at every client on every write.  Entries of a
+    // `std::map` are stable, so we can point into `clients`.
+    region_map_t<std::set<client_entry_t *> > client_index;
+
+    // Returns false if none of the client's subscriptions can see `change`, in
+    // which case nothing should be sent.  Otherwise `out` is set to the message
+    // the client should receive.  Doesn't block.
+    bool filter_change(client_info_t *info,
+                       const msg_t::change_t &change,
+                       const boost::optional<uint64_t> &journal_seq,
+                       boost::optional<pending_msg_t> *out);
+    // Returns the message that gives a journaled change to just the subscription
+    // `sub_uuid` that is resuming, or `boost::none` if it wouldn't see it.
+    boost::optional<pending_msg_t> replay_change(
+        const uuid_u &sub_uuid,
+        const counted_t<sub_filter_t> &filter,
+        uint64_t seq,
+        const msg_t::change_t &change);
+
+    // Returns the journal, creating it first if there is none.
+    counted_t<change_journal_t> get_or_create_journal(rdb_context_t *ctx);
+    // Called when a journaling subscription goes away.
+    void release_journal_user(const auto_drainer_t::lock_t &keepalive);
+    void drop_idle_journal(uint64_t idle_generation, auto_drainer_t::lock_t keepalive);
 
     void prune_dead_limit(
         auto_drainer_t::lock_t *stealable_lock,
@@ -555,6 +814,20 @@ private:
                             msg_t msg,
                             const auto_drainer_t::lock_t &lock);
 
+    // Stamps `msg` and adds it to the client's pending messages.  If that fills
+    // up the batch it is returned and must be sent by the caller, otherwise
+    // `flush_cb` will send it once the current coroutines have had a chance to add
+    // more to it.  Doesn't block.
+    boost::optional<pending_batch_t> stamp_and_queue(
+        std::pair<const client_t::addr_t, client_info_t> *client,
+        pending_msg_t &&msg,
+        const auto_drainer_t::lock_t &keepalive);
+    pending_batch_t take_pending(client_info_t *info);
+    // Applies the outstanding transforms and sends the batch.  Must be called
+    // without holding the stamp lock or `clients_lock`, since it may block.
+    void send_pending(const client_t::addr_t &addr, pending_batch_t &&batch);
+    void flush_cb(client_t::addr_t addr, auto_drainer_t::lock_t keepalive);
+
     // Controls access to `clients`.  A `server_t` needs to read `clients` when:
     // * `send_all` is called
     // * `get_stamp` is called
@@ -564,11 +837,29 @@ private:
     // * A message is received at `stop_mailbox` unsubscribing a client
     // A lock is needed because e.g. `send_all` calls `send`, which can block,
     // while looping over `clients`, and we need to make sure the map doesn't
-    // change under it.
+    // change under it.  `client_index` and the `sub_index`es are protected by the
+    // same lock.
     rwlock_t clients_lock;
     // We need access to the stamp lock that exists on the parent.
     store_t *parent;
 
+    // Created by the first subscription that asks for resume tokens, and dropped
+    // once no subscription has asked for them for the journal's `max_age`, after
+    // which nothing that's left in it could still be resumed from.  `send_all`
+    // appends to it without blocking while it holds the stamp lock, so it has the
+    // same order as the stamps.
+    counted_t<change_journal_t> journal;
+    // Held while `journal` is created, which blocks on the disk.
+    mutex_t journal_mutex;
+    // The journaling subscriptions that are registered or being registered.
+    size_t journal_users;
+    // Bumped every time `journal_users` drops to zero, so that `drop_idle_journal`
+    // can tell whether the journal has been in use since it started waiting.
+    uint64_t journal_idle_generation;
+    // Where the next journal starts, so that positions from a dropped journal are
+    // never mistaken for positions in a later one.
+    uint64_t next_journal_seq;
+
     auto_drainer_t drainer;
     // Clients send a message to this mailbox with their address when they want
     // to unsubscribe.  The callback of this mailbox acquires the drainer, so it
@@ -578,6 +869,9 @@ private:
     // changefeed.
     mailbox_t<void(client_t::addr_t, boost::optional<std::string>, uuid_u)>
         limit_stop_mailbox;
+    // Clients send a message to this mailbox to unregister a range or point
+    // subscription.
+    mailbox_t<void(client_t::addr_t, uuid_u)> sub_stop_mailbox;
 };
 
 class artificial_feed_t;
@@ -3,6 +3,7 @@
 
 #include "clustering/administration/metadata.hpp"
 #include "concurrency/cross_thread_watchable.hpp"
+#include "config/args.hpp"
 #include "rdb_protocol/query_cache.hpp"
 #include "rdb_protocol/datum.hpp"
 #include "rpc/semilattice/view/field.hpp"
@@ -72,13 +73,27 @@ rdb_context_t::stats_t::stats_t(perfmon_collection_t *global_stats)
       queries_per_sec_membership(&qe_stats_collection,
                                  &queries_per_sec, "queries_per_sec"),
       queries_total_membership(&qe_stats_collection,
-                               &queries_total, "queries_total") { }
+                               &queries_total, "queries_total"),
+      compressed_responses_total_membership(&qe_stats_collection,
+                                            &compressed_responses_total,
+                                            "compressed_responses_total"),
+      compression_bytes_saved_total_membership(&qe_stats_collection,
+                                               &compression_bytes_saved_total,
+                                               "compression_bytes_saved_total"),
+      compute_offloads_total_membership(&qe_stats_collection,
+                                        &compute_offloads_total,
+                                        "compute_offloads_total") { }
 
 rdb_context_t::rdb_context_t()
     : extproc_pool(nullptr),
+      compute_pool(nullptr),
       cluster_interface(nullptr),
       manager(nullptr),
       reql_http_proxy(),
+      io_backender(nullptr),
+      changefeed_journal_max_bytes(CHANGEFEED_JOURNAL_MAX_BYTES),
+      changefeed_journal_max_age(CHANGEFEED_JOURNAL_MAX_AGE_SECS * MILLION),
+      prefetched_bytes(0),
       stats(&get_global_perfmon_collection()) { }
 
 rdb_context_t::rdb_context_t(
@@ -87,25 +102,41 @@ rdb_context_t::rdb_context_t(
         std::shared_ptr<semilattice_read_view_t<auth_semilattice_metadata_t>>
             auth_semilattice_view)
     : extproc_pool(_extproc_pool),
+      compute_pool(nullptr),
       cluster_interface(_cluster_interface),
       manager(nullptr),
       reql_http_proxy(),
+      io_backender(nullptr),
+      changefeed_journal_max_bytes(CHANGEFEED_JOURNAL_MAX_BYTES),
+      changefeed_journal_max_age(CHANGEFEED_JOURNAL_MAX_AGE_SECS * MILLION),
+      prefetched_bytes(0),
       stats(&get_global_perfmon_collection()) {
     init_auth_watchables(auth_semilattice_view);
 }
 
 rdb_context_t::rdb_context_t(
         extproc_pool_t *_extproc_pool,
+        compute_pool_t *_compute_pool,
         mailbox_manager_t *_mailbox_manager,
         reql_cluster_interface_t *_cluster_interface,
         std::shared_ptr<semilattice_read_view_t<auth_semilattice_metadata_t>>
             auth_semilattice_view,
         perfmon_collection_t *global_stats,
-        const std::string &_reql_http_proxy)
+        const std::string &_reql_http_proxy,
+        io_backender_t *_io_backender,
+        const base_path_t &_base_path,
+        int64_t _changefeed_journal_max_bytes,
+        microtime_t _changefeed_journal_max_age)
     : extproc_pool(_extproc_pool),
+      compute_pool(_compute_pool),
       cluster_interface(_cluster_interface),
       manager(_mailbox_manager),
       reql_http_proxy(_reql_http_proxy),
+      io_backender(_io_backender),
+      base_path(_base_path),
+      changefeed_journal_max_bytes(_changefeed_journal_max_bytes),
+      changefeed_journal_max_age(_changefeed_journal_max_age),
+      prefetched_bytes(0),
       stats(global_stats) {
     init_auth_watchables(auth_semilattice_view);
 }
@@ -2,6 +2,7 @@
 #ifndef RDB_PROTOCOL_CONTEXT_HPP_
 #define RDB_PROTOCOL_CONTEXT_HPP_
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <set>
@@ -45,8 +46,10 @@ ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
         return_changes_t::NO, return_changes_t::ALWAYS);
 
 class auth_semilattice_metadata_t;
+class compute_pool_t;
 class ellipsoid_spec_t;
 class extproc_pool_t;
+class io_backender_t;
 class name_string_t;
 class namespace_interface_t;
 template <class> class cross_thread_watchable_variable_t;
@@ -301,6 +304,13 @@ public:
             ql::env_t *env,
             std::vector<int64_t> *doc_counts_out,
             admin_err_t *error_out) = 0;
+    virtual bool table_estimate_sindex_counts(
+            auth::user_context_t const &user_context,
+            counted_t<const ql::db_t> db,
+            const name_string_t &name,
+            ql::env_t *env,
+            std::map<std::string, int64_t> *sindex_counts_out,
+            admin_err_t *error_out) = 0;
     virtual bool table_config(
             auth::user_context_t const &user_context,
             counted_t<const ql::db_t> db,
@@ -465,22 +475,43 @@ public:
     // The "real" constructor used outside of unit tests.
     rdb_context_t(
         extproc_pool_t *_extproc_pool,
+        compute_pool_t *_compute_pool,
         mailbox_manager_t *_mailbox_manager,
         reql_cluster_interface_t *_cluster_interface,
         std::shared_ptr<semilattice_read_view_t<auth_semilattice_metadata_t>>
             auth_semilattice_view,
         perfmon_collection_t *global_stats,
-        const std::string &_reql_http_proxy);
+        const std::string &_reql_http_proxy,
+        io_backender_t *_io_backender,
+        const base_path_t &_base_path,
+        int64_t _changefeed_journal_max_bytes,
+        microtime_t _changefeed_journal_max_age);
 
     ~rdb_context_t();
 
     extproc_pool_t *extproc_pool;
+    // Where CPU-heavy terms can run their work, see `ql::should_offload()`.  It's
+    // `nullptr` unless the server was started with `--compute-threads`.
+    compute_pool_t *compute_pool;
     reql_cluster_interface_t *cluster_interface;
 
     mailbox_manager_t *manager;
 
     const std::string reql_http_proxy;
 
+    // Where changefeeds can spill their queues to disk.  `io_backender` is
+    // `nullptr` on proxies and in unit tests, which don't have a data directory.
+    io_backender_t *io_backender;
+    const base_path_t base_path;
+
+    // How much the changefeed servers keep in their journals for resuming feeds.
+    const int64_t changefeed_journal_max_bytes;
+    const microtime_t changefeed_journal_max_age;
+
+    // The bytes that the prefetched batches of all connections take up or have
+    // reserved, see `ql::MAX_PREFETCHED_BYTES`.
+    std::atomic<int64_t> prefetched_bytes;
+
     class stats_t {
     public:
         explicit stats_t(perfmon_collection_t *global_stats);
@@ -495,6 +526,12 @@ public:
         perfmon_membership_t queries_per_sec_membership;
         perfmon_counter_t queries_total;
         perfmon_membership_t queries_total_membership;
+        perfmon_counter_t compressed_responses_total;
+        perfmon_membership_t compressed_responses_total_membership;
+        perfmon_counter_t compression_bytes_saved_total;
+        perfmon_membership_t compression_bytes_saved_total_membership;
+        perfmon_counter_t compute_offloads_total;
+        perfmon_membership_t compute_offloads_total_membership;
     private:
         DISABLE_COPYING(stats_t);
     } stats;
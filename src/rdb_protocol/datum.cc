@@ -108,13 +108,16 @@ datum_t::data_wrapper_t::data_wrapper_t(const char *cstr) :
 
 datum_t::data_wrapper_t::data_wrapper_t(std::vector<datum_t> &&array) :
     r_array(new countable_wrapper_t<std::vector<datum_t> >(std::move(array))),
-    internal_type(internal_type_t::R_ARRAY) { }
+    internal_type(internal_type_t::R_ARRAY) {
+    count_datum_allocation(datum_allocation_t::ARRAY);
+}
 
 datum_t::data_wrapper_t::data_wrapper_t(
         std::vector<std::pair<datum_string_t, datum_t> > &&object) :
     r_object(new countable_wrapper_t<std::vector<std::pair<datum_string_t, datum_t> > >(
         std::move(object))),
     internal_type(internal_type_t::R_OBJECT) {
+    count_datum_allocation(datum_allocation_t::OBJECT);
 
 #ifndef NDEBUG
     auto key_cmp = [](const std::pair<datum_string_t, datum_t> &p1,
@@ -1534,6 +1537,10 @@ void datum_t::write_json_unchecked_stack(json_writer_t *writer) const {
     } break;
     case R_STR: writer->String(as_str().data(), as_str().size()); break;
     case R_ARRAY: {
+        if (data.get_internal_type() == internal_type_t::BUF_R_ARRAY) {
+            datum_write_json_array_from_buf(data.buf_ref, writer);
+            break;
+        }
         writer->StartArray();
         const size_t sz = arr_size();
         for (size_t i = 0; i < sz; ++i) {
@@ -1542,6 +1549,10 @@ void datum_t::write_json_unchecked_stack(json_writer_t *writer) const {
         writer->EndArray();
     } break;
     case R_OBJECT: {
+        if (data.get_internal_type() == internal_type_t::BUF_R_OBJECT) {
+            datum_write_json_object_from_buf(data.buf_ref, writer);
+            break;
+        }
         writer->StartObject();
         const size_t sz = obj_size();
         for (size_t i = 0; i < sz; ++i) {
@@ -2038,18 +2049,70 @@ datum_t stats_merge(UNUSED const datum_string_t &key,
 }
 
 datum_object_builder_t::datum_object_builder_t(const datum_t &copy_from) {
+    // The pairs of an object datum are already sorted by key.
     const size_t copy_from_sz = copy_from.obj_size();
+    pairs.reserve(copy_from_sz);
     for (size_t i = 0; i < copy_from_sz; ++i) {
-        map.insert(copy_from.get_pair(i));
+        pairs.push_back(copy_from.get_pair(i));
     }
 }
 
+std::vector<std::pair<datum_string_t, datum_t> >::iterator
+datum_object_builder_t::lower_bound(const datum_string_t &key) {
+    return std::lower_bound(
+        pairs.begin(), pairs.end(), key,
+        [](const std::pair<datum_string_t, datum_t> &p, const datum_string_t &k) {
+            return p.first < k;
+        });
+}
+
+datum_t *datum_object_builder_t::find(const datum_string_t &key) {
+    if (!map.empty()) {
+        auto it = map.find(key);
+        return it == map.end() ? nullptr : &it->second;
+    }
+    auto it = lower_bound(key);
+    return (it != pairs.end() && it->first == key) ? &it->second : nullptr;
+}
+
+const datum_t *datum_object_builder_t::find(const datum_string_t &key) const {
+    return const_cast<datum_object_builder_t *>(this)->find(key);
+}
+
+datum_t *datum_object_builder_t::insert(const datum_string_t &key, datum_t val) {
+    if (map.empty()) {
+        auto it = lower_bound(key);
+        rassert(it == pairs.end() || it->first != key);
+        if (it == pairs.end() || pairs.size() < MAX_SORTED_VECTOR_SIZE) {
+            it = pairs.insert(it, std::make_pair(key, std::move(val)));
+            return &it->second;
+        }
+        // Inserting into the middle of a large vector is too expensive, so from
+        // now on we use the map.
+        for (auto &&pair : pairs) {
+            map.insert(map.end(), std::move(pair));
+        }
+        pairs.clear();
+    }
+    auto res = map.insert(std::make_pair(key, std::move(val)));
+    rassert(res.second);
+    return &res.first->second;
+}
+
+datum_t *datum_object_builder_t::get_or_insert(const datum_string_t &key) {
+    datum_t *existing = find(key);
+    return existing != nullptr ? existing : insert(key, datum_t());
+}
+
 bool datum_object_builder_t::add(const datum_string_t &key, datum_t val) {
     r_sanity_check(val.has());
-    auto res = map.insert(std::make_pair(key, std::move(val)));
-    // Return _false_ if the insertion actually happened.  Because we are being
-    // backwards to the C++ convention.
-    return !res.second;
+    if (find(key) != nullptr) {
+        // Return _true_ if the insertion did not happen.  Because we are being
+        // backwards to the C++ convention.
+        return true;
+    }
+    insert(key, std::move(val));
+    return false;
 }
 
 bool datum_object_builder_t::add(const char *key, datum_t val) {
@@ -2059,7 +2122,12 @@ bool datum_object_builder_t::add(const char *key, datum_t val) {
 void datum_object_builder_t::overwrite(const datum_string_t &key,
                                        datum_t val) {
     r_sanity_check(val.has());
-    map[key] = std::move(val);
+    datum_t *existing = find(key);
+    if (existing != nullptr) {
+        *existing = std::move(val);
+    } else {
+        insert(key, std::move(val));
+    }
 }
 
 void datum_object_builder_t::overwrite(const char *key,
@@ -2068,7 +2136,7 @@ void datum_object_builder_t::overwrite(const char *key,
 }
 
 void datum_object_builder_t::add_warning(const char *msg, const configured_limits_t &limits) {
-    datum_t *warnings_entry = &map[warnings_field];
+    datum_t *warnings_entry = get_or_insert(warnings_field);
     if (warnings_entry->has()) {
         // assume here that the warnings array will "always" be small.
         const size_t warnings_entry_sz = warnings_entry->arr_size();
@@ -2092,7 +2160,7 @@ void datum_object_builder_t::add_warning(const char *msg, const configured_limit
 
 void datum_object_builder_t::add_warnings(const std::set<std::string> &msgs, const configured_limits_t &limits) {
     if (msgs.empty()) return;
-    datum_t *warnings_entry = &map[warnings_field];
+    datum_t *warnings_entry = get_or_insert(warnings_field);
     if (warnings_entry->has()) {
         rcheck_datum(
             warnings_entry->arr_size() + msgs.size() <= limits.array_size_limit(),
@@ -2126,17 +2194,25 @@ void datum_object_builder_t::add_warnings(const std::set<std::string> &msgs, con
 void datum_object_builder_t::add_error(const char *msg) {
     // Insert or update the "errors" entry.
     {
-        datum_t *errors_entry = &map[errors_field];
+        datum_t *errors_entry = get_or_insert(errors_field);
         double ecount = (errors_entry->has() ? (*errors_entry).as_num() : 0) + 1;
         *errors_entry = datum_t(ecount);
     }
 
     // If first_error already exists, nothing gets inserted.
-    map.insert(std::make_pair(first_error_field, datum_t(msg)));
+    UNUSED bool first_error_existed = add(first_error_field, datum_t(msg));
 }
 
 MUST_USE bool datum_object_builder_t::delete_field(const datum_string_t &key) {
-    return 0 != map.erase(key);
+    if (!map.empty()) {
+        return 0 != map.erase(key);
+    }
+    auto it = lower_bound(key);
+    if (it == pairs.end() || it->first != key) {
+        return false;
+    }
+    pairs.erase(it);
+    return true;
 }
 
 MUST_USE bool datum_object_builder_t::delete_field(const char *key) {
@@ -2145,21 +2221,31 @@ MUST_USE bool datum_object_builder_t::delete_field(const char *key) {
 
 
 datum_t datum_object_builder_t::at(const datum_string_t &key) const {
-    return map.at(key);
+    const datum_t *val = find(key);
+    if (val == nullptr) {
+        throw std::out_of_range("datum_object_builder_t::at");
+    }
+    return *val;
 }
 
 datum_t datum_object_builder_t::try_get(const datum_string_t &key) const {
-    auto it = map.find(key);
-    return it == map.end() ? datum_t() : it->second;
+    const datum_t *val = find(key);
+    return val == nullptr ? datum_t() : *val;
 }
 
 datum_t datum_object_builder_t::to_datum() RVALUE_THIS {
-    return datum_t(std::move(map));
+    if (!map.empty()) {
+        return datum_t(std::move(map));
+    }
+    return datum_t(std::move(pairs));
 }
 
 datum_t datum_object_builder_t::to_datum(
         const std::set<std::string> &permissible_ptypes) RVALUE_THIS {
-    return datum_t(std::move(map), permissible_ptypes);
+    if (!map.empty()) {
+        return datum_t(std::move(map), permissible_ptypes);
+    }
+    return datum_t(std::move(pairs), permissible_ptypes);
 }
 
 datum_array_builder_t::datum_array_builder_t(const datum_t &copy_from,
@@ -492,7 +492,7 @@ public:
     explicit datum_object_builder_t(const datum_t &copy_from);
 
     bool empty() const {
-        return map.empty();
+        return pairs.empty() && map.empty();
     }
 
     // Returns true if the insertion did _not_ happen because the key was already in
@@ -521,6 +521,23 @@ public:
             const std::set<std::string> &permissible_ptypes) RVALUE_THIS;
 
 private:
+    std::vector<std::pair<datum_string_t, datum_t> >::iterator
+    lower_bound(const datum_string_t &key);
+    // These return `nullptr` if the key doesn't exist.
+    datum_t *find(const datum_string_t &key);
+    const datum_t *find(const datum_string_t &key) const;
+    // `key` must not exist yet.
+    datum_t *insert(const datum_string_t &key, datum_t val);
+    // Returns the value for `key`, inserting an uninitialized datum if it's missing.
+    datum_t *get_or_insert(const datum_string_t &key);
+
+    // Objects are built in a vector that is kept sorted by key, so that `to_datum`
+    // can hand it over to the datum without building a map and copying it into a
+    // new vector.  Once the object is larger than `MAX_SORTED_VECTOR_SIZE` and a key
+    // has to be inserted in the middle, the pairs are moved to `map` instead, which
+    // is used from then on.
+    static const size_t MAX_SORTED_VECTOR_SIZE = 64;
+    std::vector<std::pair<datum_string_t, datum_t> > pairs;
     std::map<datum_string_t, datum_t> map;
     DISABLE_COPYING(datum_object_builder_t);
 };
@@ -2276,23 +2276,39 @@ eq_join_datum_stream_t::eq_join_datum_stream_t(counted_t<datum_stream_t> _stream
     is_infinite_eq_join(stream->is_infinite()),
     eq_join_type(stream->cfeed_type()) { }
 
+datum_t eq_join_datum_stream_t::eval_join_key(env_t *env, const datum_t &left) {
+    try {
+        return predicate->call(env, std::vector<datum_t>{left})->as_datum();
+    } catch (const exc_t &e) {
+        if (e.get_type() == base_exc_t::NON_EXISTENCE) {
+            return datum_t::null();
+        } else {
+            throw;
+        }
+    }
+}
+
+datum_t eq_join_datum_stream_t::right_join_key(const rget_item_t &item) const {
+    return item.sindex_key.has()
+        ? item.sindex_key
+        : item.data.get_field(join_index);
+}
+
 std::vector<datum_t> eq_join_datum_stream_t::next_raw_batch(
     env_t *env,
     const batchspec_t &batchspec) {
+    if (ordered) {
+        return next_ordered_batch(env, batchspec);
+    }
     batcher_t batcher = batchspec.to_batcher();
 
-    batchspec_t inner_batchspec = ordered ?
-        batchspec_t::all().with_at_most(1) :
-        batchspec;
-
     std::vector<datum_t> res;
     while (!is_exhausted() && !batcher.should_send_batch()) {
         if (!get_all_reader.has() ||
             (get_all_reader->is_finished() &&
              get_all_items.empty())) {
             // Get a new batch of keys
-            std::vector<datum_t> stream_batch = stream->next_batch(env,
-                                                                   inner_batchspec);
+            std::vector<datum_t> stream_batch = stream->next_batch(env, batchspec);
             if (stream_batch.empty()) {
                 // We got an empty batch from the input stream. It's either exhausted
                 // or a changefeed. In either case we abort and emit our current results.
@@ -2303,18 +2319,7 @@ std::vector<datum_t> eq_join_datum_stream_t::next_raw_batch(
             sindex_to_datum.clear();
             std::map<datum_t, uint64_t> keys;
             for (size_t i = 0; i < stream_batch.size(); ++i) {
-                datum_t key_val;
-                try {
-                    key_val = predicate->call(
-                        env,
-                        std::vector<datum_t>{stream_batch[i]})->as_datum();
-                } catch (const exc_t &e) {
-                    if (e.get_type() == base_exc_t::NON_EXISTENCE) {
-                        continue;
-                    } else {
-                        throw;
-                    }
-                }
+                datum_t key_val = eval_join_key(env, stream_batch[i]);
                 // Build a multimap from sindex value to datums from left side stream.
                 if (key_val.get_type() != datum_t::type_t::R_NULL) {
                     sindex_to_datum.insert(std::pair<datum_t, datum_t>{
@@ -2341,12 +2346,8 @@ std::vector<datum_t> eq_join_datum_stream_t::next_raw_batch(
         // Get each item in get_all results, and match it with all datums that match
         // in the multimap from the left side stream.
         std::pair<std::multimap<datum_t, datum_t>::iterator,
-                  std::multimap<datum_t, datum_t>::iterator> range;
-        if (item.sindex_key.has()) {
-            range = sindex_to_datum.equal_range(item.sindex_key);
-        } else {
-            range = sindex_to_datum.equal_range(item.data.get_field(join_index));
-        }
+                  std::multimap<datum_t, datum_t>::iterator> range =
+            sindex_to_datum.equal_range(right_join_key(item));
         datum_string_t right("right");
         datum_string_t left("left");
         for (auto pair = range.first; pair != range.second; ++pair) {
@@ -2363,9 +2364,83 @@ std::vector<datum_t> eq_join_datum_stream_t::next_raw_batch(
     return res;
 }
 
+std::vector<datum_t> eq_join_datum_stream_t::next_ordered_batch(
+    env_t *env,
+    const batchspec_t &batchspec) {
+    batcher_t batcher = batchspec.to_batcher();
+
+    std::vector<datum_t> res;
+    while (!is_exhausted() && !batcher.should_send_batch()) {
+        if (!ordered_results.empty()) {
+            batcher.note_el(ordered_results.front());
+            res.push_back(std::move(ordered_results.front()));
+            ordered_results.pop_front();
+            continue;
+        }
+
+        std::vector<datum_t> stream_batch = stream->next_batch(env, batchspec);
+        if (stream_batch.empty()) {
+            // Either exhausted or a changefeed, see `next_raw_batch`.
+            break;
+        }
+
+        // Look up the whole batch at once instead of issuing one read per
+        // left-side row.
+        std::vector<datum_t> left_keys;
+        left_keys.reserve(stream_batch.size());
+        std::map<datum_t, uint64_t> keys;
+        for (const datum_t &left_row : stream_batch) {
+            datum_t key_val = eval_join_key(env, left_row);
+            if (key_val.get_type() != datum_t::type_t::R_NULL) {
+                keys[key_val] = 1;
+            }
+            left_keys.push_back(std::move(key_val));
+        }
+        if (keys.empty()) {
+            continue;
+        }
+
+        std::map<datum_t, std::vector<datum_t> > key_to_right;
+        scoped_ptr_t<reader_t> reader = table->get_all_with_sindexes(
+            env,
+            datumspec_t(std::move(keys)),
+            join_index.to_std(),
+            backtrace());
+        while (!reader->is_finished()) {
+            std::vector<rget_item_t> items = reader->raw_next_batch(env, batchspec);
+            for (const rget_item_t &item : items) {
+                key_to_right[right_join_key(item)].push_back(item.data);
+            }
+        }
+
+        // Reassemble the results in left-side order.
+        datum_string_t right("right");
+        datum_string_t left("left");
+        for (size_t i = 0; i < stream_batch.size(); ++i) {
+            if (left_keys[i].get_type() == datum_t::type_t::R_NULL) {
+                continue;
+            }
+            auto it = key_to_right.find(left_keys[i]);
+            if (it == key_to_right.end()) {
+                continue;
+            }
+            for (const datum_t &right_row : it->second) {
+                ql::datum_object_builder_t res_item;
+                bool conflict = true;
+                conflict &= res_item.add(right, right_row);
+                conflict &= res_item.add(left, stream_batch[i]);
+                guarantee(!conflict);
+                ordered_results.push_back(std::move(res_item).to_datum());
+            }
+        }
+    }
+    return res;
+}
+
 bool eq_join_datum_stream_t::is_exhausted() const {
     if (stream->is_exhausted() &&
         get_all_items.empty() &&
+        ordered_results.empty() &&
         (!get_all_reader.has() || get_all_reader->is_finished())) {
         return batch_cache_exhausted();
     }
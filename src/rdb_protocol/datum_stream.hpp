@@ -968,10 +968,23 @@ public:
     }
 
 private:
+    // Used when `ordered` is set.  Looks up the right-side rows for a whole batch
+    // of left-side rows with a single `get_all` (which `rget_read_t::primary_keys`
+    // and the sharding code split into one multi-key read per shard), then emits
+    // the joined rows in left-side order.
+    std::vector<datum_t> next_ordered_batch(env_t *env, const batchspec_t &batchspec);
+
+    datum_t eval_join_key(env_t *env, const datum_t &left);
+    datum_t right_join_key(const rget_item_t &item) const;
+
     counted_t<datum_stream_t> stream;
     scoped_ptr_t<reader_t> get_all_reader;
     std::vector<rget_item_t> get_all_items;
 
+    // Joined rows of the current left-side batch that haven't been emitted yet, in
+    // left-side order.  Only used when `ordered` is set.
+    std::deque<datum_t> ordered_results;
+
     counted_t<table_t> table;
     datum_string_t join_index;
 
@@ -12,12 +12,41 @@
 #include "containers/archive/varint.hpp"
 #include "containers/scoped.hpp"
 #include "debug.hpp"
+#include "thread_local.hpp"
 #include "utils.hpp"
 
-datum_string_t::datum_string_t() {
-    init(0, "");
+TLS_with_init(uint64_t, datum_string_allocations, 0);
+TLS_with_init(uint64_t, datum_array_allocations, 0);
+TLS_with_init(uint64_t, datum_object_allocations, 0);
+
+void count_datum_allocation(datum_allocation_t type) {
+    switch (type) {
+    case datum_allocation_t::STRING:
+        TLS_set_datum_string_allocations(TLS_get_datum_string_allocations() + 1);
+        break;
+    case datum_allocation_t::ARRAY:
+        TLS_set_datum_array_allocations(TLS_get_datum_array_allocations() + 1);
+        break;
+    case datum_allocation_t::OBJECT:
+        TLS_set_datum_object_allocations(TLS_get_datum_object_allocations() + 1);
+        break;
+    default: unreachable();
+    }
+}
+
+datum_allocation_counts_t get_datum_allocation_counts() {
+    datum_allocation_counts_t counts;
+    counts.strings = TLS_get_datum_string_allocations();
+    counts.arrays = TLS_get_datum_array_allocations();
+    counts.objects = TLS_get_datum_object_allocations();
+    return counts;
 }
 
+// Default-constructed strings are common (e.g. in containers of pairs), so empty
+// strings have no buffer at all rather than sharing one, whose reference count every
+// thread would then be updating.
+datum_string_t::datum_string_t() { }
+
 datum_string_t::datum_string_t(size_t _size, const char *_data) {
     init(_size, _data);
 }
@@ -37,6 +66,10 @@ datum_string_t::datum_string_t(const std::string &str) {
 }
 
 void datum_string_t::init(size_t _size, const char *_data) {
+    if (_size == 0) {
+        return;
+    }
+    count_datum_allocation(datum_allocation_t::STRING);
     const size_t str_offset = varint_uint64_serialized_size(_size);
     counted_t<shared_buf_t> buffer = shared_buf_t::create(str_offset + _size);
     serialize_varint_uint64_into_buf(_size, reinterpret_cast<uint8_t *>(buffer->data()));
@@ -45,6 +78,9 @@ void datum_string_t::init(size_t _size, const char *_data) {
 }
 
 const char *datum_string_t::data() const {
+    if (!data_.has()) {
+        return "";
+    }
     const size_t str_size = size();
     size_t data_offset = varint_uint64_serialized_size(str_size);
     data_.guarantee_in_boundary(data_offset + str_size);
@@ -52,6 +88,9 @@ const char *datum_string_t::data() const {
 }
 
 size_t datum_string_t::size() const {
+    if (!data_.has()) {
+        return 0;
+    }
     uint64_t res = 0;
     static_assert(sizeof(uint8_t) == sizeof(char), "sizeof(uint8_t) != sizeof(char)");
     buffer_read_stream_t data_stream(data_.get(), data_.get_safety_boundary());
@@ -126,6 +165,7 @@ datum_string_t concat(const datum_string_t &a, const datum_string_t &b) {
     const size_t a_size = a.size();
     const size_t b_size = b.size();
     const size_t str_offset = varint_uint64_serialized_size(a_size + b_size);
+    count_datum_allocation(datum_allocation_t::STRING);
     counted_t<shared_buf_t> buf = shared_buf_t::create(str_offset + a_size + b_size);
     serialize_varint_uint64_into_buf(a_size + b_size,
                                      reinterpret_cast<uint8_t *>(buf->data(0)));
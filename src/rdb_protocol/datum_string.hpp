@@ -60,12 +60,25 @@ private:
     int compare(size_t other_size, const char *other_data) const;
 
     // Contains the length of the string in varint encoding, followed by the actual
-    // string content.
+    // string content.  Empty for an empty string.
     shared_buf_ref_t<char> data_;
 };
 
 datum_string_t concat(const datum_string_t &a, const datum_string_t &b);
 
+// Per-thread counts of the heap allocations made to back datums.  The query profiler
+// reports the allocations made on a query's thread while the query was running.
+struct datum_allocation_counts_t {
+    uint64_t strings;
+    uint64_t arrays;
+    uint64_t objects;
+};
+
+enum class datum_allocation_t { STRING, ARRAY, OBJECT };
+
+void count_datum_allocation(datum_allocation_t type);
+datum_allocation_counts_t get_datum_allocation_counts();
+
 void debug_print(printf_buffer_t *buf, const datum_string_t &s);
 
 #endif  // RDB_PROTOCOL_DATUM_STRING_HPP_
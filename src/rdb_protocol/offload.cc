@@ -0,0 +1,24 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include "rdb_protocol/offload.hpp"
+
+#include "arch/runtime/compute_pool.hpp"
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/env.hpp"
+
+namespace ql {
+
+bool should_offload(env_t *env, size_t work_size, size_t min_work_size) {
+    rdb_context_t *rdb_ctx = env->get_rdb_ctx();
+    return rdb_ctx != nullptr
+        && rdb_ctx->compute_pool != nullptr
+        && work_size >= min_work_size;
+}
+
+void run_offloaded(env_t *env, const std::function<void()> &fn) {
+    rdb_context_t *rdb_ctx = env->get_rdb_ctx();
+    guarantee(rdb_ctx != nullptr && rdb_ctx->compute_pool != nullptr);
+    ++rdb_ctx->stats.compute_offloads_total;
+    rdb_ctx->compute_pool->run(fn);
+}
+
+}  // namespace ql
@@ -0,0 +1,29 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_OFFLOAD_HPP_
+#define RDB_PROTOCOL_OFFLOAD_HPP_
+
+#include <stddef.h>
+
+#include <functional>
+
+namespace ql {
+
+class env_t;
+
+/* Terms that do a lot of CPU-bound work in one go, such as sorting a large array or
+parsing a large JSON string, can hand it to the compute pool so that it doesn't hold
+up the other queries on their thread.  Handing work off costs a round trip to another
+thread, so it's only worth it once the work is at least `min_work_size` large, in
+whatever unit the term measures its work in.  It's never done if the server has no
+compute pool. */
+bool should_offload(env_t *env, size_t work_size, size_t min_work_size);
+
+/* Runs `fn` in the compute pool, which `should_offload()` must have agreed to.  `fn`
+must follow the rules of `compute_pool_t::run()`; in particular it must not evaluate
+any terms, but it may create, read and throw errors about datums that only this query
+uses. */
+void run_offloaded(env_t *env, const std::function<void()> &fn);
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_OFFLOAD_HPP_
@@ -46,6 +46,7 @@ static const std::set<std::string> acceptable_optargs({
     "base",
     "binary_format",
     "changefeed_queue_size",
+    "changefeed_spill_size",
     "conflict",
     "data",
     "db",
@@ -67,6 +68,7 @@ static const std::set<std::string> acceptable_optargs({
     "ignore_write_hook",
     "include_initial",
     "include_offsets",
+    "include_resume_tokens",
     "include_states",
     "include_types",
     "index",
@@ -89,13 +91,16 @@ static const std::set<std::string> acceptable_optargs({
     "page",
     "page_limit",
     "params",
+    "prefetch",
     "primary_key",
     "primary_replica_tag",
+    "priority",
     "profile",
     "read_mode",
     "redirects",
     "replicas",
     "result_format",
+    "resume_from",
     "return_changes",
     "return_vals",
     "right_bound",
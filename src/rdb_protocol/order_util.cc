@@ -1,6 +1,7 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "rdb_protocol/order_util.hpp"
 
+#include <algorithm>
 #include <string>
 #include <utility>
 
@@ -11,6 +12,7 @@
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/minidriver.hpp"
+#include "rdb_protocol/offload.hpp"
 #include "rdb_protocol/op.hpp"
 #include "rdb_protocol/term_storage.hpp"
 #include "rdb_protocol/term_walker.hpp"
@@ -93,6 +95,26 @@ build_comparisons_from_optional_terms(const term_t *target,
     return comparisons;
 }
 
+// Returns -1, 0 or 1 depending on whether `lval` sorts before, together with, or
+// after `rval`.  An empty datum means that the row didn't have the field, and those
+// sort before all others in ascending order.
+int compare_sort_keys(order_direction_t direction,
+                      const datum_t &lval,
+                      const datum_t &rval) {
+    int res;
+    if (!lval.has() && !rval.has()) {
+        return 0;
+    } else if (!lval.has()) {
+        res = -1;
+    } else if (!rval.has()) {
+        res = 1;
+    } else {
+        res = lval.cmp(rval);
+        res = res < 0 ? -1 : (res > 0 ? 1 : 0);
+    }
+    return direction == DESC ? -res : res;
+}
+
 lt_cmp_t::lt_cmp_t(std::vector<std::pair<order_direction_t, counted_t<const func_t> > > _comparisons)
             : comparisons(std::move(_comparisons)) { }
 
@@ -124,23 +146,55 @@ bool lt_cmp_t::operator()(env_t *env,
             }
         }
 
-        if (!lval.has() && !rval.has()) {
-            continue;
+        int cmp_res = compare_sort_keys(it->first, lval, rval);
+        if (cmp_res != 0) {
+            return cmp_res < 0;
         }
-        if (!lval.has()) {
-            return true != (it->first == DESC);
-        }
-        if (!rval.has()) {
-            return false != (it->first == DESC);
-        }
-        int cmp_res = lval.cmp(rval);
-        if (cmp_res == 0) {
-            continue;
-        }
-        return (cmp_res < 0) != (it->first == DESC);
     }
 
     return false;
 }
 
+void lt_cmp_t::sort_offloaded(env_t *env, std::vector<datum_t> *data) const {
+    const size_t num_keys = comparisons.size();
+    std::vector<datum_t> keys(data->size() * num_keys);
+    for (size_t i = 0; i < data->size(); ++i) {
+        for (size_t j = 0; j < num_keys; ++j) {
+            try {
+                keys[i * num_keys + j] =
+                    comparisons[j].second->call(env, (*data)[i])->as_datum();
+            } catch (const base_exc_t &e) {
+                if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                    throw;
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> order(data->size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    run_offloaded(env, [&]() {
+        std::stable_sort(order.begin(), order.end(), [&](size_t l, size_t r) {
+            for (size_t j = 0; j < num_keys; ++j) {
+                int cmp_res = compare_sort_keys(comparisons[j].first,
+                                                keys[l * num_keys + j],
+                                                keys[r * num_keys + j]);
+                if (cmp_res != 0) {
+                    return cmp_res < 0;
+                }
+            }
+            return false;
+        });
+    });
+
+    std::vector<datum_t> sorted;
+    sorted.reserve(data->size());
+    for (size_t i : order) {
+        sorted.push_back(std::move((*data)[i]));
+    }
+    data->swap(sorted);
+}
+
 } // namespace ql
@@ -5,6 +5,7 @@
 
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "errors.hpp"
 
@@ -54,6 +55,11 @@ public:
                     datum_t l,
                     datum_t r) const;
 
+    /* Sorts `*data` the same way as `std::stable_sort()` with this comparison, but
+    evaluates the comparison functions only once for each row, and then sorts by
+    their results in the compute pool. */
+    void sort_offloaded(env_t *env, std::vector<datum_t> *data) const;
+
 private:
     const std::vector<std::pair<order_direction_t, counted_t<const func_t> > >
         comparisons;
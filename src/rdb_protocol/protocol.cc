@@ -100,7 +100,7 @@ void resume_construct_sindex(
     index. While this happens, we use a queue to keep track of any writes to the range
     we're constructing. We then drain the queue and atomically delete it, before we
     start the next pass. */
-    const int64_t PAIRS_TO_CONSTRUCT_PER_PASS = 512;
+    const int64_t PAIRS_TO_CONSTRUCT_PER_PASS = 4 * SINDEX_POST_CONSTRUCTION_BATCH_SIZE;
     key_range_t remaining_range = construct_range;
     while (!remaining_range.is_empty()) {
         scoped_ptr_t<disk_backed_queue_wrapper_t<rdb_modification_report_t> > mod_queue;
@@ -252,8 +252,7 @@ void post_construct_and_drain_queue(
             // Pretend that the indexes in `sindexes` have been post-constructed up to
             // the new range. This is important to make the call to
             // `rdb_update_sindexes()` below actually update the indexes.
-            // We use the same trick in the `post_construct_traversal_helper_t`.
-            // TODO: Avoid this hackery (here and in `post_construct_traversal_helper_t`)
+            // TODO: Avoid this hackery
             for (auto &&access : sindexes) {
                 access->sindex.needs_post_construction_range = *construction_range_inout;
             }
@@ -736,6 +735,10 @@ void rdb_r_unshard_visitor_t::operator()(const changefeed_subscribe_t &) {
              it != res->server_uuids.end(); ++it) {
             out->server_uuids.insert(std::move(*it));
         }
+        for (auto it = res->sub_stop_addrs.begin();
+             it != res->sub_stop_addrs.end(); ++it) {
+            out->sub_stop_addrs.insert(std::move(*it));
+        }
     }
 }
 
@@ -956,6 +959,24 @@ void rdb_r_unshard_visitor_t::unshard_range_batch(const query_t &q, sorting_t so
 }
 
 void rdb_r_unshard_visitor_t::operator()(const distribution_read_t &dg) {
+    if (static_cast<bool>(dg.sindex_id)) {
+        // Every shard has its own secondary index covering the whole key space, so
+        // unlike for the primary index the shards don't partition the key space and
+        // we just add up their populations.
+        distribution_read_response_t res;
+        res.region = dg.region;
+        for (size_t i = 0; i < count; ++i) {
+            auto result =
+                boost::get<distribution_read_response_t>(&responses[i].response);
+            guarantee(result != NULL, "Bad boost::get\n");
+            for (const auto &pair : result->key_counts) {
+                res.key_counts[pair.first] += pair.second;
+            }
+        }
+        response_out->response = res;
+        return;
+    }
+
     // TODO: do this without copying so much and/or without dynamic memory
     // Sort results by region
     std::vector<distribution_read_response_t> results(count);
@@ -1471,12 +1492,12 @@ RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
     rget_read_response_t, stamp_response, result, reql_version);
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(nearest_geo_read_response_t, results_or_error);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(distribution_read_response_t, region, key_counts);
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
-    changefeed_subscribe_response_t, server_uuids, addrs);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
+    changefeed_subscribe_response_t, server_uuids, addrs, sub_stop_addrs);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
     changefeed_limit_subscribe_response_t, shards, limit_addrs);
-RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
-    shard_stamp_info_t, stamp, shard_region, last_read_start);
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(
+    shard_stamp_info_t, stamp, shard_region, last_read_start, journal_pos);
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(changefeed_stamp_response_t, stamp_infos);
 
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
@@ -1537,8 +1558,8 @@ RDB_IMPL_SERIALIZABLE_8_FOR_CLUSTER(
     table_name,
     sindex_id);
 
-RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
-        distribution_read_t, max_depth, result_limit, region);
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(
+        distribution_read_t, max_depth, result_limit, region, sindex_id);
 
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_subscribe_t, addr, shard_region);
 RDB_IMPL_SERIALIZABLE_7_FOR_CLUSTER(
@@ -1550,8 +1571,9 @@ RDB_IMPL_SERIALIZABLE_7_FOR_CLUSTER(
     serializable_env,
     region,
     current_shard);
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_stamp_t, addr, region);
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_point_stamp_t, addr, key);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(changefeed_stamp_t, addr, region, registration);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
+    changefeed_point_stamp_t, addr, key, registration);
 
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(read_t, read, profile, read_mode);
 
@@ -108,6 +108,8 @@ struct shard_stamp_info_t {
     region_t shard_region;
     // The starting points of the reads (assuming left to right traversal)
     store_key_t last_read_start;
+    // Only set for subscriptions that journal, see `ql::changefeed::server_t::add_sub`.
+    boost::optional<ql::changefeed::journal_pos_t> journal_pos;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(shard_stamp_info_t);
 
@@ -168,6 +170,7 @@ struct changefeed_subscribe_response_t {
     changefeed_subscribe_response_t() { }
     std::set<uuid_u> server_uuids;
     std::set<ql::changefeed::server_t::addr_t> addrs;
+    std::set<ql::changefeed::server_t::sub_stop_addr_t> sub_stop_addrs;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_subscribe_response_t);
 
@@ -289,6 +292,8 @@ struct changefeed_stamp_t {
         : addr(std::move(_addr)), region(region_t::universe()) { }
     ql::changefeed::client_t::addr_t addr;
     region_t region;
+    // Set by range subscriptions so the shards filter changes for them.
+    boost::optional<ql::changefeed::sub_registration_t> registration;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_stamp_t);
 
@@ -432,10 +437,22 @@ public:
         : max_depth(_max_depth), result_limit(_result_limit),
           region(region_t::universe())
     { }
+    explicit distribution_read_t(const std::string &_sindex_id)
+        : max_depth(0), result_limit(0), region(region_t::universe()),
+          sindex_id(_sindex_id)
+    { }
 
     int max_depth;
     size_t result_limit;
-    region_t region;
+    region_t region; // We need this even for sindex reads due to sharding.
+
+    // If set, the number of entries in this secondary index instead of the
+    // distribution of the primary keys, as a single count under the minimum key.  The
+    // counts of the shards are added up, because every shard covers the whole range
+    // of the index, and `max_depth` and `result_limit` are ignored.  This changed the
+    // cluster wire format without a new `cluster_version_t`, see
+    // `CLUSTER_VERSION_STRING`.
+    boost::optional<std::string> sindex_id;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(distribution_read_t);
 
@@ -477,6 +494,7 @@ RDB_DECLARE_SERIALIZABLE(changefeed_limit_subscribe_t);
 struct changefeed_point_stamp_t {
     ql::changefeed::client_t::addr_t addr;
     store_key_t key;
+    boost::optional<ql::changefeed::sub_registration_t> registration;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_point_stamp_t);
 
@@ -2,12 +2,21 @@
 #include "rdb_protocol/query_cache.hpp"
 
 #include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
 #include "rdb_protocol/pseudo_time.hpp"
 #include "rdb_protocol/response.hpp"
+#include "rdb_protocol/serialize_datum.hpp"
 #include "rdb_protocol/term_walker.hpp"
 
 namespace ql {
 
+prepared_query_t::prepared_query_t(scoped_ptr_t<term_storage_t> &&_term_storage,
+                                   counted_t<const term_t> &&_func_term,
+                                   ticks_t _compile_duration) :
+        term_storage(std::move(_term_storage)),
+        func_term(std::move(_func_term)),
+        compile_duration(_compile_duration) { }
+
 query_cache_t::query_cache_t(
             rdb_context_t *_rdb_ctx,
             ip_and_port_t _client_addr_port,
@@ -17,6 +26,9 @@ query_cache_t::query_cache_t(
         client_addr_port(_client_addr_port),
         return_empty_normal_batches(_return_empty_normal_batches),
         user_context(std::move(_user_context)),
+        prefetched_bytes(0),
+        next_prepared_id(0),
+        prepared_queries(MAX_PREPARED_QUERIES_PER_CONNECTION),
         next_query_id(0),
         oldest_outstanding_query_id(0) {
     auto res = rdb_ctx->get_query_caches_for_this_thread()->insert(this);
@@ -24,6 +36,10 @@ query_cache_t::query_cache_t(
 }
 
 query_cache_t::~query_cache_t() {
+    // The batches that were prefetched but never read no longer count towards the
+    // server's limit, once the prefetches that are still running are done.
+    drainer.drain();
+    rdb_ctx->prefetched_bytes.fetch_sub(static_cast<int64_t>(prefetched_bytes));
     size_t res = rdb_ctx->get_query_caches_for_this_thread()->erase(this);
     guarantee(res == 1);
 }
@@ -99,6 +115,42 @@ scoped_ptr_t<query_cache_t::ref_t> query_cache_t::get(query_params_t *query_para
                                          interruptor));
 }
 
+int64_t query_cache_t::prepare(query_params_t *query_params) {
+    r_sanity_check(query_params->type == Query::PREPARE);
+    guarantee(this == query_params->query_cache);
+    assert_thread();
+    query_params->maybe_release_query_id();
+
+    counted_t<const term_t> func_term;
+    ticks_t start_ticks = get_ticks();
+    try {
+        query_params->term_storage->preprocess();
+        raw_term_t root_term = query_params->term_storage->root_term();
+        rcheck_toplevel(root_term.type() == Term::FUNC, base_exc_t::LOGIC,
+                        "A prepared query must be a function of its placeholders.");
+
+        compile_env_t compile_env((var_visibility_t()));
+        func_term = compile_term(&compile_env, root_term);
+    } catch (const exc_t &e) {
+        throw bt_exc_t(Response::COMPILE_ERROR,
+            e.get_error_type(),
+            e.what(),
+            query_params->term_storage->backtrace_registry().datum_backtrace(e));
+    } catch (const datum_exc_t &e) {
+        throw bt_exc_t(Response::COMPILE_ERROR,
+                       e.get_error_type(),
+                       e.what(),
+                       backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+
+    int64_t id = next_prepared_id++;
+    prepared_queries[id] = make_counted<const prepared_query_t>(
+        std::move(query_params->term_storage),
+        std::move(func_term),
+        get_ticks() - start_ticks);
+    return id;
+}
+
 void query_cache_t::noreply_wait(const query_params_t &query_params,
                                  signal_t *interruptor) {
     guarantee(this == query_params.query_cache);
@@ -136,12 +188,24 @@ void query_cache_t::terminate_internal(query_cache_t::entry_t *entry) {
         entry->state = entry_t::state_t::DONE;
     }
     entry->persistent_interruptor.pulse_if_not_already_pulsed();
+
+    // Nobody is going to read a prefetched batch anymore.  A prefetch that's still
+    // running finds the query stopped and doesn't store its batch.
+    entry->prefetched_batch = boost::none;
+    set_prefetched_bytes(entry, 0);
+    entry->prefetch_error = nullptr;
 }
 
 auth::user_context_t const &query_cache_t::get_user_context() const {
     return user_context;
 }
 
+bool query_cache_t::is_empty() const {
+    return queries.empty()
+        && prepared_queries.empty()
+        && outstanding_query_ids.empty();
+}
+
 query_cache_t::ref_t::ref_t(query_cache_t *_query_cache,
                             int64_t _token,
                             new_semaphore_in_line_t _throttler,
@@ -162,6 +226,84 @@ void query_cache_t::async_destroy_entry(query_cache_t::entry_t *entry) {
     delete entry;
 }
 
+void query_cache_t::prefetch_next_batch(query_cache_t::entry_t *entry,
+                                        auto_drainer_t::lock_t entry_lock,
+                                        auto_drainer_t::lock_t cache_lock,
+                                        new_mutex_in_line_t *_mutex_lock) {
+    assert_thread();
+    scoped_ptr_t<new_mutex_in_line_t> mutex_lock(_mutex_lock);
+    wait_any_t interruptor(&entry->persistent_interruptor,
+                           entry_lock.get_drain_signal(),
+                           cache_lock.get_drain_signal());
+    try {
+        wait_interruptible(mutex_lock->acq_signal(), &interruptor);
+    } catch (const interrupted_exc_t &) {
+        set_prefetched_bytes(entry, 0);
+        return;
+    }
+
+    // The query may have been stopped while we were waiting for the previous
+    // reference to release the entry.
+    if (entry->state != entry_t::state_t::STREAM) {
+        set_prefetched_bytes(entry, 0);
+        return;
+    }
+    guarantee(!entry->prefetched_batch && entry->prefetch_error == nullptr);
+
+    try {
+        serializable_env_t serializable{
+                entry->global_optargs,
+                get_user_context(),
+                pseudo::time_now()};
+        env_t env(rdb_ctx,
+                  return_empty_normal_batches,
+                  &interruptor,
+                  serializable,
+                  nullptr);
+        std::vector<datum_t> batch = entry->stream->next_batch(
+            &env, batchspec_t::user(batch_type_t::NORMAL, &env));
+
+        size_t batch_bytes = 0;
+        for (const datum_t &d : batch) {
+            batch_bytes += serialized_size<cluster_version_t::CLUSTER>(d);
+        }
+        entry->prefetched_batch = std::move(batch);
+        set_prefetched_bytes(entry, batch_bytes);
+    } catch (const interrupted_exc_t &) {
+        // Whoever interrupted us will also take care of the query
+        set_prefetched_bytes(entry, 0);
+    } catch (...) {
+        // The error is reported to the client in response to its next `CONTINUE`
+        entry->prefetch_error = std::current_exception();
+        set_prefetched_bytes(entry, 0);
+    }
+}
+
+bool query_cache_t::reserve_prefetched_bytes(entry_t *entry, size_t bytes) {
+    guarantee(entry->prefetched_bytes == 0);
+    if (prefetched_bytes + bytes > MAX_PREFETCHED_BYTES_PER_CONNECTION) {
+        return false;
+    }
+    // The other connections are on other threads, so we take our share first and
+    // give it back if it doesn't fit.
+    const int64_t signed_bytes = static_cast<int64_t>(bytes);
+    if (rdb_ctx->prefetched_bytes.fetch_add(signed_bytes) + signed_bytes
+        > static_cast<int64_t>(MAX_PREFETCHED_BYTES)) {
+        rdb_ctx->prefetched_bytes.fetch_sub(signed_bytes);
+        return false;
+    }
+    prefetched_bytes += bytes;
+    entry->prefetched_bytes = bytes;
+    return true;
+}
+
+void query_cache_t::set_prefetched_bytes(entry_t *entry, size_t bytes) {
+    prefetched_bytes = prefetched_bytes - entry->prefetched_bytes + bytes;
+    rdb_ctx->prefetched_bytes.fetch_add(static_cast<int64_t>(bytes)
+                                        - static_cast<int64_t>(entry->prefetched_bytes));
+    entry->prefetched_bytes = bytes;
+}
+
 query_cache_t::ref_t::~ref_t() {
     query_cache->assert_thread();
     guarantee(entry->state != entry_t::state_t::START);
@@ -208,6 +350,9 @@ void query_cache_t::ref_t::fill_response(response_t *res) {
             serializable,
             trace.get_or_null());
 
+        const datum_allocation_counts_t allocations_before =
+            get_datum_allocation_counts();
+
         if (entry->state == entry_t::state_t::START) {
             run(&env, res);
             entry->term_tree.reset();
@@ -218,8 +363,41 @@ void query_cache_t::ref_t::fill_response(response_t *res) {
         }
 
         if (trace.has()) {
+            const datum_allocation_counts_t allocations_after =
+                get_datum_allocation_counts();
+            {
+                // Like the durations in the profile, these counts include other
+                // queries that ran on this thread while this one was waiting.
+                profile::starter_t allocations_starter(
+                    strprintf("Allocated %" PRIu64 " datum strings, %" PRIu64
+                              " arrays and %" PRIu64 " objects.",
+                              allocations_after.strings - allocations_before.strings,
+                              allocations_after.arrays - allocations_before.arrays,
+                              allocations_after.objects - allocations_before.objects),
+                    trace);
+            }
             res->set_profile(trace->as_datum());
         }
+
+        // Profiled queries are not prefetched, so that the profile of each batch
+        // accounts for the work done to produce it.
+        if (entry->state == entry_t::state_t::STREAM
+            && entry->prefetch
+            && !trace.has()
+            && entry->stream->cfeed_type() == feed_type_t::not_feed
+            && query_cache->reserve_prefetched_bytes(
+                entry,
+                batchspec_t::user(batch_type_t::NORMAL, &env).get_max_size())) {
+            // We get in line for the mutex before spawning, so the prefetch runs
+            // before the `CONTINUE` that will consume it.
+            coro_t::spawn_sometime(std::bind(&query_cache_t::prefetch_next_batch,
+                                             query_cache,
+                                             entry,
+                                             auto_drainer_t::lock_t(&entry->drainer),
+                                             auto_drainer_t::lock_t(
+                                                 &query_cache->drainer),
+                                             new new_mutex_in_line_t(&entry->mutex)));
+        }
     } catch (const interrupted_exc_t &ex) {
         // We grab this before `terminate_internal` which will always pulse it.
         bool persistent_interruptor_pulsed = entry->persistent_interruptor.is_pulsed();
@@ -254,13 +432,13 @@ void query_cache_t::ref_t::fill_response(response_t *res) {
         throw bt_exc_t(Response::RUNTIME_ERROR,
                        ex.get_error_type(),
                        ex.what(),
-                       entry->term_storage->backtrace_registry().datum_backtrace(ex));
+                       entry->backtrace_registry().datum_backtrace(ex));
     } catch (const datum_exc_t &ex) {
         query_cache->terminate_internal(entry);
         throw bt_exc_t(Response::RUNTIME_ERROR,
                        ex.get_error_type(),
                        ex.what(),
-                       entry->term_storage->backtrace_registry().datum_backtrace(
+                       entry->backtrace_registry().datum_backtrace(
                             backtrace_id_t::empty(), 0));
     } catch (const std::exception &ex) {
         query_cache->terminate_internal(entry);
@@ -274,6 +452,9 @@ void query_cache_t::ref_t::fill_response(response_t *res) {
 void query_cache_t::ref_t::run(env_t *env, response_t *res) {
     scope_env_t scope_env(env, var_scope_t());
     scoped_ptr_t<val_t> val = entry->term_tree->eval(&scope_env);
+    if (entry->type == Query::EXECUTE) {
+        val = run_prepared(env, val->as_datum());
+    }
 
     if (val->get_type().is_convertible(val_t::type_t::DATUM)) {
         res->set_type(Response::SUCCESS_ATOM);
@@ -305,6 +486,37 @@ void query_cache_t::ref_t::run(env_t *env, response_t *res) {
     }
 }
 
+scoped_ptr_t<val_t> query_cache_t::ref_t::run_prepared(env_t *env,
+                                                       const datum_t &params) {
+    rcheck_toplevel(params.get_type() == datum_t::R_ARRAY && params.arr_size() >= 1,
+                    base_exc_t::LOGIC,
+                    "An EXECUTE query must be an array of a prepared query id "
+                    "followed by the query's arguments.");
+    int64_t id = params.get(0).as_int();
+    auto it = query_cache->prepared_queries.find(id);
+    rcheck_toplevel(it != query_cache->prepared_queries.end(), base_exc_t::LOGIC,
+                    strprintf("Prepared query %" PRIi64 " not found "
+                              "(it may have been evicted).", id));
+    entry->prepared = it->second;
+
+    std::vector<datum_t> args;
+    args.reserve(params.arr_size() - 1);
+    for (size_t i = 1; i < params.arr_size(); ++i) {
+        args.push_back(params.get(i));
+    }
+
+    PROFILE_STARTER_IF_ENABLED(
+        env->profile() == profile_bool_t::PROFILE,
+        strprintf("Execute prepared query %" PRIi64 " "
+                  "(compilation skipped, saved %.3fms).",
+                  id, ticks_to_secs(entry->prepared->compile_duration) * 1000.0),
+        env->trace);
+    scope_env_t scope_env(env, var_scope_t());
+    counted_t<const func_t> func =
+        entry->prepared->func_term->eval(&scope_env)->as_func();
+    return func->call(env, args);
+}
+
 void query_cache_t::ref_t::serve(env_t *env, response_t *res) {
     guarantee(entry->stream.has());
 
@@ -317,8 +529,18 @@ void query_cache_t::ref_t::serve(env_t *env, response_t *res) {
     batch_type_t batch_type = entry->has_sent_batch
                                   ? batch_type_t::NORMAL
                                   : batch_type_t::NORMAL_FIRST;
-    std::vector<datum_t> ds = entry->stream->next_batch(
-            env, batchspec_t::user(batch_type, env));
+    std::vector<datum_t> ds;
+    if (entry->prefetch_error != nullptr) {
+        std::exception_ptr error = entry->prefetch_error;
+        entry->prefetch_error = nullptr;
+        std::rethrow_exception(error);
+    } else if (entry->prefetched_batch) {
+        ds = std::move(*entry->prefetched_batch);
+        entry->prefetched_batch = boost::none;
+        query_cache->set_prefetched_bytes(entry, 0);
+    } else {
+        ds = entry->stream->next_batch(env, batchspec_t::user(batch_type, env));
+    }
     entry->has_sent_batch = true;
     res->set_data(std::move(ds));
 
@@ -364,15 +586,26 @@ query_cache_t::entry_t::entry_t(query_params_t *query_params,
         state(state_t::START),
         interrupt_reason(interrupt_reason_t::UNKNOWN),
         job_id(generate_uuid()),
+        type(query_params->type),
         noreply(query_params->noreply),
+        prefetch(query_params->prefetch),
         profile(query_params->profile ? profile_bool_t::PROFILE :
                                         profile_bool_t::DONT_PROFILE),
         term_storage(std::move(query_params->term_storage)),
         global_optargs(std::move(_global_optargs)),
         start_time(current_microtime()),
         term_tree(std::move(_term_tree)),
-        has_sent_batch(false) { }
+        has_sent_batch(false),
+        prefetched_bytes(0) { }
 
 query_cache_t::entry_t::~entry_t() { }
 
+const backtrace_registry_t &query_cache_t::entry_t::backtrace_registry() const {
+    // Once an `EXECUTE` query is running its prepared query, errors come from the
+    // prepared query's term tree.
+    return prepared.has()
+        ? prepared->term_storage->backtrace_registry()
+        : term_storage->backtrace_registry();
+}
+
 } // namespace ql
@@ -8,6 +8,9 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
 
 #include "arch/address.hpp"
 #include "clustering/administration/auth/user_context.hpp"
@@ -19,6 +22,7 @@
 #include "containers/scoped.hpp"
 #include "containers/counted.hpp"
 #include "containers/intrusive_list.hpp"
+#include "containers/lru_cache.hpp"
 #include "containers/object_buffer.hpp"
 #include "rdb_protocol/datum_stream.hpp"
 #include "rdb_protocol/rdb_backtrace.hpp"
@@ -29,9 +33,42 @@
 #include "rdb_protocol/term.hpp"
 #include "rdb_protocol/term_storage.hpp"
 #include "rdb_protocol/wire_func.hpp"
+#include "time.hpp"
 
 namespace ql {
 
+// Queries run with the `prefetch` global optarg start producing their next batch as
+// soon as a batch has been sent.  Before a prefetch starts it reserves the most its
+// batch may take up, and it only starts if that keeps the prefetched batches of its
+// connection and of the whole server within these limits.  (A batch can go over its
+// size by its last row, which the reservation is corrected for once it's done.)
+const size_t MAX_PREFETCHED_BYTES_PER_CONNECTION = 32 * MEGABYTE;
+const size_t MAX_PREFETCHED_BYTES = 1024 * MEGABYTE;
+
+// The maximum number of prepared queries a single connection may hold.  Preparing
+// more than this evicts the least recently executed one.
+const size_t MAX_PREPARED_QUERIES_PER_CONNECTION = 1024;
+
+// A query compiled by a `PREPARE` query.  `EXECUTE` queries evaluate `func_term` and
+// call the resulting function with their arguments, skipping the parsing and
+// compilation of the query.  Running queries keep a reference to the prepared query,
+// because their term trees point into `term_storage`.
+class prepared_query_t : public single_threaded_countable_t<prepared_query_t> {
+public:
+    prepared_query_t(scoped_ptr_t<term_storage_t> &&_term_storage,
+                     counted_t<const term_t> &&_func_term,
+                     ticks_t _compile_duration);
+
+    const scoped_ptr_t<const term_storage_t> term_storage;
+    const counted_t<const term_t> func_term;
+    // How long it took to compile `func_term`, which is the time each execution of
+    // the prepared query saves.
+    const ticks_t compile_duration;
+
+private:
+    DISABLE_COPYING(prepared_query_t);
+};
+
 class query_cache_t : public home_thread_mixin_t {
     class entry_t;
 public:
@@ -57,6 +94,8 @@ public:
 
         // Run a new query
         void run(env_t *env, response_t *res);
+        // Bind the arguments of an `EXECUTE` query to the prepared query it names
+        scoped_ptr_t<val_t> run_prepared(env_t *env, const datum_t &params);
         // Serve a batch from a stream
         void serve(env_t *env, response_t *res);
 
@@ -91,6 +130,9 @@ public:
     void noreply_wait(const query_params_t &query_params,
                       signal_t *interruptor);
 
+    // Compile a `PREPARE` query and return the id under which it was cached
+    int64_t prepare(query_params_t *query_params);
+
     // Issue a stop query to the cache
     void stop_query(query_params_t *query_params, signal_t *interruptor);
 
@@ -101,6 +143,10 @@ public:
 
     auth::user_context_t const &get_user_context() const;
 
+    // Returns true if the cache has no queries or prepared queries, so the connection
+    // could continue with a new cache, for example on another thread.
+    bool is_empty() const;
+
 private:
     class entry_t {
     public:
@@ -112,8 +158,12 @@ private:
         enum class state_t { START, STREAM, DONE, DELETING } state;
         interrupt_reason_t interrupt_reason;
 
+        const backtrace_registry_t &backtrace_registry() const;
+
         const uuid_u job_id;
+        const Query::QueryType type;
         const bool noreply;
+        const bool prefetch;
         const profile_bool_t profile;
         const scoped_ptr_t<const term_storage_t> term_storage;
         const global_optargs_t global_optargs;
@@ -121,6 +171,10 @@ private:
 
         cond_t persistent_interruptor;
 
+        // This will be set once an `EXECUTE` query has looked up its prepared query,
+        // and must outlive `term_tree` and `stream`
+        counted_t<const prepared_query_t> prepared;
+
         // This will be empty if the root term has already been run
         counted_t<const term_t> term_tree;
 
@@ -130,6 +184,13 @@ private:
         counted_t<datum_stream_t> stream;
         bool has_sent_batch;
 
+        // The next batch of `stream` if it has been prefetched, or the error that
+        // prefetching it ran into.  `prefetched_bytes` is the size of the batch, or
+        // what's reserved for it while the prefetch is running.
+        boost::optional<std::vector<datum_t> > prefetched_batch;
+        size_t prefetched_bytes;
+        std::exception_ptr prefetch_error;
+
         // The order of these is very important, do not move them around
         new_mutex_t mutex; // Only one coroutine may be using this query at a time
         auto_drainer_t drainer; // Keep this entry alive until all refs are destroyed
@@ -140,18 +201,42 @@ private:
 
     static void async_destroy_entry(entry_t *entry);
 
+    // Produces the next batch of `entry`'s stream ahead of the client's `CONTINUE`.
+    // `mutex_lock` must already be in line for the entry's mutex, so the `CONTINUE`
+    // waits for the prefetch to finish and then serves its result.
+    void prefetch_next_batch(entry_t *entry,
+                             auto_drainer_t::lock_t entry_lock,
+                             auto_drainer_t::lock_t cache_lock,
+                             new_mutex_in_line_t *mutex_lock);
+    // Reserves `bytes` for a prefetch of `entry`, or returns false if that would go
+    // over the limits.
+    bool reserve_prefetched_bytes(entry_t *entry, size_t bytes);
+    // Changes what `entry` accounts for, e.g. to zero once nobody is going to read
+    // its prefetched batch.
+    void set_prefetched_bytes(entry_t *entry, size_t bytes);
+
     rdb_context_t *const rdb_ctx;
     ip_and_port_t client_addr_port;
     return_empty_normal_batches_t return_empty_normal_batches;
     auth::user_context_t user_context;
     std::map<int64_t, scoped_ptr_t<entry_t> > queries;
 
+    // The total size of the batches prefetched by the entries in `queries`, including
+    // reservations
+    size_t prefetched_bytes;
+
+    int64_t next_prepared_id;
+    lru_cache_t<int64_t, counted_t<const prepared_query_t> > prepared_queries;
+
     // Used for noreply waiting, this contains all allocated-but-incomplete query ids
     friend class query_params_t::query_id_t;
     uint64_t next_query_id;
     intrusive_list_t<query_params_t::query_id_t> outstanding_query_ids;
     watchable_variable_t<uint64_t> oldest_outstanding_query_id;
 
+    // Keeps the cache alive while prefetches are running
+    auto_drainer_t drainer;
+
     DISABLE_COPYING(query_cache_t);
 };
 
@@ -63,16 +63,43 @@ void query_params_t::maybe_release_query_id() {
     }
 }
 
+const char *query_priority_name(query_priority_t priority) {
+    switch (priority) {
+    case query_priority_t::HIGH: return "high";
+    case query_priority_t::NORMAL: return "normal";
+    case query_priority_t::LOW: return "low";
+    default: unreachable();
+    }
+}
+
 query_params_t::query_params_t(int64_t _token,
                                ql::query_cache_t *_query_cache,
                                scoped_ptr_t<term_storage_t> &&_term_storage) :
         query_cache(_query_cache),
         term_storage(std::move(_term_storage)),
-        id(query_cache), token(_token), noreply(false), profile(false) {
+        id(query_cache), token(_token), noreply(false), profile(false),
+        prefetch(false), priority(query_priority_t::NORMAL) {
     // Parse out information that is needed before query evaluation
     type = term_storage->query_type();
     noreply = term_storage->static_optarg_as_bool("noreply", noreply);
     profile = term_storage->static_optarg_as_bool("profile", profile);
+    prefetch = term_storage->static_optarg_as_bool("prefetch", prefetch);
+
+    const std::string priority_name = term_storage->static_optarg_as_string(
+        "priority", query_priority_name(priority));
+    bool found = false;
+    for (size_t i = 0; i < NUM_QUERY_PRIORITIES; ++i) {
+        if (priority_name == query_priority_name(static_cast<query_priority_t>(i))) {
+            priority = static_cast<query_priority_t>(i);
+            found = true;
+        }
+    }
+    if (!found) {
+        throw bt_exc_t(Response::CLIENT_ERROR, Response::QUERY_LOGIC,
+                       strprintf("Unrecognized priority `%s`, expected `high`, "
+                                 "`normal` or `low`.", priority_name.c_str()),
+                       backtrace_registry_t::EMPTY_BACKTRACE);
+    }
 }
 
 } // namespace ql
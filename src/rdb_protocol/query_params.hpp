@@ -13,6 +13,18 @@ namespace ql {
 class query_cache_t;
 class term_storage_t;
 
+// The priority class that a query waits in to be admitted to run when the server is
+// busy.  It's set with the `priority` global optarg.
+enum class query_priority_t {
+    HIGH = 0,
+    NORMAL = 1,
+    LOW = 2
+};
+
+static const size_t NUM_QUERY_PRIORITIES = 3;
+
+const char *query_priority_name(query_priority_t priority);
+
 class query_params_t {
 public:
     query_params_t(int64_t _token,
@@ -45,6 +57,8 @@ public:
     Query::QueryType type;
     bool noreply;
     bool profile;
+    bool prefetch;
+    query_priority_t priority;
 
     new_semaphore_in_line_t throttler;
 
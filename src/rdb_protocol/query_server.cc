@@ -9,12 +9,13 @@
 #include "rdb_protocol/response.hpp"
 
 rdb_query_server_t::rdb_query_server_t(
-    const std::set<ip_address_t> &local_addresses, int port,
+    const std::set<ip_address_t> &local_addresses, int port, bool reuse_port,
     rdb_context_t *_rdb_ctx, server_config_client_t *_server_config_client,
     const server_id_t &_server_id, tls_ctx_t *tls_ctx
 ) :
     server(
-        _rdb_ctx, local_addresses, port, this, default_http_timeout_sec, tls_ctx
+        _rdb_ctx, local_addresses, port, reuse_port, this, default_http_timeout_sec,
+        tls_ctx
     ),
     rdb_ctx(_rdb_ctx),
     server_config_client(_server_config_client),
@@ -39,7 +40,8 @@ void rdb_query_server_t::run_query(ql::query_params_t *query_params,
         scoped_perfmon_counter_t client_active(&rdb_ctx->stats.clients_active);
 
         switch (query_params->type) {
-        case Query::START: {
+        case Query::START:
+        case Query::EXECUTE: {
             scoped_ptr_t<ql::query_cache_t::ref_t> query_ref =
                 query_params->query_cache->create(query_params, interruptor);
             query_ref->fill_response(response_out);
@@ -57,6 +59,11 @@ void rdb_query_server_t::run_query(ql::query_params_t *query_params,
             query_params->query_cache->noreply_wait(*query_params, interruptor);
             response_out->set_type(Response::WAIT_COMPLETE);
         } break;
+        case Query::PREPARE: {
+            int64_t id = query_params->query_cache->prepare(query_params);
+            response_out->set_type(Response::SUCCESS_ATOM);
+            response_out->set_data(ql::datum_t(static_cast<double>(id)));
+        } break;
         case Query::SERVER_INFO: {
             fill_server_info(response_out);
             response_out->set_type(Response::SERVER_INFO);
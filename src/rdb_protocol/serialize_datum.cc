@@ -13,6 +13,9 @@
 #include "containers/archive/versioned.hpp"
 #include "containers/counted.hpp"
 #include "containers/shared_buffer.hpp"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/error.hpp"
@@ -886,51 +889,57 @@ size_t datum_get_array_size(const shared_buf_ref_t<char> &array) {
      varint ser_size
      varint num_elements
      uint*_t offsets[num_elements - 1] // counted from `data`, first element omitted
-     T data[num_elements] */
-size_t datum_get_element_offset(const shared_buf_ref_t<char> &array, size_t index) {
-    buffer_read_stream_t sz_read_stream(array.get(), array.get_safety_boundary());
-    uint64_t ser_size = 0;
-    guarantee_deserialization(deserialize_varint_uint64(&sz_read_stream, &ser_size),
-                              "datum decode array");
-    const datum_offset_size_t offset_size = get_offset_size_from_inner_size(ser_size);
-    size_t serialized_offset_size;
-    switch (offset_size) {
-    case datum_offset_size_t::U8BIT:
-        serialized_offset_size = serialize_universal_size_t<uint8_t>::value; break;
-    case datum_offset_size_t::U16BIT:
-        serialized_offset_size = serialize_universal_size_t<uint16_t>::value; break;
-    case datum_offset_size_t::U32BIT:
-        serialized_offset_size = serialize_universal_size_t<uint32_t>::value; break;
-    case datum_offset_size_t::U64BIT:
-        serialized_offset_size = serialize_universal_size_t<uint64_t>::value; break;
-    default:
-        unreachable();
-    }
+     T data[num_elements]
+   `offset_table_t` parses the header of such a buffer. */
+class offset_table_t {
+public:
+    offset_table_t(const char *_array, size_t _array_size)
+        : array(_array), array_size(_array_size) {
+        buffer_read_stream_t sz_read_stream(array, array_size);
+        uint64_t ser_size = 0;
+        guarantee_deserialization(deserialize_varint_uint64(&sz_read_stream, &ser_size),
+                                  "datum decode array");
+        offset_size = get_offset_size_from_inner_size(ser_size);
+        switch (offset_size) {
+        case datum_offset_size_t::U8BIT:
+            serialized_offset_size = serialize_universal_size_t<uint8_t>::value; break;
+        case datum_offset_size_t::U16BIT:
+            serialized_offset_size = serialize_universal_size_t<uint16_t>::value; break;
+        case datum_offset_size_t::U32BIT:
+            serialized_offset_size = serialize_universal_size_t<uint32_t>::value; break;
+        case datum_offset_size_t::U64BIT:
+            serialized_offset_size = serialize_universal_size_t<uint64_t>::value; break;
+        default:
+            unreachable();
+        }
 
-    uint64_t num_elements = 0;
-    guarantee_deserialization(deserialize_varint_uint64(&sz_read_stream, &num_elements),
-                              "datum decode array");
-    guarantee(num_elements <= std::numeric_limits<size_t>::max());
-    const size_t sz = static_cast<size_t>(num_elements);
+        uint64_t num_elements_u64 = 0;
+        guarantee_deserialization(
+            deserialize_varint_uint64(&sz_read_stream, &num_elements_u64),
+            "datum decode array");
+        guarantee(num_elements_u64 <= std::numeric_limits<size_t>::max());
+        num_elements = static_cast<size_t>(num_elements_u64);
+
+        table_offset = static_cast<size_t>(sz_read_stream.tell());
+        data_offset = num_elements == 0
+            ? table_offset
+            : table_offset + (num_elements - 1) * serialized_offset_size;
+    }
 
-    guarantee(index < sz);
+    size_t size() const { return num_elements; }
 
-    rassert(sz > 0);
-    const size_t data_offset =
-        static_cast<size_t>(sz_read_stream.tell())
-        + (num_elements - 1) * serialized_offset_size;
+    // The offset of the element `index` from the start of the array
+    size_t element_offset(size_t index) const {
+        guarantee(index < num_elements);
+        if (index == 0) {
+            return data_offset;
+        }
 
-    if (index == 0) {
-        return data_offset;
-    } else {
         const size_t element_offset_offset =
-            static_cast<size_t>(sz_read_stream.tell())
-            + (index - 1) * serialized_offset_size;
-
-        array.guarantee_in_boundary(element_offset_offset);
-        buffer_read_stream_t read_stream(
-            array.get() + element_offset_offset,
-            array.get_safety_boundary() - element_offset_offset);
+            table_offset + (index - 1) * serialized_offset_size;
+        guarantee(element_offset_offset < array_size);
+        buffer_read_stream_t read_stream(array + element_offset_offset,
+                                         array_size - element_offset_offset);
 
         uint64_t element_offset;
         switch (offset_size) {
@@ -958,14 +967,185 @@ size_t datum_get_element_offset(const shared_buf_ref_t<char> &array, size_t inde
                                       "datum decode array offset");
             element_offset = off;
         } break;
+        default:
+            unreachable();
         }
         guarantee(element_offset <= std::numeric_limits<size_t>::max(),
                   "Datum too large for this architecture.");
 
         return data_offset + static_cast<size_t>(element_offset);
     }
+
+private:
+    const char *array;
+    size_t array_size;
+    datum_offset_size_t offset_size;
+    size_t serialized_offset_size;
+    size_t num_elements;
+    size_t table_offset;
+    size_t data_offset;
+};
+
+size_t datum_get_element_offset(const shared_buf_ref_t<char> &array, size_t index) {
+    offset_table_t table(array.get(), array.get_safety_boundary());
+    return table.element_offset(index);
 }
 
+template <class json_writer_t>
+void datum_write_json_from_buf(const shared_buf_ref_t<char> &buf,
+                               size_t at_offset,
+                               json_writer_t *writer);
+
+// Writes the contents of the `BUF_R_ARRAY` or `BUF_R_OBJECT` that starts at
+// `at_offset` (after its type byte).
+template <class json_writer_t>
+void datum_write_json_elements_from_buf(const shared_buf_ref_t<char> &buf,
+                                     size_t at_offset,
+                                     datum_t::type_t type,
+                                     json_writer_t *writer) {
+    buf.guarantee_in_boundary(at_offset);
+    const char *array = buf.get() + at_offset;
+    const size_t array_size = buf.get_safety_boundary() - at_offset;
+    offset_table_t table(array, array_size);
+    if (type == datum_t::R_ARRAY) {
+        writer->StartArray();
+        for (size_t i = 0; i < table.size(); ++i) {
+            datum_write_json_from_buf(buf, at_offset + table.element_offset(i), writer);
+        }
+        writer->EndArray();
+    } else {
+        writer->StartObject();
+        for (size_t i = 0; i < table.size(); ++i) {
+            const size_t key_offset = table.element_offset(i);
+            guarantee(key_offset < array_size);
+            buffer_read_stream_t key_stream(array + key_offset, array_size - key_offset);
+            uint64_t key_size = 0;
+            guarantee_deserialization(deserialize_varint_uint64(&key_stream, &key_size),
+                                      "datum decode object key");
+            const size_t key_data_offset =
+                key_offset + static_cast<size_t>(key_stream.tell());
+            guarantee(key_size <= array_size - key_data_offset);
+            writer->Key(array + key_data_offset, key_size);
+            datum_write_json_from_buf(buf,
+                                      at_offset + key_data_offset + key_size,
+                                      writer);
+        }
+        writer->EndObject();
+    }
+}
+
+// Unlike `datum_deserialize_from_buf(buf, at_offset).write_json(writer)`, this doesn't
+// construct a `datum_t` for every element of an array or object.
+template <class json_writer_t>
+void datum_write_json_from_buf(const shared_buf_ref_t<char> &buf,
+                               size_t at_offset,
+                               json_writer_t *writer) {
+    buf.guarantee_in_boundary(at_offset);
+    const size_t remaining = buf.get_safety_boundary() - at_offset;
+    buffer_read_stream_t read_stream(buf.get() + at_offset, remaining);
+    datum_serialized_type_t type = datum_serialized_type_t::R_NULL;
+    guarantee_deserialization(datum_deserialize(&read_stream, &type),
+                              "datum type from buf");
+
+    switch (type) {
+    case datum_serialized_type_t::R_NULL: {
+        writer->Null();
+    } break;
+    case datum_serialized_type_t::R_BOOL: {
+        bool value;
+        guarantee_deserialization(deserialize_universal(&read_stream, &value),
+                                  "datum bool from buf");
+        writer->Bool(value);
+    } break;
+    case datum_serialized_type_t::INT_NEGATIVE: // fallthru
+    case datum_serialized_type_t::INT_POSITIVE: {
+        uint64_t unsigned_value;
+        guarantee_deserialization(deserialize_varint_uint64(&read_stream,
+                                                            &unsigned_value),
+                                  "datum int from buf");
+        guarantee(unsigned_value <= max_dbl_int);
+        if (type == datum_serialized_type_t::INT_POSITIVE) {
+            writer->Int64(static_cast<int64_t>(unsigned_value));
+        } else if (unsigned_value == 0) {
+            // Integers cannot represent -0, see `datum_t::write_json`
+            writer->Double(-0.0);
+        } else {
+            writer->Int64(-static_cast<int64_t>(unsigned_value));
+        }
+    } break;
+    case datum_serialized_type_t::DOUBLE: {
+        double d;
+        guarantee_deserialization(deserialize_universal(&read_stream, &d),
+                                  "datum double from buf");
+        int64_t i;
+        if (!(d == 0.0 && std::signbit(d))
+            && number_as_integer(d, &i)) {
+            writer->Int64(i);
+        } else {
+            writer->Double(d);
+        }
+    } break;
+    case datum_serialized_type_t::R_STR: {
+        uint64_t str_size;
+        guarantee_deserialization(deserialize_varint_uint64(&read_stream, &str_size),
+                                  "datum string from buf");
+        const size_t str_offset = static_cast<size_t>(read_stream.tell());
+        guarantee(str_size <= remaining - str_offset);
+        writer->String(buf.get() + at_offset + str_offset, str_size);
+    } break;
+    case datum_serialized_type_t::BUF_R_ARRAY: {
+        call_with_enough_stack([&] () {
+                datum_write_json_elements_from_buf(
+                    buf, at_offset + static_cast<size_t>(read_stream.tell()),
+                    datum_t::R_ARRAY, writer);
+            }, MIN_DATUM_SERIALIZATION_STACK_SPACE);
+    } break;
+    case datum_serialized_type_t::BUF_R_OBJECT: {
+        call_with_enough_stack([&] () {
+                datum_write_json_elements_from_buf(
+                    buf, at_offset + static_cast<size_t>(read_stream.tell()),
+                    datum_t::R_OBJECT, writer);
+            }, MIN_DATUM_SERIALIZATION_STACK_SPACE);
+    } break;
+    case datum_serialized_type_t::R_BINARY: // fallthru
+    case datum_serialized_type_t::R_ARRAY: // fallthru
+    case datum_serialized_type_t::R_OBJECT: // fallthru
+    case datum_serialized_type_t::MINVAL: // fallthru
+    case datum_serialized_type_t::MAXVAL: // fallthru
+    case datum_serialized_type_t::UNINITIALIZED: {
+        // These are rare enough not to need a fast path.
+        datum_deserialize_from_buf(buf, at_offset).write_json(writer);
+    } break;
+    default:
+        unreachable();
+    }
+}
+
+template <class json_writer_t>
+void datum_write_json_array_from_buf(const shared_buf_ref_t<char> &array,
+                                     json_writer_t *writer) {
+    datum_write_json_elements_from_buf(array, 0, datum_t::R_ARRAY, writer);
+}
+
+template <class json_writer_t>
+void datum_write_json_object_from_buf(const shared_buf_ref_t<char> &object,
+                                      json_writer_t *writer) {
+    datum_write_json_elements_from_buf(object, 0, datum_t::R_OBJECT, writer);
+}
+
+template void datum_write_json_array_from_buf(
+    const shared_buf_ref_t<char> &array,
+    rapidjson::Writer<rapidjson::StringBuffer> *writer);
+template void datum_write_json_array_from_buf(
+    const shared_buf_ref_t<char> &array,
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> *writer);
+template void datum_write_json_object_from_buf(
+    const shared_buf_ref_t<char> &object,
+    rapidjson::Writer<rapidjson::StringBuffer> *writer);
+template void datum_write_json_object_from_buf(
+    const shared_buf_ref_t<char> &object,
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> *writer);
+
 size_t datum_serialized_size(const datum_string_t &s) {
     const size_t s_size = s.size();
     return varint_uint64_serialized_size(s_size) + s_size;
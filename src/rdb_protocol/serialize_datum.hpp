@@ -58,6 +58,16 @@ size_t datum_get_element_offset(const shared_buf_ref_t<char> &array, size_t inde
 // Reads the number of elements in the array stored in the buffer
 size_t datum_get_array_size(const shared_buf_ref_t<char> &array);
 
+// Write the array or object stored in the buffer as JSON.  These read the elements
+// straight from the serialized representation, so they're cheaper than going through
+// `datum_t::get` or `datum_t::get_pair` for every element.
+template <class json_writer_t>
+void datum_write_json_array_from_buf(const shared_buf_ref_t<char> &array,
+                                     json_writer_t *writer);
+template <class json_writer_t>
+void datum_write_json_object_from_buf(const shared_buf_ref_t<char> &object,
+                                      json_writer_t *writer);
+
 size_t datum_serialized_size(const datum_string_t &s);
 serialization_result_t datum_serialize(write_message_t *wm, const datum_string_t &s);
 
@@ -4,6 +4,7 @@
 #include <list>
 
 #include "btree/backfill_debug.hpp"
+#include "btree/get_distribution.hpp"
 #include "btree/reql_specific.hpp"
 #include "btree/superblock.hpp"
 #include "concurrency/cross_thread_signal.hpp"
@@ -298,6 +299,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         guarantee(res != NULL);
         res->server_uuids.insert(cserver.first->get_uuid());
         res->addrs.insert(cserver.first->get_stop_addr());
+        res->sub_stop_addrs.insert(cserver.first->get_sub_stop_addr());
     }
 
     void operator()(const changefeed_limit_subscribe_t &s) {
@@ -322,7 +324,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             if (s.spec.range.sindex) {
                 rget.terminal = ql::limit_read_t{
                     is_primary_t::NO,
-                    s.spec.limit,
+                    ql::changefeed::limit_manager_t::capacity(s.spec.limit),
                     s.region,
                     !reversed(s.spec.range.sorting)
                         ? store_key_t::min()
@@ -336,7 +338,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             } else {
                 rget.terminal = ql::limit_read_t{
                     is_primary_t::YES,
-                    s.spec.limit,
+                    ql::changefeed::limit_manager_t::capacity(s.spec.limit),
                     s.region,
                     !reversed(s.spec.range.sorting)
                         ? store_key_t::min()
@@ -370,7 +372,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             std::move(stream),
             s.spec.range.sindex ? is_primary_t::NO : is_primary_t::YES,
             s.spec.range.sorting,
-            s.spec.limit);
+            ql::changefeed::limit_manager_t::capacity(s.spec.limit));
 
         guarantee(s.current_shard);
         auto cserver = store->get_or_make_changefeed_server(*s.current_shard);
@@ -402,14 +404,18 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
 
         auto cserver = store->changefeed_server(s.region);
         if (cserver.first != nullptr) {
-            if (boost::optional<uint64_t> stamp
-                    = cserver.first->get_stamp(s.addr, cserver.second)) {
+            boost::optional<ql::changefeed::journal_pos_t> journal_pos;
+            if (boost::optional<uint64_t> stamp = s.registration
+                    ? cserver.first->add_sub(s.addr, ctx, *s.registration,
+                                             cserver.second, &journal_pos)
+                    : cserver.first->get_stamp(s.addr, cserver.second)) {
                 changefeed_stamp_response_t out;
                 out.stamp_infos = std::map<uuid_u, shard_stamp_info_t>();
                 (*out.stamp_infos)[cserver.first->get_uuid()] = shard_stamp_info_t{
                     *stamp,
                     current_shard,
-                    read_start};
+                    read_start,
+                    journal_pos};
                 return out;
             }
         }
@@ -431,8 +437,12 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         if (cserver.first != nullptr) {
             res->resp = changefeed_point_stamp_response_t::valid_response_t();
             auto *vres = &*res->resp;
-            if (boost::optional<uint64_t> stamp
-                    = cserver.first->get_stamp(s.addr, cserver.second)) {
+            // Point subscriptions never journal.
+            boost::optional<ql::changefeed::journal_pos_t> journal_pos;
+            if (boost::optional<uint64_t> stamp = s.registration
+                    ? cserver.first->add_sub(s.addr, ctx, *s.registration,
+                                             cserver.second, &journal_pos)
+                    : cserver.first->get_stamp(s.addr, cserver.second)) {
                 vres->stamp = std::make_pair(cserver.first->get_uuid(), *stamp);
             } else {
                 // The client was removed, so no future messages are coming.
@@ -645,6 +655,10 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
     void operator()(const distribution_read_t &dg) {
         response->response = distribution_read_response_t();
         distribution_read_response_t *res = boost::get<distribution_read_response_t>(&response->response);
+        if (static_cast<bool>(dg.sindex_id)) {
+            sindex_population_get(dg, res);
+            return;
+        }
         rdb_distribution_get(dg.max_depth, dg.region.inner.left,
                              superblock, res);
         for (std::map<store_key_t, int64_t>::iterator it = res->key_counts.begin(); it != res->key_counts.end(); ) {
@@ -685,6 +699,34 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         trace(_trace) { }
 
 private:
+    void sindex_population_get(const distribution_read_t &dg,
+                               distribution_read_response_t *res) {
+        // An index that doesn't exist (anymore), is still being constructed or was
+        // created by a version that didn't keep track of its population has no
+        // statistics, so we return an empty distribution for it.
+        scoped_ptr_t<sindex_superblock_t> sindex_sb;
+        std::vector<char> sindex_mapping_data;
+        uuid_u sindex_uuid;
+        try {
+            bool found = store->acquire_sindex_superblock_for_read(
+                sindex_name_t(*dg.sindex_id),
+                "",
+                superblock,
+                &sindex_sb,
+                &sindex_mapping_data,
+                &sindex_uuid);
+            if (!found) {
+                return;
+            }
+        } catch (const sindex_not_ready_exc_t &) {
+            return;
+        }
+        if (sindex_sb->get_stat_block_id() == NULL_BLOCK_ID) {
+            return;
+        }
+        res->key_counts[store_key_t::min()] = get_btree_population(sindex_sb.get());
+        res->region = dg.region;
+    }
 
     read_response_t *const response;
     rdb_context_t *const ctx;
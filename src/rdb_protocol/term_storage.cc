@@ -30,6 +30,8 @@ bool query_type_is_valid(Query::QueryType query_type) {
     case Query::STOP:
     case Query::NOREPLY_WAIT:
     case Query::SERVER_INFO:
+    case Query::PREPARE:
+    case Query::EXECUTE:
         return true;
     default:
         return false;
@@ -229,6 +231,14 @@ bool term_storage_t::static_optarg_as_bool(UNUSED const std::string &key,
     unreachable();
 }
 
+std::string term_storage_t::static_optarg_as_string(
+        UNUSED const std::string &key,
+        UNUSED const std::string &default_value) const {
+    r_sanity_check(false, "static_optarg_as_string() is unimplemented "
+                   "for this term_storage_t type");
+    unreachable();
+}
+
 global_optargs_t term_storage_t::global_optargs() {
     r_sanity_check(false, "global_optargs() is unimplemented "
                    "for this term_storage_t type");
@@ -295,11 +305,11 @@ raw_term_t json_term_storage_t::root_term() const {
     return raw_term_t(&query_json[1]);
 }
 
-bool json_term_storage_t::static_optarg_as_bool(const std::string &key,
-                                                bool default_value) const {
+const rapidjson::Value *json_term_storage_t::static_optarg(
+        const std::string &key) const {
     r_sanity_check(query_json.IsArray());
     if (query_json.Size() < 3) {
-        return default_value;
+        return nullptr;
     }
 
     const rapidjson::Value *_global_optargs = &query_json[2];
@@ -307,19 +317,34 @@ bool json_term_storage_t::static_optarg_as_bool(const std::string &key,
 
     const auto it = _global_optargs->FindMember(key.c_str());
     if (it == _global_optargs->MemberEnd()) {
-        return default_value;
-    } else if (it->value.IsBool()) {
-        return it->value.GetBool();
-    } else if (!it->value.IsArray() ||
-               it->value.Size() != 2 ||
+        return nullptr;
+    } else if (!it->value.IsArray()) {
+        return &it->value;
+    } else if (it->value.Size() != 2 ||
                !it->value[0].IsNumber() ||
                static_cast<Term::TermType>(it->value[0].GetInt()) != Term::DATUM) {
-        return default_value;
-    } else if (!it->value[1].IsBool()) {
+        return nullptr;
+    }
+    return &it->value[1];
+}
+
+bool json_term_storage_t::static_optarg_as_bool(const std::string &key,
+                                                bool default_value) const {
+    const rapidjson::Value *value = static_optarg(key);
+    if (value == nullptr || !value->IsBool()) {
         return default_value;
     }
-    return it->value[1].GetBool();
+    return value->GetBool();
+}
 
+std::string json_term_storage_t::static_optarg_as_string(
+        const std::string &key,
+        const std::string &default_value) const {
+    const rapidjson::Value *value = static_optarg(key);
+    if (value == nullptr || !value->IsString()) {
+        return default_value;
+    }
+    return std::string(value->GetString(), value->GetStringLength());
 }
 
 global_optargs_t json_term_storage_t::global_optargs() {
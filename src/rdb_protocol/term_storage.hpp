@@ -131,6 +131,8 @@ public:
     virtual Query::QueryType query_type() const;
     virtual bool static_optarg_as_bool(const std::string &key,
                                        bool default_value) const;
+    virtual std::string static_optarg_as_string(const std::string &key,
+                                                const std::string &default_value) const;
     virtual void preprocess();
     virtual global_optargs_t global_optargs();
 
@@ -145,10 +147,16 @@ public:
     Query::QueryType query_type() const;
     bool static_optarg_as_bool(const std::string &key,
                                bool default_value) const;
+    std::string static_optarg_as_string(const std::string &key,
+                                        const std::string &default_value) const;
     void preprocess();
     raw_term_t root_term() const;
     global_optargs_t global_optargs();
 private:
+    // Returns the value of the global optarg `key` if it's given as a datum, or
+    // nullptr.
+    const rapidjson::Value *static_optarg(const std::string &key) const;
+
     scoped_array_t<char> original_data;
     rapidjson::Document query_json;
 };
@@ -1,5 +1,6 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "cjson/json.hpp"
+#include "rdb_protocol/offload.hpp"
 #include "rdb_protocol/op.hpp"
 #include "rdb_protocol/term.hpp"
 #include "rdb_protocol/terms/terms.hpp"
@@ -29,30 +30,43 @@ public:
             return new_val(to_datum(cjson.get(), env->env->limits(),
                                     env->env->reql_version()));
         } else {
-            // Copy the string into a null-terminated c-string that we can write
-            // to, so we can use RapidJSON in-situ parsing (and at least avoid
-            // some additional copying).
-            std::vector<char> str_buf(data.size() + 1);
-            memcpy(str_buf.data(), data.data(), data.size());
-            for (size_t i = 0; i < data.size(); ++i) {
-                rcheck(str_buf[i] != '\0', base_exc_t::LOGIC,
-                       "Encountered unescaped null byte in JSON string.");
-            }
-            str_buf[data.size()] = '\0';
+            const configured_limits_t &limits = env->env->limits();
+            const reql_version_t reql_version = env->env->reql_version();
+            datum_t result;
+            auto parse = [&]() {
+                // Copy the string into a null-terminated c-string that we can write
+                // to, so we can use RapidJSON in-situ parsing (and at least avoid
+                // some additional copying).
+                std::vector<char> str_buf(data.size() + 1);
+                memcpy(str_buf.data(), data.data(), data.size());
+                for (size_t i = 0; i < data.size(); ++i) {
+                    rcheck(str_buf[i] != '\0', base_exc_t::LOGIC,
+                           "Encountered unescaped null byte in JSON string.");
+                }
+                str_buf[data.size()] = '\0';
 
-            rapidjson::Document json;
-            // Note: Insitu will cause some parts of `json` to directly point into
-            // `str_buf`. `str_buf`'s life time must be at least as long as `json`'s.
-            json.ParseInsitu(str_buf.data());
+                rapidjson::Document json;
+                // Note: Insitu will cause some parts of `json` to directly point into
+                // `str_buf`. `str_buf`'s life time must be at least as long as
+                // `json`'s.
+                json.ParseInsitu(str_buf.data());
 
-            rcheck(!json.HasParseError(), base_exc_t::LOGIC,
-                   strprintf("Failed to parse \"%s\" as JSON: %s",
-                       (data.size() > 40
-                        ? (data.to_std().substr(0, 37) + "...").c_str()
-                        : data.to_std().c_str()),
-                       rapidjson::GetParseError_En(json.GetParseError())));
-            return new_val(to_datum(json, env->env->limits(),
-                                    env->env->reql_version()));
+                rcheck(!json.HasParseError(), base_exc_t::LOGIC,
+                       strprintf("Failed to parse \"%s\" as JSON: %s",
+                           (data.size() > 40
+                            ? (data.to_std().substr(0, 37) + "...").c_str()
+                            : data.to_std().c_str()),
+                           rapidjson::GetParseError_En(json.GetParseError())));
+                result = to_datum(json, limits, reql_version);
+            };
+            // Parsing doesn't evaluate anything, so large strings can be parsed in
+            // the compute pool.
+            if (should_offload(env->env, data.size(), COMPUTE_OFFLOAD_MIN_JSON_SIZE)) {
+                run_offloaded(env->env, parse);
+            } else {
+                parse();
+            }
+            return new_val(result);
         }
     }
 
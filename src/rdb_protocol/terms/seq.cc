@@ -537,10 +537,13 @@ public:
             env, term, argspec_t(1),
             optargspec_t({"squash",
                           "changefeed_queue_size",
+                          "changefeed_spill_size",
                           "include_initial",
                           "include_offsets",
+                          "include_resume_tokens",
                           "include_states",
-                          "include_types"})) { }
+                          "include_types",
+                          "resume_from"})) { }
 private:
     virtual scoped_ptr_t<val_t> eval_impl(
         scope_env_t *env, args_t *args, eval_flags_t) const {
@@ -577,35 +580,74 @@ private:
             include_offsets = v->as_bool();
         }
 
+        bool include_resume_tokens = false;
+        if (scoped_ptr_t<val_t> v = args->optarg(env, "include_resume_tokens")) {
+            include_resume_tokens = v->as_bool();
+        }
+
+        std::map<uuid_u, uint64_t> resume_from;
+        if (scoped_ptr_t<val_t> v = args->optarg(env, "resume_from")) {
+            datum_t token = v->as_datum();
+            rcheck_target(v, token.get_type() == datum_t::R_OBJECT
+                          && token.obj_size() != 0,
+                          base_exc_t::LOGIC,
+                          "Expected a resume token from a change, but found "
+                          + token.print() + ".");
+            for (size_t i = 0; i < token.obj_size(); ++i) {
+                std::pair<datum_string_t, datum_t> pair = token.get_pair(i);
+                uuid_u server_uuid;
+                rcheck_target(v, str_to_uuid(pair.first.to_std(), &server_uuid)
+                              && pair.second.get_type() == datum_t::R_NUM
+                              && pair.second.as_num() >= 0.0,
+                              base_exc_t::LOGIC,
+                              "Invalid resume token " + token.print() + ".");
+                resume_from[server_uuid] = pair.second.as_int();
+            }
+            // A resumed feed has to be resumable again.
+            include_resume_tokens = true;
+        }
+
         scoped_ptr_t<val_t> v = args->arg(env, 0);
         configured_limits_t limits = env->env->limits_with_changefeed_queue_size(
                 args->optarg(env, "changefeed_queue_size"));
+        size_t spill_size = 0;
+        scoped_ptr_t<val_t> spill_val = args->optarg(env, "changefeed_spill_size");
+        if (spill_val.has()) {
+            spill_size = check_limit("changefeed spill size", spill_val->as_int());
+        }
         if (v->get_type().is_convertible(val_t::type_t::SEQUENCE)) {
             counted_t<datum_stream_t> seq = v->as_seq(env->env);
             std::vector<counted_t<datum_stream_t> > streams;
             std::vector<changespec_t> changespecs = seq->get_changespecs();
             r_sanity_check(changespecs.size() >= 1);
+            // The positions in a resume token are only meaningful for one table.
+            rcheck(!include_resume_tokens || changespecs.size() == 1,
+                   base_exc_t::LOGIC,
+                   "Cannot include resume tokens in a changefeed on more than one "
+                   "table.");
             for (auto &&changespec : changespecs) {
                 if (include_initial) {
                     r_sanity_check(changespec.stream.has());
                 }
                 boost::apply_visitor(rcheck_spec_visitor_t(env->env, backtrace()),
                                      changespec.keyspec.spec);
+                changefeed::streamspec_t ss(
+                    include_initial
+                        ? std::move(changespec.stream)
+                        : counted_t<datum_stream_t>(),
+                    changespec.keyspec.table_name,
+                    include_offsets,
+                    include_states,
+                    include_types,
+                    limits,
+                    squash,
+                    std::move(changespec.keyspec.spec));
+                ss.include_resume_tokens = include_resume_tokens;
+                ss.resume_from = resume_from;
+                ss.spill_size = spill_size;
                 streams.push_back(
                     changespec.keyspec.table->read_changes(
-                        env->env,
-                        changefeed::streamspec_t(
-                            include_initial
-                                ? std::move(changespec.stream)
-                                : counted_t<datum_stream_t>(),
-                            changespec.keyspec.table_name,
-                            include_offsets,
-                            include_states,
-                            include_types,
-                            limits,
-                            squash,
-                            std::move(changespec.keyspec.spec)),
-                        backtrace()));
+                        env->env, ss, backtrace()));
             }
             if (streams.size() == 1) {
                 return new_val(env->env, streams[0]);
@@ -620,26 +662,28 @@ private:
             }
         } else if (v->get_type().is_convertible(val_t::type_t::SINGLE_SELECTION)) {
             auto sel = v->as_single_selection();
+            changefeed::streamspec_t ss(
+                include_initial
+                    // We want to provide an empty stream in this case
+                    // because we get the initial values from the stamp
+                    // read instead.
+                    ? make_counted<vector_datum_stream_t>(
+                        sel->get_bt(), std::vector<datum_t>(), boost::none)
+                    : counted_t<vector_datum_stream_t>(),
+                sel->get_tbl()->display_name(),
+                include_offsets,
+                include_states,
+                include_types,
+                limits,
+                squash,
+                sel->get_spec());
+            // Point subscriptions reject these.
+            ss.include_resume_tokens = include_resume_tokens;
+            ss.resume_from = resume_from;
+            ss.spill_size = spill_size;
             return new_val(
                 env->env,
-                sel->get_tbl()->tbl->read_changes(
-                    env->env,
-                    changefeed::streamspec_t(
-                        include_initial
-                            // We want to provide an empty stream in this case
-                            // because we get the initial values from the stamp
-                            // read instead.
-                            ? make_counted<vector_datum_stream_t>(
-                                sel->get_bt(), std::vector<datum_t>(), boost::none)
-                            : counted_t<vector_datum_stream_t>(),
-                        sel->get_tbl()->display_name(),
-                        include_offsets,
-                        include_states,
-                        include_types,
-                        limits,
-                        squash,
-                        sel->get_spec()),
-                    sel->get_bt()));
+                sel->get_tbl()->tbl->read_changes(env->env, ss, sel->get_bt()));
         }
         auto selection = v->as_selection(env->env);
         rfail(base_exc_t::LOGIC,
@@ -154,7 +154,25 @@ ql::datum_t sindex_status_to_datum(
 class sindex_create_term_t : public op_term_t {
 public:
     sindex_create_term_t(compile_env_t *env, const raw_term_t &term)
-        : op_term_t(env, term, argspec_t(2, 3), optargspec_t({"multi", "geo"})) { }
+        : op_term_t(env, term, argspec_t(2, 3),
+                    optargspec_t({"multi", "geo", "filter"})) {
+        // A filtered index maps the rows that don't match the filter to `null`,
+        // which `compute_keys` leaves out of the index.  We build that function
+        // here because the filter and index functions have to be compiled in the
+        // environment they were written in.
+        if (boost::optional<raw_term_t> filter = term.optarg("filter")) {
+            minidriver_t r(term.bt());
+            auto x = minidriver_t::dummy_var_t::SINDEXCREATE_X;
+            minidriver_t::reql_t mapping = term.num_args() == 3
+                ? r.expr(term.arg(2))(r.var(x))
+                : r.var(x)[r.expr(term.arg(1))];
+            filtered_func_term = make_counted<func_term_t>(
+                env,
+                r.fun(x, r.branch(r.expr(*filter)(r.var(x)),
+                                  mapping,
+                                  r.expr(datum_t::null()))).root_term());
+        }
+    }
 
     virtual scoped_ptr_t<val_t> eval_impl(
         scope_env_t *env, args_t *args, eval_flags_t) const {
@@ -170,6 +188,7 @@ public:
         sindex_config_t config;
         config.multi = sindex_multi_bool_t::SINGLE;
         config.geo = sindex_geo_bool_t::REGULAR;
+        bool got_binary = false;
         if (args->num_args() == 3) {
             scoped_ptr_t<val_t> v = args->arg(env, 2);
             bool got_func = false;
@@ -182,6 +201,7 @@ public:
                     // to do some conversions for compatibility.
                     config.func_version = reql_version_t::LATEST;
                     got_func = true;
+                    got_binary = true;
                 }
             }
             // We do it this way so that if someone passes a string, we produce
@@ -203,6 +223,18 @@ public:
             config.func_version = reql_version_t::LATEST;
         }
 
+        if (scoped_ptr_t<val_t> filter_val = args->optarg(env, "filter")) {
+            // We just check the type here, `filtered_func_term` calls it.
+            filter_val->as_func();
+            rcheck(!got_binary,
+                   base_exc_t::LOGIC,
+                   "Cannot combine `filter` with an index function returned from "
+                   "`index_status`.  (The filter is already part of that function.)");
+            r_sanity_check(filtered_func_term.has());
+            config.func = ql::map_wire_func_t(
+                filtered_func_term->eval_to_func(env->scope));
+        }
+
         config.func.compile_wire_func()->assert_deterministic(
             "Index functions must be deterministic.");
 
@@ -241,6 +273,10 @@ public:
     }
 
     virtual const char *name() const { return "sindex_create"; }
+
+private:
+    // The index function with the filter applied, if there is a `filter`.
+    counted_t<func_term_t> filtered_func_term;
 };
 
 class sindex_drop_term_t : public op_term_t {
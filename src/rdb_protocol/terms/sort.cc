@@ -11,6 +11,7 @@
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/minidriver.hpp"
+#include "rdb_protocol/offload.hpp"
 #include "rdb_protocol/op.hpp"
 #include "rdb_protocol/order_util.hpp"
 #include "rdb_protocol/term_walker.hpp"
@@ -118,8 +119,13 @@ private:
                 rcheck_array_size(to_sort, env->env->limits());
             }
             profile::sampler_t sampler("Sorting in-memory.", env->env->trace);
-            auto fn = boost::bind(lt_cmp, env->env, &sampler, _1, _2);
-            std::stable_sort(to_sort.begin(), to_sort.end(), fn);
+            if (should_offload(env->env, to_sort.size(),
+                               COMPUTE_OFFLOAD_MIN_SORT_ROWS)) {
+                lt_cmp.sort_offloaded(env->env, &to_sort);
+            } else {
+                auto fn = boost::bind(lt_cmp, env->env, &sampler, _1, _2);
+                std::stable_sort(to_sort.begin(), to_sort.end(), fn);
+            }
             seq = make_counted<array_datum_stream_t>(
                 datum_t(std::move(to_sort), env->env->limits()),
                 backtrace());
@@ -425,6 +425,32 @@ private:
                     res.add(ql::datum_t(datum_string_t(pair.first)));
                 }
                 b |= info.add("indexes", std::move(res).to_datum());
+
+                std::map<std::string, int64_t> sindex_counts;
+                try {
+                    if (!env->env->reql_cluster_interface()->table_estimate_sindex_counts(
+                            env->env->get_user_context(),
+                            table->db,
+                            table_name,
+                            env->env,
+                            &sindex_counts,
+                            &error)) {
+                        REQL_RETHROW(error);
+                    }
+                } catch (auth::permission_error_t const &permission_error) {
+                    rfail(ql::base_exc_t::PERMISSION_ERROR, "%s", permission_error.what());
+                }
+                // Indexes that are still being constructed don't have an estimate yet.
+                ql::datum_object_builder_t estimates;
+                for (const auto &pair : configs_and_statuses) {
+                    auto it = sindex_counts.find(pair.first);
+                    estimates.overwrite(
+                        datum_string_t(pair.first),
+                        pair.second.second.ready && it != sindex_counts.end()
+                            ? datum_t(static_cast<double>(it->second))
+                            : datum_t::null());
+                }
+                b |= info.add("index_count_estimates", std::move(estimates).to_datum());
             }
         } break;
         case TABLE_SLICE_TYPE: {
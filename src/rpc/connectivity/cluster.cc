@@ -31,12 +31,20 @@
 // Number of messages after which the message handling loop yields
 #define MESSAGE_HANDLER_MAX_BATCH_SIZE           16
 
-// The cluster communication protocol version.
+// The cluster communication protocol version.  We only accept servers whose version
+// string is the same as ours or greater.  Wire format changes that don't come with a
+// new `cluster_version_t` bump it as well, so that servers from before such a change
+// can't connect to servers from after it.  2.4.1 is such a change: it added the
+// subscription registrations of changefeed stamp reads (`changefeed_stamp_t`), the
+// per-subscription values of changes (`msg_t::change_t::sub_changes`), the
+// subscription stop mailboxes (`changefeed_subscribe_response_t`), the changefeed
+// journal positions (see `sub_registration_t`) and distribution reads of secondary
+// indexes (see `distribution_read_t`).
 static_assert(cluster_version_t::CLUSTER == cluster_version_t::v2_4_is_latest,
               "We need to update CLUSTER_VERSION_STRING when we add a new cluster "
               "version.");
 
-#define CLUSTER_VERSION_STRING "2.4.0"
+#define CLUSTER_VERSION_STRING "2.4.1"
 
 const std::string connectivity_cluster_t::cluster_proto_header("RethinkDB cluster\n");
 const std::string connectivity_cluster_t::cluster_version_string(CLUSTER_VERSION_STRING);
@@ -150,11 +158,13 @@ connectivity_cluster_t::connection_t::connection_t(
     }, 1),
     pm_collection(),
     pm_bytes_sent(secs_to_ticks(1), true),
+    pm_bytes_copied(secs_to_ticks(1), true),
     pm_collection_membership(
         &_parent->parent->connectivity_collection,
         &pm_collection,
         uuid_to_str(_peer_id.get_uuid())),
     pm_bytes_sent_membership(&pm_collection, &pm_bytes_sent, "bytes_sent"),
+    pm_bytes_copied_membership(&pm_collection, &pm_bytes_copied, "bytes_copied"),
     parent(_parent),
     peer_id(_peer_id),
     server_id(_server_id),
@@ -1513,6 +1523,7 @@ void connectivity_cluster_t::send_message(connection_t *connection,
 #endif
 
     size_t bytes_sent = buffer.vector().size();
+    size_t bytes_copied = 0;
 
 #ifdef ENABLE_MESSAGE_PROFILER
     std::pair<uint64_t, uint64_t> *stats =
@@ -1561,17 +1572,20 @@ void connectivity_cluster_t::send_message(connection_t *connection,
                 }
             }
 
-            /* Write the message itself to the network */
+            /* Write the message itself to the network.  Large messages are handed
+            over to the connection as they are, rather than copied. */
             {
-                int64_t res = connection->conn->write_buffered(buffer.vector().data(),
-                                                               buffer.vector().size());
+                std::vector<char> buffer_data;
+                buffer.swap(&buffer_data);
+                int64_t res = connection->conn->write_buffered(std::move(buffer_data),
+                                                               &bytes_copied);
                 if (res == -1) {
                     if (connection->conn->is_read_open()) {
                         connection->conn->shutdown_read();
                     }
                     return;
                 } else {
-                    guarantee(res == static_cast<int64_t>(buffer.vector().size()));
+                    guarantee(res == static_cast<int64_t>(bytes_sent));
                 }
             }
         } /* Releases the send_mutex */
@@ -1588,6 +1602,7 @@ void connectivity_cluster_t::send_message(connection_t *connection,
     }
 
     connection->pm_bytes_sent.record(bytes_sent);
+    connection->pm_bytes_copied.record(bytes_copied);
 }
 
 cluster_message_handler_t::cluster_message_handler_t(
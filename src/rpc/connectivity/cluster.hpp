@@ -174,7 +174,11 @@ public:
 
         perfmon_collection_t pm_collection;
         perfmon_sampler_t pm_bytes_sent;
-        perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership;
+        /* How many of the bytes in `pm_bytes_sent` were copied into the connection's
+        write buffer, rather than handed to the socket as they were. */
+        perfmon_sampler_t pm_bytes_copied;
+        perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership,
+            pm_bytes_copied_membership;
 
         /* We only hold this information so we can deregister ourself */
         run_t *parent;
@@ -0,0 +1,233 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "arch/timing.hpp"
+#include "config/args.hpp"
+#include "rdb_protocol/changefeed.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+using ql::changefeed::change_journal_t;
+using ql::changefeed::msg_t;
+
+const char *const JOURNAL_TEST_PATH = "test_changefeed_journal";
+
+static msg_t::change_t make_journal_change(int i) {
+    msg_t::change_t change;
+    change.pkey = store_key_t(strprintf("key%06d", i));
+    change.new_val = ql::datum_t(static_cast<double>(i));
+    return change;
+}
+
+// Returns the sequence numbers and values that `replay` passed on, or nothing if
+// it returned false.
+static boost::optional<std::vector<std::pair<uint64_t, int> > > replay_journal(
+        change_journal_t *journal, uint64_t after, uint64_t up_to) {
+    std::vector<std::pair<uint64_t, int> > replayed;
+    bool complete = journal->replay(
+        after, up_to, [&](uint64_t seq, msg_t::change_t &&change) {
+            replayed.push_back(std::make_pair(seq, change.new_val.as_int()));
+        });
+    if (!complete) {
+        return boost::none;
+    }
+    return replayed;
+}
+
+static counted_t<change_journal_t> make_journal(io_backender_t *io_backender,
+                                                int64_t max_bytes) {
+    return make_counted<change_journal_t>(
+        io_backender,
+        manual_serializer_filepath(JOURNAL_TEST_PATH,
+                                   std::string(JOURNAL_TEST_PATH) + ".create"),
+        &get_global_perfmon_collection(),
+        1,
+        max_bytes,
+        3600 * MILLION);
+}
+
+TPTEST(ChangefeedJournal, Replay) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    auto journal = make_counted<change_journal_t>(
+        &io_backender,
+        manual_serializer_filepath(JOURNAL_TEST_PATH,
+                                   std::string(JOURNAL_TEST_PATH) + ".create"),
+        &get_global_perfmon_collection(),
+        10,
+        MEGABYTE,
+        3600 * MILLION);
+    EXPECT_EQ(9u, journal->last_seq());
+
+    // Some of the changes are written to disk in between, and some aren't yet when
+    // we replay them, so we read from both.
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(static_cast<uint64_t>(10 + i),
+                  journal->append(make_journal_change(i)));
+        if (i % 7 == 0) {
+            nap(1);
+        }
+    }
+    EXPECT_EQ(109u, journal->last_seq());
+
+    auto all = replay_journal(journal.get(), 9, 109);
+    ASSERT_TRUE(static_cast<bool>(all));
+    ASSERT_EQ(100u, all->size());
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(static_cast<uint64_t>(10 + i), (*all)[i].first);
+        EXPECT_EQ(i, (*all)[i].second);
+    }
+
+    auto middle = replay_journal(journal.get(), 50, 60);
+    ASSERT_TRUE(static_cast<bool>(middle));
+    ASSERT_EQ(10u, middle->size());
+    EXPECT_EQ(51u, middle->front().first);
+    EXPECT_EQ(41, middle->front().second);
+    EXPECT_EQ(60u, middle->back().first);
+
+    auto none = replay_journal(journal.get(), 109, 109);
+    ASSERT_TRUE(static_cast<bool>(none));
+    EXPECT_EQ(0u, none->size());
+
+    // Positions from before the journal started, or from after `up_to`, can't be
+    // replayed from.
+    EXPECT_FALSE(static_cast<bool>(replay_journal(journal.get(), 5, 109)));
+    EXPECT_FALSE(static_cast<bool>(replay_journal(journal.get(), 60, 50)));
+}
+
+TPTEST(ChangefeedJournal, Trim) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    // Every change is over the size limit on its own.
+    auto journal = make_counted<change_journal_t>(
+        &io_backender,
+        manual_serializer_filepath(JOURNAL_TEST_PATH,
+                                   std::string(JOURNAL_TEST_PATH) + ".create"),
+        &get_global_perfmon_collection(),
+        1,
+        1,
+        3600 * MILLION);
+    for (int i = 0; i < 10; ++i) {
+        journal->append(make_journal_change(i));
+    }
+    EXPECT_EQ(10u, journal->last_seq());
+
+    // The changes are dropped once they've been written.
+    for (int i = 0; i < 100; ++i) {
+        if (!replay_journal(journal.get(), 9, 10)) {
+            break;
+        }
+        nap(10);
+    }
+    EXPECT_FALSE(static_cast<bool>(replay_journal(journal.get(), 0, 10)));
+    EXPECT_FALSE(static_cast<bool>(replay_journal(journal.get(), 9, 10)));
+
+    // Feeds that are up to date can still resume.
+    auto up_to_date = replay_journal(journal.get(), 10, 10);
+    ASSERT_TRUE(static_cast<bool>(up_to_date));
+    EXPECT_EQ(0u, up_to_date->size());
+}
+
+TPTEST(ChangefeedJournal, ResumeAcrossTrim) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    // All the changes have the same size, so the journal keeps the last five.
+    write_message_t wm;
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, make_journal_change(0));
+    auto journal = make_journal(&io_backender, 5 * wm.size());
+    for (int i = 1; i <= 20; ++i) {
+        journal->append(make_journal_change(i));
+    }
+    for (int i = 0; i < 100; ++i) {
+        if (!replay_journal(journal.get(), 14, 20)) {
+            break;
+        }
+        nap(10);
+    }
+
+    // A feed that saw change 15 can resume, one that only saw change 14 can't.
+    EXPECT_FALSE(static_cast<bool>(replay_journal(journal.get(), 14, 20)));
+    auto at_boundary = replay_journal(journal.get(), 15, 20);
+    ASSERT_TRUE(static_cast<bool>(at_boundary));
+    ASSERT_EQ(5u, at_boundary->size());
+    EXPECT_EQ(16u, at_boundary->front().first);
+    EXPECT_EQ(16, at_boundary->front().second);
+
+    // The changes that aren't written yet continue right after the ones on disk.
+    for (int i = 21; i <= 25; ++i) {
+        journal->append(make_journal_change(i));
+    }
+    auto across = replay_journal(journal.get(), 15, 25);
+    ASSERT_TRUE(static_cast<bool>(across));
+    ASSERT_EQ(10u, across->size());
+    for (size_t i = 0; i < across->size(); ++i) {
+        EXPECT_EQ(16 + i, (*across)[i].first);
+        EXPECT_EQ(static_cast<int>(16 + i), (*across)[i].second);
+    }
+}
+
+TPTEST(ChangefeedJournal, UnwrittenLimit) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    auto journal = make_journal(&io_backender, MEGABYTE);
+    // We don't yield, so nothing gets written and the oldest changes are dropped.
+    const int num_changes = CHANGEFEED_JOURNAL_MAX_UNWRITTEN + 10;
+    for (int i = 1; i <= num_changes; ++i) {
+        journal->append(make_journal_change(i));
+    }
+    EXPECT_EQ(static_cast<uint64_t>(num_changes), journal->last_seq());
+    EXPECT_FALSE(static_cast<bool>(replay_journal(journal.get(), 9, num_changes)));
+    auto kept = replay_journal(journal.get(), 10, num_changes);
+    ASSERT_TRUE(static_cast<bool>(kept));
+    ASSERT_EQ(static_cast<size_t>(CHANGEFEED_JOURNAL_MAX_UNWRITTEN), kept->size());
+    EXPECT_EQ(11u, kept->front().first);
+    EXPECT_EQ(11, kept->front().second);
+}
+
+TPTEST(ChangefeedJournal, WritePause) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    auto journal = make_journal(&io_backender, MEGABYTE);
+    for (int i = 1; i <= 5; ++i) {
+        journal->append(make_journal_change(i));
+    }
+    // Waits until they're on disk.
+    for (int i = 0; i < 100; ++i) {
+        bool in_memory;
+        {
+            change_journal_t::write_pause_t pause(journal.get());
+            in_memory = journal->replay_unwritten(
+                pause, 0, 5, [&](uint64_t, msg_t::change_t &&) { });
+        }
+        if (!in_memory) {
+            break;
+        }
+        nap(10);
+    }
+    {
+        change_journal_t::write_pause_t pause(journal.get());
+        for (int i = 6; i <= 10; ++i) {
+            journal->append(make_journal_change(i));
+        }
+        // The changes appended during the pause stay in memory even if the journal
+        // gets the chance to write them.
+        nap(10);
+        std::vector<uint64_t> seqs;
+        EXPECT_TRUE(journal->replay_unwritten(
+            pause, 5, 10, [&](uint64_t seq, msg_t::change_t &&) {
+                seqs.push_back(seq);
+            }));
+        EXPECT_EQ((std::vector<uint64_t>{6, 7, 8, 9, 10}), seqs);
+
+        // The ones from before are on disk, so they can only be replayed with
+        // `replay`, which may block.
+        EXPECT_FALSE(journal->replay_unwritten(
+            pause, 0, 10, [&](uint64_t, msg_t::change_t &&) { }));
+        seqs.clear();
+        EXPECT_TRUE(journal->replay(
+            pause, 0, 10, [&](uint64_t seq, msg_t::change_t &&) {
+                seqs.push_back(seq);
+            }));
+        EXPECT_EQ(10u, seqs.size());
+    }
+}
+
+}  // namespace unittest
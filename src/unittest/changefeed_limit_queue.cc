@@ -0,0 +1,211 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "config/args.hpp"
+#include "rdb_protocol/changefeed.hpp"
+#include "rdb_protocol/context.hpp"
+#include "random.hpp"
+#include "time.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+using ql::changefeed::item_t;
+using ql::changefeed::limit_order_t;
+using ql::changefeed::limit_queue_t;
+
+item_t make_item(int i, bool sindex) {
+    return item_t(
+        strprintf("id%06d", i),
+        std::make_pair(sindex
+                           ? ql::datum_t(static_cast<double>(randint(20)))
+                           : ql::datum_t::null(),
+                       ql::datum_t(static_cast<double>(i))));
+}
+
+void check_queue(const limit_queue_t &queue,
+                 const std::set<item_t, limit_order_t> &model) {
+    ASSERT_EQ(model.size(), queue.size());
+    // Both are ordered worst first, and `rank` counts from the best item.
+    size_t worse = 0;
+    auto it = queue.begin();
+    for (const auto &item : model) {
+        ASSERT_EQ(item.first, it->first);
+        ASSERT_EQ(model.size() - 1 - worse, queue.rank(it));
+        ASSERT_TRUE(queue.at_rank(queue.rank(it)) == it);
+        ++worse;
+        ++it;
+    }
+}
+
+void test_limit_queue(sorting_t sorting, bool sindex) {
+    limit_order_t gt(sorting);
+    limit_queue_t queue(gt);
+    std::set<item_t, limit_order_t> model(gt);
+    std::map<std::string, item_t> by_id;
+    for (int round = 0; round < 2000; ++round) {
+        int i = randint(300);
+        item_t item = make_item(i, sindex);
+        switch (randint(4)) {
+        case 0: // fallthru
+        case 1: {
+            bool inserted = queue.insert(item).second;
+            ASSERT_EQ(by_id.count(item.first) == 0, inserted);
+            if (inserted) {
+                model.insert(item);
+                by_id.insert(std::make_pair(item.first, item));
+            }
+        } break;
+        case 2: {
+            bool deleted = queue.del_id(item.first);
+            auto it = by_id.find(item.first);
+            ASSERT_EQ(it != by_id.end(), deleted);
+            if (deleted) {
+                model.erase(it->second);
+                by_id.erase(it);
+            }
+        } break;
+        case 3: {
+            if (randint(20) == 0) {
+                size_t n = randint(model.size() + 1);
+                std::vector<std::string> truncated = queue.truncate_top(n);
+                ASSERT_EQ(model.size() - std::min(model.size(), n), truncated.size());
+                for (const auto &id : truncated) {
+                    auto it = by_id.find(id);
+                    ASSERT_TRUE(it != by_id.end());
+                    ASSERT_EQ(it->first, model.begin()->first);
+                    model.erase(model.begin());
+                    by_id.erase(it);
+                }
+            } else {
+                auto it = queue.find_id(item.first);
+                ASSERT_EQ(by_id.count(item.first) != 0, it != queue.end());
+            }
+        } break;
+        default: unreachable();
+        }
+        check_queue(queue, model);
+    }
+}
+
+TEST(ChangefeedLimitQueueTest, PrimaryAscending) {
+    test_limit_queue(sorting_t::ASCENDING, false);
+}
+
+TEST(ChangefeedLimitQueueTest, PrimaryDescending) {
+    test_limit_queue(sorting_t::DESCENDING, false);
+}
+
+TEST(ChangefeedLimitQueueTest, SindexAscending) {
+    test_limit_queue(sorting_t::ASCENDING, true);
+}
+
+TEST(ChangefeedLimitQueueTest, SindexDescending) {
+    test_limit_queue(sorting_t::DESCENDING, true);
+}
+
+// This is not really a unit test, but a micro benchmark of the bookkeeping for an
+// `.order_by.limit.changes()` feed under churn, compared to the old ordered set of
+// iterators into an ordered set, and of how often a feed whose best items keep
+// getting deleted has to read from disk with and without spare items.  No need to
+// run this in debug mode.
+#ifdef NDEBUG
+TEST(ChangefeedLimitQueueTest, ChurnBenchmark) {
+    const int num_changes = 100000;
+    for (size_t limit = 10; limit <= 1000; limit *= 10) {
+        limit_order_t gt(sorting_t::ASCENDING);
+        std::vector<item_t> items;
+        for (size_t i = 0; i < limit; ++i) {
+            items.push_back(make_item(i, false));
+        }
+        std::vector<item_t> changes;
+        for (int i = 0; i < num_changes; ++i) {
+            changes.push_back(make_item(limit + randint(limit), false));
+        }
+
+        // Every change replaces a random item and reports the offsets, which is what
+        // `limit_sub_t` does for every change with `include_offsets`.
+        limit_queue_t queue(gt);
+        for (const auto &item : items) {
+            bool inserted = queue.insert(item).second;
+            guarantee(inserted);
+        }
+        size_t queue_offsets = 0;
+        ticks_t start_ticks = get_ticks();
+        for (const auto &item : changes) {
+            auto it = queue.at_rank(randint(queue.size()));
+            queue_offsets += queue.rank(it);
+            queue.erase(it);
+            auto pair = queue.insert(item);
+            queue_offsets += queue.rank(pair.first);
+            if (!pair.second) {
+                queue_offsets += 1;
+            }
+        }
+        double queue_secs = ticks_to_secs(get_ticks() - start_ticks);
+
+        std::set<item_t, limit_order_t> data(gt);
+        std::map<std::string, std::set<item_t, limit_order_t>::iterator> index;
+        for (const auto &item : items) {
+            index[item.first] = data.insert(item).first;
+        }
+        size_t set_offsets = 0;
+        start_ticks = get_ticks();
+        for (const auto &item : changes) {
+            auto it = data.begin();
+            std::advance(it, randint(data.size()));
+            set_offsets += std::distance(it, data.end()) - 1;
+            index.erase(it->first);
+            data.erase(it);
+            auto index_it = index.find(item.first);
+            if (index_it != index.end()) {
+                set_offsets += std::distance(index_it->second, data.end());
+            } else {
+                auto pair = data.insert(item);
+                index[item.first] = pair.first;
+                set_offsets += std::distance(pair.first, data.end()) - 1;
+            }
+        }
+        double set_secs = ticks_to_secs(get_ticks() - start_ticks);
+        EXPECT_EQ(data.size(), queue.size());
+
+        printf("limit %4zu: %.3f us/change sorted vector, %.3f us/change set\n",
+               limit,
+               queue_secs * 1e6 / num_changes,
+               set_secs * 1e6 / num_changes);
+        // Keep the offsets alive.
+        EXPECT_NE(0u, queue_offsets + set_offsets);
+    }
+
+    // Simulate a feed on a table of `num_rows` rows whose best row is deleted on
+    // every write, like a work queue.  The feed reads from disk whenever it runs
+    // out of items beyond the limit.
+    const size_t num_rows = 100000;
+    const size_t limit = 100;
+    for (size_t spare : {static_cast<size_t>(0),
+                         static_cast<size_t>(CHANGEFEED_LIMIT_SPARE_ITEMS)}) {
+        limit_queue_t queue(limit_order_t(sorting_t::ASCENDING));
+        size_t next_row = 0;
+        size_t reads = 0;
+        size_t deletions = 0;
+        while (next_row < num_rows) {
+            if (queue.size() < limit) {
+                ++reads;
+                while (queue.size() < limit + spare && next_row < num_rows) {
+                    bool inserted = queue.insert(make_item(next_row++, false)).second;
+                    guarantee(inserted);
+                }
+            }
+            queue.erase(queue.at_rank(0));
+            ++deletions;
+        }
+        printf("%2zu spare items: %zu disk reads for %zu deletions\n",
+               spare, reads, deletions);
+    }
+}
+#endif  // NDEBUG
+
+}  // namespace unittest
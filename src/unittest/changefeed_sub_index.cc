@@ -0,0 +1,244 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "buffer_cache/cache_balancer.hpp"
+#include "containers/uuid.hpp"
+#include "rdb_protocol/changefeed.hpp"
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/store.hpp"
+#include "random.hpp"
+#include "serializer/log/log_serializer.hpp"
+#include "time.hpp"
+#include "unittest/clustering_utils.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+using ql::changefeed::journal_pos_t;
+using ql::changefeed::keyspec_t;
+using ql::changefeed::msg_t;
+using ql::changefeed::server_t;
+using ql::changefeed::stamped_msgs_t;
+using ql::changefeed::sub_index_t;
+using ql::changefeed::sub_registration_t;
+
+typedef boost::optional<std::vector<key_range_t> > ranges_t;
+
+store_key_t make_key(int i) {
+    return store_key_t(strprintf("key%06d", i));
+}
+
+ranges_t random_ranges(int max_key) {
+    switch (randint(4)) {
+    case 0:
+        return boost::none;
+    case 1:
+        return std::vector<key_range_t>{key_range_t::one_key(
+            make_key(randint(max_key)))};
+    case 2: {
+        std::vector<key_range_t> ranges;
+        for (int i = randint(4); i >= 0; --i) {
+            ranges.push_back(key_range_t::one_key(make_key(randint(max_key))));
+        }
+        return ranges;
+    }
+    default: {
+        int left = randint(max_key);
+        int right = left + randint(max_key - left + 1);
+        return std::vector<key_range_t>{key_range_t(
+            key_range_t::closed, make_key(left), key_range_t::open, make_key(right))};
+    }
+    }
+}
+
+std::set<uuid_u> expected_candidates(const std::map<uuid_u, ranges_t> &subs,
+                                     const store_key_t &key) {
+    std::set<uuid_u> ret;
+    for (const auto &pair : subs) {
+        if (!pair.second) {
+            ret.insert(pair.first);
+            continue;
+        }
+        for (const auto &range : *pair.second) {
+            if (range.contains_key(key)) {
+                ret.insert(pair.first);
+            }
+        }
+    }
+    return ret;
+}
+
+void check_candidates(const sub_index_t &index,
+                      const std::map<uuid_u, ranges_t> &subs,
+                      int max_key) {
+    for (int i = 0; i < max_key; ++i) {
+        store_key_t key = make_key(i);
+        std::multiset<uuid_u> found;
+        index.each_candidate(key, [&](const uuid_u &sub) { found.insert(sub); });
+        std::set<uuid_u> expected = expected_candidates(subs, key);
+        ASSERT_EQ(expected.size(), found.size());
+        ASSERT_TRUE(std::equal(expected.begin(), expected.end(), found.begin()));
+    }
+}
+
+TEST(ChangefeedSubIndexTest, Candidates) {
+    const int max_key = 200;
+    sub_index_t index;
+    std::map<uuid_u, ranges_t> subs;
+    for (int i = 0; i < 100; ++i) {
+        uuid_u sub = generate_uuid();
+        ranges_t ranges = random_ranges(max_key);
+        index.insert(sub, ranges);
+        subs[sub] = ranges;
+    }
+    check_candidates(index, subs, max_key);
+
+    for (auto it = subs.begin(); it != subs.end();) {
+        if (randint(2) == 0) {
+            index.erase(it->first, it->second);
+            it = subs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    check_candidates(index, subs, max_key);
+
+    for (const auto &pair : subs) {
+        index.erase(pair.first, pair.second);
+    }
+    subs.clear();
+    check_candidates(index, subs, max_key);
+}
+
+// This is not really a unit test, but a micro benchmark of the per-write cost of
+// `server_t::send_all` on a server whose client has many range subscriptions, up to
+// the client receiving the changes its subscriptions can see.  No need to run this
+// in debug mode.
+#ifdef NDEBUG
+TPTEST(ChangefeedSubIndexTest, SendAllBenchmark) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    log_serializer_t::create(
+        &file_opener,
+        log_serializer_t::static_config_t());
+
+    log_serializer_t serializer(
+        log_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    // The `server_t` only uses the store for its stamp lock.
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            nullptr,
+            &io_backender,
+            base_path_t("."),
+            generate_uuid(),
+            update_sindexes_t::UPDATE);
+
+    simple_mailbox_cluster_t cluster;
+    rdb_context_t ctx;
+
+    const int num_writes = 100000;
+    for (int num_subs = 10; num_subs <= 10000; num_subs *= 10) {
+        // Every subscription watches a few keys out of a key space ten times the
+        // number of subscriptions, which is roughly what many point and small
+        // range changefeeds look like.
+        const int max_key = num_subs * 10;
+        std::vector<bool> watched(max_key, false);
+        std::vector<sub_registration_t> registrations;
+        for (int i = 0; i < num_subs; ++i) {
+            int left = randint(max_key);
+            int right = std::min(max_key, left + 1 + randint(5));
+            for (int key = left; key < right; ++key) {
+                watched[key] = true;
+            }
+            keyspec_t::range_t range;
+            range.sorting = sorting_t::UNORDERED;
+            range.datumspec = ql::datumspec_t(ql::datum_range_t(
+                ql::datum_t(static_cast<double>(left)), key_range_t::closed,
+                ql::datum_t(static_cast<double>(right)), key_range_t::open));
+            sub_registration_t registration;
+            registration.sub = generate_uuid();
+            registration.spec = std::move(range);
+            registration.journal = false;
+            registrations.push_back(std::move(registration));
+        }
+
+        // Only the changes that some subscription can see are sent to the client.
+        std::vector<msg_t::change_t> changes;
+        size_t expected = 0;
+        for (int i = 0; i < num_writes; ++i) {
+            int key = randint(max_key);
+            msg_t::change_t change;
+            change.pkey = store_key_t(
+                ql::datum_t(static_cast<double>(key)).print_primary());
+            change.new_val = ql::datum_t(static_cast<double>(key));
+            changes.push_back(std::move(change));
+            if (watched[key]) {
+                ++expected;
+            }
+        }
+
+        size_t received = 0;
+        cond_t all_received;
+        mailbox_t<void(stamped_msgs_t)> client_mailbox(
+            cluster.get_mailbox_manager(),
+            [&](signal_t *, const stamped_msgs_t &msgs) {
+                for (const auto &msg : msgs.msgs) {
+                    if (boost::get<msg_t::change_t>(&msg.op) != nullptr) {
+                        ++received;
+                    }
+                }
+                if (received == expected) {
+                    all_received.pulse_if_not_already_pulsed();
+                }
+            });
+        server_t server(cluster.get_mailbox_manager(), &store);
+        auto_drainer_t::lock_t keepalive = server.get_keepalive();
+        server.add_client(client_mailbox.get_address(), region_t::universe(), keepalive);
+        for (const auto &registration : registrations) {
+            boost::optional<journal_pos_t> journal_pos;
+            guarantee(static_cast<bool>(server.add_sub(
+                client_mailbox.get_address(), &ctx, registration, keepalive,
+                &journal_pos)));
+        }
+
+        ticks_t start_ticks = get_ticks();
+        for (const auto &change : changes) {
+            rwlock_in_line_t stamp_spot =
+                store.get_in_line_for_cfeed_stamp(access_t::write);
+            server.send_all(
+                msg_t(msg_t::change_t(change)), change.pkey, &stamp_spot, keepalive);
+        }
+        if (expected != 0) {
+            all_received.wait();
+        }
+        double secs = ticks_to_secs(get_ticks() - start_ticks);
+        EXPECT_EQ(expected, received);
+
+        printf("%5d subscriptions: %.3f us/write, %zu of %d writes sent\n",
+               num_subs,
+               secs * 1e6 / num_writes,
+               expected,
+               num_writes);
+    }
+}
+#endif  // NDEBUG
+
+}  // namespace unittest
@@ -0,0 +1,76 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <zlib.h>
+
+#include <string>
+
+#include "client_protocol/compression.hpp"
+#include "config/args.hpp"
+#include "perfmon/perfmon.hpp"
+#include "random.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+std::string inflate_response(const char *data, size_t size, size_t original_size) {
+    std::string out(original_size, '\0');
+    uLongf out_size = original_size;
+    int res = uncompress(reinterpret_cast<Bytef *>(&out[0]), &out_size,
+                         reinterpret_cast<const Bytef *>(data), size);
+    guarantee(res == Z_OK);
+    out.resize(out_size);
+    return out;
+}
+
+// All the counting happens on this thread, so that's the only one we visit.
+int64_t compression_counter_value(perfmon_counter_t *counter) {
+    void *ctx = counter->begin_stats();
+    counter->visit_stats(ctx);
+    return static_cast<int64_t>(counter->end_stats(ctx).as_num());
+}
+
+TPTEST(ClientCompressionTest, Compress) {
+    perfmon_counter_t responses_compressed;
+    perfmon_counter_t bytes_saved;
+    response_compressor_t compressor(&responses_compressed, &bytes_saved);
+    const size_t offset = 13;
+
+    // Small responses are left alone.
+    std::string small(CLIENT_COMPRESSION_MIN_RESPONSE_SIZE - 1, 'a');
+    scoped_array_t<char> out;
+    size_t compressed_size;
+    EXPECT_FALSE(compressor.compress(small.data(), small.size(), offset,
+                                     &out, &compressed_size));
+
+    // Large compressible responses are compressed, more than once with the same
+    // compressor, and also across several chunks.
+    for (size_t size : {static_cast<size_t>(CLIENT_COMPRESSION_MIN_RESPONSE_SIZE),
+                        static_cast<size_t>(3 * MEGABYTE + 17)}) {
+        for (int round = 0; round < 2; ++round) {
+            std::string response;
+            while (response.size() < size) {
+                response += strprintf("{\"id\":%zu,\"value\":\"row\"},", response.size());
+            }
+            response.resize(size);
+            ASSERT_TRUE(compressor.compress(response.data(), response.size(), offset,
+                                            &out, &compressed_size));
+            ASSERT_LT(compressed_size, response.size());
+            ASSERT_EQ(response,
+                      inflate_response(out.data() + offset, compressed_size, size));
+        }
+    }
+    EXPECT_EQ(4, compression_counter_value(&responses_compressed));
+    EXPECT_LT(0, compression_counter_value(&bytes_saved));
+
+    // Incompressible responses are sent as they are.
+    std::string noise(64 * KILOBYTE, '\0');
+    for (char &c : noise) {
+        c = static_cast<char>(randint(256));
+    }
+    EXPECT_FALSE(compressor.compress(noise.data(), noise.size(), offset,
+                                     &out, &compressed_size));
+    EXPECT_EQ(4, compression_counter_value(&responses_compressed));
+}
+
+}  // namespace unittest
@@ -0,0 +1,96 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "client_protocol/thread_load.hpp"
+#include "concurrency/pmap.hpp"
+#include "config/args.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+TPTEST(ClientThreadLoadTest, Placement, 4) {
+    client_thread_load_t load;
+    const int num_threads = get_num_db_threads();
+    ASSERT_GE(num_threads, 2);
+
+    // Without any running queries, connections are spread evenly over the threads.
+    std::vector<scoped_ptr_t<client_thread_load_t::connection_t> > connections;
+    for (int i = 0; i < 2 * num_threads; ++i) {
+        threadnum_t thread = load.least_loaded_thread();
+        EXPECT_EQ(i % num_threads, thread.threadnum);
+        connections.push_back(
+            make_scoped<client_thread_load_t::connection_t>(&load, thread));
+    }
+
+    // Running queries weigh more than connections.
+    threadnum_t busy_thread(0);
+    threadnum_t target = INVALID_THREAD;
+    std::vector<scoped_ptr_t<client_thread_load_t::query_t> > queries;
+    {
+        on_thread_t thread_switcher(busy_thread);
+        for (int i = 0; i < CLIENT_REBALANCE_MIN_QUERY_IMBALANCE - 1; ++i) {
+            queries.push_back(make_scoped<client_thread_load_t::query_t>(&load));
+        }
+    }
+    EXPECT_NE(busy_thread, load.least_loaded_thread());
+    EXPECT_FALSE(load.should_move_from(busy_thread, &target));
+
+    // Only a big enough difference makes idle connections move.
+    {
+        on_thread_t thread_switcher(busy_thread);
+        queries.push_back(make_scoped<client_thread_load_t::query_t>(&load));
+    }
+    ASSERT_TRUE(load.should_move_from(busy_thread, &target));
+    EXPECT_EQ(load.least_loaded_thread(), target);
+    EXPECT_FALSE(load.should_move_from(target, &target));
+
+    connections[0]->move_to(target);
+    EXPECT_NE(target, load.least_loaded_thread());
+
+    {
+        on_thread_t thread_switcher(busy_thread);
+        queries.clear();
+    }
+    EXPECT_FALSE(load.should_move_from(busy_thread, &target));
+}
+
+TPTEST(ClientThreadLoadTest, BurstPlacement, 4) {
+    client_thread_load_t load;
+    const int num_threads = get_num_db_threads();
+
+    // A burst of connections is placed from the listener's thread before any of them
+    // gets to switch threads, like the query server does.
+    std::vector<threadnum_t> placed;
+    std::vector<scoped_ptr_t<client_thread_load_t::connection_t> > connections;
+    for (int i = 0; i < 25 * num_threads; ++i) {
+        threadnum_t thread = load.least_loaded_thread();
+        placed.push_back(thread);
+        connections.push_back(
+            make_scoped<client_thread_load_t::connection_t>(&load, thread));
+    }
+    std::vector<int> per_thread(num_threads, 0);
+    for (threadnum_t thread : placed) {
+        ++per_thread[thread.threadnum];
+    }
+    for (int count : per_thread) {
+        EXPECT_EQ(25, count);
+    }
+
+    // The connections only leave the count of their thread once they're gone,
+    // whichever thread they go away on.
+    pmap(num_threads, [&](int i) {
+        on_thread_t thread_switcher((threadnum_t(i)));
+        for (size_t j = (i + 1) % num_threads; j < connections.size();
+             j += num_threads) {
+            connections[j].reset();
+        }
+    });
+    for (int i = 0; i < 2 * num_threads; ++i) {
+        EXPECT_EQ(i % num_threads, load.least_loaded_thread().threadnum);
+        connections.push_back(make_scoped<client_thread_load_t::connection_t>(
+            &load, load.least_loaded_thread()));
+    }
+}
+
+}  // namespace unittest
@@ -0,0 +1,117 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <pthread.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "arch/runtime/compute_pool.hpp"
+#include "arch/runtime/coroutines.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
+#include "concurrency/pmap.hpp"
+#include "random.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "time.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+TPTEST(ComputePool, RunsOffThePool) {
+    compute_pool_t pool(2);
+    const pthread_t caller = pthread_self();
+    bool ran_elsewhere = false;
+    pool.run([&]() {
+        ran_elsewhere = !pthread_equal(caller, pthread_self());
+    });
+    EXPECT_TRUE(ran_elsewhere);
+
+    // Exceptions come back to the caller.
+    EXPECT_THROW(pool.run([]() { throw std::runtime_error("oops"); }),
+                 std::runtime_error);
+
+    // Several coroutines can wait for jobs at once, and each gets its own result.
+    std::vector<int> results(16, 0);
+    pmap(results.size(), [&](int64_t i) {
+        pool.run([&]() { results[i] = i * i; });
+    });
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(static_cast<int>(i * i), results[i]);
+    }
+}
+
+#ifdef NDEBUG
+std::vector<ql::datum_t> make_compute_pool_rows(size_t count) {
+    std::vector<ql::datum_t> rows;
+    rows.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        rows.push_back(ql::datum_t(static_cast<double>(randint(1000000000))));
+    }
+    return rows;
+}
+
+/* Runs heavy queries, which each sort a large array, on this thread, while a light
+query keeps yielding.  Each of the light query's yields is one of its round trips
+through the event loop, so how long it takes is how long a cheap query on the same
+thread has to wait. */
+void run_mixed_compute_load(compute_pool_t *pool, std::vector<double> *waits_ms_out) {
+    const int num_heavy = 10;
+    const size_t rows_per_heavy = 500000;
+    std::vector<std::vector<ql::datum_t> > heavy_rows;
+    for (int i = 0; i < num_heavy; ++i) {
+        heavy_rows.push_back(make_compute_pool_rows(rows_per_heavy));
+    }
+
+    bool heavy_done = false;
+    cond_t light_done;
+    coro_t::spawn_sometime([&]() {
+        while (!heavy_done) {
+            ticks_t start = get_ticks();
+            coro_t::yield();
+            waits_ms_out->push_back(ticks_to_secs(get_ticks() - start) * 1000);
+        }
+        light_done.pulse();
+    });
+
+    for (auto &rows : heavy_rows) {
+        auto sort_rows = [&]() {
+            std::sort(rows.begin(), rows.end(),
+                      [](const ql::datum_t &l, const ql::datum_t &r) {
+                          return l.cmp(r) < 0;
+                      });
+        };
+        if (pool != nullptr) {
+            pool->run(sort_rows);
+        } else {
+            sort_rows();
+        }
+        coro_t::yield();
+    }
+    heavy_done = true;
+    light_done.wait();
+}
+
+void print_compute_load_waits(const char *name, std::vector<double> *waits_ms) {
+    ASSERT_FALSE(waits_ms->empty());
+    std::sort(waits_ms->begin(), waits_ms->end());
+    printf("%-9s %8zu light round trips, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           name, waits_ms->size(),
+           (*waits_ms)[waits_ms->size() / 2],
+           (*waits_ms)[waits_ms->size() * 99 / 100],
+           waits_ms->back());
+}
+
+TPTEST(ComputePool, MixedLoadBenchmark) {
+    std::vector<double> inline_waits_ms;
+    run_mixed_compute_load(nullptr, &inline_waits_ms);
+    print_compute_load_waits("inline", &inline_waits_ms);
+
+    compute_pool_t pool(2);
+    std::vector<double> offloaded_waits_ms;
+    run_mixed_compute_load(&pool, &offloaded_waits_ms);
+    print_compute_load_waits("offloaded", &offloaded_waits_ms);
+}
+#endif  // NDEBUG
+
+}  // namespace unittest
@@ -1,6 +1,8 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 
 #include "containers/archive/string_stream.hpp"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/datum_string.hpp"
 #include "rdb_protocol/env.hpp"
@@ -9,6 +11,13 @@
 
 namespace unittest {
 
+std::string datum_to_json(const ql::datum_t &datum) {
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    datum.write_json(&writer);
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
 void test_datum_serialization(const ql::datum_t datum) {
     ql::datum_t deserialized_datum;
     {
@@ -24,6 +33,8 @@ void test_datum_serialization(const ql::datum_t datum) {
                                                              &deserialized_datum);
         ASSERT_EQ(archive_result_t::SUCCESS, res);
         ASSERT_EQ(datum, deserialized_datum);
+        // Arrays and objects are now written straight from their buffers
+        ASSERT_EQ(datum_to_json(datum), datum_to_json(deserialized_datum));
     }
 
     // Re-serialize the just deserialized datum a second time. This might use
@@ -172,6 +183,67 @@ TEST(DatumTest, ArraySerialization) {
     }
 }
 
+TEST(DatumTest, ObjectBuilder) {
+    ql::datum_object_builder_t builder;
+    ASSERT_FALSE(builder.add("c", ql::datum_t(3.0)));
+    ASSERT_FALSE(builder.add("a", ql::datum_t(1.0)));
+    ASSERT_FALSE(builder.add("b", ql::datum_t(2.0)));
+    // `add` doesn't overwrite existing keys, `overwrite` does.
+    ASSERT_TRUE(builder.add("a", ql::datum_t(10.0)));
+    builder.overwrite("b", ql::datum_t(20.0));
+    builder.overwrite("d", ql::datum_t(4.0));
+    ASSERT_TRUE(builder.delete_field("c"));
+    ASSERT_FALSE(builder.delete_field("c"));
+    ASSERT_EQ(ql::datum_t(20.0), builder.at(datum_string_t("b")));
+    ASSERT_FALSE(builder.try_get(datum_string_t("c")).has());
+
+    ql::datum_t object = std::move(builder).to_datum();
+    ql::datum_t expected(std::map<datum_string_t, ql::datum_t>
+            {std::make_pair(datum_string_t("a"), ql::datum_t(1.0)),
+             std::make_pair(datum_string_t("b"), ql::datum_t(20.0)),
+             std::make_pair(datum_string_t("d"), ql::datum_t(4.0))});
+    ASSERT_EQ(expected, object);
+    test_datum_serialization(object);
+
+    // Copying an object and adding to it keeps the keys sorted.
+    ql::datum_object_builder_t copy(object);
+    ASSERT_FALSE(copy.add("c", ql::datum_t(3.0)));
+    ql::datum_t copied = std::move(copy).to_datum();
+    ASSERT_EQ(4u, copied.obj_size());
+    ASSERT_EQ(datum_string_t("c"), copied.get_pair(2).first);
+
+    // Large objects built out of order.
+    ql::datum_object_builder_t large;
+    for (int i = 999; i >= 0; --i) {
+        ASSERT_FALSE(large.add(datum_string_t(strprintf("%03d", i)), ql::datum_t(1.0)));
+    }
+    ASSERT_TRUE(large.add(datum_string_t("500"), ql::datum_t(2.0)));
+    ASSERT_TRUE(large.delete_field(datum_string_t("500")));
+    ql::datum_t large_object = std::move(large).to_datum();
+    ASSERT_EQ(999u, large_object.obj_size());
+    ASSERT_EQ(datum_string_t("000"), large_object.get_pair(0).first);
+    ASSERT_EQ(datum_string_t("999"), large_object.get_pair(998).first);
+}
+
+TEST(DatumTest, EmptyString) {
+    // However an empty string is made, it behaves the same.
+    for (const datum_string_t &empty : {datum_string_t(),
+                                        datum_string_t(""),
+                                        datum_string_t(std::string()),
+                                        concat(datum_string_t(), datum_string_t())}) {
+        ASSERT_EQ(0u, empty.size());
+        ASSERT_TRUE(empty.empty());
+        ASSERT_EQ(std::string(), empty.to_std());
+        ASSERT_TRUE(empty == "");
+        ASSERT_EQ(datum_string_t(), empty);
+        ASSERT_LT(empty, datum_string_t("a"));
+        ASSERT_EQ(datum_string_t("a"), concat(empty, datum_string_t("a")));
+        ql::datum_t datum(empty);
+        ASSERT_EQ("\"\"", datum_to_json(datum));
+        test_datum_serialization(datum);
+    }
+}
+
 // Tests serialization with different offset sizes, up to 32 bit
 // (64 bit not tested here, because that would use too much memory for a unit test)
 TEST(DatumTest, OffsetScaling) {
@@ -205,4 +277,40 @@ TEST(DatumTest, OffsetScaling) {
     }
 }
 
+// The characters JSON strings need to escape, as `rapidjson::Writer` escapes them
+std::string escape_json_string(const std::string &str) {
+    std::string res = "\"";
+    for (char c : str) {
+        switch (c) {
+        case '"': res += "\\\""; break;
+        case '\\': res += "\\\\"; break;
+        case '\b': res += "\\b"; break;
+        case '\f': res += "\\f"; break;
+        case '\n': res += "\\n"; break;
+        case '\r': res += "\\r"; break;
+        case '\t': res += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                res += strprintf("\\u%04X", static_cast<unsigned int>(c));
+            } else {
+                res += c;
+            }
+        }
+    }
+    return res + "\"";
+}
+
+TEST(DatumTest, JsonStringEscaping) {
+    // Put characters that need escaping at every position of the blocks that are
+    // scanned at once.
+    const char special[] = { '"', '\\', '\n', '\x01', '\x1f', '\x7f', '\xc3' };
+    for (char c : special) {
+        for (size_t prefix = 0; prefix < 40; ++prefix) {
+            std::string str = std::string(prefix, 'a') + c + std::string(20, 'b');
+            ql::datum_t datum((datum_string_t(str)));
+            ASSERT_EQ(escape_json_string(str), datum_to_json(datum));
+        }
+    }
+}
+
 }  // namespace unittest
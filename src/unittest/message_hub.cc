@@ -0,0 +1,138 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <inttypes.h>
+
+#include <vector>
+
+#include "arch/runtime/runtime.hpp"
+#include "arch/runtime/runtime_utils.hpp"
+#include "arch/runtime/starter.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
+#include "config/args.hpp"
+#include "containers/spsc_ring.hpp"
+#include "time.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+TEST(SpscRing, FifoAndBounded) {
+    spsc_ring_t<int> ring(4);
+    int out;
+    EXPECT_FALSE(ring.pop(&out));
+
+    // Go around the ring a few times, so that the indices wrap.
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_TRUE(ring.push(round * 10 + i));
+        }
+        EXPECT_FALSE(ring.push(-1));
+        for (int i = 0; i < 4; ++i) {
+            ASSERT_TRUE(ring.pop(&out));
+            EXPECT_EQ(round * 10 + i, out);
+        }
+        EXPECT_FALSE(ring.pop(&out));
+    }
+}
+
+class numbered_message_t : public linux_thread_message_t {
+public:
+    numbered_message_t() : number(0), received(nullptr) { }
+    void on_thread_switch() {
+        received->push_back(number);
+    }
+    int number;
+    std::vector<int> *received;
+};
+
+void check_ordered_messages() {
+    // More messages than fit onto one ring at once, so that the sending thread has to
+    // wait for the receiving thread to make room.
+    on_thread_t start_on((threadnum_t(0)));
+    const int num_messages = 4 * MESSAGE_HUB_RING_SIZE + 3;
+    std::vector<int> received;
+    std::vector<numbered_message_t> messages(num_messages);
+    for (int i = 0; i < num_messages; ++i) {
+        messages[i].number = i;
+        messages[i].received = &received;
+        EXPECT_FALSE(continue_on_thread(threadnum_t(1), &messages[i]));
+    }
+
+    // We travel behind the messages, so by the time we get there they've all been
+    // handled.
+    on_thread_t travel_behind((threadnum_t(1)));
+    ASSERT_EQ(static_cast<size_t>(num_messages), received.size());
+    for (int i = 0; i < num_messages; ++i) {
+        EXPECT_EQ(i, received[i]);
+    }
+}
+
+TPTEST(MessageHub, OrderedMessagesStayInOrder, 2) {
+    check_ordered_messages();
+}
+
+TEST(MessageHub, OrderedMessagesStayInOrderWhileBusyPolling) {
+    ::run_in_thread_pool(&check_ordered_messages, 2, 100);
+}
+
+#ifdef NDEBUG
+/* Hops back and forth between threads 0 and 1 until it has made `hops_left` hops, which
+must be even so that it finishes on thread 0. */
+class bouncing_message_t : public linux_thread_message_t {
+public:
+    bouncing_message_t() : hops_left(0), in_flight(nullptr), done(nullptr) { }
+    void on_thread_switch() {
+        --hops_left;
+        if (hops_left > 0) {
+            const threadnum_t other(get_thread_id().threadnum == 0 ? 1 : 0);
+            continue_on_thread(other, this);
+        } else if (--*in_flight == 0) {
+            done->pulse();
+        }
+    }
+    int hops_left;
+    int *in_flight;
+    cond_t *done;
+};
+
+void run_message_hub_throughput(int num_in_flight, int hops_per_message) {
+    std::vector<bouncing_message_t> messages(num_in_flight);
+    int in_flight = num_in_flight;
+    cond_t done;
+    ticks_t start = get_ticks();
+    for (auto &message : messages) {
+        message.hops_left = hops_per_message;
+        message.in_flight = &in_flight;
+        message.done = &done;
+        continue_on_thread(threadnum_t(1), &message);
+    }
+    done.wait();
+    double secs = ticks_to_secs(get_ticks() - start);
+    printf("%5d in flight: %10.0f hops/sec\n",
+           num_in_flight, num_in_flight * hops_per_message / secs);
+}
+
+TPTEST(MessageHub, ThroughputBenchmark, 2) {
+    on_thread_t thread_switcher((threadnum_t(0)));
+    // One message measures the latency of a hop, many measure how well the hub
+    // batches them.
+    run_message_hub_throughput(1, 200000);
+    run_message_hub_throughput(16, 50000);
+    run_message_hub_throughput(256, 10000);
+    run_message_hub_throughput(4 * MESSAGE_HUB_RING_SIZE, 1000);
+}
+
+TEST(MessageHub, BusyPollingBenchmark) {
+    // A single message in flight means that the receiving thread is idle before every
+    // hop, which is where busy polling makes a difference.
+    for (int64_t busy_poll_usec : {0, 50}) {
+        printf("busy polling for up to %" PRIi64 " usec:\n", busy_poll_usec);
+        ::run_in_thread_pool([]() {
+            on_thread_t thread_switcher((threadnum_t(0)));
+            run_message_hub_throughput(1, 100000);
+        }, 2, busy_poll_usec);
+    }
+}
+#endif  // NDEBUG
+
+}  // namespace unittest
@@ -0,0 +1,224 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <string>
+#include <vector>
+
+#include "arch/timing.hpp"
+#include "client_protocol/protocols.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/pseudo_time.hpp"
+#include "rdb_protocol/response.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+#include "version.hpp"
+
+namespace unittest {
+
+ql::datum_t msgpack_round_trip(const ql::datum_t &datum) {
+    rapidjson::StringBuffer buffer;
+    msgpack_protocol_t::write_datum(datum, &buffer);
+    rapidjson::Document doc;
+    guarantee(msgpack_protocol_t::parse_document(buffer.GetString(), buffer.GetSize(),
+                                                 &doc));
+    return ql::to_datum(doc, ql::configured_limits_t::unlimited, reql_version_t::LATEST);
+}
+
+ql::datum_t make_msgpack_test_row(int i) {
+    ql::datum_object_builder_t row;
+    row.overwrite("id", ql::datum_t(static_cast<double>(i)));
+    row.overwrite("name", ql::datum_t(datum_string_t(strprintf("user %d", i))));
+    row.overwrite("score", ql::datum_t(i * 0.25));
+    row.overwrite("tags", ql::datum_t(std::vector<ql::datum_t>{
+                ql::datum_t("a"), ql::datum_t("b\n\"c\"")},
+            ql::configured_limits_t::unlimited));
+    row.overwrite("created", ql::pseudo::make_time(1e9 + i, "+00:00"));
+    std::string blob(256, '\0');
+    for (size_t j = 0; j < blob.size(); ++j) {
+        blob[j] = static_cast<char>(i + j);
+    }
+    row.overwrite("avatar", ql::datum_t::binary(datum_string_t(blob)));
+    return std::move(row).to_datum();
+}
+
+TEST(MsgpackProtocolTest, RoundTrip) {
+    std::vector<ql::datum_t> values{
+        ql::datum_t::null(),
+        ql::datum_t::boolean(true),
+        ql::datum_t::boolean(false),
+        ql::datum_t(0.0),
+        ql::datum_t(-0.0),
+        ql::datum_t(127.0),
+        ql::datum_t(-32.0),
+        ql::datum_t(-33.0),
+        ql::datum_t(300.0),
+        ql::datum_t(-70000.0),
+        ql::datum_t(5e12),
+        ql::datum_t(-5e12),
+        ql::datum_t(0.1),
+        ql::datum_t(1e300),
+        ql::datum_t(""),
+        ql::datum_t(datum_string_t(std::string(31, 'x'))),
+        ql::datum_t(datum_string_t(std::string(300, 'y'))),
+        ql::datum_t(datum_string_t(std::string(70000, 'z'))),
+        ql::datum_t::binary(datum_string_t(std::string("\0\xff\x01", 3))),
+        ql::datum_t::binary(datum_string_t(std::string(70000, '\xc1'))),
+        ql::pseudo::make_time(1234567890.125, "-07:00"),
+        ql::datum_t(std::vector<ql::datum_t>(20, ql::datum_t(1.0)),
+                    ql::configured_limits_t::unlimited),
+        make_msgpack_test_row(7)
+    };
+    for (const auto &value : values) {
+        ASSERT_EQ(value, msgpack_round_trip(value));
+    }
+    ql::datum_t all(std::vector<ql::datum_t>(values), ql::configured_limits_t::unlimited);
+    ASSERT_EQ(all, msgpack_round_trip(all));
+}
+
+TEST(MsgpackProtocolTest, QueryTerms) {
+    // [START, [MAKE_ARRAY, [1, 2]], {}] must decode to the same types as the JSON
+    // parser produces, since the term storage checks for integers.
+    rapidjson::StringBuffer buffer;
+    msgpack_protocol_t::write_datum(
+        ql::datum_t(std::vector<ql::datum_t>{
+                ql::datum_t(1.0),
+                ql::datum_t(std::vector<ql::datum_t>{
+                        ql::datum_t(2.0),
+                        ql::datum_t(std::vector<ql::datum_t>{
+                                ql::datum_t(1.0), ql::datum_t(2.0)},
+                            ql::configured_limits_t::unlimited)},
+                    ql::configured_limits_t::unlimited),
+                ql::datum_t::empty_object()},
+            ql::configured_limits_t::unlimited),
+        &buffer);
+    rapidjson::Document doc;
+    ASSERT_TRUE(msgpack_protocol_t::parse_document(buffer.GetString(),
+                                                   buffer.GetSize(),
+                                                   &doc));
+    ASSERT_TRUE(doc.IsArray());
+    ASSERT_EQ(3u, doc.Size());
+    EXPECT_TRUE(doc[0].IsInt());
+    EXPECT_TRUE(doc[1][0].IsInt());
+    EXPECT_TRUE(doc[2].IsObject());
+}
+
+TEST(MsgpackProtocolTest, Malformed) {
+    rapidjson::StringBuffer buffer;
+    msgpack_protocol_t::write_datum(make_msgpack_test_row(3), &buffer);
+    const std::string encoded(buffer.GetString(), buffer.GetSize());
+
+    // Every truncation and any trailing data must be rejected.
+    for (size_t size = 0; size < encoded.size(); ++size) {
+        rapidjson::Document doc;
+        ASSERT_FALSE(msgpack_protocol_t::parse_document(encoded.data(), size, &doc));
+    }
+    {
+        rapidjson::Document doc;
+        std::string extended = encoded + '\xc0';
+        ASSERT_FALSE(msgpack_protocol_t::parse_document(
+            extended.data(), extended.size(), &doc));
+    }
+
+    std::vector<std::string> bad{
+        // The never-used type byte
+        std::string("\xc1", 1),
+        // A map with a non-string key
+        std::string("\x81\x01\x02", 3),
+        // An unknown extension type
+        std::string("\xd4\x05\x00", 3),
+        // A time that's too short for the epoch time
+        std::string("\xd6\x01\x00\x00\x00\x00", 6),
+        // An array that claims more elements than there are bytes
+        std::string("\xdd\xff\xff\xff\xff", 5)
+    };
+    for (const auto &data : bad) {
+        rapidjson::Document doc;
+        ASSERT_FALSE(msgpack_protocol_t::parse_document(data.data(), data.size(), &doc));
+    }
+}
+
+// This is not really a unit test, but a micro benchmark of writing a large response
+// and of decoding a large value, with the JSON and with the MessagePack protocol.  No
+// need to run this in debug mode.
+#ifdef NDEBUG
+TPTEST(MsgpackProtocolTest, ThroughputBenchmark, 4) {
+    const int num_rows = 10000;
+    const int num_rounds = 10;
+    std::vector<ql::datum_t> rows;
+    for (int i = 0; i < num_rows; ++i) {
+        rows.push_back(make_msgpack_test_row(i));
+    }
+    const ql::datum_t array(std::vector<ql::datum_t>(rows),
+                            ql::configured_limits_t::unlimited);
+
+    size_t json_size = 0;
+    ticks_t start_ticks = get_ticks();
+    for (int round = 0; round < num_rounds; ++round) {
+        ql::response_t response;
+        response.set_type(Response::SUCCESS_SEQUENCE);
+        response.set_data(std::vector<ql::datum_t>(rows));
+        rapidjson::StringBuffer buffer;
+        json_protocol_t::write_response_to_buffer(&response, &buffer);
+        json_size = buffer.GetSize();
+    }
+    double json_encode_secs = ticks_to_secs(get_ticks() - start_ticks);
+
+    size_t msgpack_size = 0;
+    start_ticks = get_ticks();
+    for (int round = 0; round < num_rounds; ++round) {
+        ql::response_t response;
+        response.set_type(Response::SUCCESS_SEQUENCE);
+        response.set_data(std::vector<ql::datum_t>(rows));
+        rapidjson::StringBuffer buffer;
+        msgpack_protocol_t::write_response_to_buffer(&response, &buffer);
+        msgpack_size = buffer.GetSize();
+    }
+    double msgpack_encode_secs = ticks_to_secs(get_ticks() - start_ticks);
+
+    // Decoding includes the conversion to a datum, which is where binary values and
+    // times from JSON are decoded.
+    rapidjson::StringBuffer json_buffer;
+    {
+        rapidjson::Writer<rapidjson::StringBuffer> writer(json_buffer);
+        array.write_json(&writer);
+    }
+    const std::string json_text(json_buffer.GetString(), json_buffer.GetSize());
+    start_ticks = get_ticks();
+    for (int round = 0; round < num_rounds; ++round) {
+        std::string copy = json_text;
+        rapidjson::Document doc;
+        doc.ParseInsitu(&copy[0]);
+        ASSERT_FALSE(doc.HasParseError());
+        ASSERT_EQ(array, ql::to_datum(doc, ql::configured_limits_t::unlimited,
+                                      reql_version_t::LATEST));
+    }
+    double json_decode_secs = ticks_to_secs(get_ticks() - start_ticks);
+
+    rapidjson::StringBuffer msgpack_buffer;
+    msgpack_protocol_t::write_datum(array, &msgpack_buffer);
+    start_ticks = get_ticks();
+    for (int round = 0; round < num_rounds; ++round) {
+        rapidjson::Document doc;
+        ASSERT_TRUE(msgpack_protocol_t::parse_document(msgpack_buffer.GetString(),
+                                                       msgpack_buffer.GetSize(),
+                                                       &doc));
+        ASSERT_EQ(array, ql::to_datum(doc, ql::configured_limits_t::unlimited,
+                                      reql_version_t::LATEST));
+    }
+    double msgpack_decode_secs = ticks_to_secs(get_ticks() - start_ticks);
+
+    const double total_rows = static_cast<double>(num_rows) * num_rounds;
+    printf("response of %d rows: JSON %zu bytes, %.3f us/row; "
+           "MessagePack %zu bytes, %.3f us/row\n",
+           num_rows,
+           json_size, json_encode_secs * 1e6 / total_rows,
+           msgpack_size, msgpack_encode_secs * 1e6 / total_rows);
+    printf("decoding %d rows: JSON %.3f us/row; MessagePack %.3f us/row\n",
+           num_rows,
+           json_decode_secs * 1e6 / total_rows,
+           msgpack_decode_secs * 1e6 / total_rows);
+}
+#endif  // NDEBUG
+
+}  // namespace unittest
@@ -0,0 +1,126 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "arch/runtime/compute_pool.hpp"
+#include "concurrency/cond_var.hpp"
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
+#include "rdb_protocol/order_util.hpp"
+#include "random.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+typedef std::vector<std::pair<ql::order_direction_t, counted_t<const ql::func_t> > >
+    comparisons_t;
+
+/* Holds an `env_t` whose context has a compute pool, which `sort_offloaded()` needs. */
+class offload_env_t {
+public:
+    offload_env_t()
+        : pool(2),
+          env(&ctx,
+              ql::return_empty_normal_batches_t::NO,
+              &interruptor,
+              serializable_env_t{
+                  ql::global_optargs_t(),
+                  auth::user_context_t(auth::permissions_t(true, true, true, true)),
+                  ql::datum_t()},
+              nullptr) {
+        ctx.compute_pool = &pool;
+    }
+    ql::env_t *get() { return &env; }
+private:
+    compute_pool_t pool;
+    rdb_context_t ctx;
+    cond_t interruptor;
+    ql::env_t env;
+};
+
+counted_t<const ql::func_t> sort_field(const char *name) {
+    return ql::new_get_field_func(ql::datum_t(name), ql::backtrace_id_t::empty());
+}
+
+/* Rows with a unique `id`, so that we can tell whether equal rows kept their order,
+and a few values of `a` and `b`.  Every fifth row has no `b`. */
+std::vector<ql::datum_t> make_sort_rows(size_t count) {
+    std::vector<ql::datum_t> rows;
+    for (size_t i = 0; i < count; ++i) {
+        ql::datum_object_builder_t builder;
+        builder.overwrite("id", ql::datum_t(static_cast<double>(i)));
+        builder.overwrite("a", ql::datum_t(static_cast<double>(randint(4))));
+        if (i % 5 != 0) {
+            builder.overwrite("b", ql::datum_t(static_cast<double>(randint(10))));
+        }
+        rows.push_back(std::move(builder).to_datum());
+    }
+    return rows;
+}
+
+void check_sort_offloaded(ql::env_t *env,
+                          comparisons_t comparisons,
+                          const std::vector<ql::datum_t> &rows) {
+    ql::lt_cmp_t lt_cmp(std::move(comparisons));
+    std::vector<ql::datum_t> expected = rows;
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&](const ql::datum_t &l, const ql::datum_t &r) {
+                         return lt_cmp(env, nullptr, l, r);
+                     });
+    std::vector<ql::datum_t> actual = rows;
+    lt_cmp.sort_offloaded(env, &actual);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].print(), actual[i].print());
+    }
+}
+
+TPTEST(OrderUtil, SortOffloadedMatchesInline) {
+    offload_env_t env;
+    const std::vector<ql::datum_t> rows = make_sort_rows(500);
+
+    check_sort_offloaded(env.get(), {{ql::ASC, sort_field("a")}}, rows);
+    check_sort_offloaded(env.get(), {{ql::DESC, sort_field("a")}}, rows);
+    // The rows without `b` sort first in ascending order and last in descending
+    // order.
+    check_sort_offloaded(env.get(), {{ql::ASC, sort_field("b")}}, rows);
+    check_sort_offloaded(env.get(), {{ql::DESC, sort_field("b")}}, rows);
+    check_sort_offloaded(env.get(),
+                         {{ql::ASC, sort_field("a")}, {ql::DESC, sort_field("b")}},
+                         rows);
+    check_sort_offloaded(env.get(),
+                         {{ql::DESC, sort_field("b")},
+                          {ql::ASC, sort_field("a")},
+                          {ql::DESC, sort_field("id")}},
+                         rows);
+    check_sort_offloaded(env.get(), {{ql::ASC, sort_field("a")}}, {});
+}
+
+TPTEST(OrderUtil, SortOffloadedThrows) {
+    offload_env_t env;
+    std::vector<ql::datum_t> rows = make_sort_rows(100);
+    // `get_field` on a number is an error other than a missing field, so both ways
+    // of sorting pass it on.
+    rows.push_back(ql::datum_t(1.0));
+    ql::lt_cmp_t lt_cmp({{ql::ASC, sort_field("a")}});
+
+    std::vector<ql::datum_t> inline_rows = rows;
+    EXPECT_THROW(std::stable_sort(inline_rows.begin(), inline_rows.end(),
+                                  [&](const ql::datum_t &l, const ql::datum_t &r) {
+                                      return lt_cmp(env.get(), nullptr, l, r);
+                                  }),
+                 ql::base_exc_t);
+
+    std::vector<ql::datum_t> offloaded_rows = rows;
+    EXPECT_THROW(lt_cmp.sort_offloaded(env.get(), &offloaded_rows), ql::base_exc_t);
+    // The keys are all computed before anything is moved, so the rows are intact.
+    ASSERT_EQ(rows.size(), offloaded_rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        EXPECT_EQ(rows[i].print(), offloaded_rows[i].print());
+    }
+}
+
+}  // namespace unittest
@@ -0,0 +1,187 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "arch/runtime/coroutines.hpp"
+#include "arch/runtime/runtime_utils.hpp"
+#include "client_protocol/admission.hpp"
+#include "clustering/administration/auth/username.hpp"
+#include "concurrency/cond_var.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+// All the queries in these tests are admitted on this thread, so that's the only one
+// we visit.
+ql::datum_t admission_stats(query_admission_t *admission,
+                            ql::query_priority_t priority) {
+    void *ctx = admission->begin_stats();
+    admission->visit_stats(ctx);
+    return admission->end_stats(ctx).get_field(ql::query_priority_name(priority));
+}
+
+int64_t admission_stat(query_admission_t *admission,
+                       ql::query_priority_t priority,
+                       const char *name) {
+    return static_cast<int64_t>(
+        admission_stats(admission, priority).get_field(name).as_num());
+}
+
+void wait_for_waiting_queries(query_admission_t *admission,
+                              ql::query_priority_t priority,
+                              int64_t count) {
+    while (admission_stat(admission, priority, "queries_waiting") != count) {
+        coro_t::yield();
+    }
+}
+
+// Starts a query that waits to be admitted, and adds its name to `*order_out` as soon
+// as it is, and then finishes right away.
+void spawn_admission_waiter(query_admission_t *admission,
+                            ql::query_priority_t priority,
+                            const auth::user_context_t &user_context,
+                            const std::string &name,
+                            std::vector<std::string> *order_out,
+                            cond_t *non_interruptor) {
+    coro_t::spawn_sometime([=]() {
+        query_admission_t::ticket_t ticket;
+        ASSERT_TRUE(admission->admit(priority, user_context, false, &ticket,
+                                     non_interruptor));
+        order_out->push_back(name);
+    });
+}
+
+void wait_for_admitted_queries(std::vector<std::string> *order, size_t count) {
+    while (order->size() != count) {
+        coro_t::yield();
+    }
+}
+
+TPTEST(QueryAdmission, PriorityOrder) {
+    query_admission_t admission(1);
+    auth::user_context_t user(auth::username_t("alice"));
+    cond_t non_interruptor;
+    std::vector<std::string> order;
+
+    query_admission_t::ticket_t running;
+    ASSERT_TRUE(admission.admit(ql::query_priority_t::NORMAL, user, false, &running,
+                                &non_interruptor));
+
+    spawn_admission_waiter(&admission, ql::query_priority_t::LOW, user, "low",
+                           &order, &non_interruptor);
+    wait_for_waiting_queries(&admission, ql::query_priority_t::LOW, 1);
+    spawn_admission_waiter(&admission, ql::query_priority_t::NORMAL, user, "normal",
+                           &order, &non_interruptor);
+    wait_for_waiting_queries(&admission, ql::query_priority_t::NORMAL, 1);
+    spawn_admission_waiter(&admission, ql::query_priority_t::HIGH, user, "high",
+                           &order, &non_interruptor);
+    wait_for_waiting_queries(&admission, ql::query_priority_t::HIGH, 1);
+    EXPECT_TRUE(order.empty());
+
+    running.reset();
+    wait_for_admitted_queries(&order, 3);
+    EXPECT_EQ((std::vector<std::string>{"high", "normal", "low"}), order);
+    EXPECT_EQ(2, admission_stat(&admission, ql::query_priority_t::NORMAL,
+                                "queries_admitted_total"));
+    EXPECT_EQ(0, admission_stat(&admission, ql::query_priority_t::LOW,
+                                "queries_waiting"));
+}
+
+TPTEST(QueryAdmission, UsersTakeTurns) {
+    query_admission_t admission(1);
+    auth::user_context_t alice(auth::username_t("alice"));
+    auth::user_context_t bob(auth::username_t("bob"));
+    cond_t non_interruptor;
+    std::vector<std::string> order;
+
+    query_admission_t::ticket_t running;
+    ASSERT_TRUE(admission.admit(ql::query_priority_t::NORMAL, alice, false, &running,
+                                &non_interruptor));
+
+    // Alice sends all her queries before Bob sends any of his.
+    for (int i = 0; i < 3; ++i) {
+        spawn_admission_waiter(&admission, ql::query_priority_t::NORMAL, alice,
+                               "alice", &order, &non_interruptor);
+        wait_for_waiting_queries(&admission, ql::query_priority_t::NORMAL, i + 1);
+    }
+    for (int i = 0; i < 3; ++i) {
+        spawn_admission_waiter(&admission, ql::query_priority_t::NORMAL, bob,
+                               "bob", &order, &non_interruptor);
+        wait_for_waiting_queries(&admission, ql::query_priority_t::NORMAL, i + 4);
+    }
+
+    running.reset();
+    wait_for_admitted_queries(&order, 6);
+    for (size_t i = 1; i < order.size(); ++i) {
+        EXPECT_NE(order[i - 1], order[i]);
+    }
+}
+
+TPTEST(QueryAdmission, InterruptWhileWaiting) {
+    query_admission_t admission(1);
+    auth::user_context_t user(auth::username_t("alice"));
+    cond_t non_interruptor;
+
+    query_admission_t::ticket_t running;
+    ASSERT_TRUE(admission.admit(ql::query_priority_t::NORMAL, user, false, &running,
+                                &non_interruptor));
+
+    cond_t interruptor;
+    cond_t done;
+    coro_t::spawn_sometime([&]() {
+        query_admission_t::ticket_t ticket;
+        EXPECT_THROW(admission.admit(ql::query_priority_t::LOW, user, false, &ticket,
+                                     &interruptor),
+                     interrupted_exc_t);
+        done.pulse();
+    });
+    wait_for_waiting_queries(&admission, ql::query_priority_t::LOW, 1);
+    interruptor.pulse();
+    done.wait();
+    EXPECT_EQ(0, admission_stat(&admission, ql::query_priority_t::LOW,
+                                "queries_waiting"));
+
+    // The interrupted query didn't take the slot, so the next one gets it.
+    running.reset();
+    query_admission_t::ticket_t ticket;
+    ASSERT_TRUE(admission.admit(ql::query_priority_t::LOW, user, false, &ticket,
+                                &non_interruptor));
+    EXPECT_EQ(1, admission_stat(&admission, ql::query_priority_t::LOW,
+                                "queries_admitted_total"));
+}
+
+TPTEST(QueryAdmission, ReleaseDoesNotBlock, 2) {
+    query_admission_t admission(1);
+    auth::user_context_t user(auth::username_t("alice"));
+    cond_t non_interruptor;
+    std::vector<std::string> order;
+
+    // The ticket is released on another thread than the admission's home thread, with
+    // a query waiting, while an exception unwinds, like when a query fails.
+    {
+        on_thread_t thread_switcher((threadnum_t(1)));
+        query_admission_t::ticket_t running;
+        ASSERT_TRUE(admission.admit(ql::query_priority_t::NORMAL, user, false,
+                                    &running, &non_interruptor));
+        {
+            on_thread_t back_home(admission.home_thread());
+            spawn_admission_waiter(&admission, ql::query_priority_t::NORMAL, user,
+                                   "waiter", &order, &non_interruptor);
+            wait_for_waiting_queries(&admission, ql::query_priority_t::NORMAL, 1);
+        }
+        try {
+            throw std::runtime_error("query failed");
+        } catch (const std::runtime_error &) {
+            ASSERT_NO_CORO_WAITING;
+            running.reset();
+        }
+    }
+    wait_for_admitted_queries(&order, 1);
+    EXPECT_EQ(0, admission_stat(&admission, ql::query_priority_t::NORMAL,
+                                "queries_waiting"));
+}
+
+}  // namespace unittest
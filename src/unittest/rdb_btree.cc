@@ -1,5 +1,7 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include <functional>
+#include <map>
+#include <vector>
 
 #include "arch/io/disk.hpp"
 #include "arch/runtime/coroutines.hpp"
@@ -28,31 +30,31 @@
 
 namespace unittest {
 
-void insert_rows(int start, int finish, store_t *store) {
+/* Sets row `i` to `{"id": i, "sid": sid}`, or deletes it if `sid` is empty, and updates
+the secondary indexes the way a write query does. */
+void write_row(int i, const boost::optional<int> &sid, store_t *store) {
     ql::configured_limits_t limits;
 
-    guarantee(start <= finish);
-    for (int i = start; i < finish; ++i) {
-        cond_t dummy_interruptor;
-        scoped_ptr_t<txn_t> txn;
-        {
-            scoped_ptr_t<real_superblock_t> superblock;
-            write_token_t token;
-            store->new_write_token(&token);
-            store->acquire_superblock_for_write(
-                1, write_durability_t::SOFT,
-                &token, &txn, &superblock, &dummy_interruptor);
-            buf_lock_t sindex_block(
-                superblock->expose_buf(),
-                superblock->get_sindex_block_id(),
-                access_t::write);
-
-            std::string data = strprintf("{\"id\" : %d, \"sid\" : %d}", i, i * i);
+    cond_t dummy_interruptor;
+    scoped_ptr_t<txn_t> txn;
+    {
+        scoped_ptr_t<real_superblock_t> superblock;
+        write_token_t token;
+        store->new_write_token(&token);
+        store->acquire_superblock_for_write(
+            1, write_durability_t::SOFT,
+            &token, &txn, &superblock, &dummy_interruptor);
+        buf_lock_t sindex_block(
+            superblock->expose_buf(),
+            superblock->get_sindex_block_id(),
+            access_t::write);
+
+        store_key_t pk(ql::datum_t(static_cast<double>(i)).print_primary());
+        rdb_modification_report_t mod_report(pk);
+        rdb_live_deletion_context_t deletion_context;
+        if (static_cast<bool>(sid)) {
+            std::string data = strprintf("{\"id\" : %d, \"sid\" : %d}", i, *sid);
             point_write_response_t response;
-
-            store_key_t pk(ql::datum_t(static_cast<double>(i)).print_primary());
-            rdb_modification_report_t mod_report(pk);
-            rdb_live_deletion_context_t deletion_context;
             rapidjson::Document doc;
             doc.Parse(data.c_str());
             rdb_set(
@@ -61,23 +63,36 @@ void insert_rows(int start, int finish, store_t *store) {
                 false, store->btree.get(), repli_timestamp_t::distant_past,
                 superblock.get(), &deletion_context, &response, &mod_report.info,
                 static_cast<profile::trace_t *>(NULL));
+        } else {
+            point_delete_response_t response;
+            rdb_delete(
+                pk, store->btree.get(), repli_timestamp_t::distant_past,
+                superblock.get(), &deletion_context, delete_mode_t::REGULAR_QUERY,
+                &response, &mod_report.info, static_cast<profile::trace_t *>(NULL));
+        }
 
-            store_t::sindex_access_vector_t sindexes;
-            store->acquire_all_sindex_superblocks_for_write(&sindex_block, &sindexes);
-            rdb_update_sindexes(
-                store,
-                sindexes,
-                &mod_report,
-                txn.get(),
-                &deletion_context,
-                nullptr,
-                nullptr,
-                nullptr);
+        store_t::sindex_access_vector_t sindexes;
+        store->acquire_all_sindex_superblocks_for_write(&sindex_block, &sindexes);
+        rdb_update_sindexes(
+            store,
+            sindexes,
+            &mod_report,
+            txn.get(),
+            &deletion_context,
+            nullptr,
+            nullptr,
+            nullptr);
 
-            new_mutex_in_line_t acq = store->get_in_line_for_sindex_queue(&sindex_block);
-            store->sindex_queue_push(mod_report, &acq);
-        }
-        txn->commit();
+        new_mutex_in_line_t acq = store->get_in_line_for_sindex_queue(&sindex_block);
+        store->sindex_queue_push(mod_report, &acq);
+    }
+    txn->commit();
+}
+
+void insert_rows(int start, int finish, store_t *store) {
+    guarantee(start <= finish);
+    for (int i = start; i < finish; ++i) {
+        write_row(i, i * i, store);
     }
 }
 
@@ -110,10 +125,11 @@ void spawn_writes(store_t *store, cond_t *background_inserts_done) {
                 store, background_inserts_done));
 }
 
-ql::grouped_t<ql::stream_t> read_row_via_sindex(
+ql::grouped_t<ql::stream_t> read_sindex_range(
         store_t *store,
         const sindex_name_t &sindex_name,
-        int sindex_value) {
+        const ql::datum_range_t &datum_range,
+        const ql::batchspec_t &batchspec) {
     cond_t dummy_interruptor;
     read_token_t token;
     store->new_read_token(&token);
@@ -146,7 +162,6 @@ ql::grouped_t<ql::stream_t> read_row_via_sindex(
     }
 
     rget_read_response_t res;
-    ql::datum_range_t datum_range(ql::datum_t(static_cast<double>(sindex_value)));
     /* The only thing this does is have a NULL `profile::trace_t *` in it which
      * prevents to profiling code from crashing. */
     ql::env_t dummy_env(&dummy_interruptor,
@@ -160,7 +175,7 @@ ql::grouped_t<ql::stream_t> read_row_via_sindex(
         datum_range.to_sindex_keyrange(reql_version_t::LATEST),
         sindex_sb.get(),
         &dummy_env, // env_t
-        ql::batchspec_t::default_for(ql::batch_type_t::NORMAL),
+        batchspec,
         std::vector<ql::transform_variant_t>(),
         boost::optional<ql::terminal_variant_t>(),
         key_range_t::universe(),
@@ -176,6 +191,17 @@ ql::grouped_t<ql::stream_t> read_row_via_sindex(
     return *groups;
 }
 
+ql::grouped_t<ql::stream_t> read_row_via_sindex(
+        store_t *store,
+        const sindex_name_t &sindex_name,
+        int sindex_value) {
+    return read_sindex_range(
+        store,
+        sindex_name,
+        ql::datum_range_t(ql::datum_t(static_cast<double>(sindex_value))),
+        ql::batchspec_t::default_for(ql::batch_type_t::NORMAL));
+}
+
 void _check_keys_are_present(store_t *store,
         sindex_name_t sindex_name) {
     ql::configured_limits_t limits;
@@ -451,4 +477,220 @@ TPTEST(RDBBtree, SindexInterruptionViaStoreDelete) {
     store.reset();
 }
 
+std::vector<ql::datum_t> stream_rows(ql::grouped_t<ql::stream_t> *groups) {
+    std::vector<ql::datum_t> rows;
+    for (auto &&group : *groups) {
+        for (auto &&substream : group.second.substreams) {
+            for (auto &&item : substream.second.stream) {
+                rows.push_back(item.data);
+            }
+        }
+    }
+    return rows;
+}
+
+/* Scans the primary index and returns the `sid` of every row, keyed by `id`. */
+std::map<int, int> read_all_rows(store_t *store) {
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store->new_read_token(&token);
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> super_block;
+    store->acquire_superblock_for_read(
+            &token, &txn, &super_block,
+            &dummy_interruptor, true);
+
+    rget_read_response_t res;
+    ql::env_t dummy_env(&dummy_interruptor,
+                        ql::return_empty_normal_batches_t::NO,
+                        reql_version_t::LATEST);
+    rdb_rget_slice(
+        store->btree.get(),
+        region_t::universe(),
+        key_range_t::universe(),
+        boost::none,
+        super_block.get(),
+        &dummy_env,
+        ql::batchspec_t::all(),
+        std::vector<ql::transform_variant_t>(),
+        boost::optional<ql::terminal_variant_t>(),
+        sorting_t::ASCENDING,
+        &res,
+        release_superblock_t::RELEASE);
+
+    ql::grouped_t<ql::stream_t> *groups =
+        boost::get<ql::grouped_t<ql::stream_t> >(&res.result);
+    guarantee(groups != nullptr);
+    std::map<int, int> rows;
+    for (const ql::datum_t &row : stream_rows(groups)) {
+        rows[row.get_field("id").as_int()] = row.get_field("sid").as_int();
+    }
+    return rows;
+}
+
+bool sindex_is_ready(store_t *store, const sindex_name_t &sindex_name) {
+    try {
+        // No row has a negative `sid`, so this doesn't read anything.
+        read_row_via_sindex(store, sindex_name, -1);
+        return true;
+    } catch (const sindex_not_ready_exc_t &) {
+        return false;
+    }
+}
+
+/* Rewrites the rows until the index is ready, so that the writes land both in the part
+of the table that has been post-constructed and in the part that hasn't.  Every round
+changes the `sid` of every row and deletes or re-inserts a fifth of them. */
+void rewrite_rows_and_pulse_when_done(int count, store_t *store,
+        const sindex_name_t &sindex_name, cond_t *pulse_when_done) {
+    for (int round = 1; round <= MAX_RETRIES_FOR_SINDEX_POSTCONSTRUCT; ++round) {
+        for (int i = 0; i < count; ++i) {
+            if ((i + round) % 5 == 0) {
+                write_row(i, boost::none, store);
+            } else {
+                write_row(i, i * i + round, store);
+            }
+        }
+        if (sindex_is_ready(store, sindex_name)) {
+            break;
+        }
+    }
+    pulse_when_done->pulse();
+}
+
+void _check_sindex_matches_rows(store_t *store, const sindex_name_t &sindex_name) {
+    ql::grouped_t<ql::stream_t> groups = read_sindex_range(
+        store, sindex_name, ql::datum_range_t::universe(), ql::batchspec_t::all());
+    std::map<int, int> indexed;
+    for (const ql::datum_t &row : stream_rows(&groups)) {
+        int id = row.get_field("id").as_int();
+        // An entry left over from an older version of the row would show up twice.
+        ASSERT_EQ(0u, indexed.count(id));
+        indexed[id] = row.get_field("sid").as_int();
+    }
+    ASSERT_EQ(read_all_rows(store), indexed);
+}
+
+void check_sindex_matches_rows(store_t *store, const sindex_name_t &sindex_name) {
+    for (int i = 0; i < MAX_RETRIES_FOR_SINDEX_POSTCONSTRUCT; ++i) {
+        try {
+            _check_sindex_matches_rows(store, sindex_name);
+            return;
+        } catch (const sindex_not_ready_exc_t&) { }
+        nap(500);
+    }
+    ADD_FAILURE() << "Sindex still not available after many tries.";
+}
+
+TPTEST(RDBBtree, SindexPostConstructConcurrentWrites) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    log_serializer_t::create(
+        &file_opener,
+        log_serializer_t::static_config_t());
+
+    log_serializer_t serializer(
+        log_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            nullptr,
+            &io_backender,
+            base_path_t("."),
+            generate_uuid(),
+            update_sindexes_t::UPDATE);
+
+    // Enough rows for several batches of `SINDEX_POST_CONSTRUCTION_BATCH_SIZE`.
+    const int num_rows = TOTAL_KEYS_TO_INSERT;
+    insert_rows(0, num_rows, &store);
+
+    sindex_name_t sindex_name = create_sindex(&store);
+
+    cond_t rewrites_done;
+    coro_t::spawn_sometime(std::bind(&rewrite_rows_and_pulse_when_done,
+                num_rows, &store, sindex_name, &rewrites_done));
+    rewrites_done.wait();
+
+    check_sindex_matches_rows(&store, sindex_name);
+}
+
+ql::datum_t parse_row(const char *json) {
+    rapidjson::Document doc;
+    doc.Parse(json);
+    return ql::to_datum(doc, ql::configured_limits_t(), reql_version_t::LATEST);
+}
+
+// Before 2.1, a multi index row whose array had an element that can't be an index key
+// wasn't indexed at all.  That's the case where `compute_keys` can fail after it has
+// already produced keys for the earlier elements.
+sindex_disk_info_t make_old_multi_sindex_info() {
+    ql::sym_t one(1);
+    ql::minidriver_t r(ql::backtrace_id_t::empty());
+    ql::raw_term_t mapping = r.var(one)["tags"].root_term();
+    sindex_reql_version_info_t version_info = { reql_version_t::v2_0,
+                                                reql_version_t::v2_0,
+                                                reql_version_t::v2_0 };
+    return sindex_disk_info_t(
+        ql::map_wire_func_t(mapping, make_vector(one)),
+        version_info,
+        sindex_multi_bool_t::MULTI,
+        sindex_geo_bool_t::REGULAR);
+}
+
+TPTEST(RDBBtree, SindexUpdateKeys) {
+    const sindex_disk_info_t info = make_old_multi_sindex_info();
+    const store_key_t pk(ql::datum_t(1.0).print_primary());
+
+    std::vector<std::pair<store_key_t, ql::datum_t> > old_keys;
+    ASSERT_TRUE(compute_keys_or_drop(
+        pk, parse_row("{\"id\": 1, \"tags\": [1, 2]}"), info, &old_keys, nullptr));
+    ASSERT_EQ(2u, old_keys.size());
+
+    // The keys didn't change, so all of the entries get overwritten in place.
+    {
+        std::vector<std::pair<store_key_t, ql::datum_t> > new_keys;
+        ASSERT_TRUE(compute_keys_or_drop(
+            pk, parse_row("{\"id\": 1, \"tags\": [1, 2], \"x\": 3}"), info,
+            &new_keys, nullptr));
+        EXPECT_TRUE(sindex_keys_to_delete(old_keys, new_keys).empty());
+    }
+
+    // Only the entry for the second tag changed.
+    {
+        std::vector<std::pair<store_key_t, ql::datum_t> > new_keys;
+        ASSERT_TRUE(compute_keys_or_drop(
+            pk, parse_row("{\"id\": 1, \"tags\": [1, 3]}"), info,
+            &new_keys, nullptr));
+        std::vector<store_key_t> to_delete = sindex_keys_to_delete(old_keys, new_keys);
+        ASSERT_EQ(1u, to_delete.size());
+        EXPECT_EQ(old_keys[1].first, to_delete[0]);
+    }
+
+    // The second tag can't be an index key, so the row drops out of the index even
+    // though the first tag is still the same.  Its old entries must all go.
+    {
+        std::vector<std::pair<store_key_t, ql::datum_t> > new_keys;
+        std::vector<index_pair_t> cfeed_new_keys;
+        EXPECT_FALSE(compute_keys_or_drop(
+            pk, parse_row("{\"id\": 1, \"tags\": [1, {\"a\": 1}]}"), info,
+            &new_keys, &cfeed_new_keys));
+        EXPECT_TRUE(new_keys.empty());
+        EXPECT_TRUE(cfeed_new_keys.empty());
+        EXPECT_EQ(2u, sindex_keys_to_delete(old_keys, new_keys).size());
+    }
+}
+
 } //namespace unittest
@@ -503,6 +503,19 @@ bool test_rdb_env_t::instance_t::table_estimate_doc_counts(
     return false;
 }
 
+bool test_rdb_env_t::instance_t::table_estimate_sindex_counts(
+        UNUSED auth::user_context_t const &user_context,
+        UNUSED counted_t<const ql::db_t> db,
+        UNUSED const name_string_t &name,
+        UNUSED ql::env_t *local_env,
+        UNUSED std::map<std::string, int64_t> *sindex_counts_out,
+        admin_err_t *error_out) {
+    *error_out = admin_err_t{
+        "test_rdb_env_t::instance_t doesn't support info()",
+        query_state_t::FAILED};
+    return false;
+}
+
 bool test_rdb_env_t::instance_t::table_config(
         UNUSED auth::user_context_t const &user_context,
         UNUSED counted_t<const ql::db_t> db,
@@ -0,0 +1,56 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <atomic>
+#include <set>
+
+#include "arch/io/network.hpp"
+#include "arch/timing.hpp"
+#include "arch/types.hpp"
+#include "concurrency/cond_var.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+TPTEST(ReuseportListener, AcceptOnEveryThread, 4) {
+    const int num_threads = 4;
+    const int num_connections = 64;
+    std::atomic<int> accepted[num_threads];
+    for (int i = 0; i < num_threads; ++i) {
+        accepted[i] = 0;
+    }
+
+    ip_address_t loopback("127.0.0.1");
+    std::set<ip_address_t> addresses;
+    addresses.insert(loopback);
+    reuseport_tcp_listener_t listener(addresses, ANY_PORT, num_threads,
+        [&](scoped_ptr_t<tcp_conn_descriptor_t> &) {
+            ASSERT_LT(get_thread_id().threadnum, num_threads);
+            ++accepted[get_thread_id().threadnum];
+        });
+    ASSERT_NE(ANY_PORT, listener.get_port());
+
+    cond_t non_interruptor;
+    for (int i = 0; i < num_connections; ++i) {
+        tcp_conn_t conn(loopback, listener.get_port(), &non_interruptor);
+    }
+
+    int total = 0;
+    for (int attempt = 0; attempt < 500 && total < num_connections; ++attempt) {
+        nap(10);
+        total = 0;
+        for (int i = 0; i < num_threads; ++i) {
+            total += accepted[i];
+        }
+    }
+    ASSERT_EQ(num_connections, total);
+
+    // The kernel hashes connections to the sockets, so with this many connections
+    // it's practically impossible for a single thread to get all of them.
+    int busy_threads = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        busy_threads += accepted[i] > 0 ? 1 : 0;
+    }
+    EXPECT_LT(1, busy_threads);
+}
+
+}  // namespace unittest
@@ -0,0 +1,72 @@
+// Copyright 2010-2016 RethinkDB, all rights reserved.
+#include <set>
+#include <string>
+#include <vector>
+
+#include "arch/io/network.hpp"
+#include "arch/timing.hpp"
+#include "arch/types.hpp"
+#include "concurrency/cond_var.hpp"
+#include "concurrency/wait_any.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+std::vector<char> make_tcp_conn_test_data(size_t size, char seed) {
+    std::vector<char> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>(seed + i * 7);
+    }
+    return data;
+}
+
+TPTEST(TcpConnTest, OwnedBufferedWrites) {
+    // Small data is copied, large data is written as it is, and all of it arrives in
+    // the order it was written in.
+    std::vector<std::vector<char> > pieces{
+        make_tcp_conn_test_data(100, 1),
+        make_tcp_conn_test_data(MEGABYTE + 3, 2),
+        make_tcp_conn_test_data(KILOBYTE, 3),
+        make_tcp_conn_test_data(300 * KILOBYTE, 4),
+        make_tcp_conn_test_data(200 * KILOBYTE, 5)
+    };
+    std::string expected;
+    for (const auto &piece : pieces) {
+        expected.append(piece.data(), piece.size());
+    }
+
+    std::string received;
+    cond_t done;
+    ip_address_t loopback("127.0.0.1");
+    std::set<ip_address_t> addresses;
+    addresses.insert(loopback);
+    tcp_listener_t listener(addresses, ANY_PORT,
+        [&](scoped_ptr_t<tcp_conn_descriptor_t> &nconn) {
+            cond_t non_interruptor;
+            scoped_ptr_t<tcp_conn_t> conn;
+            nconn->make_server_connection(nullptr, &conn, &non_interruptor);
+            received.resize(expected.size());
+            conn->read(&received[0], received.size(), &non_interruptor);
+            done.pulse();
+        });
+
+    cond_t non_interruptor;
+    tcp_conn_t conn(loopback, listener.get_port(), &non_interruptor);
+    EXPECT_EQ(100u, conn.write_buffered(std::move(pieces[0]), &non_interruptor));
+    EXPECT_EQ(0u, conn.write_buffered(std::move(pieces[1]), &non_interruptor));
+    EXPECT_EQ(static_cast<size_t>(KILOBYTE),
+              conn.write_buffered(std::move(pieces[2]), &non_interruptor));
+    EXPECT_EQ(0u, conn.write_buffered(std::move(pieces[3]), &non_interruptor));
+    EXPECT_EQ(0u, conn.write_buffered(std::move(pieces[4]), &non_interruptor));
+    conn.flush_buffer(&non_interruptor);
+
+    signal_timer_t timeout;
+    timeout.start(10000);
+    wait_any_t waiter(&done, &timeout);
+    waiter.wait();
+    ASSERT_TRUE(done.is_pulsed());
+    ASSERT_EQ(expected, received);
+}
+
+}  // namespace unittest
@@ -167,7 +167,7 @@ std::set<ip_address_t> get_unittest_addresses() {
 }
 
 void run_in_thread_pool(const std::function<void()> &fun, int num_workers) {
-    ::run_in_thread_pool(fun, num_workers);
+    ::run_in_thread_pool(fun, num_workers, 0);
 }
 
 key_range_t quick_range(const char *bounds) {